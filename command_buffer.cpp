@@ -0,0 +1,85 @@
+#include "command_buffer.h"
+
+#include "vk_common.h"
+
+namespace sren {
+
+bool CommandBufferManager::init(VkDevice device, u32 queue_family, u32 num_threads_,
+                                VkAllocationCallbacks *alloc_callbacks) {
+    vk_device = device;
+    vk_alloc_callbacks = alloc_callbacks;
+    num_threads = num_threads_ < 1 ? 1 : (num_threads_ > max_recording_threads ? max_recording_threads
+                                                                                : num_threads_);
+    for (VkCommandPool &pool : vk_command_pools) {
+        pool = VK_NULL_HANDLE;
+    }
+
+    for (u32 frame = 0; frame < max_frames; ++frame) {
+        for (u32 thread = 0; thread < num_threads; ++thread) {
+            const u32 index = pool_index(frame, thread);
+
+            VkCommandPoolCreateInfo pool_info = {};
+            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            pool_info.queueFamilyIndex = queue_family;
+            // The whole pool is reset every frame.
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            if (!vkCheck(vkCreateCommandPool(vk_device, &pool_info, vk_alloc_callbacks,
+                                             &vk_command_pools[index]))) {
+                return false;
+            }
+
+            VkCommandBufferAllocateInfo command_buffer_info = {};
+            command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            command_buffer_info.commandPool = vk_command_pools[index];
+            if (thread == 0) {
+                command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                command_buffer_info.commandBufferCount = 1;
+                if (!vkCheck(vkAllocateCommandBuffers(vk_device, &command_buffer_info,
+                                                      &vk_primary_command_buffers[frame]))) {
+                    return false;
+                }
+            }
+
+            command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            command_buffer_info.commandBufferCount = max_secondary_command_buffers;
+            if (!vkCheck(vkAllocateCommandBuffers(vk_device, &command_buffer_info,
+                                                  vk_secondary_command_buffers[index]))) {
+                return false;
+            }
+            used_secondary_command_buffers[index] = 0;
+        }
+    }
+    return true;
+}
+
+void CommandBufferManager::shutdown() {
+    // Destroying the pools frees their command buffers.
+    for (u32 i = 0; i < max_frames * num_threads; ++i) {
+        if (vk_command_pools[i] != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(vk_device, vk_command_pools[i], vk_alloc_callbacks);
+            vk_command_pools[i] = VK_NULL_HANDLE;
+        }
+    }
+    num_threads = 0;
+}
+
+void CommandBufferManager::reset_pools(u32 frame) {
+    for (u32 thread = 0; thread < num_threads; ++thread) {
+        const u32 index = pool_index(frame, thread);
+        vkResetCommandPool(vk_device, vk_command_pools[index], 0);
+        used_secondary_command_buffers[index] = 0;
+    }
+}
+
+VkCommandBuffer CommandBufferManager::get_secondary(u32 frame, u32 thread_index) {
+    if (thread_index >= num_threads) {
+        return VK_NULL_HANDLE;
+    }
+    const u32 index = pool_index(frame, thread_index);
+    if (used_secondary_command_buffers[index] >= max_secondary_command_buffers) {
+        return VK_NULL_HANDLE;
+    }
+    return vk_secondary_command_buffers[index][used_secondary_command_buffers[index]++];
+}
+
+} // namespace sren
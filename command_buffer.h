@@ -0,0 +1,47 @@
+#pragma once
+
+#include "gpu_resources.h"
+#include "platform.h"
+
+#include <vulkan/vulkan.h>
+
+namespace sren {
+
+static const u32 max_recording_threads = 16;
+// Secondary command buffers available to each thread, per frame. Work stealing can hand every recording
+// job of a frame to the same thread.
+static const u32 max_secondary_command_buffers = max_recording_threads;
+
+// Command pools are externally synchronized, so every recording thread gets its own pool for every frame
+// in flight. Thread 0 is the main thread and also owns the frame's primary command buffer.
+class CommandBufferManager {
+  public:
+    bool init(VkDevice device, u32 queue_family, u32 num_threads,
+              VkAllocationCallbacks *alloc_callbacks);
+    void shutdown();
+
+    // Resets every pool of the frame. Only valid once the frame's fence has signalled.
+    void reset_pools(u32 frame);
+
+    VkCommandBuffer get_primary(u32 frame) const { return vk_primary_command_buffers[frame]; }
+    // Next unused secondary command buffer of the thread's pool. Only the thread owning thread_index may
+    // call this for a given frame. Returns VK_NULL_HANDLE when the thread ran out of buffers.
+    VkCommandBuffer get_secondary(u32 frame, u32 thread_index);
+
+    u32 num_threads = 0;
+
+  private:
+    u32 pool_index(u32 frame, u32 thread_index) const { return frame * num_threads + thread_index; }
+
+    VkDevice vk_device = VK_NULL_HANDLE;
+    VkAllocationCallbacks *vk_alloc_callbacks = nullptr;
+
+    // VK_NULL_HANDLE until created, init can fail part way.
+    VkCommandPool vk_command_pools[max_frames * max_recording_threads] = {};
+    VkCommandBuffer vk_primary_command_buffers[max_frames];
+    VkCommandBuffer vk_secondary_command_buffers[max_frames * max_recording_threads]
+                                                [max_secondary_command_buffers];
+    u32 used_secondary_command_buffers[max_frames * max_recording_threads];
+}; // class CommandBufferManager
+
+} // namespace sren
@@ -1,5 +1,7 @@
 #include "device.h"
 
+#include "file.h"
+#include "timer.h"
 #include "vk_common.h"
 
 #include <SDL2/SDL_vulkan.h>
@@ -43,14 +45,86 @@ static const char *requested_layers[] = {
 #endif
 };
 
-// Extensions to request.
-static std::vector<const char *> requested_extensions = {
-    VK_KHR_SURFACE_EXTENSION_NAME,
+// Extensions to request. Surface extensions are appended at init time when a window is used.
+static const char *requested_extensions[] = {
 #ifdef VULKAN_DEBUG_REPORT
     VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
     VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
+#else
+    nullptr,
 #endif
 };
+#ifdef VULKAN_DEBUG_REPORT
+static const u32 num_requested_extensions =
+    sizeof(requested_extensions) / sizeof(requested_extensions[0]);
+#else
+static const u32 num_requested_extensions = 0;
+#endif
+
+// Enumeration arrays and other short-lived allocations, cleared every frame.
+static const size_t frame_scratch_size = 1024 * 1024;
+
+// Driver and VMA host allocations, routed to a tracking allocator through pUserData.
+static void *VKAPI_PTR vk_allocation(void *user_data, size_t size, size_t alignment,
+                                     VkSystemAllocationScope) {
+    return ((Allocator *)user_data)->allocate(size, alignment);
+}
+
+static void *VKAPI_PTR vk_reallocation(void *user_data, void *original, size_t size, size_t alignment,
+                                       VkSystemAllocationScope) {
+    // A zero size frees, as with realloc.
+    if (size == 0) {
+        ((Allocator *)user_data)->deallocate(original);
+        return nullptr;
+    }
+    return ((Allocator *)user_data)->reallocate(original, size, alignment);
+}
+
+static void VKAPI_PTR vk_free(void *user_data, void *memory) {
+    ((Allocator *)user_data)->deallocate(memory);
+}
+
+// DeviceCreation
+DeviceCreation &DeviceCreation::set_window(u32 width_, u32 height_, SDL_Window *window_) {
+    width = width_;
+    height = height_;
+    window = window_;
+    headless = false;
+    return *this;
+}
+
+DeviceCreation &DeviceCreation::set_headless(u32 width_, u32 height_) {
+    width = width_;
+    height = height_;
+    window = nullptr;
+    headless = true;
+    return *this;
+}
+
+DeviceCreation &DeviceCreation::set_gpu_index(i32 index) {
+    gpu_index = index;
+    return *this;
+}
+
+DeviceCreation &DeviceCreation::set_gpu_name(const char *name) {
+    gpu_name = name;
+    return *this;
+}
+
+DeviceCreation &DeviceCreation::set_pipeline_cache_path(const char *path) {
+    pipeline_cache_path = path;
+    return *this;
+}
+
+DeviceCreation &DeviceCreation::set_num_threads(u32 num_threads_) {
+    num_threads = num_threads_;
+    return *this;
+}
+
+DeviceCreation &DeviceCreation::set_dynamic_rendering(bool enabled) {
+    dynamic_rendering = enabled;
+    return *this;
+}
 
 #ifdef VULKAN_DEBUG_REPORT
 static VkBool32 debug_utils_callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
@@ -85,29 +159,171 @@ bool Device::get_family_queue(VkPhysicalDevice physical_device) {
     u32 queue_family_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
 
+    LinearScope scope(frame_scratch);
     VkQueueFamilyProperties *queue_families =
-        (VkQueueFamilyProperties *)malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
+        allocate_array<VkQueueFamilyProperties>(frame_scratch, queue_family_count);
+    if (!queue_families) {
+        return false;
+    }
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families);
 
     u32 family_index = 0;
-    VkBool32 surface_supported;
+    VkBool32 surface_supported = VK_FALSE;
     for (; family_index < queue_family_count; ++family_index) {
         VkQueueFamilyProperties queue_family = queue_families[family_index];
+        if (headless) {
+            // No presentation: any family that can render will do.
+            if (queue_family.queueCount > 0 && queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                vk_queue_family = family_index;
+                gpu_timestamp_valid_bits = queue_family.timestampValidBits;
+                surface_supported = VK_TRUE;
+                break;
+            }
+            continue;
+        }
         if (queue_family.queueCount > 0 &&
             queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) {
             vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, family_index, vk_surface,
                                                  &surface_supported);
             if (surface_supported) {
                 vk_queue_family = family_index;
+                gpu_timestamp_valid_bits = queue_family.timestampValidBits;
                 break;
             }
         }
     }
-    free(queue_families);
+
+    // Prefer a transfer-only family (usually a DMA engine), whose copies run alongside graphics work.
+    vk_transfer_queue_family = vk_queue_family;
+    for (u32 i = 0; surface_supported && i < queue_family_count; ++i) {
+        const VkQueueFlags flags = queue_families[i].queueFlags;
+        if (queue_families[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) &&
+            !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            vk_transfer_queue_family = i;
+            break;
+        }
+    }
     return surface_supported;
 }
 
-bool Device::init(u32 window_width_, u32 window_height_, SDL_Window *window) {
+bool Device::select_physical_device(const DeviceCreation &creation) {
+    u32 num_physical_device;
+    if (!vkCheck(vkEnumeratePhysicalDevices(vk_instance, &num_physical_device, nullptr))) {
+        return false;
+    }
+    if (num_physical_device == 0) {
+        LOG_ERR("No Vulkan physical devices found!");
+        return false;
+    }
+    LinearScope scope(frame_scratch);
+    VkPhysicalDevice *gpus = allocate_array<VkPhysicalDevice>(frame_scratch, num_physical_device);
+    if (!gpus || !vkCheck(vkEnumeratePhysicalDevices(vk_instance, &num_physical_device, gpus))) {
+        return false;
+    }
+
+    for (u32 i = 0; i < num_physical_device; ++i) {
+        vkGetPhysicalDeviceProperties(gpus[i], &vk_physical_device_properties);
+        LOG_DBG("GPU %u: %s (%s)", i, vk_physical_device_properties.deviceName,
+                string_VkPhysicalDeviceType(vk_physical_device_properties.deviceType));
+    }
+
+    vk_physical_device = VK_NULL_HANDLE;
+
+    // Explicit selection, by index or by (sub)string of the device name.
+    if (creation.gpu_index >= 0 || creation.gpu_name) {
+        for (u32 i = 0; i < num_physical_device; ++i) {
+            vkGetPhysicalDeviceProperties(gpus[i], &vk_physical_device_properties);
+            const char *device_name = vk_physical_device_properties.deviceName;
+            bool matches = creation.gpu_index >= 0 ? (u32)creation.gpu_index == i
+                                                   : strstr(device_name, creation.gpu_name) != nullptr;
+            if (!matches) {
+                continue;
+            }
+            if (get_family_queue(gpus[i])) {
+                vk_physical_device = gpus[i];
+            } else {
+                LOG_ERR("Requested GPU %s has no suitable queue family.",
+                        vk_physical_device_properties.deviceName);
+            }
+            break;
+        }
+
+        if (vk_physical_device == VK_NULL_HANDLE) {
+            LOG_ERR("Requested GPU not found!");
+            return false;
+        }
+        return true;
+    }
+
+    VkPhysicalDevice discrete_gpu = VK_NULL_HANDLE;
+    VkPhysicalDevice integrated_gpu = VK_NULL_HANDLE;
+    VkPhysicalDevice fallback_gpu = VK_NULL_HANDLE;
+    for (u32 i = 0; i < num_physical_device; ++i) {
+        VkPhysicalDevice physical_device = gpus[i];
+        vkGetPhysicalDeviceProperties(physical_device, &vk_physical_device_properties);
+        if (vk_physical_device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+            if (get_family_queue(physical_device)) {
+                // NOTE: prefer discrete GPU over integrated one, stop at first discrete GPU that
+                // has present capabilities
+                discrete_gpu = physical_device;
+                break;
+            }
+            continue;
+        }
+        if (vk_physical_device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
+            if (integrated_gpu == VK_NULL_HANDLE && get_family_queue(physical_device)) {
+                integrated_gpu = physical_device;
+            }
+            continue;
+        }
+        // Software rasterizers (lavapipe, swiftshader) and virtual GPUs, used as a last resort.
+        if (vk_physical_device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ||
+            vk_physical_device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU) {
+            if (fallback_gpu == VK_NULL_HANDLE && get_family_queue(physical_device)) {
+                fallback_gpu = physical_device;
+            }
+            continue;
+        }
+    }
+
+    if (discrete_gpu != VK_NULL_HANDLE) {
+        vk_physical_device = discrete_gpu;
+    } else if (integrated_gpu != VK_NULL_HANDLE) {
+        vk_physical_device = integrated_gpu;
+    } else if (fallback_gpu != VK_NULL_HANDLE) {
+        vk_physical_device = fallback_gpu;
+    }
+
+    if (vk_physical_device == VK_NULL_HANDLE) {
+        LOG_ERR("Suitable GPU device not found!");
+        return false;
+    }
+
+    // The queue family is cached by get_family_queue, so re-query it for the device actually chosen.
+    return get_family_queue(vk_physical_device);
+}
+
+bool Device::init(const DeviceCreation &creation) {
+    headless = creation.headless;
+    num_recording_threads = creation.num_threads;
+    if (!headless && !creation.window) {
+        LOG_ERR("A window is required unless the device is headless.");
+        return false;
+    }
+
+    // Memory comes first, the instance is already created with the allocation callbacks.
+    vk_allocation_callbacks = {};
+    vk_allocation_callbacks.pUserData = &vulkan_allocator;
+    vk_allocation_callbacks.pfnAllocation = vk_allocation;
+    vk_allocation_callbacks.pfnReallocation = vk_reallocation;
+    vk_allocation_callbacks.pfnFree = vk_free;
+    vk_alloc_callbacks = &vk_allocation_callbacks;
+    if (!frame_scratch.init(&scratch_allocator, frame_scratch_size)) {
+        LOG_ERR("Failed to allocate the frame scratch memory.");
+        return false;
+    }
+    LinearScope init_scope(frame_scratch);
+
     // 1. Initialize Vulkan instance.
     VkApplicationInfo app_info;
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -117,24 +333,33 @@ bool Device::init(u32 window_width_, u32 window_height_, SDL_Window *window) {
     app_info.pEngineName = "Sren Engine";
     app_info.apiVersion = VK_API_VERSION_1_3;
 
-    // Query SDL required extensions.
+    // Query SDL required extensions, they go right after the requested ones.
     // TODO: Is there a more platform/window agnostic way of doing this?
-    u32 sdl_extension_count;
-    if (SDL_Vulkan_GetInstanceExtensions(window, &sdl_extension_count, nullptr) == SDL_FALSE) {
+    u32 sdl_extension_count = 0;
+    if (!headless &&
+        SDL_Vulkan_GetInstanceExtensions(creation.window, &sdl_extension_count, nullptr) == SDL_FALSE) {
         LOG_ERR("Failed to enumerate SDL extensions: %s", SDL_GetError());
         return false;
     }
-    const char **sdl_extensions = (const char **)malloc(sizeof(const char *) * sdl_extension_count);
-    if (SDL_Vulkan_GetInstanceExtensions(window, &sdl_extension_count, sdl_extensions) == SDL_FALSE) {
-        LOG_ERR("Failed to get SDL instance extensions: %s", SDL_GetError());
-        free(sdl_extensions);
+    const char **instance_extensions =
+        allocate_array<const char *>(frame_scratch, num_requested_extensions + 1 + sdl_extension_count);
+    if (!instance_extensions) {
         return false;
     }
-    // Add these extensions to our requested extensions.
-    for (u32 i = 0; i < sdl_extension_count; i++) {
-        requested_extensions.push_back(sdl_extensions[i]);
+    u32 num_instance_extensions = 0;
+    for (u32 i = 0; i < num_requested_extensions; ++i) {
+        instance_extensions[num_instance_extensions++] = requested_extensions[i];
+    }
+    if (!headless) {
+        instance_extensions[num_instance_extensions++] = VK_KHR_SURFACE_EXTENSION_NAME;
+        const char **sdl_extensions = instance_extensions + num_instance_extensions;
+        if (SDL_Vulkan_GetInstanceExtensions(creation.window, &sdl_extension_count, sdl_extensions) ==
+            SDL_FALSE) {
+            LOG_ERR("Failed to get SDL instance extensions: %s", SDL_GetError());
+            return false;
+        }
+        num_instance_extensions += sdl_extension_count;
     }
-    free(sdl_extensions);
 
     VkInstanceCreateInfo create_info;
     create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -151,8 +376,8 @@ bool Device::init(u32 window_width_, u32 window_height_, SDL_Window *window) {
     create_info.enabledLayerCount = 0;
     create_info.ppEnabledLayerNames = nullptr;
 #endif
-    create_info.enabledExtensionCount = requested_extensions.size();
-    create_info.ppEnabledExtensionNames = requested_extensions.data();
+    create_info.enabledExtensionCount = num_instance_extensions;
+    create_info.ppEnabledExtensionNames = instance_extensions;
 
     // Create Vulkan instance.
     if (!vkCheck(vkCreateInstance(&create_info, vk_alloc_callbacks, &vk_instance))) {
@@ -160,24 +385,26 @@ bool Device::init(u32 window_width_, u32 window_height_, SDL_Window *window) {
     }
     LOG_DBG("Created Vulkan instance.");
 
-    swapchain_width = window_width_;
-    swapchain_height = window_height_;
+    swapchain_width = creation.width;
+    swapchain_height = creation.height;
 
 // Choose extensions.
 #ifdef VULKAN_DEBUG_REPORT
     {
-        u32 num_instance_extensions;
-        vkEnumerateInstanceExtensionProperties(nullptr, &num_instance_extensions, nullptr);
+        LinearScope scope(frame_scratch);
+        u32 num_available_extensions;
+        vkEnumerateInstanceExtensionProperties(nullptr, &num_available_extensions, nullptr);
         VkExtensionProperties *extensions =
-            (VkExtensionProperties *)malloc(sizeof(VkExtensionProperties) * num_instance_extensions);
-        vkEnumerateInstanceExtensionProperties(nullptr, &num_instance_extensions, extensions);
-        for (size_t i = 0; i < num_instance_extensions; i++) {
+            allocate_array<VkExtensionProperties>(frame_scratch, num_available_extensions);
+        if (extensions) {
+            vkEnumerateInstanceExtensionProperties(nullptr, &num_available_extensions, extensions);
+        }
+        for (u32 i = 0; extensions && i < num_available_extensions; i++) {
             if (!strcmp(extensions[i].extensionName, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
                 debug_utils_extension_present = true;
                 break;
             }
         }
-        free(extensions);
 
         if (!debug_utils_extension_present) {
             LOG_DBG("Extension %s for debugging non present.", VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -196,86 +423,106 @@ bool Device::init(u32 window_width_, u32 window_height_, SDL_Window *window) {
 #endif
     // TODO: Do I have to do anything for the other extensions I request?
 
-    // Choose physical device.
-    // TODO: Do I want a way to manually select a device?
-    u32 num_physical_device;
-    if (!vkCheck(vkEnumeratePhysicalDevices(vk_instance, &num_physical_device, nullptr))) {
-        return false;
-    }
-    VkPhysicalDevice *gpus = (VkPhysicalDevice *)malloc(sizeof(VkPhysicalDevice) * num_physical_device);
-    if (!vkCheck(vkEnumeratePhysicalDevices(vk_instance, &num_physical_device, gpus))) {
-        return false;
-    }
-
-    // Create drawable surface.
-    window_handle = window;
-    if (SDL_Vulkan_CreateSurface(window_handle, vk_instance, &vk_surface) == SDL_FALSE) {
-        LOG_ERR("Failed to create window surface: %s", SDL_GetError());
-        return false;
-    }
-
-    VkPhysicalDevice discrete_gpu = VK_NULL_HANDLE;
-    VkPhysicalDevice integrated_gpu = VK_NULL_HANDLE;
-    // TODO: More sophisticated device selection, e.g if there are multiple gpus w/ the required
-    // capabilities, give ability to select.
-    for (u32 i = 0; i < num_physical_device; ++i) {
-        VkPhysicalDevice physical_device = gpus[i];
-        vkGetPhysicalDeviceProperties(physical_device, &vk_physical_device_properties);
-        if (vk_physical_device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-            if (get_family_queue(physical_device)) {
-                // NOTE: prefer discrete GPU over integrated one, stop at first discrete GPU that
-                // has present capabilities
-                discrete_gpu = physical_device;
-                break;
-            }
-            continue;
-        }
-        if (vk_physical_device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
-            if (get_family_queue(physical_device)) {
-                integrated_gpu = physical_device;
-            }
-            continue;
+    // Create drawable surface. The surface is needed to check present support while choosing a GPU.
+    window_handle = creation.window;
+    vk_surface = VK_NULL_HANDLE;
+    if (!headless) {
+        if (SDL_Vulkan_CreateSurface(window_handle, vk_instance, &vk_surface) == SDL_FALSE) {
+            LOG_ERR("Failed to create window surface: %s", SDL_GetError());
+            return false;
         }
     }
 
-    if (discrete_gpu != VK_NULL_HANDLE) {
-        vk_physical_device = discrete_gpu;
-    } else if (integrated_gpu != VK_NULL_HANDLE) {
-        vk_physical_device = integrated_gpu;
-    } else {
-        LOG_ERR("Suitable GPU device not found!");
+    // Choose physical device.
+    if (!select_physical_device(creation)) {
         return false;
     }
-    free(gpus);
 
     // Query physical device properties.
     vkGetPhysicalDeviceProperties(vk_physical_device, &vk_physical_device_properties);
     LOG_DBG("Selected GPU: %s", vk_physical_device_properties.deviceName);
     gpu_timestamp_period = vk_physical_device_properties.limits.timestampPeriod / (1000 * 1000);
     LOG_DBG("GPU timestamp period: %f", gpu_timestamp_period);
-    ubo_alignment = vk_physical_device_properties.limits.minUniformBufferOffsetAlignment;
-    ssbo_alignment = vk_physical_device_properties.limits.minStorageBufferOffsetAlignment;
+    ubo_alignment = (u32)vk_physical_device_properties.limits.minUniformBufferOffsetAlignment;
+    ssbo_alignment = (u32)vk_physical_device_properties.limits.minStorageBufferOffsetAlignment;
 
     // 2. Create logical device.
-    u32 device_extension_count = 1;
-    const char *device_extensions[] = {"VK_KHR_swapchain"};
+    // Headless devices never present, so they don't need (and may not support) the swapchain extension.
+    u32 device_extension_count = 0;
+    const char *device_extensions[2];
+    if (!headless) {
+        device_extensions[device_extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    }
+    // Real heap budgets from the driver, otherwise VMA can only estimate them.
+    memory_budget_supported = is_device_extension_supported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memory_budget_supported) {
+        device_extensions[device_extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+    LOG_DBG("Memory budget extension %s.", memory_budget_supported ? "supported" : "not supported");
     const float queue_priority[] = {1.0f};
-    VkDeviceQueueCreateInfo queue_info[1] = {};
+    VkDeviceQueueCreateInfo queue_info[2] = {};
     queue_info[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queue_info[0].queueFamilyIndex = vk_queue_family;
     queue_info[0].queueCount = 1;
     queue_info[0].pQueuePriorities = queue_priority;
+    // Without a dedicated transfer family, uploads share the graphics queue.
+    const u32 queue_info_count = vk_transfer_queue_family != vk_queue_family ? 2 : 1;
+    queue_info[1] = queue_info[0];
+    queue_info[1].queueFamilyIndex = vk_transfer_queue_family;
+
+    // Enable all features: just pass the physical features 2 struct, with the 1.2 (and on 1.3 devices
+    // the 1.3) features chained.
+    VkPhysicalDeviceVulkan13Features vulkan13_features = {};
+    vulkan13_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+    vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    if (vk_physical_device_properties.apiVersion >= VK_API_VERSION_1_3) {
+        vulkan12_features.pNext = &vulkan13_features;
+    }
 
-    // Enable all features: just pass the physical features 2 struct.
     VkPhysicalDeviceFeatures2 physical_features2;
     physical_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-    physical_features2.pNext = nullptr;
+    physical_features2.pNext = &vulkan12_features;
     physical_features2.features = {};
     vkGetPhysicalDeviceFeatures2(vk_physical_device, &physical_features2);
 
+    // Uploads synchronize with the graphics queue through a timeline semaphore.
+    if (!vulkan12_features.timelineSemaphore) {
+        LOG_ERR("GPU %s doesn't support timeline semaphores!", vk_physical_device_properties.deviceName);
+        return false;
+    }
+    // Slots of the bindless set are written while frames using other slots are in flight.
+    bindless_supported = vulkan12_features.descriptorIndexing &&
+                         vulkan12_features.runtimeDescriptorArray &&
+                         vulkan12_features.descriptorBindingPartiallyBound &&
+                         vulkan12_features.descriptorBindingSampledImageUpdateAfterBind &&
+                         vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind &&
+                         vulkan12_features.descriptorBindingUpdateUnusedWhilePending;
+    LOG_DBG("Bindless descriptors %s.", bindless_supported ? "supported" : "not supported");
+
+    dynamic_rendering = creation.dynamic_rendering && vulkan13_features.dynamicRendering;
+    if (creation.dynamic_rendering && !dynamic_rendering) {
+        LOG_ERR("GPU %s doesn't support dynamic rendering, using render passes.",
+                vk_physical_device_properties.deviceName);
+    }
+
+    // GPU-driven draws: without these, draw_indexed_indirect falls back to fixed draw counts and one
+    // call per command.
+    multi_draw_indirect_supported = physical_features2.features.multiDrawIndirect;
+    draw_indirect_count_supported =
+        vulkan12_features.drawIndirectCount && multi_draw_indirect_supported;
+    draw_indirect_first_instance_supported = physical_features2.features.drawIndirectFirstInstance;
+    // Single draws are looped over without multiDrawIndirect, which has no limit.
+    max_draw_indirect_count = multi_draw_indirect_supported
+                                  ? vk_physical_device_properties.limits.maxDrawIndirectCount
+                                  : u32_max;
+    LOG_DBG("Indirect draw count %s, multi draw indirect %s.",
+            draw_indirect_count_supported ? "supported" : "not supported",
+            multi_draw_indirect_supported ? "supported" : "not supported");
+
     VkDeviceCreateInfo device_create_info = {};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    device_create_info.queueCreateInfoCount = sizeof(queue_info) / sizeof(queue_info[0]);
+    device_create_info.queueCreateInfoCount = queue_info_count;
     device_create_info.pQueueCreateInfos = queue_info;
     device_create_info.enabledExtensionCount = device_extension_count;
     device_create_info.ppEnabledExtensionNames = device_extensions;
@@ -297,67 +544,178 @@ bool Device::init(u32 window_width_, u32 window_height_, SDL_Window *window) {
     }
 
     vkGetDeviceQueue(vk_device, vk_queue_family, 0, &vk_queue);
+    vkGetDeviceQueue(vk_device, vk_transfer_queue_family, 0, &vk_transfer_queue);
+    LOG_DBG("Graphics queue family %u, transfer queue family %u.", vk_queue_family,
+            vk_transfer_queue_family);
 
-    // 3. Create framebuffers.
-    int window_width, window_height;
-    SDL_GetWindowSize(window_handle, &window_width, &window_height);
+    pipeline_cache_path = creation.pipeline_cache_path;
+    if (!load_pipeline_cache(pipeline_cache_path)) {
+        return false;
+    }
+
+    // Create VMA allocator.
+    VmaAllocatorCreateInfo allocator_info = {};
+    allocator_info.physicalDevice = vk_physical_device;
+    allocator_info.device = vk_device;
+    allocator_info.instance = vk_instance;
+    allocator_info.pAllocationCallbacks = vk_alloc_callbacks;
+    // Timeline semaphores already require a 1.2 device.
+    allocator_info.vulkanApiVersion = vk_physical_device_properties.apiVersion >= VK_API_VERSION_1_3
+                                          ? VK_API_VERSION_1_3
+                                          : VK_API_VERSION_1_2;
+    if (memory_budget_supported) {
+        allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
+    if (!vkCheck(vmaCreateAllocator(&allocator_info, &vma_allocator))) {
+        LOG_ERR("Failed to create VMA allocator.")
+        return false;
+    }
+    memory_budget = {};
+    num_memory_pressure_listeners = 0;
+
+    if (!upload_manager.init(vk_device, vma_allocator, vk_transfer_queue, vk_transfer_queue_family,
+                             vk_queue_family,
+                             (u32)vk_physical_device_properties.limits.optimalBufferCopyOffsetAlignment,
+                             vk_alloc_callbacks)) {
+        LOG_ERR("Failed to create upload manager.");
+        return false;
+    }
+
+    buffers.init(max_buffers, &resource_allocator);
+    textures.init(max_textures, &resource_allocator);
+    samplers.init(max_samplers, &resource_allocator);
+    pipelines.init(max_pipelines, &resource_allocator);
+    descriptor_set_layouts.init(max_descriptor_set_layout_resources, &resource_allocator);
+    memories.init(max_memory_blocks, &resource_allocator);
+    // Twice the pool sizes, so the caches can never fill up and probe sequences stay short.
+    sampler_cache.init(max_samplers * 2, &resource_allocator);
+    descriptor_set_layout_cache.init(max_descriptor_set_layout_resources * 2, &resource_allocator);
+    pipeline_layout_cache.init(max_pipelines * 2, &resource_allocator);
+    render_pass_cache.init(max_render_passes * 2, &resource_allocator);
+    framebuffer_cache.init(max_framebuffers * 2, &resource_allocator);
+    resource_deletion_queue.reserve(max_resource_deletions);
 
+    // 3. Create framebuffers.
     // Select surface format.
     const VkFormat surface_image_formats[] = {VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM,
                                               VK_FORMAT_B8G8R8_UNORM, VK_FORMAT_R8G8B8_UNORM};
     const VkColorSpaceKHR surface_color_space = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
-    u32 supported_count;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &supported_count, NULL);
-    VkSurfaceFormatKHR *supported_formats =
-        (VkSurfaceFormatKHR *)malloc(sizeof(VkSurfaceFormatKHR) * supported_count);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &supported_count,
-                                         supported_formats);
+    const u32 surface_format_count = sizeof(surface_image_formats) / sizeof(surface_image_formats[0]);
 
     swapchain_output.reset();
 
-    // Check for supported formats.
-    bool format_found = false;
-    const u32 surface_format_count = sizeof(surface_image_formats) / sizeof(surface_image_formats[0]);
-
-    for (u32 i = 0; i < surface_format_count; i++) {
-        for (u32 j = 0; j < supported_count; j++) {
-            if (supported_formats[j].format == surface_image_formats[i] &&
-                supported_formats[j].colorSpace == surface_color_space) {
-                vk_surface_format = supported_formats[j];
-                swapchain_output.color(surface_image_formats[j]);
+    if (headless) {
+        // Pick the first format usable as an offscreen render target that can also be read back.
+        const VkFormatFeatureFlags required_features =
+            VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT;
+        bool format_found = false;
+        for (u32 i = 0; i < surface_format_count; i++) {
+            VkFormatProperties format_properties;
+            vkGetPhysicalDeviceFormatProperties(vk_physical_device, surface_image_formats[i],
+                                                &format_properties);
+            if ((format_properties.optimalTilingFeatures & required_features) == required_features) {
+                vk_surface_format.format = surface_image_formats[i];
+                vk_surface_format.colorSpace = surface_color_space;
                 format_found = true;
                 break;
             }
         }
+        if (!format_found) {
+            LOG_ERR("Failed to find a supported offscreen format");
+            return false;
+        }
+    } else {
+        LinearScope scope(frame_scratch);
+        u32 supported_count;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &supported_count, NULL);
+        VkSurfaceFormatKHR *supported_formats =
+            allocate_array<VkSurfaceFormatKHR>(frame_scratch, supported_count);
+        if (!supported_formats || supported_count == 0) {
+            LOG_ERR("Failed to query the surface formats.");
+            return false;
+        }
+        vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &supported_count,
+                                             supported_formats);
+
+        // Check for supported formats.
+        bool format_found = false;
+        for (u32 i = 0; i < surface_format_count; i++) {
+            for (u32 j = 0; j < supported_count; j++) {
+                if (supported_formats[j].format == surface_image_formats[i] &&
+                    supported_formats[j].colorSpace == surface_color_space) {
+                    vk_surface_format = supported_formats[j];
+                    format_found = true;
+                    break;
+                }
+            }
+
+            if (format_found)
+                break;
+        }
 
-        if (format_found)
-            break;
+        if (!format_found) {
+            // Default to the first format supported.
+            vk_surface_format = supported_formats[0];
+            LOG_ERR("Failed to find supported surface format");
+        }
     }
-
-    if (!format_found) {
-        // Default to the first format supported.
-        vk_surface_format = supported_formats[0];
-        LOG_ERR("Failed to find supported surface format");
+    swapchain_output.color(vk_surface_format.format)
+        .set_operations(RenderPassOperation::Clear, RenderPassOperation::DontCare,
+                        RenderPassOperation::DontCare);
+
+    // Offscreen images are left ready to be copied out, swapchain images ready to be presented.
+    const VkImageLayout swapchain_final_layout =
+        headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    if (!dynamic_rendering) {
+        vk_swapchain_renderpass =
+            obtain_render_pass(swapchain_output, swapchain_final_layout, "Swapchain");
+        if (vk_swapchain_renderpass == VK_NULL_HANDLE) {
+            LOG_ERR("Failed to create swapchain render pass!");
+            return false;
+        }
     }
-    free(supported_formats);
 
-    set_present_mode(present_mode);
+    if (headless) {
+        vk_present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        vk_swapchain_image_count = max_swapchain_images;
+        vk_swapchain = VK_NULL_HANDLE;
 
-    // Create swapchain
-    if (!create_swapchain()) {
-        LOG_ERR("Failed to create swapchain!");
-        return false;
+        if (!create_offscreen_images()) {
+            LOG_ERR("Failed to create offscreen images!");
+            return false;
+        }
+    } else {
+        set_present_mode(present_mode);
+
+        // Create swapchain
+        if (!create_swapchain(VK_NULL_HANDLE)) {
+            LOG_ERR("Failed to create swapchain!");
+            return false;
+        }
     }
 
-    // Create VMA allocator.
-    VmaAllocatorCreateInfo allocator_info = {};
-    allocator_info.physicalDevice = vk_physical_device;
-    allocator_info.device = vk_device;
-    allocator_info.instance = vk_instance;
-    if (!vkCheck(vmaCreateAllocator(&allocator_info, &vma_allocator))) {
-        LOG_ERR("Failed to create VMA allocator.")
+    if (!create_frame_resources()) {
+        LOG_ERR("Failed to create frame resources!");
         return false;
     }
+
+    // Timestamp queries: two per scope, one range per frame in flight.
+    if (gpu_timestamp_valid_bits > 0) {
+        VkQueryPoolCreateInfo query_pool_info = {};
+        query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_info.queryCount = max_gpu_timestamps_per_frame * 2 * max_frames;
+        if (!vkCheck(vkCreateQueryPool(vk_device, &query_pool_info, vk_alloc_callbacks,
+                                       &vk_timestamp_query_pool))) {
+            return false;
+        }
+    } else {
+        LOG_DBG("GPU timestamps not supported on the selected queue.");
+    }
+    for (u32 i = 0; i < max_frames; ++i) {
+        gpu_timestamps.reset(i);
+    }
+
     ////////  Create pools
     static const u32 global_pool_elements = 128;
     VkDescriptorPoolSize pool_sizes[] = {
@@ -384,16 +742,61 @@ bool Device::init(u32 window_width_, u32 window_height_, SDL_Window *window) {
         return false;
     }
 
+    if (!create_bindless_resources()) {
+        LOG_ERR("Failed to create bindless descriptor set.");
+        return false;
+    }
+
+    if (!create_dynamic_buffer()) {
+        LOG_ERR("Failed to create dynamic buffer.");
+        return false;
+    }
+
     LOG_DBG("Initialized Device.");
     return true;
 }
 
 void Device::teardown() {
-    destroy_swapchain();
+    vkDeviceWaitIdle(vk_device);
+
+    destroy_frame_resources();
+    upload_manager.shutdown();
+    if (vk_timestamp_query_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(vk_device, vk_timestamp_query_pool, vk_alloc_callbacks);
+    }
+
+    destroy_retired_swapchains(true);
+    if (headless) {
+        destroy_offscreen_images();
+    } else {
+        destroy_swapchain();
+    }
+    destroy_render_pass_caches();
+
+    destroy_buffer(dynamic_buffer);
+    process_resource_deletions(true);
+    destroy_all_resources();
+
+    save_pipeline_cache();
+    vkDestroyPipelineCache(vk_device, vk_pipeline_cache, vk_alloc_callbacks);
+
+    vkDestroyDescriptorSetLayout(vk_device, vk_dynamic_descriptor_set_layout, vk_alloc_callbacks);
+    vkDestroyDescriptorPool(vk_device, vk_descriptor_pool, vk_alloc_callbacks);
+    vkDestroyDescriptorSetLayout(vk_device, vk_bindless_descriptor_set_layout, vk_alloc_callbacks);
+    if (bindless_supported) {
+        vkDestroyDescriptorPool(vk_device, vk_bindless_descriptor_pool, vk_alloc_callbacks);
+        bindless_texture_slots.shutdown();
+        bindless_storage_buffer_slots.shutdown();
+        bindless_sampler_slots.shutdown();
+    }
+    vmaDestroyAllocator(vma_allocator);
 
     vkDestroyDevice(vk_device, vk_alloc_callbacks);
 
-    vkDestroySurfaceKHR(vk_instance, vk_surface, vk_alloc_callbacks);
+    if (vk_surface != VK_NULL_HANDLE) {
+        // SDL creates the surface without allocation callbacks.
+        vkDestroySurfaceKHR(vk_instance, vk_surface, nullptr);
+    }
 
 #ifdef VULKAN_DEBUG_REPORT
     // Remove the debug report callback
@@ -404,10 +807,32 @@ void Device::teardown() {
 
     vkDestroyInstance(vk_instance, vk_alloc_callbacks);
 
+    frame_scratch.shutdown();
+    MemoryStats stats[max_memory_stats];
+    const u32 num_stats = get_memory_stats(stats, max_memory_stats);
+    for (u32 i = 0; i < num_stats; ++i) {
+        if (stats[i].allocated_bytes) {
+            LOG_ERR("%s memory leaked: %llu bytes.", stats[i].name,
+                    (unsigned long long)stats[i].allocated_bytes);
+        }
+    }
+
     LOG_DBG("Device cleaned up.");
 }
 
-bool Device::create_swapchain() {
+bool Device::get_surface_extent(const VkSurfaceCapabilitiesKHR &capabilities, VkExtent2D &extent) const {
+    extent = capabilities.currentExtent;
+    if (extent.width == UINT32_MAX) {
+        // The surface size follows the swapchain, use the size the window asked for.
+        extent.width = clamp(swapchain_width, capabilities.minImageExtent.width,
+                             capabilities.maxImageExtent.width);
+        extent.height = clamp(swapchain_height, capabilities.minImageExtent.height,
+                              capabilities.maxImageExtent.height);
+    }
+    return extent.width != 0 && extent.height != 0;
+}
+
+bool Device::create_swapchain(VkSwapchainKHR old_swapchain) {
     //// Check if surface is supported
     VkBool32 surface_supported;
     vkGetPhysicalDeviceSurfaceSupportKHR(vk_physical_device, vk_queue_family, vk_surface,
@@ -420,13 +845,23 @@ bool Device::create_swapchain() {
     VkSurfaceCapabilitiesKHR surface_capabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk_physical_device, vk_surface, &surface_capabilities);
 
-    VkExtent2D swapchain_extent = surface_capabilities.currentExtent;
-    if (swapchain_extent.width == UINT32_MAX) {
-        swapchain_extent.width = clamp(swapchain_extent.width, surface_capabilities.minImageExtent.width,
-                                       surface_capabilities.maxImageExtent.width);
-        swapchain_extent.height =
-            clamp(swapchain_extent.height, surface_capabilities.minImageExtent.height,
-                  surface_capabilities.maxImageExtent.height);
+    VkExtent2D swapchain_extent;
+    if (!get_surface_extent(surface_capabilities, swapchain_extent)) {
+        // Minimized, there is nothing to present to.
+        return false;
+    }
+
+    u32 min_image_count = vk_swapchain_min_image_count;
+    if (min_image_count < surface_capabilities.minImageCount) {
+        min_image_count = surface_capabilities.minImageCount;
+    }
+    if (surface_capabilities.maxImageCount && min_image_count > surface_capabilities.maxImageCount) {
+        min_image_count = surface_capabilities.maxImageCount;
+    }
+    if (min_image_count > max_swapchain_images) {
+        LOG_ERR("The surface needs %u swapchain images, more than the supported %u.", min_image_count,
+                max_swapchain_images);
+        return false;
     }
 
     LOG_DBG("Create swapchain %u %u - saved %u %u, min image %u\n", swapchain_extent.width,
@@ -441,7 +876,7 @@ bool Device::create_swapchain() {
     VkSwapchainCreateInfoKHR swapchain_create_info = {};
     swapchain_create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     swapchain_create_info.surface = vk_surface;
-    swapchain_create_info.minImageCount = vk_swapchain_image_count;
+    swapchain_create_info.minImageCount = min_image_count;
     swapchain_create_info.imageFormat = vk_surface_format.format;
     swapchain_create_info.imageExtent = swapchain_extent;
     swapchain_create_info.clipped = VK_TRUE;
@@ -452,16 +887,29 @@ bool Device::create_swapchain() {
     swapchain_create_info.preTransform = surface_capabilities.currentTransform;
     swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchain_create_info.presentMode = vk_present_mode;
+    // Lets the driver hand the old swapchain's resources over, and keeps its queued presents valid.
+    swapchain_create_info.oldSwapchain = old_swapchain;
 
-    if (!vkCheck(vkCreateSwapchainKHR(vk_device, &swapchain_create_info, 0, &vk_swapchain))) {
+    vk_swapchain = VK_NULL_HANDLE;
+    vk_swapchain_image_count = 0;
+    VkSwapchainKHR swapchain;
+    if (!vkCheck(
+            vkCreateSwapchainKHR(vk_device, &swapchain_create_info, vk_alloc_callbacks, &swapchain))) {
         return false;
     }
+    vk_swapchain = swapchain;
 
     // Cache swapchain images
-    vkGetSwapchainImagesKHR(vk_device, vk_swapchain, &vk_swapchain_image_count, nullptr);
-    vkGetSwapchainImagesKHR(vk_device, vk_swapchain, &vk_swapchain_image_count, vk_swapchain_images);
+    u32 image_count = 0;
+    vkGetSwapchainImagesKHR(vk_device, vk_swapchain, &image_count, nullptr);
+    if (image_count > max_swapchain_images) {
+        LOG_ERR("Swapchain has %u images, more than the supported %u.", image_count,
+                max_swapchain_images);
+        return false;
+    }
+    vkGetSwapchainImagesKHR(vk_device, vk_swapchain, &image_count, vk_swapchain_images);
 
-    for (size_t iv = 0; iv < vk_swapchain_image_count; iv++) {
+    for (u32 iv = 0; iv < image_count; iv++) {
         // Create an image view which we can render into.
         VkImageViewCreateInfo view_info;
         view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -482,67 +930,1141 @@ bool Device::create_swapchain() {
                                        &vk_swapchain_image_views[iv]))) {
             return false;
         }
+        vk_swapchain_image_count = iv + 1;
     }
 
     return true;
 }
 
-bool Device::resize_swapchain() {
-    vkDeviceWaitIdle(vk_device);
-
-    VkSurfaceCapabilitiesKHR surface_capabilities;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk_physical_device, vk_surface, &surface_capabilities);
-    VkExtent2D swapchain_extent = surface_capabilities.currentExtent;
+void Device::resize(u32 width, u32 height) {
+    swapchain_width = width;
+    swapchain_height = height;
+    swapchain_dirty = true;
+}
 
-    // Skip zero-sized swapchain
-    // rprint( "Requested swapchain resize %u %u\n", swapchain_extent.width, swapchain_extent.height );
-    if (swapchain_extent.width == 0 || swapchain_extent.height == 0) {
-        LOG_ERR("Cannot create a zero-sized swapchain");
+bool Device::recreate_swapchain() {
+    // Nothing to present to while minimized, the current swapchain stays until there is.
+    bool presentable = swapchain_width != 0 && swapchain_height != 0;
+    if (!headless) {
+        VkSurfaceCapabilitiesKHR surface_capabilities;
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk_physical_device, vk_surface, &surface_capabilities);
+        VkExtent2D extent;
+        presentable = get_surface_extent(surface_capabilities, extent);
+    }
+    if (!presentable) {
+        LOG_DBG("Swapchain recreation postponed, the surface is empty.");
         return false;
     }
 
-    // Internal destroy of swapchain pass to retain the same handle.
-    // TODO: Why do we do this?
-    vkDestroyRenderPass(vk_device, vk_swapchain_renderpass, vk_alloc_callbacks);
-
-    // Destroy swapchain images and framebuffers
-    destroy_swapchain();
-    vkDestroySurfaceKHR(vk_instance, vk_surface, vk_alloc_callbacks);
-
-    // Recreate window surface
-    if (SDL_Vulkan_CreateSurface(window_handle, vk_instance, &vk_surface) == SDL_FALSE) {
-        LOG_ERR("Failed to re-create Vulkan surface.");
+    // Frames still in flight keep using the old swapchain's images, so it is retired rather than
+    // destroyed.
+    RetiredSwapchain retired = {};
+    retired.vk_swapchain = vk_swapchain;
+    retired.image_count = vk_swapchain_image_count;
+    for (u32 i = 0; i < vk_swapchain_image_count; ++i) {
+        retired.vk_image_views[i] = vk_swapchain_image_views[i];
+        if (headless) {
+            retired.vk_images[i] = vk_swapchain_images[i];
+            retired.vma_allocations[i] = vma_offscreen_allocations[i];
+        }
+    }
+    retired.frame = absolute_frame;
+
+    const bool created = headless ? create_offscreen_images() : create_swapchain(retired.vk_swapchain);
+    // Only once the old handles were replaced: create_swapchain clears vk_swapchain just before
+    // vkCreateSwapchainKHR, which retires the old swapchain even when it fails. Offscreen images are
+    // cleared whether or not they could be recreated.
+    const bool replaced = headless || vk_swapchain != retired.vk_swapchain;
+    if (replaced && (retired.vk_swapchain != VK_NULL_HANDLE || retired.image_count)) {
+        retired_swapchains.push_back(retired);
+    }
+    if (!created) {
+        // Minimized or failed, try again next frame.
+        LOG_DBG("Swapchain recreation postponed.");
+        return false;
     }
 
-    // Create swapchain
-    create_swapchain();
-
-    // Resize depth texture, maintaining handle, using a dummy texture to destroy.
-    // TODO: Implement me.
-    // TextureHandle texture_to_delete = {textures.obtain_resource()};
-    // Texture *vk_texture_to_delete = access_texture(texture_to_delete);
-    // vk_texture_to_delete->handle = texture_to_delete;
-    // Texture *vk_depth_texture = access_texture(depth_texture);
-    // vulkan_resize_texture(*this, vk_depth_texture, vk_texture_to_delete, swapchain_width,
-    //                       swapchain_height, 1);
-
-    // destroy_texture(texture_to_delete);
-
-    // RenderPassCreation swapchain_pass_creation = {};
-    // swapchain_pass_creation.set_type(RenderPassType::Swapchain).set_name("Swapchain");
-    // vulkan_create_swapchain_pass(*this, swapchain_pass_creation, vk_swapchain_pass);
-
-    vkDeviceWaitIdle(vk_device);
+    swapchain_dirty = false;
+    LOG_DBG("Recreated swapchain %u %u", swapchain_width, swapchain_height);
     return true;
 }
 
-void Device::destroy_swapchain() {
-    for (size_t iv = 0; iv < vk_swapchain_image_count; iv++) {
+void Device::destroy_retired_swapchains(bool force) {
+    u32 i = 0;
+    while (i < retired_swapchains.size()) {
+        const RetiredSwapchain &retired = retired_swapchains[i];
+        if (!force && retired.frame + max_frames > absolute_frame) {
+            ++i;
+            continue;
+        }
+
+        for (u32 iv = 0; iv < retired.image_count; ++iv) {
+            evict_framebuffers(retired.vk_image_views[iv]);
+            vkDestroyImageView(vk_device, retired.vk_image_views[iv], vk_alloc_callbacks);
+            if (retired.vma_allocations[iv] != VK_NULL_HANDLE) {
+                track_gpu_memory(GpuMemoryCategory::RenderTarget, retired.vma_allocations[iv], false);
+                vmaDestroyImage(vma_allocator, retired.vk_images[iv], retired.vma_allocations[iv]);
+            }
+        }
+        if (retired.vk_swapchain != VK_NULL_HANDLE) {
+            vkDestroySwapchainKHR(vk_device, retired.vk_swapchain, vk_alloc_callbacks);
+        }
+
+        retired_swapchains[i] = retired_swapchains.back();
+        retired_swapchains.pop_back();
+    }
+}
+
+void Device::destroy_swapchain() {
+    for (size_t iv = 0; iv < vk_swapchain_image_count; iv++) {
+        evict_framebuffers(vk_swapchain_image_views[iv]);
         vkDestroyImageView(vk_device, vk_swapchain_image_views[iv], vk_alloc_callbacks);
-        vkDestroyFramebuffer(vk_device, vk_swapchain_framebuffers[iv], vk_alloc_callbacks);
     }
 
-    vkDestroySwapchainKHR(vk_device, vk_swapchain, vk_alloc_callbacks);
+    vkDestroySwapchainKHR(vk_device, vk_swapchain, vk_alloc_callbacks);
+}
+
+bool Device::create_offscreen_images() {
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = vk_surface_format.format;
+    image_info.extent = {swapchain_width, swapchain_height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // Same usage as the swapchain images, plus transfer source so frames can be read back.
+    image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo memory_info = {};
+    memory_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    // The previous images are retired or destroyed by now.
+    for (u32 i = 0; i < vk_swapchain_image_count; i++) {
+        vk_swapchain_images[i] = VK_NULL_HANDLE;
+        vk_swapchain_image_views[i] = VK_NULL_HANDLE;
+        vma_offscreen_allocations[i] = VK_NULL_HANDLE;
+    }
+    for (u32 i = 0; i < vk_swapchain_image_count; i++) {
+        if (!vkCheck(vmaCreateImage(vma_allocator, &image_info, &memory_info, &vk_swapchain_images[i],
+                                    &vma_offscreen_allocations[i], nullptr))) {
+            vk_swapchain_images[i] = VK_NULL_HANDLE;
+            vma_offscreen_allocations[i] = VK_NULL_HANDLE;
+            destroy_offscreen_images();
+            return false;
+        }
+        track_gpu_memory(GpuMemoryCategory::RenderTarget, vma_offscreen_allocations[i], true);
+
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = vk_surface_format.format;
+        view_info.image = vk_swapchain_images[i];
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.layerCount = 1;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.components.r = VK_COMPONENT_SWIZZLE_R;
+        view_info.components.g = VK_COMPONENT_SWIZZLE_G;
+        view_info.components.b = VK_COMPONENT_SWIZZLE_B;
+        view_info.components.a = VK_COMPONENT_SWIZZLE_A;
+
+        if (!vkCheck(vkCreateImageView(vk_device, &view_info, vk_alloc_callbacks,
+                                       &vk_swapchain_image_views[i]))) {
+            vk_swapchain_image_views[i] = VK_NULL_HANDLE;
+            destroy_offscreen_images();
+            return false;
+        }
+    }
+
+    LOG_DBG("Created %u offscreen images %u %u", vk_swapchain_image_count, swapchain_width,
+            swapchain_height);
+    return true;
+}
+
+void Device::destroy_offscreen_images() {
+    for (u32 i = 0; i < vk_swapchain_image_count; i++) {
+        if (vk_swapchain_image_views[i] != VK_NULL_HANDLE) {
+            evict_framebuffers(vk_swapchain_image_views[i]);
+            vkDestroyImageView(vk_device, vk_swapchain_image_views[i], vk_alloc_callbacks);
+        }
+        if (vma_offscreen_allocations[i] != VK_NULL_HANDLE) {
+            track_gpu_memory(GpuMemoryCategory::RenderTarget, vma_offscreen_allocations[i], false);
+            vmaDestroyImage(vma_allocator, vk_swapchain_images[i], vma_offscreen_allocations[i]);
+        }
+        vk_swapchain_images[i] = VK_NULL_HANDLE;
+        vk_swapchain_image_views[i] = VK_NULL_HANDLE;
+        vma_offscreen_allocations[i] = VK_NULL_HANDLE;
+    }
+}
+
+static VkAttachmentLoadOp to_vk_load_op(RenderPassOperation::Enum operation) {
+    switch (operation) {
+    case RenderPassOperation::Load:
+        return VK_ATTACHMENT_LOAD_OP_LOAD;
+    case RenderPassOperation::Clear:
+        return VK_ATTACHMENT_LOAD_OP_CLEAR;
+    case RenderPassOperation::DontCare:
+    default:
+        return VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    }
+}
+
+VkRenderPass Device::create_render_pass(const RenderPassOutput &output, VkImageLayout color_final_layout,
+                                        const char *name) {
+    VkAttachmentDescription attachments[max_image_outputs + 1];
+    VkAttachmentReference color_references[max_image_outputs];
+    VkAttachmentReference depth_reference;
+    u32 attachment_count = 0;
+
+    // Loading keeps the previous contents, so the attachment has to come in already in its layout.
+    const VkAttachmentLoadOp color_load = to_vk_load_op(output.color_operation);
+    const VkImageLayout color_initial_layout = color_load == VK_ATTACHMENT_LOAD_OP_LOAD
+                                                   ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                                   : VK_IMAGE_LAYOUT_UNDEFINED;
+    for (u32 i = 0; i < output.num_color_formats; ++i) {
+        VkAttachmentDescription &color = attachments[attachment_count];
+        color = {};
+        color.format = output.color_formats[i];
+        color.samples = VK_SAMPLE_COUNT_1_BIT;
+        color.loadOp = color_load;
+        color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color.initialLayout = color_initial_layout;
+        color.finalLayout = color_final_layout;
+
+        color_references[i].attachment = attachment_count++;
+        color_references[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
+    const bool has_depth = output.depth_stencil_format != VK_FORMAT_UNDEFINED;
+    if (has_depth) {
+        const VkAttachmentLoadOp depth_load = to_vk_load_op(output.depth_operation);
+        const VkAttachmentLoadOp stencil_load = to_vk_load_op(output.stencil_operation);
+
+        VkAttachmentDescription &depth = attachments[attachment_count];
+        depth = {};
+        depth.format = output.depth_stencil_format;
+        depth.samples = VK_SAMPLE_COUNT_1_BIT;
+        depth.loadOp = depth_load;
+        depth.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        depth.stencilLoadOp = stencil_load;
+        depth.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depth.initialLayout = (depth_load == VK_ATTACHMENT_LOAD_OP_LOAD ||
+                               stencil_load == VK_ATTACHMENT_LOAD_OP_LOAD)
+                                  ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                                  : VK_IMAGE_LAYOUT_UNDEFINED;
+        depth.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        depth_reference.attachment = attachment_count++;
+        depth_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    }
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = output.num_color_formats;
+    subpass.pColorAttachments = color_references;
+    subpass.pDepthStencilAttachment = has_depth ? &depth_reference : nullptr;
+
+    // Order attachment writes after the previous frame's use of the same images, and after the
+    // swapchain image acquire (which the submit waits on at the color output stage).
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependency.srcAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo render_pass_info = {};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = attachment_count;
+    render_pass_info.pAttachments = attachments;
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+    render_pass_info.dependencyCount = 1;
+    render_pass_info.pDependencies = &dependency;
+
+    VkRenderPass render_pass;
+    if (!vkCheck(vkCreateRenderPass(vk_device, &render_pass_info, vk_alloc_callbacks, &render_pass))) {
+        return VK_NULL_HANDLE;
+    }
+    set_resource_name(VK_OBJECT_TYPE_RENDER_PASS, (u64)render_pass, name);
+    return render_pass;
+}
+
+VkRenderPass Device::obtain_render_pass(const RenderPassOutput &output, VkImageLayout color_final_layout,
+                                        const char *name) {
+    RenderPassKey key = {};
+    key.output = output;
+    key.color_final_layout = color_final_layout;
+    if (VkRenderPass *cached = render_pass_cache.find(key)) {
+        return *cached;
+    }
+
+    VkRenderPass render_pass = create_render_pass(output, color_final_layout, name);
+    if (render_pass != VK_NULL_HANDLE && !render_pass_cache.insert(key, render_pass)) {
+        LOG_ERR("Render pass cache is full!");
+        vkDestroyRenderPass(vk_device, render_pass, vk_alloc_callbacks);
+        return VK_NULL_HANDLE;
+    }
+    return render_pass;
+}
+
+VkFramebuffer Device::obtain_framebuffer(VkRenderPass render_pass, const VkImageView *attachments,
+                                         u32 num_attachments, u32 width, u32 height) {
+    FramebufferKey key = {};
+    key.render_pass = render_pass;
+    for (u32 i = 0; i < num_attachments; ++i) {
+        key.attachments[i] = attachments[i];
+    }
+    key.num_attachments = num_attachments;
+    key.width = width;
+    key.height = height;
+    if (VkFramebuffer *cached = framebuffer_cache.find(key)) {
+        return *cached;
+    }
+
+    VkFramebufferCreateInfo framebuffer_info = {};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = render_pass;
+    framebuffer_info.attachmentCount = num_attachments;
+    framebuffer_info.pAttachments = attachments;
+    framebuffer_info.width = width;
+    framebuffer_info.height = height;
+    framebuffer_info.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (!vkCheck(vkCreateFramebuffer(vk_device, &framebuffer_info, vk_alloc_callbacks, &framebuffer))) {
+        return VK_NULL_HANDLE;
+    }
+    if (!framebuffer_cache.insert(key, framebuffer)) {
+        LOG_ERR("Framebuffer cache is full!");
+        vkDestroyFramebuffer(vk_device, framebuffer, vk_alloc_callbacks);
+        return VK_NULL_HANDLE;
+    }
+    return framebuffer;
+}
+
+void Device::evict_framebuffers(VkImageView attachment) {
+    u32 i = 0;
+    while (i < framebuffer_cache.capacity) {
+        bool uses_attachment = false;
+        if (framebuffer_cache.is_used(i)) {
+            const FramebufferKey &key = framebuffer_cache.key_at(i);
+            for (u32 a = 0; a < key.num_attachments; ++a) {
+                uses_attachment |= key.attachments[a] == attachment;
+            }
+        }
+        if (!uses_attachment) {
+            ++i;
+            continue;
+        }
+
+        vkDestroyFramebuffer(vk_device, framebuffer_cache.value_at(i), vk_alloc_callbacks);
+        const FramebufferKey key = framebuffer_cache.key_at(i);
+        framebuffer_cache.remove(key);
+    }
+}
+
+void Device::destroy_render_pass_caches() {
+    for (u32 i = 0; i < framebuffer_cache.capacity; ++i) {
+        if (framebuffer_cache.is_used(i)) {
+            vkDestroyFramebuffer(vk_device, framebuffer_cache.value_at(i), vk_alloc_callbacks);
+        }
+    }
+    for (u32 i = 0; i < render_pass_cache.capacity; ++i) {
+        if (render_pass_cache.is_used(i)) {
+            vkDestroyRenderPass(vk_device, render_pass_cache.value_at(i), vk_alloc_callbacks);
+        }
+    }
+    framebuffer_cache.shutdown();
+    render_pass_cache.shutdown();
+    vk_swapchain_renderpass = VK_NULL_HANDLE;
+}
+
+bool Device::create_frame_resources() {
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    // Fences start signalled so the first wait on each frame slot returns immediately.
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    if (!command_buffer_manager.init(vk_device, vk_queue_family, num_recording_threads,
+                                     vk_alloc_callbacks)) {
+        return false;
+    }
+
+    for (u32 i = 0; i < max_frames; ++i) {
+        if (!vkCheck(vkCreateSemaphore(vk_device, &semaphore_info, vk_alloc_callbacks,
+                                       &vk_image_acquired_semaphores[i])) ||
+            !vkCheck(vkCreateFence(vk_device, &fence_info, vk_alloc_callbacks,
+                                   &vk_command_buffer_executed_fences[i]))) {
+            return false;
+        }
+    }
+    for (u32 i = 0; i < max_swapchain_images; ++i) {
+        if (!vkCheck(vkCreateSemaphore(vk_device, &semaphore_info, vk_alloc_callbacks,
+                                       &vk_render_complete_semaphores[i]))) {
+            return false;
+        }
+    }
+
+    current_frame = 0;
+    previous_frame = 0;
+    absolute_frame = 0;
+    return true;
+}
+
+bool Device::create_dynamic_buffer() {
+    BufferCreation buffer_creation;
+    const u32 size = dynamic_buffer_frame_size * max_frames + max_dynamic_allocation_size;
+    buffer_creation.reset()
+        .set(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+             ResourceUsageType::Dynamic, size)
+        .set_name("Dynamic");
+    dynamic_buffer = create_buffer(buffer_creation);
+    Buffer *buffer = access_buffer(dynamic_buffer);
+    if (!buffer) {
+        return false;
+    }
+    dynamic_mapped_data = buffer->mapped_data;
+    dynamic_allocated_size.store(0);
+    dynamic_frame_end = dynamic_buffer_frame_size;
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1] = bindings[0];
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 2;
+    layout_info.pBindings = bindings;
+    if (!vkCheck(vkCreateDescriptorSetLayout(vk_device, &layout_info, vk_alloc_callbacks,
+                                             &vk_dynamic_descriptor_set_layout))) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool = vk_descriptor_pool;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts = &vk_dynamic_descriptor_set_layout;
+    if (!vkCheck(vkAllocateDescriptorSets(vk_device, &allocate_info, &vk_dynamic_descriptor_set))) {
+        return false;
+    }
+
+    // Written once: allocations only change the dynamic offsets.
+    const u32 max_uniform_range = vk_physical_device_properties.limits.maxUniformBufferRange;
+    VkDescriptorBufferInfo buffer_infos[2];
+    buffer_infos[0] = {buffer->vk_buffer, 0,
+                       max_dynamic_allocation_size < max_uniform_range ? max_dynamic_allocation_size
+                                                                       : max_uniform_range};
+    buffer_infos[1] = {buffer->vk_buffer, 0, max_dynamic_allocation_size};
+
+    VkWriteDescriptorSet writes[2] = {};
+    for (u32 i = 0; i < 2; ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = vk_dynamic_descriptor_set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = bindings[i].descriptorType;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
+    vkUpdateDescriptorSets(vk_device, 2, writes, 0, nullptr);
+    return true;
+}
+
+void *Device::dynamic_allocate(u32 size, u32 alignment, u32 &offset) {
+    if (size > max_dynamic_allocation_size) {
+        LOG_ERR("Dynamic allocation of %u bytes is larger than the descriptor range.", size);
+        return nullptr;
+    }
+
+    u32 current = dynamic_allocated_size.load(std::memory_order_relaxed);
+    u32 aligned;
+    do {
+        aligned = (current + alignment - 1) & ~(alignment - 1);
+        if (aligned + size > dynamic_frame_end) {
+            LOG_ERR("Dynamic buffer full for this frame (%u bytes).", dynamic_buffer_frame_size);
+            return nullptr;
+        }
+    } while (!dynamic_allocated_size.compare_exchange_weak(current, aligned + size,
+                                                           std::memory_order_relaxed));
+
+    offset = aligned;
+    return dynamic_mapped_data + aligned;
+}
+
+void *Device::dynamic_allocate_uniform(u32 size, u32 &offset) {
+    return dynamic_allocate(size, ubo_alignment, offset);
+}
+
+void *Device::dynamic_allocate_storage(u32 size, u32 &offset) {
+    return dynamic_allocate(size, ssbo_alignment, offset);
+}
+
+void Device::bind_dynamic_buffers(VkCommandBuffer command_buffer, PipelineHandle pipeline,
+                                  u32 uniform_offset, u32 storage_offset) {
+    Pipeline *vk_pipeline = pipelines.access_resource(pipeline.index);
+    if (!vk_pipeline) {
+        return;
+    }
+    const u32 offsets[2] = {uniform_offset, storage_offset};
+    vkCmdBindDescriptorSets(command_buffer, vk_pipeline->vk_bind_point, vk_pipeline->vk_pipeline_layout,
+                            0, 1, &vk_dynamic_descriptor_set, 2, offsets);
+}
+
+bool Device::create_bindless_resources() {
+    if (!bindless_supported) {
+        // Set 1 stays empty, so material sets keep their indices on every device.
+        VkDescriptorSetLayoutCreateInfo layout_info = {};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        return vkCheck(vkCreateDescriptorSetLayout(vk_device, &layout_info, vk_alloc_callbacks,
+                                                   &vk_bindless_descriptor_set_layout));
+    }
+
+    VkPhysicalDeviceVulkan12Properties vulkan12_properties = {};
+    vulkan12_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &vulkan12_properties;
+    vkGetPhysicalDeviceProperties2(vk_physical_device, &properties2);
+
+    // One slot per resource the pools can hold, unless the device allows fewer.
+    const VkPhysicalDeviceVulkan12Properties &limits = vulkan12_properties;
+    u32 texture_count = limits.maxPerStageDescriptorUpdateAfterBindSampledImages;
+    texture_count = texture_count < max_textures ? texture_count : max_textures;
+    u32 storage_buffer_count = limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+    storage_buffer_count = storage_buffer_count < max_buffers ? storage_buffer_count : max_buffers;
+    u32 sampler_count = limits.maxPerStageDescriptorUpdateAfterBindSamplers;
+    sampler_count = sampler_count < max_samplers ? sampler_count : max_samplers;
+
+    VkDescriptorPoolSize pool_sizes[] = {{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, texture_count},
+                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storage_buffer_count},
+                                         {VK_DESCRIPTOR_TYPE_SAMPLER, sampler_count}};
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 3;
+    pool_info.pPoolSizes = pool_sizes;
+    if (!vkCheck(vkCreateDescriptorPool(vk_device, &pool_info, vk_alloc_callbacks,
+                                        &vk_bindless_descriptor_pool))) {
+        return false;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    for (u32 i = 0; i < 3; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = pool_sizes[i].type;
+        bindings[i].descriptorCount = pool_sizes[i].descriptorCount;
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+    }
+    static_assert(bindless_texture_binding == 0 && bindless_storage_buffer_binding == 1 &&
+                      bindless_sampler_binding == 2,
+                  "Bindings are laid out in pool_sizes order");
+
+    // Unused slots stay unwritten, and slots no pending frame uses can be rewritten at any time.
+    const VkDescriptorBindingFlags binding_flag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                                                  VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                                  VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    const VkDescriptorBindingFlags binding_flags[3] = {binding_flag, binding_flag, binding_flag};
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {};
+    binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_info.bindingCount = 3;
+    binding_flags_info.pBindingFlags = binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &binding_flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = 3;
+    layout_info.pBindings = bindings;
+    if (!vkCheck(vkCreateDescriptorSetLayout(vk_device, &layout_info, vk_alloc_callbacks,
+                                             &vk_bindless_descriptor_set_layout))) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool = vk_bindless_descriptor_pool;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts = &vk_bindless_descriptor_set_layout;
+    if (!vkCheck(vkAllocateDescriptorSets(vk_device, &allocate_info, &vk_bindless_descriptor_set))) {
+        return false;
+    }
+
+    bindless_texture_slots.init(texture_count);
+    bindless_storage_buffer_slots.init(storage_buffer_count);
+    bindless_sampler_slots.init(sampler_count);
+    LOG_DBG("Bindless set: %u textures, %u storage buffers, %u samplers.", texture_count,
+            storage_buffer_count, sampler_count);
+    return true;
+}
+
+void Device::write_bindless_descriptor(u32 binding, u32 slot, VkDescriptorType type, VkBuffer buffer,
+                                       VkImageView image_view, VkSampler sampler) {
+    if (slot == invalid_bindless_index) {
+        LOG_ERR("Out of bindless slots for binding %u.", binding);
+        return;
+    }
+
+    VkDescriptorBufferInfo buffer_info = {buffer, 0, VK_WHOLE_SIZE};
+    VkDescriptorImageInfo image_info = {sampler, image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = vk_bindless_descriptor_set;
+    write.dstBinding = binding;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+        write.pBufferInfo = &buffer_info;
+    } else {
+        write.pImageInfo = &image_info;
+    }
+    vkUpdateDescriptorSets(vk_device, 1, &write, 0, nullptr);
+}
+
+void Device::bind_bindless_set(VkCommandBuffer command_buffer, PipelineHandle pipeline) {
+    Pipeline *vk_pipeline = pipelines.access_resource(pipeline.index);
+    if (!bindless_supported || !vk_pipeline) {
+        return;
+    }
+    vkCmdBindDescriptorSets(command_buffer, vk_pipeline->vk_bind_point, vk_pipeline->vk_pipeline_layout,
+                            bindless_set_index, 1, &vk_bindless_descriptor_set, 0, nullptr);
+}
+
+void Device::dispatch(VkCommandBuffer command_buffer, PipelineHandle pipeline, u32 group_count_x,
+                      u32 group_count_y, u32 group_count_z) {
+    Pipeline *vk_pipeline = pipelines.access_resource(pipeline.index);
+    if (!vk_pipeline || vk_pipeline->vk_bind_point != VK_PIPELINE_BIND_POINT_COMPUTE) {
+        LOG_ERR("Dispatch needs a compute pipeline.");
+        return;
+    }
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vk_pipeline->vk_pipeline);
+    vkCmdDispatch(command_buffer, group_count_x, group_count_y, group_count_z);
+}
+
+void Device::draw_indexed_indirect(VkCommandBuffer command_buffer, BufferHandle commands,
+                                   BufferHandle count, u32 max_draw_count) {
+    Buffer *command_buffer_resource = buffers.access_resource(commands.index);
+    Buffer *count_buffer = buffers.access_resource(count.index);
+    if (!command_buffer_resource) {
+        return;
+    }
+    const u32 stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (draw_indirect_count_supported && count_buffer) {
+        vkCmdDrawIndexedIndirectCount(command_buffer, command_buffer_resource->vk_buffer, 0,
+                                      count_buffer->vk_buffer, 0, max_draw_count, stride);
+    } else if (multi_draw_indirect_supported) {
+        vkCmdDrawIndexedIndirect(command_buffer, command_buffer_resource->vk_buffer, 0, max_draw_count,
+                                 stride);
+    } else {
+        for (u32 i = 0; i < max_draw_count; ++i) {
+            vkCmdDrawIndexedIndirect(command_buffer, command_buffer_resource->vk_buffer, i * stride, 1,
+                                     stride);
+        }
+    }
+}
+
+void Device::destroy_frame_resources() {
+    for (u32 i = 0; i < max_frames; ++i) {
+        vkDestroySemaphore(vk_device, vk_image_acquired_semaphores[i], vk_alloc_callbacks);
+        vkDestroyFence(vk_device, vk_command_buffer_executed_fences[i], vk_alloc_callbacks);
+    }
+    for (u32 i = 0; i < max_swapchain_images; ++i) {
+        vkDestroySemaphore(vk_device, vk_render_complete_semaphores[i], vk_alloc_callbacks);
+    }
+    command_buffer_manager.shutdown();
+}
+
+void Device::set_resource_name(VkObjectType type, u64 handle, const char *name) {
+    if (!debug_utils_extension_present || !name) {
+        return;
+    }
+    VkDebugUtilsObjectNameInfoEXT name_info = {};
+    name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+    name_info.objectType = type;
+    name_info.objectHandle = handle;
+    name_info.pObjectName = name;
+    pfnSetDebugUtilsObjectNameEXT(vk_device, &name_info);
+}
+
+bool Device::new_frame() {
+    // Wait for the GPU to finish the frame that last used this slot (max_frames frames ago).
+    i64 wait_start = time_now();
+    VkFence *render_complete_fence = &vk_command_buffer_executed_fences[current_frame];
+    vkWaitForFences(vk_device, 1, render_complete_fence, VK_TRUE, u64_max);
+    fence_wait_ms = (f32)time_elapsed_ms(wait_start);
+
+    // The slot's previous queries are complete now, so reading them back doesn't stall.
+    resolve_gpu_timestamps();
+    // Same for the slot's dynamic allocations.
+    dynamic_allocated_size.store(dynamic_buffer_frame_size * current_frame, std::memory_order_relaxed);
+    dynamic_frame_end = dynamic_buffer_frame_size * (current_frame + 1);
+    process_resource_deletions(false);
+    frame_scratch.clear();
+    update_memory_budget();
+    if (memory_budget.pressure > memory_pressure_threshold) {
+        notify_memory_pressure();
+    }
+
+    destroy_retired_swapchains(false);
+    if (headless) {
+        if (swapchain_dirty && !recreate_swapchain()) {
+            return false;
+        }
+        // No presentation engine: cycle through the offscreen ring.
+        vk_image_index = (u32)(absolute_frame % vk_swapchain_image_count);
+    } else {
+        if (swapchain_dirty && !recreate_swapchain()) {
+            return false;
+        }
+
+        VkResult result = vkAcquireNextImageKHR(vk_device, vk_swapchain, u64_max,
+                                                vk_image_acquired_semaphores[current_frame],
+                                                VK_NULL_HANDLE, &vk_image_index);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // Nothing was acquired and the semaphore is left unsignalled, so retry once on a new
+            // swapchain.
+            if (!recreate_swapchain()) {
+                return false;
+            }
+            result = vkAcquireNextImageKHR(vk_device, vk_swapchain, u64_max,
+                                           vk_image_acquired_semaphores[current_frame], VK_NULL_HANDLE,
+                                           &vk_image_index);
+        }
+        if (result == VK_SUBOPTIMAL_KHR) {
+            // The image is still presentable, render this frame and recreate for the next one.
+            swapchain_dirty = true;
+        } else if (result != VK_SUCCESS) {
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                swapchain_dirty = true;
+            } else {
+                vkCheck(result);
+            }
+            return false;
+        }
+    }
+
+    // The fence guarantees the GPU is done with everything recorded from this pool.
+    command_buffer_manager.reset_pools(current_frame);
+
+    VkCommandBufferBeginInfo begin_info = {};
+
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VkCommandBuffer command_buffer = command_buffer_manager.get_primary(current_frame);
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    if (vk_timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, vk_timestamp_query_pool,
+                            gpu_timestamps.first_query(current_frame), max_gpu_timestamps_per_frame * 2);
+    }
+
+    // Take ownership of whatever finished uploading. In-flight uploads are left alone, so the frame
+    // only waits on copies that are already done.
+    upload_ready_value = upload_manager.acquire_completed(command_buffer);
+
+    return true;
+}
+
+void Device::resolve_gpu_timestamps() {
+    const u32 query_count = gpu_timestamps.query_count(current_frame);
+    if (vk_timestamp_query_pool != VK_NULL_HANDLE && query_count > 0 &&
+        !gpu_timestamps.has_open_scopes(current_frame)) {
+        u64 ticks[max_gpu_timestamps_per_frame * 2];
+        const u32 first_query = gpu_timestamps.first_query(current_frame);
+        VkResult result = vkGetQueryPoolResults(vk_device, vk_timestamp_query_pool, first_query,
+                                                query_count, sizeof(ticks), ticks, sizeof(u64),
+                                                VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            const u64 valid_mask =
+                gpu_timestamp_valid_bits >= 64 ? u64_max : (1ull << gpu_timestamp_valid_bits) - 1;
+            gpu_timestamps.resolve(current_frame, ticks, valid_mask, gpu_timestamp_period);
+        }
+    }
+    gpu_timestamps.reset(current_frame);
+}
+
+void Device::push_gpu_marker(VkCommandBuffer command_buffer, const char *name) {
+    if (debug_utils_extension_present) {
+        VkDebugUtilsLabelEXT label = {};
+        label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+        label.pLabelName = name;
+        label.color[0] = label.color[1] = label.color[2] = label.color[3] = 1.0f;
+        pfnCmdBeginDebugUtilsLabelEXT(command_buffer, &label);
+    }
+
+    if (vk_timestamp_query_pool != VK_NULL_HANDLE) {
+        u32 query = gpu_timestamps.push(current_frame, absolute_frame, name);
+        if (query != u32_max) {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                vk_timestamp_query_pool, query);
+        }
+    }
+}
+
+void Device::pop_gpu_marker(VkCommandBuffer command_buffer) {
+    if (vk_timestamp_query_pool != VK_NULL_HANDLE) {
+        u32 query = gpu_timestamps.pop(current_frame);
+        if (query != u32_max) {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                vk_timestamp_query_pool, query);
+        }
+    }
+
+    if (debug_utils_extension_present) {
+        pfnCmdEndDebugUtilsLabelEXT(command_buffer);
+    }
+}
+
+const GpuTimestamp *Device::get_gpu_timestamps(u32 &count, u64 &frame_index) const {
+    count = gpu_timestamps.resolved_count;
+    frame_index = gpu_timestamps.resolved_frame;
+    return gpu_timestamps.resolved_timestamps();
+}
+
+void Device::present() {
+    VkCommandBuffer command_buffer = command_buffer_manager.get_primary(current_frame);
+    vkEndCommandBuffer(command_buffer);
+
+    // Reset right before submitting, so a skipped frame never leaves the fence unsignalled.
+    VkFence render_complete_fence = vk_command_buffer_executed_fences[current_frame];
+    vkResetFences(vk_device, 1, &render_complete_fence);
+
+    // Uploads recorded during the frame go out first, they complete asynchronously.
+    upload_manager.submit();
+
+    VkSemaphore wait_semaphores[2];
+    VkPipelineStageFlags wait_stages[2];
+    u64 wait_values[2] = {0, 0};
+    u32 wait_count = 0;
+    if (!headless) {
+        wait_semaphores[wait_count] = vk_image_acquired_semaphores[current_frame];
+        wait_stages[wait_count++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    }
+    if (upload_ready_value > 0) {
+        // Already signalled: this orders the acquired uploads before the frame without stalling.
+        wait_semaphores[wait_count] = upload_manager.vk_timeline_semaphore;
+        wait_values[wait_count] = upload_ready_value;
+        wait_stages[wait_count++] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = wait_count;
+    timeline_info.pWaitSemaphoreValues = wait_values;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    submit_info.waitSemaphoreCount = wait_count;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+    if (!headless) {
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &vk_render_complete_semaphores[vk_image_index];
+    }
+    vkCheck(vkQueueSubmit(vk_queue, 1, &submit_info, render_complete_fence));
+
+    if (!headless) {
+        VkPresentInfoKHR present_info = {};
+        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        present_info.waitSemaphoreCount = 1;
+        present_info.pWaitSemaphores = &vk_render_complete_semaphores[vk_image_index];
+        present_info.swapchainCount = 1;
+        present_info.pSwapchains = &vk_swapchain;
+        present_info.pImageIndices = &vk_image_index;
+        VkResult result = vkQueuePresentKHR(vk_queue, &present_info);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            // The frame was still submitted, so only the presentation is lost.
+            swapchain_dirty = true;
+        } else {
+            vkCheck(result);
+        }
+    }
+
+    previous_frame = current_frame;
+    current_frame = (current_frame + 1) % max_frames;
+    ++absolute_frame;
+}
+
+u64 Device::upload_buffer(BufferHandle buffer, const void *data, u32 size, u32 offset) {
+    Buffer *vk_buffer = buffers.access_resource(buffer.index);
+    if (!vk_buffer || offset + size > vk_buffer->size) {
+        LOG_ERR("Invalid upload of %u bytes at %u to buffer %u.", size, offset, buffer.index);
+        return 0;
+    }
+    u64 upload = upload_manager.upload_buffer(vk_buffer->vk_buffer, offset, data, size);
+    if (upload) {
+        vk_buffer->upload_value = upload;
+    }
+    return upload;
+}
+
+u64 Device::upload_texture(TextureHandle texture, const void *data, u32 size, u32 mip_level) {
+    Texture *vk_texture = textures.access_resource(texture.index);
+    if (!vk_texture || mip_level >= vk_texture->mipmaps) {
+        LOG_ERR("Invalid upload to mip %u of texture %u.", mip_level, texture.index);
+        return 0;
+    }
+
+    const bool has_depth = texture_format_has_depth(vk_texture->vk_format);
+    VkExtent3D extent;
+    extent.width = vk_texture->width >> mip_level ? vk_texture->width >> mip_level : 1;
+    extent.height = vk_texture->height >> mip_level ? vk_texture->height >> mip_level : 1;
+    extent.depth = vk_texture->depth >> mip_level ? vk_texture->depth >> mip_level : 1;
+    const u32 layer_count = vk_texture->type == TextureType::TextureCube ? 6 : 1;
+    const VkImageAspectFlags aspect =
+        has_depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    u64 upload = upload_manager.upload_image(vk_texture->vk_image, aspect, mip_level, layer_count,
+                                             extent, texture_format_block_height(vk_texture->vk_format),
+                                             data, size);
+    if (upload) {
+        vk_texture->upload_value = upload;
+        vk_texture->vk_image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    return upload;
+}
+
+void Device::flush_uploads() { upload_manager.submit(); }
+
+VkCommandBuffer Device::get_command_buffer() {
+    return command_buffer_manager.get_primary(current_frame);
+}
+
+VkCommandBuffer Device::begin_swapchain_secondary_command_buffer(u32 thread_index) {
+    VkCommandBuffer command_buffer = command_buffer_manager.get_secondary(current_frame, thread_index);
+    if (command_buffer == VK_NULL_HANDLE) {
+        LOG_ERR("Out of secondary command buffers for thread %u", thread_index);
+        return VK_NULL_HANDLE;
+    }
+
+    VkCommandBufferInheritanceRenderingInfo rendering_inheritance = {};
+    rendering_inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    rendering_inheritance.colorAttachmentCount = 1;
+    rendering_inheritance.pColorAttachmentFormats = &vk_surface_format.format;
+    rendering_inheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritance = {};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.pNext = dynamic_rendering ? &rendering_inheritance : nullptr;
+    inheritance.renderPass = vk_swapchain_renderpass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = vk_swapchain_framebuffer;
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags =
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.pInheritanceInfo = &inheritance;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    return command_buffer;
+}
+
+void Device::begin_swapchain_pass(VkCommandBuffer command_buffer, const f32 clear_color[4],
+                                  VkSubpassContents contents) {
+    VkClearValue clear_value;
+    clear_value.color = {{clear_color[0], clear_color[1], clear_color[2], clear_color[3]}};
+
+    if (dynamic_rendering) {
+        // Same ordering as the render pass' external dependency. The swapchain pass always clears, so
+        // the previous contents can be discarded.
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = vk_swapchain_images[vk_image_index];
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        const VkPipelineStageFlags src_stages =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        vkCmdPipelineBarrier(command_buffer, src_stages, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkRenderingAttachmentInfo color_attachment = {};
+        color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        color_attachment.imageView = vk_swapchain_image_views[vk_image_index];
+        color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        color_attachment.clearValue = clear_value;
+
+        VkRenderingInfo rendering_info = {};
+        rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        rendering_info.flags = contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                                   ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT
+                                   : 0;
+        rendering_info.renderArea.offset = {0, 0};
+        rendering_info.renderArea.extent = {swapchain_width, swapchain_height};
+        rendering_info.layerCount = 1;
+        rendering_info.colorAttachmentCount = 1;
+        rendering_info.pColorAttachments = &color_attachment;
+        vkCmdBeginRendering(command_buffer, &rendering_info);
+        return;
+    }
+
+    vk_swapchain_framebuffer =
+        obtain_framebuffer(vk_swapchain_renderpass, &vk_swapchain_image_views[vk_image_index], 1,
+                           swapchain_width, swapchain_height);
+
+    VkRenderPassBeginInfo pass_info = {};
+
+    pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    pass_info.renderPass = vk_swapchain_renderpass;
+    pass_info.framebuffer = vk_swapchain_framebuffer;
+    pass_info.renderArea.offset = {0, 0};
+    pass_info.renderArea.extent = {swapchain_width, swapchain_height};
+    pass_info.clearValueCount = 1;
+    pass_info.pClearValues = &clear_value;
+    vkCmdBeginRenderPass(command_buffer, &pass_info, contents);
+}
+
+void Device::end_swapchain_pass(VkCommandBuffer command_buffer) {
+    if (!dynamic_rendering) {
+        vkCmdEndRenderPass(command_buffer);
+        return;
+    }
+
+    vkCmdEndRendering(command_buffer);
+
+    // The render pass' final layout transition: ready to be presented, or copied out when headless.
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = headless ? VK_ACCESS_TRANSFER_READ_BIT : 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.newLayout =
+        headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = vk_swapchain_images[vk_image_index];
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    const VkPipelineStageFlags dst_stage =
+        headless ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, dst_stage, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+}
+
+bool Device::begin_render_pass(VkCommandBuffer command_buffer, const RenderPassOutput &output,
+                               const TextureHandle *color_attachments, TextureHandle depth_attachment,
+                               const VkClearValue *clear_values) {
+    const bool has_depth = output.depth_stencil_format != VK_FORMAT_UNDEFINED;
+    Texture *colors[max_image_outputs];
+    for (u32 i = 0; i < output.num_color_formats; ++i) {
+        colors[i] = textures.access_resource(color_attachments[i].index);
+        if (!colors[i]) {
+            LOG_ERR("Render pass color attachment %u is not a valid texture.", i);
+            return false;
+        }
+    }
+    Texture *depth = has_depth ? textures.access_resource(depth_attachment.index) : nullptr;
+    if (has_depth && !depth) {
+        LOG_ERR("Render pass depth attachment is not a valid texture.");
+        return false;
+    }
+    Texture *first = output.num_color_formats ? colors[0] : depth;
+    if (!first) {
+        LOG_ERR("Render pass without attachments.");
+        return false;
+    }
+    const VkRect2D render_area = {{0, 0}, {first->width, first->height}};
+
+    if (dynamic_rendering) {
+        VkRenderingAttachmentInfo color_infos[max_image_outputs];
+        for (u32 i = 0; i < output.num_color_formats; ++i) {
+            VkRenderingAttachmentInfo &color = color_infos[i];
+            color = {};
+            color.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+            color.imageView = colors[i]->vk_image_view;
+            color.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            color.loadOp = to_vk_load_op(output.color_operation);
+            color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            color.clearValue = clear_values[i];
+        }
+        VkRenderingAttachmentInfo depth_info = {};
+        VkRenderingAttachmentInfo stencil_info = {};
+        if (has_depth) {
+            depth_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+            depth_info.imageView = depth->vk_image_view;
+            depth_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            depth_info.loadOp = to_vk_load_op(output.depth_operation);
+            depth_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            depth_info.clearValue = clear_values[output.num_color_formats];
+            stencil_info = depth_info;
+            stencil_info.loadOp = to_vk_load_op(output.stencil_operation);
+            stencil_info.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        }
+
+        VkRenderingInfo rendering_info = {};
+        rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        rendering_info.renderArea = render_area;
+        rendering_info.layerCount = 1;
+        rendering_info.colorAttachmentCount = output.num_color_formats;
+        rendering_info.pColorAttachments = color_infos;
+        rendering_info.pDepthAttachment = has_depth ? &depth_info : nullptr;
+        rendering_info.pStencilAttachment =
+            texture_format_has_stencil(output.depth_stencil_format) ? &stencil_info : nullptr;
+        vkCmdBeginRendering(command_buffer, &rendering_info);
+        return true;
+    }
+
+    VkImageView views[max_image_outputs + 1];
+    u32 num_views = 0;
+    for (u32 i = 0; i < output.num_color_formats; ++i) {
+        views[num_views++] = colors[i]->vk_image_view;
+    }
+    if (has_depth) {
+        views[num_views++] = depth->vk_image_view;
+    }
+
+    VkRenderPassBeginInfo pass_info = {};
+    pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    pass_info.renderPass =
+        obtain_render_pass(output, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, "Texture Pass");
+    pass_info.framebuffer = obtain_framebuffer(pass_info.renderPass, views, num_views,
+                                               render_area.extent.width, render_area.extent.height);
+    pass_info.renderArea = render_area;
+    pass_info.clearValueCount = num_views;
+    pass_info.pClearValues = clear_values;
+    vkCmdBeginRenderPass(command_buffer, &pass_info, VK_SUBPASS_CONTENTS_INLINE);
+    return true;
+}
+
+void Device::end_render_pass(VkCommandBuffer command_buffer) {
+    if (dynamic_rendering) {
+        vkCmdEndRendering(command_buffer);
+    } else {
+        vkCmdEndRenderPass(command_buffer);
+    }
 }
 
 static VkPresentModeKHR to_vk_present_mode(PresentMode::Enum mode) {
@@ -564,9 +2086,13 @@ void Device::set_present_mode(PresentMode::Enum mode) {
     // is mandatory
     u32 supported_count = 0;
 
-    static VkPresentModeKHR supported_mode_allocated[8];
+    LinearScope scope(frame_scratch);
     vkGetPhysicalDeviceSurfacePresentModesKHR(vk_physical_device, vk_surface, &supported_count, NULL);
-    assert(supported_count < 8);
+    VkPresentModeKHR *supported_mode_allocated =
+        allocate_array<VkPresentModeKHR>(frame_scratch, supported_count);
+    if (!supported_mode_allocated) {
+        supported_count = 0;
+    }
     vkGetPhysicalDeviceSurfacePresentModesKHR(vk_physical_device, vk_surface, &supported_count,
                                               supported_mode_allocated);
 
@@ -583,9 +2109,1056 @@ void Device::set_present_mode(PresentMode::Enum mode) {
     // Default to VK_PRESENT_MODE_FIFO_KHR that is guaranteed to always be supported
     vk_present_mode = mode_found ? requested_mode : VK_PRESENT_MODE_FIFO_KHR;
     // Use 4 for immediate ?
-    vk_swapchain_image_count = 3; // vulkan_present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR ? 2 : 3;
+    vk_swapchain_min_image_count = 3; // vulkan_present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR ? 2 : 3;
 
     present_mode = mode_found ? mode : PresentMode::VSync;
 }
 
-} // namespace sren
\ No newline at end of file
+bool Device::is_device_extension_supported(const char *name) {
+    LinearScope scope(frame_scratch);
+    u32 num_extensions = 0;
+    vkEnumerateDeviceExtensionProperties(vk_physical_device, nullptr, &num_extensions, nullptr);
+    VkExtensionProperties *extensions =
+        allocate_array<VkExtensionProperties>(frame_scratch, num_extensions);
+    if (!extensions) {
+        return false;
+    }
+    vkEnumerateDeviceExtensionProperties(vk_physical_device, nullptr, &num_extensions, extensions);
+    for (u32 i = 0; i < num_extensions; ++i) {
+        if (!strcmp(extensions[i].extensionName, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Resources
+static VkImageType to_vk_image_type(TextureType::Enum type) {
+    switch (type) {
+    case TextureType::Texture1D:
+        return VK_IMAGE_TYPE_1D;
+    case TextureType::Texture3D:
+        return VK_IMAGE_TYPE_3D;
+    case TextureType::Texture2D:
+    case TextureType::TextureCube:
+    default:
+        return VK_IMAGE_TYPE_2D;
+    }
+}
+
+static GpuMemoryCategory::Enum texture_memory_category(u8 flags) {
+    return (flags & TextureFlags::RenderTarget_mask) ? GpuMemoryCategory::RenderTarget
+                                                     : GpuMemoryCategory::Texture;
+}
+
+static void fill_image_info(const TextureCreation &creation, VkImageCreateInfo &image_info) {
+    const bool is_render_target = (creation.flags & TextureFlags::RenderTarget_mask) != 0;
+    const bool is_compute = (creation.flags & TextureFlags::Compute_mask) != 0;
+    const bool has_depth = texture_format_has_depth(creation.format);
+    const bool is_cube = creation.type == TextureType::TextureCube;
+
+    image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.flags = is_cube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+    image_info.imageType = to_vk_image_type(creation.type);
+    image_info.format = creation.format;
+    image_info.extent = {creation.width, creation.height, creation.depth};
+    image_info.mipLevels = creation.mipmaps;
+    image_info.arrayLayers = is_cube ? 6 : 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (is_compute) {
+        image_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    if (is_render_target) {
+        image_info.usage |= has_depth ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                                      : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    }
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+static VkImageViewType to_vk_image_view_type(TextureType::Enum type) {
+    switch (type) {
+    case TextureType::Texture1D:
+        return VK_IMAGE_VIEW_TYPE_1D;
+    case TextureType::Texture3D:
+        return VK_IMAGE_VIEW_TYPE_3D;
+    case TextureType::TextureCube:
+        return VK_IMAGE_VIEW_TYPE_CUBE;
+    case TextureType::Texture2D:
+    default:
+        return VK_IMAGE_VIEW_TYPE_2D;
+    }
+}
+
+BufferHandle Device::create_buffer(const BufferCreation &creation) {
+    BufferHandle handle = {buffers.obtain_resource()};
+    if (handle.index == invalid_resource_handle) {
+        LOG_ERR("Buffer pool is full!");
+        return handle;
+    }
+    if (creation.size == 0) {
+        LOG_ERR("Cannot create zero-sized buffer %s", creation.name ? creation.name : "");
+        buffers.release_resource(handle.index);
+        return invalid_buffer;
+    }
+
+    Buffer *buffer = buffers.access_resource(handle.index);
+    buffer->name = creation.name;
+    buffer->size = creation.size;
+    buffer->type_flags = creation.type_flags;
+    buffer->usage = creation.usage;
+    buffer->handle = handle;
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    // Every buffer can be the target of an upload.
+    buffer_info.usage = creation.type_flags | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_info.size = creation.size;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo memory_info = {};
+    memory_info.usage = VMA_MEMORY_USAGE_AUTO;
+    if (creation.usage != ResourceUsageType::Immutable) {
+        memory_info.flags =
+            VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    }
+
+    VmaAllocationInfo allocation_info;
+    const VkResult result =
+        vmaCreateBuffer(vma_allocator, &buffer_info, &memory_info, &buffer->vk_buffer,
+                        &buffer->vma_allocation, &allocation_info);
+    if (!vkCheck(result)) {
+        buffers.release_resource(handle.index);
+        if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+            handle_out_of_device_memory(creation.name);
+        }
+        return invalid_buffer;
+    }
+    track_gpu_memory(GpuMemoryCategory::Buffer, buffer->vma_allocation, true);
+    buffer->vk_device_size = allocation_info.size;
+    buffer->mapped_data = (u8 *)allocation_info.pMappedData;
+    set_resource_name(VK_OBJECT_TYPE_BUFFER, (u64)buffer->vk_buffer, creation.name);
+
+    buffer->bindless_index = invalid_bindless_index;
+    if (bindless_supported && (creation.type_flags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+        buffer->bindless_index = bindless_storage_buffer_slots.obtain();
+        write_bindless_descriptor(bindless_storage_buffer_binding, buffer->bindless_index,
+                                  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer->vk_buffer, VK_NULL_HANDLE,
+                                  VK_NULL_HANDLE);
+    }
+
+    if (creation.initial_data) {
+        if (buffer->mapped_data) {
+            memcpy(buffer->mapped_data, creation.initial_data, creation.size);
+        } else {
+            upload_buffer(handle, creation.initial_data, creation.size);
+        }
+    }
+
+    return handle;
+}
+
+TextureHandle Device::create_texture(const TextureCreation &creation) {
+    TextureHandle handle = {textures.obtain_resource()};
+    if (handle.index == invalid_resource_handle) {
+        LOG_ERR("Texture pool is full!");
+        return handle;
+    }
+
+    Texture *texture = textures.access_resource(handle.index);
+    texture->width = creation.width;
+    texture->height = creation.height;
+    texture->depth = creation.depth;
+    texture->mipmaps = creation.mipmaps;
+    texture->flags = creation.flags;
+    texture->type = creation.type;
+    texture->name = creation.name;
+    texture->vk_format = creation.format;
+    texture->vk_image_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    texture->handle = handle;
+
+    const bool has_depth = texture_format_has_depth(creation.format);
+
+    VkImageCreateInfo image_info;
+    fill_image_info(creation, image_info);
+
+    VkResult result;
+    if (creation.alias.index != invalid_resource_handle) {
+        Memory *memory = memories.access_resource(creation.alias.index);
+        result = memory ? vmaCreateAliasingImage(vma_allocator, memory->vma_allocation, &image_info,
+                                                 &texture->vk_image)
+                        : VK_ERROR_UNKNOWN;
+        texture->vma_allocation = VK_NULL_HANDLE;
+    } else {
+        VmaAllocationCreateInfo memory_info = {};
+        memory_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+        result = vmaCreateImage(vma_allocator, &image_info, &memory_info, &texture->vk_image,
+                                &texture->vma_allocation, nullptr);
+    }
+    if (!vkCheck(result)) {
+        textures.release_resource(handle.index);
+        if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+            handle_out_of_device_memory(creation.name);
+        }
+        return invalid_texture;
+    }
+    set_resource_name(VK_OBJECT_TYPE_IMAGE, (u64)texture->vk_image, creation.name);
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = texture->vk_image;
+    view_info.viewType = to_vk_image_view_type(creation.type);
+    view_info.format = creation.format;
+    // Views are used for sampling, so only the depth aspect of depth/stencil formats.
+    view_info.subresourceRange.aspectMask =
+        has_depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = creation.mipmaps;
+    view_info.subresourceRange.layerCount = image_info.arrayLayers;
+    if (!vkCheck(
+            vkCreateImageView(vk_device, &view_info, vk_alloc_callbacks, &texture->vk_image_view))) {
+        vmaDestroyImage(vma_allocator, texture->vk_image, texture->vma_allocation);
+        textures.release_resource(handle.index);
+        return invalid_texture;
+    }
+    track_gpu_memory(texture_memory_category(texture->flags), texture->vma_allocation, true);
+    set_resource_name(VK_OBJECT_TYPE_IMAGE_VIEW, (u64)texture->vk_image_view, creation.name);
+
+    texture->bindless_index = invalid_bindless_index;
+    if (bindless_supported) {
+        texture->bindless_index = bindless_texture_slots.obtain();
+        write_bindless_descriptor(bindless_texture_binding, texture->bindless_index,
+                                  VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_NULL_HANDLE,
+                                  texture->vk_image_view, VK_NULL_HANDLE);
+    }
+
+    return handle;
+}
+
+VkMemoryRequirements Device::get_texture_memory_requirements(const TextureCreation &creation) {
+    VkImageCreateInfo image_info;
+    fill_image_info(creation, image_info);
+
+    // Requirements only depend on the creation parameters, a throwaway image is enough.
+    VkMemoryRequirements requirements = {};
+    VkImage image;
+    if (vkCheck(vkCreateImage(vk_device, &image_info, vk_alloc_callbacks, &image))) {
+        vkGetImageMemoryRequirements(vk_device, image, &requirements);
+        vkDestroyImage(vk_device, image, vk_alloc_callbacks);
+    }
+    return requirements;
+}
+
+bool Device::is_texture_format_supported(VkFormat format) const {
+    const VkFormatFeatureFlags required_features =
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(vk_physical_device, format, &format_properties);
+    return (format_properties.optimalTilingFeatures & required_features) == required_features;
+}
+
+MemoryHandle Device::create_memory(const VkMemoryRequirements &requirements, const char *name) {
+    MemoryHandle handle = {memories.obtain_resource()};
+    if (handle.index == invalid_resource_handle) {
+        LOG_ERR("Memory pool is full!");
+        return handle;
+    }
+
+    Memory *memory = memories.access_resource(handle.index);
+    memory->size = requirements.size;
+    memory->handle = handle;
+    memory->name = name;
+
+    VmaAllocationCreateInfo memory_info = {};
+    memory_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    const VkResult result =
+        vmaAllocateMemory(vma_allocator, &requirements, &memory_info, &memory->vma_allocation, nullptr);
+    if (!vkCheck(result)) {
+        memories.release_resource(handle.index);
+        if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+            handle_out_of_device_memory(name);
+        }
+        return invalid_memory;
+    }
+    track_gpu_memory(GpuMemoryCategory::MemoryBlock, memory->vma_allocation, true);
+    if (name) {
+        vmaSetAllocationName(vma_allocator, memory->vma_allocation, name);
+    }
+    return handle;
+}
+
+SamplerHandle Device::create_sampler(const SamplerCreation &creation) {
+    if (SamplerHandle *cached = sampler_cache.find(creation)) {
+        samplers.access_resource(cached->index)->references++;
+        return *cached;
+    }
+
+    SamplerHandle handle = {samplers.obtain_resource()};
+    if (handle.index == invalid_resource_handle) {
+        LOG_ERR("Sampler pool is full!");
+        return handle;
+    }
+
+    Sampler *sampler = samplers.access_resource(handle.index);
+    sampler->min_filter = creation.min_filter;
+    sampler->mag_filter = creation.mag_filter;
+    sampler->mip_filter = creation.mip_filter;
+    sampler->address_mode_u = creation.address_mode_u;
+    sampler->address_mode_v = creation.address_mode_v;
+    sampler->address_mode_w = creation.address_mode_w;
+    sampler->references = 1;
+    sampler->name = creation.name;
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.minFilter = creation.min_filter;
+    sampler_info.magFilter = creation.mag_filter;
+    sampler_info.mipmapMode = creation.mip_filter;
+    sampler_info.addressModeU = creation.address_mode_u;
+    sampler_info.addressModeV = creation.address_mode_v;
+    sampler_info.addressModeW = creation.address_mode_w;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+
+    if (!vkCheck(vkCreateSampler(vk_device, &sampler_info, vk_alloc_callbacks, &sampler->vk_sampler))) {
+        samplers.release_resource(handle.index);
+        return invalid_sampler;
+    }
+    set_resource_name(VK_OBJECT_TYPE_SAMPLER, (u64)sampler->vk_sampler, creation.name);
+
+    sampler->bindless_index = invalid_bindless_index;
+    if (bindless_supported) {
+        sampler->bindless_index = bindless_sampler_slots.obtain();
+        write_bindless_descriptor(bindless_sampler_binding, sampler->bindless_index,
+                                  VK_DESCRIPTOR_TYPE_SAMPLER, VK_NULL_HANDLE, VK_NULL_HANDLE,
+                                  sampler->vk_sampler);
+    }
+
+    sampler_cache.insert(creation, handle);
+    return handle;
+}
+
+static VkShaderModule create_shader_module(VkDevice device, const ShaderStage &stage,
+                                           VkAllocationCallbacks *alloc_callbacks) {
+    VkShaderModuleCreateInfo module_info = {};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = stage.code_size;
+    module_info.pCode = stage.code;
+
+    VkShaderModule module;
+    if (!vkCheck(vkCreateShaderModule(device, &module_info, alloc_callbacks, &module))) {
+        return VK_NULL_HANDLE;
+    }
+    return module;
+}
+
+PipelineHandle Device::create_pipeline(const PipelineCreation &creation) {
+    PipelineHandle handle = {pipelines.obtain_resource()};
+    if (handle.index == invalid_resource_handle) {
+        LOG_ERR("Pipeline pool is full!");
+        return handle;
+    }
+
+    i64 creation_start = time_now();
+
+    Pipeline *pipeline = pipelines.access_resource(handle.index);
+    pipeline->name = creation.name;
+    pipeline->handle = handle;
+    // A lone compute stage makes a compute pipeline, which ignores the render pass and fixed function
+    // state of the creation.
+    const bool compute = creation.shaders.stages_count == 1 &&
+                         creation.shaders.stages[0].type == VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline->vk_bind_point = compute ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+    // Shader modules are only needed while the pipeline is created.
+    VkPipelineShaderStageCreateInfo stages[max_shader_stages];
+    u32 stages_count = 0;
+    bool shaders_valid = true;
+    for (u32 i = 0; i < creation.shaders.stages_count; ++i) {
+        const ShaderStage &stage = creation.shaders.stages[i];
+        VkPipelineShaderStageCreateInfo &stage_info = stages[stages_count];
+        stage_info = {};
+        stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage_info.stage = stage.type;
+        stage_info.module = create_shader_module(vk_device, stage, vk_alloc_callbacks);
+        stage_info.pName = "main";
+        if (stage_info.module == VK_NULL_HANDLE) {
+            shaders_valid = false;
+            break;
+        }
+        ++stages_count;
+    }
+
+    // Set 0 is always the dynamic buffer set and set 1 the bindless set, so binding them survives
+    // pipeline changes.
+    PipelineLayoutKey &layout_key = pipeline->layout_key;
+    layout_key = {};
+    layout_key.set_layouts[0] = vk_dynamic_descriptor_set_layout;
+    layout_key.set_layouts[1] = vk_bindless_descriptor_set_layout;
+    layout_key.num_set_layouts = first_material_set_index;
+    layout_key.push_constant_size = creation.push_constant_size;
+    bool layouts_valid = true;
+    for (u32 i = 0; i < creation.num_descriptor_set_layouts; ++i) {
+        DescriptorSetLayout *set_layout =
+            access_descriptor_set_layout(creation.descriptor_set_layouts[i]);
+        if (!set_layout) {
+            LOG_ERR("Invalid descriptor set layout for set %u", first_material_set_index + i);
+            layouts_valid = false;
+            break;
+        }
+        layout_key.set_layouts[layout_key.num_set_layouts++] = set_layout->vk_descriptor_set_layout;
+    }
+    if (shaders_valid && layouts_valid) {
+        pipeline->vk_pipeline_layout = obtain_pipeline_layout(layout_key);
+    }
+
+    // Only used as a compatible render pass for creation: final layouts don't affect compatibility.
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    bool created = false;
+    if (pipeline->vk_pipeline_layout != VK_NULL_HANDLE && compute) {
+        VkComputePipelineCreateInfo pipeline_info = {};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_info.stage = stages[0];
+        pipeline_info.layout = pipeline->vk_pipeline_layout;
+        created = vkCheck(vkCreateComputePipelines(vk_device, vk_pipeline_cache, 1, &pipeline_info,
+                                                   vk_alloc_callbacks, &pipeline->vk_pipeline));
+    } else if (pipeline->vk_pipeline_layout != VK_NULL_HANDLE) {
+        if (!dynamic_rendering) {
+            render_pass = obtain_render_pass(creation.render_pass,
+                                             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, creation.name);
+        }
+
+        // Vertex input
+        VkVertexInputBindingDescription vertex_bindings[max_vertex_streams];
+        for (u32 i = 0; i < creation.vertex_input.num_vertex_streams; ++i) {
+            const VertexStream &stream = creation.vertex_input.vertex_streams[i];
+            vertex_bindings[i] = {stream.binding, stream.stride, stream.input_rate};
+        }
+        VkVertexInputAttributeDescription vertex_attributes[max_vertex_attributes];
+        for (u32 i = 0; i < creation.vertex_input.num_vertex_attributes; ++i) {
+            const VertexAttribute &attribute = creation.vertex_input.vertex_attributes[i];
+            vertex_attributes[i] = {attribute.location, attribute.binding, attribute.format,
+                                    attribute.offset};
+        }
+        VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
+        vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertex_input_info.vertexBindingDescriptionCount = creation.vertex_input.num_vertex_streams;
+        vertex_input_info.pVertexBindingDescriptions = vertex_bindings;
+        vertex_input_info.vertexAttributeDescriptionCount = creation.vertex_input.num_vertex_attributes;
+        vertex_input_info.pVertexAttributeDescriptions = vertex_attributes;
+
+        VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+        input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        input_assembly.topology = creation.topology;
+
+        // Viewport and scissor are dynamic, so pipelines survive swapchain resizes.
+        VkPipelineViewportStateCreateInfo viewport_state = {};
+        viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewport_state.viewportCount = 1;
+        viewport_state.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer = {};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = creation.cull_mode;
+        rasterizer.frontFace = creation.front_face;
+
+        VkPipelineMultisampleStateCreateInfo multisampling = {};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;
+
+        VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+        depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depth_stencil.depthTestEnable = creation.depth_test ? VK_TRUE : VK_FALSE;
+        depth_stencil.depthWriteEnable = creation.depth_write ? VK_TRUE : VK_FALSE;
+        depth_stencil.depthCompareOp = creation.depth_compare;
+
+        VkPipelineColorBlendAttachmentState blend_attachments[max_image_outputs];
+        for (u32 i = 0; i < creation.render_pass.num_color_formats; ++i) {
+            VkPipelineColorBlendAttachmentState &attachment = blend_attachments[i];
+            attachment = {};
+            attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+            attachment.blendEnable = creation.blend ? VK_TRUE : VK_FALSE;
+            attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+            attachment.colorBlendOp = VK_BLEND_OP_ADD;
+            attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+            attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+            attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+        }
+        VkPipelineColorBlendStateCreateInfo color_blending = {};
+        color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        color_blending.attachmentCount = creation.render_pass.num_color_formats;
+        color_blending.pAttachments = blend_attachments;
+
+        const VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamic_state = {};
+        dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamic_state.dynamicStateCount = sizeof(dynamic_states) / sizeof(dynamic_states[0]);
+        dynamic_state.pDynamicStates = dynamic_states;
+
+        VkGraphicsPipelineCreateInfo pipeline_info = {};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipeline_info.stageCount = stages_count;
+        pipeline_info.pStages = stages;
+        pipeline_info.pVertexInputState = &vertex_input_info;
+        pipeline_info.pInputAssemblyState = &input_assembly;
+        pipeline_info.pViewportState = &viewport_state;
+        pipeline_info.pRasterizationState = &rasterizer;
+        pipeline_info.pMultisampleState = &multisampling;
+        pipeline_info.pDepthStencilState = &depth_stencil;
+        pipeline_info.pColorBlendState = &color_blending;
+        pipeline_info.pDynamicState = &dynamic_state;
+        pipeline_info.layout = pipeline->vk_pipeline_layout;
+        pipeline_info.renderPass = render_pass;
+
+        // With dynamic rendering the attachment formats replace the render pass.
+        const RenderPassOutput &output = creation.render_pass;
+        VkPipelineRenderingCreateInfo rendering_info = {};
+        rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        rendering_info.colorAttachmentCount = output.num_color_formats;
+        rendering_info.pColorAttachmentFormats = output.color_formats;
+        if (texture_format_has_depth(output.depth_stencil_format)) {
+            rendering_info.depthAttachmentFormat = output.depth_stencil_format;
+        }
+        if (texture_format_has_stencil(output.depth_stencil_format)) {
+            rendering_info.stencilAttachmentFormat = output.depth_stencil_format;
+        }
+        if (dynamic_rendering) {
+            pipeline_info.pNext = &rendering_info;
+        }
+
+        created = (dynamic_rendering || render_pass != VK_NULL_HANDLE) &&
+                  vkCheck(vkCreateGraphicsPipelines(vk_device, vk_pipeline_cache, 1, &pipeline_info,
+                                                    vk_alloc_callbacks, &pipeline->vk_pipeline));
+    }
+
+    for (u32 i = 0; i < stages_count; ++i) {
+        vkDestroyShaderModule(vk_device, stages[i].module, vk_alloc_callbacks);
+    }
+
+    if (!created) {
+        LOG_ERR("Failed to create pipeline %s", creation.name ? creation.name : "");
+        if (pipeline->vk_pipeline_layout != VK_NULL_HANDLE) {
+            release_pipeline_layout(layout_key);
+        }
+        pipelines.release_resource(handle.index);
+        return invalid_pipeline;
+    }
+    set_resource_name(VK_OBJECT_TYPE_PIPELINE, (u64)pipeline->vk_pipeline, creation.name);
+
+    pipeline_cache_stats.pipelines_created++;
+    pipeline_cache_stats.pipeline_creation_ms += time_elapsed_ms(creation_start);
+    return handle;
+}
+
+DescriptorSetLayoutHandle
+Device::create_descriptor_set_layout(const DescriptorSetLayoutCreation &creation) {
+    if (DescriptorSetLayoutHandle *cached = descriptor_set_layout_cache.find(creation)) {
+        descriptor_set_layouts.access_resource(cached->index)->references++;
+        return *cached;
+    }
+
+    DescriptorSetLayoutHandle handle = {descriptor_set_layouts.obtain_resource()};
+    if (handle.index == invalid_resource_handle) {
+        LOG_ERR("Descriptor set layout pool is full!");
+        return handle;
+    }
+
+    DescriptorSetLayout *layout = descriptor_set_layouts.access_resource(handle.index);
+    layout->creation = creation;
+    layout->references = 1;
+    layout->handle = handle;
+
+    VkDescriptorSetLayoutBinding bindings[max_descriptors_per_set];
+    for (u32 i = 0; i < creation.num_bindings; ++i) {
+        const DescriptorBinding &binding = creation.bindings[i];
+        bindings[i] = {};
+        bindings[i].binding = binding.index;
+        bindings[i].descriptorType = binding.type;
+        bindings[i].descriptorCount = binding.count;
+        bindings[i].stageFlags = binding.stages;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = creation.num_bindings;
+    layout_info.pBindings = bindings;
+    if (!vkCheck(vkCreateDescriptorSetLayout(vk_device, &layout_info, vk_alloc_callbacks,
+                                             &layout->vk_descriptor_set_layout))) {
+        descriptor_set_layouts.release_resource(handle.index);
+        return invalid_descriptor_set_layout;
+    }
+    set_resource_name(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, (u64)layout->vk_descriptor_set_layout,
+                      creation.name);
+
+    descriptor_set_layout_cache.insert(creation, handle);
+    return handle;
+}
+
+VkPipelineLayout Device::obtain_pipeline_layout(const PipelineLayoutKey &key) {
+    if (PipelineLayout *cached = pipeline_layout_cache.find(key)) {
+        cached->references++;
+        return cached->vk_pipeline_layout;
+    }
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_ALL;
+    push_constant_range.size = key.push_constant_size;
+
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = key.num_set_layouts;
+    layout_info.pSetLayouts = key.set_layouts;
+    layout_info.pushConstantRangeCount = key.push_constant_size ? 1 : 0;
+    layout_info.pPushConstantRanges = &push_constant_range;
+
+    PipelineLayout layout = {VK_NULL_HANDLE, 1};
+    if (!vkCheck(vkCreatePipelineLayout(vk_device, &layout_info, vk_alloc_callbacks,
+                                        &layout.vk_pipeline_layout))) {
+        return VK_NULL_HANDLE;
+    }
+    pipeline_layout_cache.insert(key, layout);
+    return layout.vk_pipeline_layout;
+}
+
+void Device::release_pipeline_layout(const PipelineLayoutKey &key) {
+    PipelineLayout *cached = pipeline_layout_cache.get(key);
+    if (!cached || --cached->references > 0) {
+        return;
+    }
+    vkDestroyPipelineLayout(vk_device, cached->vk_pipeline_layout, vk_alloc_callbacks);
+    pipeline_layout_cache.remove(key);
+}
+
+bool Device::load_pipeline_cache(const char *path) {
+    i64 load_start = time_now();
+
+    MappedFile cache_file;
+    const void *initial_data = nullptr;
+    size_t initial_size = 0;
+    if (path && cache_file.map(path)) {
+        // Only hand the data to the driver if it was written by this exact device and driver.
+        VkPipelineCacheHeaderVersionOne header;
+        bool valid = cache_file.size >= sizeof(header);
+        if (valid) {
+            memcpy(&header, cache_file.data, sizeof(header));
+            valid = header.headerSize >= sizeof(header) &&
+                    header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                    header.vendorID == vk_physical_device_properties.vendorID &&
+                    header.deviceID == vk_physical_device_properties.deviceID &&
+                    memcmp(header.pipelineCacheUUID, vk_physical_device_properties.pipelineCacheUUID,
+                           VK_UUID_SIZE) == 0;
+        }
+        if (valid) {
+            initial_data = cache_file.data;
+            initial_size = cache_file.size;
+        } else {
+            LOG_DBG("Pipeline cache %s is stale or from another device, ignoring it.", path);
+        }
+    }
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.initialDataSize = initial_size;
+    cache_info.pInitialData = initial_data;
+    VkResult result =
+        vkCreatePipelineCache(vk_device, &cache_info, vk_alloc_callbacks, &vk_pipeline_cache);
+    if (result != VK_SUCCESS && initial_data) {
+        // A corrupt cache is not fatal, start cold.
+        LOG_ERR("Failed to create pipeline cache from %s, starting empty.", path);
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = nullptr;
+        initial_size = 0;
+        result = vkCreatePipelineCache(vk_device, &cache_info, vk_alloc_callbacks, &vk_pipeline_cache);
+    }
+    // The driver copies the initial data.
+    cache_file.unmap();
+    if (!vkCheck(result)) {
+        return false;
+    }
+
+    pipeline_cache_stats.warm = initial_size > 0;
+    pipeline_cache_stats.loaded_size = initial_size;
+    pipeline_cache_stats.load_ms = time_elapsed_ms(load_start);
+    LOG_DBG("Pipeline cache %s: %zu bytes loaded in %.3f ms",
+            pipeline_cache_stats.warm ? "warm" : "cold", initial_size, pipeline_cache_stats.load_ms);
+    return true;
+}
+
+u32 Device::get_memory_stats(MemoryStats *stats, u32 max_stats) const {
+    const TrackingAllocator *allocators[max_memory_stats] = {&resource_allocator, &vulkan_allocator,
+                                                             &scratch_allocator};
+    u32 count = 0;
+    for (; count < max_stats && count < max_memory_stats; ++count) {
+        stats[count] = allocators[count]->get_stats();
+    }
+    return count;
+}
+
+void Device::update_memory_budget() {
+    // Lets VMA refresh the budget from the driver.
+    vmaSetCurrentFrameIndex(vma_allocator, (u32)absolute_frame);
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(vma_allocator, budgets);
+    const VkPhysicalDeviceMemoryProperties *memory_properties;
+    vmaGetMemoryProperties(vma_allocator, &memory_properties);
+
+    memory_budget.num_heaps = memory_properties->memoryHeapCount;
+    memory_budget.frame = absolute_frame;
+    memory_budget.pressure = 0.0f;
+    for (u32 i = 0; i < memory_budget.num_heaps; ++i) {
+        GpuHeapBudget &heap = memory_budget.heaps[i];
+        heap.usage = budgets[i].usage;
+        heap.budget = budgets[i].budget;
+        heap.block_bytes = budgets[i].statistics.blockBytes;
+        heap.allocation_bytes = budgets[i].statistics.allocationBytes;
+        const VkMemoryHeapFlags flags = memory_properties->memoryHeaps[i].flags;
+        heap.device_local = (flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        if (heap.device_local && heap.budget) {
+            const f32 pressure = (f32)((f64)heap.usage / (f64)heap.budget);
+            if (pressure > memory_budget.pressure) {
+                memory_budget.pressure = pressure;
+            }
+        }
+    }
+}
+
+void Device::track_gpu_memory(GpuMemoryCategory::Enum category, VmaAllocation allocation,
+                              bool allocated) {
+    // Textures placed in a memory block don't own any memory.
+    if (allocation == VK_NULL_HANDLE) {
+        return;
+    }
+    VmaAllocationInfo allocation_info;
+    vmaGetAllocationInfo(vma_allocator, allocation, &allocation_info);
+    if (allocated) {
+        memory_budget.category_bytes[category] += allocation_info.size;
+        ++memory_budget.category_allocations[category];
+    } else {
+        memory_budget.category_bytes[category] -= allocation_info.size;
+        --memory_budget.category_allocations[category];
+    }
+}
+
+void Device::notify_memory_pressure() {
+    for (u32 i = 0; i < num_memory_pressure_listeners; ++i) {
+        memory_pressure_listeners[i].callback(memory_budget, memory_pressure_listeners[i].user_data);
+    }
+}
+
+void Device::handle_out_of_device_memory(const char *name) {
+    update_memory_budget();
+    LOG_ERR("Out of device memory creating %s, device local heaps at %.0f%% of their budget.",
+            name ? name : "unnamed resource", memory_budget.pressure * 100.0f);
+    notify_memory_pressure();
+}
+
+bool Device::add_memory_pressure_callback(MemoryPressureCallback callback, void *user_data) {
+    if (num_memory_pressure_listeners == max_memory_pressure_callbacks) {
+        LOG_ERR("Too many memory pressure callbacks!");
+        return false;
+    }
+    memory_pressure_listeners[num_memory_pressure_listeners++] = {callback, user_data};
+    return true;
+}
+
+void Device::remove_memory_pressure_callback(MemoryPressureCallback callback, void *user_data) {
+    for (u32 i = 0; i < num_memory_pressure_listeners; ++i) {
+        const MemoryPressureListener &listener = memory_pressure_listeners[i];
+        if (listener.callback == callback && listener.user_data == user_data) {
+            // Keep the registration order.
+            for (u32 j = i + 1; j < num_memory_pressure_listeners; ++j) {
+                memory_pressure_listeners[j - 1] = memory_pressure_listeners[j];
+            }
+            --num_memory_pressure_listeners;
+            return;
+        }
+    }
+}
+
+void Device::save_pipeline_cache() {
+    if (!pipeline_cache_path || vk_pipeline_cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    size_t data_size = 0;
+    if (!vkAssert(vkGetPipelineCacheData(vk_device, vk_pipeline_cache, &data_size, nullptr), false) ||
+        data_size == 0) {
+        return;
+    }
+    // Can be larger than the frame scratch, so it comes from the heap.
+    void *data = scratch_allocator.allocate(data_size, default_alignment);
+    if (data &&
+        vkAssert(vkGetPipelineCacheData(vk_device, vk_pipeline_cache, &data_size, data), false)) {
+        if (file_write_atomic(pipeline_cache_path, data, data_size)) {
+            LOG_DBG("Saved pipeline cache %s (%zu bytes)", pipeline_cache_path, data_size);
+        }
+    }
+    scratch_allocator.deallocate(data);
+}
+
+void Device::destroy_buffer(BufferHandle buffer) {
+    queue_resource_deletion(ResourceDeletionType::Buffer, buffer.index);
+}
+
+void Device::destroy_texture(TextureHandle texture) {
+    queue_resource_deletion(ResourceDeletionType::Texture, texture.index);
+}
+
+void Device::destroy_sampler(SamplerHandle sampler) {
+    queue_resource_deletion(ResourceDeletionType::Sampler, sampler.index);
+}
+
+void Device::destroy_pipeline(PipelineHandle pipeline) {
+    queue_resource_deletion(ResourceDeletionType::Pipeline, pipeline.index);
+}
+
+void Device::destroy_descriptor_set_layout(DescriptorSetLayoutHandle layout) {
+    queue_resource_deletion(ResourceDeletionType::DescriptorSetLayout, layout.index);
+}
+
+void Device::destroy_memory(MemoryHandle memory) {
+    queue_resource_deletion(ResourceDeletionType::Memory, memory.index);
+}
+
+void Device::queue_resource_deletion(ResourceDeletionType::Enum type, ResourceHandle handle) {
+    if (handle == invalid_resource_handle) {
+        return;
+    }
+    if (resource_deletion_queue.size() == resource_deletion_queue.capacity()) {
+        LOG_DBG("Resource deletion queue full (%zu), growing.", resource_deletion_queue.size());
+    }
+    // Tagged with the frame being recorded: it is the last one that can reference the resource.
+    // The transfer queue may still be writing to it.
+    u64 upload_value = 0;
+    if (type == ResourceDeletionType::Buffer) {
+        Buffer *buffer = buffers.access_resource(handle);
+        upload_value = buffer ? buffer->upload_value : 0;
+    } else if (type == ResourceDeletionType::Texture) {
+        Texture *texture = textures.access_resource(handle);
+        upload_value = texture ? texture->upload_value : 0;
+    }
+    resource_deletion_queue.push_back({type, handle, absolute_frame, upload_value});
+}
+
+void Device::process_resource_deletions(bool force) {
+    u32 i = 0;
+    while (i < resource_deletion_queue.size()) {
+        const ResourceUpdate &update = resource_deletion_queue[i];
+        // new_frame() waited on this slot's fence, so frames up to absolute_frame - max_frames are done.
+        if (!force && update.frame + max_frames > absolute_frame) {
+            ++i;
+            continue;
+        }
+        if (!force && update.upload_value > upload_ready_value) {
+            // Its upload is still in flight and the graphics queue may acquire it in a coming frame,
+            // so count the frames from now on.
+            resource_deletion_queue[i].frame = absolute_frame;
+            ++i;
+            continue;
+        }
+
+        switch (update.type) {
+        case ResourceDeletionType::Buffer:
+            destroy_buffer_instant(update.handle);
+            break;
+        case ResourceDeletionType::Texture:
+            destroy_texture_instant(update.handle);
+            break;
+        case ResourceDeletionType::Sampler:
+            destroy_sampler_instant(update.handle);
+            break;
+        case ResourceDeletionType::Pipeline:
+            destroy_pipeline_instant(update.handle);
+            break;
+        case ResourceDeletionType::DescriptorSetLayout:
+            destroy_descriptor_set_layout_instant(update.handle);
+            break;
+        case ResourceDeletionType::Memory:
+            destroy_memory_instant(update.handle);
+            break;
+        default:
+            break;
+        }
+
+        // Order doesn't matter: swap with the last entry.
+        resource_deletion_queue[i] = resource_deletion_queue.back();
+        resource_deletion_queue.pop_back();
+    }
+}
+
+void Device::destroy_buffer_instant(ResourceHandle buffer) {
+    Buffer *vk_buffer = buffers.access_resource(buffer);
+    if (!vk_buffer) {
+        LOG_ERR("Trying to free invalid buffer %u", buffer);
+        return;
+    }
+    track_gpu_memory(GpuMemoryCategory::Buffer, vk_buffer->vma_allocation, false);
+    vmaDestroyBuffer(vma_allocator, vk_buffer->vk_buffer, vk_buffer->vma_allocation);
+    bindless_storage_buffer_slots.release(vk_buffer->bindless_index);
+    buffers.release_resource(buffer);
+}
+
+void Device::destroy_texture_instant(ResourceHandle texture) {
+    Texture *vk_texture = textures.access_resource(texture);
+    if (!vk_texture) {
+        LOG_ERR("Trying to free invalid texture %u", texture);
+        return;
+    }
+    evict_framebuffers(vk_texture->vk_image_view);
+    vkDestroyImageView(vk_device, vk_texture->vk_image_view, vk_alloc_callbacks);
+    track_gpu_memory(texture_memory_category(vk_texture->flags), vk_texture->vma_allocation, false);
+    vmaDestroyImage(vma_allocator, vk_texture->vk_image, vk_texture->vma_allocation);
+    bindless_texture_slots.release(vk_texture->bindless_index);
+    textures.release_resource(texture);
+}
+
+void Device::destroy_sampler_instant(ResourceHandle sampler) {
+    Sampler *vk_sampler = samplers.access_resource(sampler);
+    if (!vk_sampler) {
+        LOG_ERR("Trying to free invalid sampler %u", sampler);
+        return;
+    }
+    if (--vk_sampler->references > 0) {
+        return;
+    }
+    SamplerCreation key;
+    key.set_min_mag_mip(vk_sampler->min_filter, vk_sampler->mag_filter, vk_sampler->mip_filter)
+        .set_address_mode_uvw(vk_sampler->address_mode_u, vk_sampler->address_mode_v,
+                              vk_sampler->address_mode_w);
+    sampler_cache.remove(key);
+    vkDestroySampler(vk_device, vk_sampler->vk_sampler, vk_alloc_callbacks);
+    bindless_sampler_slots.release(vk_sampler->bindless_index);
+    samplers.release_resource(sampler);
+}
+
+void Device::destroy_pipeline_instant(ResourceHandle pipeline) {
+    Pipeline *vk_pipeline = pipelines.access_resource(pipeline);
+    if (!vk_pipeline) {
+        LOG_ERR("Trying to free invalid pipeline %u", pipeline);
+        return;
+    }
+    vkDestroyPipeline(vk_device, vk_pipeline->vk_pipeline, vk_alloc_callbacks);
+    release_pipeline_layout(vk_pipeline->layout_key);
+    pipelines.release_resource(pipeline);
+}
+
+void Device::destroy_descriptor_set_layout_instant(ResourceHandle layout) {
+    DescriptorSetLayout *vk_layout = descriptor_set_layouts.access_resource(layout);
+    if (!vk_layout) {
+        LOG_ERR("Trying to free invalid descriptor set layout %u", layout);
+        return;
+    }
+    if (--vk_layout->references > 0) {
+        return;
+    }
+    descriptor_set_layout_cache.remove(vk_layout->creation);
+    vkDestroyDescriptorSetLayout(vk_device, vk_layout->vk_descriptor_set_layout, vk_alloc_callbacks);
+    descriptor_set_layouts.release_resource(layout);
+}
+
+void Device::destroy_memory_instant(ResourceHandle memory) {
+    Memory *vk_memory = memories.access_resource(memory);
+    if (!vk_memory) {
+        LOG_ERR("Trying to free invalid memory %u", memory);
+        return;
+    }
+    track_gpu_memory(GpuMemoryCategory::MemoryBlock, vk_memory->vma_allocation, false);
+    vmaFreeMemory(vma_allocator, vk_memory->vma_allocation);
+    memories.release_resource(memory);
+}
+
+void Device::destroy_all_resources() {
+    u32 leaked = buffers.used_indices + textures.used_indices + samplers.used_indices +
+                 pipelines.used_indices + descriptor_set_layouts.used_indices + memories.used_indices;
+    if (leaked) {
+        LOG_DBG("Destroying %u resources still alive at shutdown.", leaked);
+    }
+
+    for (u32 i = 0; i < pipelines.pool_size; ++i) {
+        if (pipelines.is_alive(i)) {
+            destroy_pipeline_instant(pipelines.handle_at(i));
+        }
+    }
+    // Shared samplers and layouts hold one reference per create.
+    for (u32 i = 0; i < descriptor_set_layouts.pool_size; ++i) {
+        while (descriptor_set_layouts.is_alive(i)) {
+            destroy_descriptor_set_layout_instant(descriptor_set_layouts.handle_at(i));
+        }
+    }
+    for (u32 i = 0; i < samplers.pool_size; ++i) {
+        while (samplers.is_alive(i)) {
+            destroy_sampler_instant(samplers.handle_at(i));
+        }
+    }
+    for (u32 i = 0; i < textures.pool_size; ++i) {
+        if (textures.is_alive(i)) {
+            destroy_texture_instant(textures.handle_at(i));
+        }
+    }
+    for (u32 i = 0; i < buffers.pool_size; ++i) {
+        if (buffers.is_alive(i)) {
+            destroy_buffer_instant(buffers.handle_at(i));
+        }
+    }
+    // After the textures that may be placed in them.
+    for (u32 i = 0; i < memories.pool_size; ++i) {
+        if (memories.is_alive(i)) {
+            destroy_memory_instant(memories.handle_at(i));
+        }
+    }
+
+    pipeline_layout_cache.shutdown();
+    descriptor_set_layout_cache.shutdown();
+    sampler_cache.shutdown();
+    descriptor_set_layouts.shutdown();
+    memories.shutdown();
+    pipelines.shutdown();
+    samplers.shutdown();
+    textures.shutdown();
+    buffers.shutdown();
+}
+
+Buffer *Device::access_buffer(BufferHandle buffer) { return buffers.access_resource(buffer.index); }
+
+Texture *Device::access_texture(TextureHandle texture) {
+    return textures.access_resource(texture.index);
+}
+
+Sampler *Device::access_sampler(SamplerHandle sampler) {
+    return samplers.access_resource(sampler.index);
+}
+
+Pipeline *Device::access_pipeline(PipelineHandle pipeline) {
+    return pipelines.access_resource(pipeline.index);
+}
+
+DescriptorSetLayout *Device::access_descriptor_set_layout(DescriptorSetLayoutHandle layout) {
+    return descriptor_set_layouts.access_resource(layout.index);
+}
+
+Memory *Device::access_memory(MemoryHandle memory) { return memories.access_resource(memory.index); }
+
+ResourceCacheStats Device::get_resource_cache_stats() const {
+    ResourceCacheStats stats;
+    stats.set_layout_hits = descriptor_set_layout_cache.hits;
+    stats.set_layout_misses = descriptor_set_layout_cache.misses;
+    stats.pipeline_layout_hits = pipeline_layout_cache.hits;
+    stats.pipeline_layout_misses = pipeline_layout_cache.misses;
+    stats.sampler_hits = sampler_cache.hits;
+    stats.sampler_misses = sampler_cache.misses;
+    stats.render_pass_hits = render_pass_cache.hits;
+    stats.render_pass_misses = render_pass_cache.misses;
+    stats.framebuffer_hits = framebuffer_cache.hits;
+    stats.framebuffer_misses = framebuffer_cache.misses;
+    return stats;
+}
+
+} // namespace sren
@@ -1,27 +1,350 @@
 #pragma once
 
+#include "command_buffer.h"
 #include "external/vk_mem_alloc.h"
+#include "gpu_profiler.h"
 #include "gpu_resources.h"
+#include "hash_cache.h"
+#include "memory.h"
 #include "platform.h"
+#include "upload.h"
 #include "vk_common.h"
 
 #include <SDL2/SDL.h>
+#include <atomic>
+#include <vector>
 
 namespace sren {
 
+struct DeviceCreation {
+    SDL_Window *window = nullptr;
+    u32 width = 1;
+    u32 height = 1;
+
+    // Render into a ring of offscreen images instead of a swapchain. No window or surface is needed,
+    // which allows running on display-less nodes and CPU drivers like lavapipe.
+    bool headless = false;
+
+    // Explicit GPU selection. When both are unset the best available device type is picked.
+    i32 gpu_index = -1;
+    const char *gpu_name = nullptr;
+
+    // Pipeline cache loaded at init and written back at teardown. Null disables the disk cache.
+    const char *pipeline_cache_path = nullptr;
+
+    // Threads that record command buffers in parallel, each gets its own command pools.
+    u32 num_threads = 1;
+
+    // Render with VK_KHR_dynamic_rendering (core in 1.3) instead of render pass and framebuffer
+    // objects. Falls back to render passes when the device doesn't support it.
+    bool dynamic_rendering = false;
+
+    DeviceCreation &set_window(u32 width, u32 height, SDL_Window *window);
+    DeviceCreation &set_headless(u32 width, u32 height);
+    DeviceCreation &set_gpu_index(i32 index);
+    DeviceCreation &set_gpu_name(const char *name);
+    DeviceCreation &set_pipeline_cache_path(const char *path);
+    DeviceCreation &set_num_threads(u32 num_threads);
+    DeviceCreation &set_dynamic_rendering(bool enabled);
+}; // struct DeviceCreation
+
+struct PipelineCacheStats {
+    // Whether a valid cache file for this device was found at startup.
+    bool warm = false;
+    size_t loaded_size = 0;
+    f64 load_ms = 0.0;
+
+    u32 pipelines_created = 0;
+    f64 pipeline_creation_ms = 0.0;
+}; // struct PipelineCacheStats
+
+// Lookups in the caches deduplicating descriptor set layouts, pipeline layouts, samplers, render passes
+// and framebuffers.
+struct ResourceCacheStats {
+    u32 set_layout_hits = 0;
+    u32 set_layout_misses = 0;
+    u32 pipeline_layout_hits = 0;
+    u32 pipeline_layout_misses = 0;
+    u32 sampler_hits = 0;
+    u32 sampler_misses = 0;
+    u32 render_pass_hits = 0;
+    u32 render_pass_misses = 0;
+    u32 framebuffer_hits = 0;
+    u32 framebuffer_misses = 0;
+}; // struct ResourceCacheStats
+
+// Resources, Vulkan and Scratch.
+static const u32 max_memory_stats = 3;
+static const u32 max_memory_pressure_callbacks = 8;
+// Fraction of a heap's budget above which memory pressure callbacks are called.
+static const f32 memory_pressure_threshold = 0.9f;
+
+struct GpuHeapBudget {
+    // Bytes this process uses from the heap, and how many it can use before allocations start failing
+    // or the driver starts paging. Estimates from VMA's own blocks without VK_EXT_memory_budget.
+    u64 usage;
+    u64 budget;
+    // Bytes of VMA's memory blocks, and how many of them are handed out to resources.
+    u64 block_bytes;
+    u64 allocation_bytes;
+    bool device_local;
+}; // struct GpuHeapBudget
+
+// Device memory snapshot, refreshed by every new_frame().
+struct GpuMemoryBudget {
+    GpuHeapBudget heaps[VK_MAX_MEMORY_HEAPS];
+    u32 num_heaps = 0;
+    // Highest usage / budget ratio of the device local heaps.
+    f32 pressure = 0.0f;
+    u64 frame = 0;
+
+    // Live resource allocations per GpuMemoryCategory.
+    u64 category_bytes[GpuMemoryCategory::Count] = {};
+    u32 category_allocations[GpuMemoryCategory::Count] = {};
+}; // struct GpuMemoryBudget
+
+// Asks a subsystem to destroy what it can spare. Destroyed memory comes back once the frames using it
+// have completed, so it can be called on several frames in a row.
+typedef void (*MemoryPressureCallback)(const GpuMemoryBudget &budget, void *user_data);
+
 class Device {
   public:
-    bool init(u32 window_width, u32 window_height, SDL_Window *window);
+    bool init(const DeviceCreation &creation);
     void teardown();
 
+    // Frame
+    // Waits until the GPU is done with this frame slot, acquires the next image and begins recording.
+    // Returns false when the frame has to be skipped.
+    bool new_frame();
+    // Submits the current frame's command buffer, presents it and advances to the next frame slot.
+    void present();
+
+    // Recreates the swapchain at the start of the next frame, without stalling the frames in flight. The
+    // size is only used where the surface leaves the choice to the application, and always for the
+    // offscreen images of headless devices.
+    void resize(u32 width, u32 height);
+
+    // Primary command buffer of the current frame, in the recording state between new_frame/present.
+    VkCommandBuffer get_command_buffer();
+    // Pass VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS to fill the pass with vkCmdExecuteCommands.
+    void begin_swapchain_pass(VkCommandBuffer command_buffer, const f32 clear_color[4],
+                              VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+    void end_swapchain_pass(VkCommandBuffer command_buffer);
+
+    // Renders into textures, the first attachment's size. Attachments are expected in attachment layouts
+    // and are left in them: the caller (usually the frame graph) owns the transitions. One clear value
+    // per color attachment, then one for depth. Returns false, beginning nothing, without attachments or
+    // with a stale one.
+    bool begin_render_pass(VkCommandBuffer command_buffer, const RenderPassOutput &output,
+                           const TextureHandle *color_attachments, TextureHandle depth_attachment,
+                           const VkClearValue *clear_values);
+    void end_render_pass(VkCommandBuffer command_buffer);
+
+    // Secondary command buffer from thread_index's pool, begun to continue the swapchain pass. Safe to
+    // call concurrently from different threads, as long as each uses its own thread_index.
+    VkCommandBuffer begin_swapchain_secondary_command_buffer(u32 thread_index);
+    u32 get_num_recording_threads() const { return command_buffer_manager.num_threads; }
+
+    // Named GPU scopes, timed with timestamp queries and emitted as debug labels for capture tools.
+    // Scopes nest and must be balanced within the frame. The name must outlive the frame.
+    void push_gpu_marker(VkCommandBuffer command_buffer, const char *name);
+    void pop_gpu_marker(VkCommandBuffer command_buffer);
+    // Latest resolved scope tree, max_frames frames behind the frame being recorded.
+    const GpuTimestamp *get_gpu_timestamps(u32 &count, u64 &frame_index) const;
+
+    // Resources
+    BufferHandle create_buffer(const BufferCreation &creation);
+    TextureHandle create_texture(const TextureCreation &creation);
+    SamplerHandle create_sampler(const SamplerCreation &creation);
+    PipelineHandle create_pipeline(const PipelineCreation &creation);
+    DescriptorSetLayoutHandle create_descriptor_set_layout(const DescriptorSetLayoutCreation &creation);
+    // Device local memory for textures created with TextureCreation::set_alias.
+    MemoryHandle create_memory(const VkMemoryRequirements &requirements, const char *name);
+    // What a texture with this creation needs, to size and pick the type of a shared memory block.
+    VkMemoryRequirements get_texture_memory_requirements(const TextureCreation &creation);
+    // Whether textures of the format can be uploaded and sampled, e.g. block compressed ones.
+    bool is_texture_format_supported(VkFormat format) const;
+
+    // Samplers and descriptor set layouts are hashed by their creation: identical creations return the
+    // same handle with one more reference, and each create has to be matched by a destroy. Pipelines
+    // with the same set layouts and push constants share their VkPipelineLayout the same way.
+
+    // Destruction is deferred until the GPU has finished every frame that could still use the resource,
+    // so these never wait on the device.
+    void destroy_buffer(BufferHandle buffer);
+    void destroy_texture(TextureHandle texture);
+    void destroy_sampler(SamplerHandle sampler);
+    void destroy_pipeline(PipelineHandle pipeline);
+    void destroy_descriptor_set_layout(DescriptorSetLayoutHandle layout);
+    void destroy_memory(MemoryHandle memory);
+
+    // Return nullptr for invalid or stale handles.
+    Buffer *access_buffer(BufferHandle buffer);
+    Texture *access_texture(TextureHandle texture);
+    Sampler *access_sampler(SamplerHandle sampler);
+    Pipeline *access_pipeline(PipelineHandle pipeline);
+    DescriptorSetLayout *access_descriptor_set_layout(DescriptorSetLayoutHandle layout);
+    Memory *access_memory(MemoryHandle memory);
+
+    ResourceCacheStats get_resource_cache_stats() const;
+
+    // Dynamic buffers
+    // Linear per-frame allocations from one persistently mapped buffer, recycled once the frame slot
+    // comes around again. Write the constants through the returned pointer and pass the offset as the
+    // dynamic offset of binding 0 (uniform) or 1 (storage) of set 0. Return nullptr when the frame's
+    // slice is exhausted. Safe to call from several threads.
+    void *dynamic_allocate_uniform(u32 size, u32 &offset);
+    void *dynamic_allocate_storage(u32 size, u32 &offset);
+    // Binds the dynamic buffer set (set 0 of every pipeline layout) with the given offsets.
+    void bind_dynamic_buffers(VkCommandBuffer command_buffer, PipelineHandle pipeline,
+                              u32 uniform_offset, u32 storage_offset);
+
+    // Bindless
+    // With descriptor indexing, every texture, sampler and storage buffer gets a slot (bindless_index)
+    // in one update-after-bind set, bound as set 1. Draws pick their resources by passing slots in push
+    // constants, so nothing is allocated or bound per draw.
+    bool is_bindless_supported() const { return bindless_supported; }
+    void bind_bindless_set(VkCommandBuffer command_buffer, PipelineHandle pipeline);
+
+    // Compute
+    // Pipelines created from a single VK_SHADER_STAGE_COMPUTE_BIT stage are compute pipelines. Binds one
+    // and records a dispatch. Sets and push constants recorded before with a compatible layout stay
+    // bound, the dynamic and bindless sets included.
+    void dispatch(VkCommandBuffer command_buffer, PipelineHandle pipeline, u32 group_count_x,
+                  u32 group_count_y, u32 group_count_z);
+
+    // Indirect draws
+    // Draws VkDrawIndexedIndirectCommands written by the GPU, as many as the u32 at the start of count
+    // says, up to max_draw_count (at most get_max_draw_indirect_count()). Without drawIndirectCount or
+    // multiDrawIndirect the count is ignored and all max_draw_count commands are drawn: unused ones need
+    // an instanceCount of 0. Without multiDrawIndirect every command is a call of its own.
+    void draw_indexed_indirect(VkCommandBuffer command_buffer, BufferHandle commands, BufferHandle count,
+                               u32 max_draw_count);
+    bool is_draw_indirect_count_supported() const { return draw_indirect_count_supported; }
+    // Whether indirect commands can have a non-zero firstInstance.
+    bool is_draw_indirect_first_instance_supported() const {
+        return draw_indirect_first_instance_supported;
+    }
+    u32 get_max_draw_indirect_count() const { return max_draw_indirect_count; }
+
+    // Uploads
+    // Copy data to device local resources through the transfer queue, without stalling graphics work.
+    // Return the upload's timeline value (also stored in the resource's upload_value), 0 on failure.
+    u64 upload_buffer(BufferHandle buffer, const void *data, u32 size, u32 offset = 0);
+    // One mip level, every array layer tightly packed. The level is left shader readable.
+    u64 upload_texture(TextureHandle texture, const void *data, u32 size, u32 mip_level = 0);
+    // Whether frames recorded from now on can use the resources of the upload.
+    bool is_upload_ready(u64 upload) const { return upload <= upload_ready_value; }
+    // Submits the uploads recorded so far, instead of waiting for present(). Useful while loading.
+    void flush_uploads();
+
+    const RenderPassOutput &get_swapchain_output() const { return swapchain_output; }
+    bool is_dynamic_rendering() const { return dynamic_rendering; }
+    VkExtent2D get_swapchain_extent() const { return {swapchain_width, swapchain_height}; }
+    // The mode actually used, which falls back to VSync when the requested one isn't supported.
+    PresentMode::Enum get_present_mode() const { return present_mode; }
+    const char *get_gpu_name() const { return vk_physical_device_properties.deviceName; }
+
+    // Short-lived CPU memory for the frame being recorded, cleared by the next new_frame(). Main thread
+    // only.
+    LinearAllocator &get_frame_scratch() { return frame_scratch; }
+    // CPU memory per subsystem. Returns the number of stats written.
+    u32 get_memory_stats(MemoryStats *stats, u32 max_stats) const;
+
+    // GPU memory
+    const GpuMemoryBudget &get_memory_budget() const { return memory_budget; }
+    bool is_memory_budget_supported() const { return memory_budget_supported; }
+    // Callbacks run on the main thread, from new_frame() while a device local heap is above
+    // memory_pressure_threshold of its budget, and when a resource allocation runs out of device memory.
+    bool add_memory_pressure_callback(MemoryPressureCallback callback, void *user_data);
+    void remove_memory_pressure_callback(MemoryPressureCallback callback, void *user_data);
+
+    PipelineCacheStats pipeline_cache_stats;
+
+    // CPU time spent in the last new_frame() blocked on the frame fence. A large value means the CPU is
+    // waiting on the GPU (GPU-bound), close to zero means the CPU is the bottleneck.
+    f32 fence_wait_ms = 0.0f;
+    u64 absolute_frame = 0;
+
   private:
     bool get_family_queue(VkPhysicalDevice physical_device);
+    bool select_physical_device(const DeviceCreation &creation);
     void set_present_mode(PresentMode::Enum mode);
+    bool is_device_extension_supported(const char *name);
+
+    // GPU memory
+    void update_memory_budget();
+    void track_gpu_memory(GpuMemoryCategory::Enum category, VmaAllocation allocation, bool allocated);
+    void notify_memory_pressure();
+    void handle_out_of_device_memory(const char *name);
 
     // Swapchain
-    bool create_swapchain();
-    bool resize_swapchain();
+    // Size the swapchain gets on this surface, false while it is 0x0 (minimized).
+    bool get_surface_extent(const VkSurfaceCapabilitiesKHR &capabilities, VkExtent2D &extent) const;
+    bool create_swapchain(VkSwapchainKHR old_swapchain);
+    // Replaces the swapchain without waiting on the GPU, see retired_swapchains.
+    bool recreate_swapchain();
     void destroy_swapchain();
+    void destroy_retired_swapchains(bool force);
+
+    // Headless. On failure nothing is left created, the images are all null.
+    bool create_offscreen_images();
+    void destroy_offscreen_images();
+
+    // Render passes and framebuffers are cached and live until teardown, or for framebuffers until one
+    // of their attachment views is destroyed.
+    VkRenderPass obtain_render_pass(const RenderPassOutput &output, VkImageLayout color_final_layout,
+                                    const char *name);
+    VkRenderPass create_render_pass(const RenderPassOutput &output, VkImageLayout color_final_layout,
+                                    const char *name);
+    VkFramebuffer obtain_framebuffer(VkRenderPass render_pass, const VkImageView *attachments,
+                                     u32 num_attachments, u32 width, u32 height);
+    void evict_framebuffers(VkImageView attachment);
+    void destroy_render_pass_caches();
+    bool create_frame_resources();
+    void destroy_frame_resources();
+    bool create_dynamic_buffer();
+    bool create_bindless_resources();
+    void write_bindless_descriptor(u32 binding, u32 slot, VkDescriptorType type, VkBuffer buffer,
+                                   VkImageView image_view, VkSampler sampler);
+    void *dynamic_allocate(u32 size, u32 alignment, u32 &offset);
+    void resolve_gpu_timestamps();
+
+    void set_resource_name(VkObjectType type, u64 handle, const char *name);
+
+    void destroy_buffer_instant(ResourceHandle buffer);
+    void destroy_texture_instant(ResourceHandle texture);
+    void destroy_sampler_instant(ResourceHandle sampler);
+    void destroy_pipeline_instant(ResourceHandle pipeline);
+    void destroy_descriptor_set_layout_instant(ResourceHandle layout);
+    void destroy_memory_instant(ResourceHandle memory);
+    void destroy_all_resources();
+
+    // Return a reference to the cached layout, creating it on a miss.
+    VkPipelineLayout obtain_pipeline_layout(const PipelineLayoutKey &key);
+    void release_pipeline_layout(const PipelineLayoutKey &key);
+
+    bool load_pipeline_cache(const char *path);
+    void save_pipeline_cache();
+
+    void queue_resource_deletion(ResourceDeletionType::Enum type, ResourceHandle handle);
+    // Destroys queued resources whose frame has completed. Everything when force is set.
+    void process_resource_deletions(bool force);
+
+    std::vector<ResourceUpdate> resource_deletion_queue;
+
+    ResourcePool<Buffer> buffers;
+    ResourcePool<Texture> textures;
+    ResourcePool<Sampler> samplers;
+    ResourcePool<Pipeline> pipelines;
+    ResourcePool<DescriptorSetLayout> descriptor_set_layouts;
+    ResourcePool<Memory> memories;
+
+    HashCache<SamplerCreation, SamplerHandle> sampler_cache;
+    HashCache<DescriptorSetLayoutCreation, DescriptorSetLayoutHandle> descriptor_set_layout_cache;
+    HashCache<PipelineLayoutKey, PipelineLayout> pipeline_layout_cache;
+    HashCache<RenderPassKey, VkRenderPass> render_pass_cache;
+    HashCache<FramebufferKey, VkFramebuffer> framebuffer_cache;
 
     VkInstance vk_instance;
     VkDevice vk_device;
@@ -29,47 +352,130 @@ class Device {
     VkPhysicalDeviceProperties vk_physical_device_properties;
     VkQueue vk_queue;
     u32 vk_queue_family;
+    // Same as the graphics queue when the device has no transfer-only family.
+    VkQueue vk_transfer_queue;
+    u32 vk_transfer_queue_family;
     VkDescriptorPool vk_descriptor_pool;
 
-    VkRenderPass vk_swapchain_renderpass;
+    // Null with dynamic rendering.
+    VkRenderPass vk_swapchain_renderpass = VK_NULL_HANDLE;
+    bool dynamic_rendering = false;
 
     SDL_Window *window_handle;
     VkSurfaceKHR vk_surface;
     VkSurfaceFormatKHR vk_surface_format;
     VkPresentModeKHR vk_present_mode;
-    VkSwapchainKHR vk_swapchain;
-    u32 vk_swapchain_image_count;
+    VkSwapchainKHR vk_swapchain = VK_NULL_HANDLE;
+    u32 vk_swapchain_image_count = 0;
+    u32 vk_swapchain_min_image_count = 3;
+    // Set by resize or when acquire/present report the swapchain out of date or suboptimal. The
+    // swapchain is recreated at the start of the next frame.
+    bool swapchain_dirty = false;
+
+    // Swapchains replaced by recreate_swapchain, destroyed with their views and framebuffers once the
+    // frames that could still use them are done.
+    struct RetiredSwapchain {
+        VkSwapchainKHR vk_swapchain;
+        VkImageView vk_image_views[max_swapchain_images];
+        // Headless only, the device owns the offscreen images.
+        VkImage vk_images[max_swapchain_images];
+        VmaAllocation vma_allocations[max_swapchain_images];
+        u32 image_count;
+        u64 frame;
+    }; // struct RetiredSwapchain
+    std::vector<RetiredSwapchain> retired_swapchains;
 
     u32 swapchain_width = 1;
     u32 swapchain_height = 1;
 
     RenderPassOutput swapchain_output;
 
+    // When headless, vk_swapchain_images/vk_swapchain_image_views hold the offscreen ring instead.
+    bool headless = false;
+    VmaAllocation vma_offscreen_allocations[max_swapchain_images];
+
     PresentMode::Enum present_mode = PresentMode::VSync;
-    u32 current_frame;
-    u32 previous_frame;
+    u32 current_frame = 0;
+    u32 previous_frame = 0;
+
+    // Frames in flight: the CPU records into one slot while the GPU executes the other.
+    CommandBufferManager command_buffer_manager;
+    u32 num_recording_threads = 1;
+    VkSemaphore vk_image_acquired_semaphores[max_frames];
+    // Per swapchain image: a present can still be waiting on the one of an earlier frame in this slot.
+    VkSemaphore vk_render_complete_semaphores[max_swapchain_images];
+    VkFence vk_command_buffer_executed_fences[max_frames];
+    u32 vk_image_index = 0;
 
     // Swapchain
     VkImage vk_swapchain_images[max_swapchain_images];
     VkImageView vk_swapchain_image_views[max_swapchain_images];
-    VkFramebuffer vk_swapchain_framebuffers[max_swapchain_images];
+    // Framebuffer of the acquired image, set by begin_swapchain_pass for the secondary command buffers.
+    VkFramebuffer vk_swapchain_framebuffer = VK_NULL_HANDLE;
 
     bool debug_utils_extension_present = false;
     VkDebugUtilsMessengerEXT vk_debug_utils_messenger;
 
-    // NOTE: idk know what this is used for, but I have this handle in case I want to utilize
-    // it later.
+    // Resource pools and caches.
+    TrackingAllocator resource_allocator{"Resources"};
+    // Driver and VMA host memory, reached through vk_alloc_callbacks.
+    TrackingAllocator vulkan_allocator{"Vulkan"};
+    // Backs frame_scratch and one-off temporary buffers.
+    TrackingAllocator scratch_allocator{"Scratch"};
+    LinearAllocator frame_scratch;
+    VkAllocationCallbacks vk_allocation_callbacks;
     VkAllocationCallbacks *vk_alloc_callbacks = nullptr;
 
     VmaAllocator vma_allocator;
 
-    // Time (in seconds) required for a timestamp query's counter to increment by 1
-    // TODO: I think this should be measured in ms instead.
+    bool memory_budget_supported = false;
+    GpuMemoryBudget memory_budget;
+    struct MemoryPressureListener {
+        MemoryPressureCallback callback;
+        void *user_data;
+    }; // struct MemoryPressureListener
+    MemoryPressureListener memory_pressure_listeners[max_memory_pressure_callbacks];
+    u32 num_memory_pressure_listeners = 0;
+
+    UploadManager upload_manager;
+    // Uploads up to this timeline value have been acquired and can be used.
+    u64 upload_ready_value = 0;
+
+    VkPipelineCache vk_pipeline_cache = VK_NULL_HANDLE;
+    const char *pipeline_cache_path = nullptr;
+
+    // Time (in milliseconds) required for a timestamp query's counter to increment by 1
     f32 gpu_timestamp_period;
+    // Valid bits of the graphics queue's timestamps, 0 if timestamps are unsupported.
+    u32 gpu_timestamp_valid_bits = 0;
+    VkQueryPool vk_timestamp_query_pool = VK_NULL_HANDLE;
+    GpuTimestampManager gpu_timestamps;
+
+    // Minimum offset alignments of uniform and storage buffer bindings, dynamic offsets included.
+    u32 ubo_alignment;
+    u32 ssbo_alignment;
+
+    // max_frames slices of dynamic_buffer_frame_size, plus max_dynamic_allocation_size of padding so
+    // a descriptor range starting at any allocation stays inside the buffer.
+    BufferHandle dynamic_buffer = invalid_buffer;
+    u8 *dynamic_mapped_data = nullptr;
+    std::atomic<u32> dynamic_allocated_size{0};
+    u32 dynamic_frame_end = 0;
+    VkDescriptorSetLayout vk_dynamic_descriptor_set_layout = VK_NULL_HANDLE;
+    VkDescriptorSet vk_dynamic_descriptor_set = VK_NULL_HANDLE;
+
+    bool bindless_supported = false;
+    VkDescriptorPool vk_bindless_descriptor_pool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout vk_bindless_descriptor_set_layout = VK_NULL_HANDLE;
+    VkDescriptorSet vk_bindless_descriptor_set = VK_NULL_HANDLE;
+    BindlessSlotAllocator bindless_texture_slots;
+    BindlessSlotAllocator bindless_storage_buffer_slots;
+    BindlessSlotAllocator bindless_sampler_slots;
 
-    // NOTE: Idk what these are used for either.
-    size_t ubo_alignment;
-    size_t ssbo_alignment;
+    bool draw_indirect_count_supported = false;
+    bool multi_draw_indirect_supported = false;
+    bool draw_indirect_first_instance_supported = false;
+    u32 max_draw_indirect_count = 1;
 };
 
 } // namespace sren
\ No newline at end of file
@@ -1,40 +1,480 @@
 #include "engine.h"
 
 #include "log.h"
+#include "timer.h"
+
+#include <math.h>
+#include <vector>
 
 namespace sren {
 
 const u32 window_width = 800;
 const u32 window_height = 600;
 
-bool Engine::init() {
-    // Initialize window.
-    if (!window.init(window_width, window_height, "Sren Engine")) {
-        LOG_ERR("Failed to initialize window!");
-        return false;
+// Below this, splitting draws across threads costs more than it saves.
+static const u32 min_draws_per_thread = 256;
+
+// The test scene is laid out in clip space, so the frustum is the clip volume.
+static const f32 clip_frustum_planes[num_frustum_planes][4] = {
+    {1.0f, 0.0f, 0.0f, 1.0f}, {-1.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f, 1.0f},
+    {0.0f, -1.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, -1.0f, 1.0f},
+};
+
+// Job thread indices double as command pool indices.
+static_assert(max_job_threads <= max_recording_threads, "Every job thread needs its command pools");
+
+struct RecordDrawsJob {
+    Engine *engine;
+    u32 first_draw;
+    u32 count;
+    VkCommandBuffer command_buffer;
+}; // struct RecordDrawsJob
+
+bool Engine::init(const EngineCreation &creation) {
+    LogService::init(creation.log);
+    job_system.init(JobSystemCreation().set_num_threads(creation.num_threads));
+
+    headless = creation.headless;
+    frame_limit = creation.frame_limit;
+    draw_count = creation.draw_count;
+    gpu_driven = creation.gpu_driven;
+    frame_pacing = creation.frame_pacing;
+    target_frame_rate = creation.target_frame_rate;
+
+    DeviceCreation device_creation;
+    if (headless) {
+        device_creation.set_headless(window_width, window_height);
+    } else {
+        // Initialize window.
+        if (!window.init(window_width, window_height, "Sren Engine")) {
+            LOG_ERR("Failed to initialize window!");
+            job_system.shutdown();
+            return false;
+        }
+        device_creation.set_window(window_width, window_height, window.window_handle);
     }
+    device_creation.set_gpu_index(creation.gpu_index)
+        .set_gpu_name(creation.gpu_name)
+        .set_pipeline_cache_path(creation.pipeline_cache_path)
+        .set_num_threads(job_system.get_num_threads())
+        .set_dynamic_rendering(creation.dynamic_rendering);
 
     // Initialize device.
-    if (!device.init(window_width, window_height, window.window_handle)) {
+    if (!device.init(device_creation)) {
         LOG_ERR("Failed to initialize device!");
+        if (!headless) {
+            window.teardown();
+        }
+        job_system.shutdown();
+        return false;
+    }
+
+    if (!shader_library.init(device, job_system,
+                             ShaderLibraryCreation()
+                                 .set_cache_dir(creation.shader_cache_path)
+                                 .set_hot_reload(creation.shader_hot_reload))) {
+        LOG_ERR("Failed to initialize the shader library!");
+        device.teardown();
+        if (!headless) {
+            window.teardown();
+        }
+        job_system.shutdown();
         return false;
     }
 
-    LOG_INFO("Engine succesfully initialized.");
+    if (!init_resources()) {
+        LOG_ERR("Failed to initialize resources!");
+        // Stops the shader watcher thread and destroys whatever pipelines were created.
+        shader_library.shutdown();
+        // The device owns the window surface, so it has to go before the window.
+        device.teardown();
+        if (!headless) {
+            window.teardown();
+        }
+        job_system.shutdown();
+        return false;
+    }
+
+    // Loads run in the background, the first frames render without the meshes.
+    mesh_loader.init(device, job_system, MeshLoaderCreation());
+    for (u32 i = 0; i < creation.num_mesh_paths; ++i) {
+        mesh_loader.load(creation.mesh_paths[i]);
+    }
+    // Mip tails are uploaded by the first update, higher levels stream in over the next frames.
+    texture_streamer.init(device, TextureStreamerCreation().set_budget(creation.texture_budget));
+    for (u32 i = 0; i < creation.num_texture_paths; ++i) {
+        const StreamedTextureHandle texture = texture_streamer.load(creation.texture_paths[i]);
+        if (texture.index != invalid_streamed_texture.index) {
+            streamed_textures.push_back(texture);
+        }
+    }
+
+    // FIFO presentation blocks on vblank, mailbox and immediate don't.
+    const PresentMode::Enum present_mode = device.get_present_mode();
+    const bool vsync =
+        !headless && (present_mode == PresentMode::VSync || present_mode == PresentMode::VSyncRelaxed);
+    frame_pacer.init(FramePacerCreation()
+                         .set_period(get_pacing_period_ms())
+                         .set_margin(creation.pacing_margin_ms)
+                         .set_vsync(vsync && target_frame_rate <= 0.0f));
+
+    LOG_INFO("Engine succesfully initialized%s, rendering with %s%s.", headless ? " (headless)" : "",
+             device.is_dynamic_rendering() ? "dynamic rendering" : "render passes",
+             gpu_driven ? " and GPU-driven draws" : "");
+    return true;
+}
+
+bool Engine::init_resources() {
+    ShaderCreation shader_creations[2];
+    shader_creations[0].set_source("triangle.vert", VK_SHADER_STAGE_VERTEX_BIT);
+    shader_creations[1].set_source("triangle.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
+    ShaderHandle triangle_shaders[2];
+    if (!shader_library.load(shader_creations, 2, triangle_shaders)) {
+        LOG_ERR("Failed to load the triangle shaders.");
+        return false;
+    }
+
+    PipelineCreation pipeline_creation;
+    pipeline_creation.render_pass = device.get_swapchain_output();
+    pipeline_creation.push_constant_size = sizeof(u32);
+    pipeline_creation.name = "Triangle";
+    triangle_pipeline = shader_library.create_pipeline(pipeline_creation, triangle_shaders, 2);
+    if (triangle_pipeline.index == invalid_shader_pipeline.index) {
+        return false;
+    }
+
+    if (gpu_driven && !init_gpu_driven()) {
+        LOG_ERR("GPU-driven draws unavailable, recording the draws instead.");
+        gpu_driven = false;
+    }
+
+    // Cold (empty cache) vs warm startup cost of pipeline compilation.
+    const PipelineCacheStats &cache_stats = device.pipeline_cache_stats;
+    LOG_INFO("Pipeline cache %s (%zu bytes, loaded in %.3f ms): %u pipelines created in %.3f ms",
+             cache_stats.warm ? "warm" : "cold", cache_stats.loaded_size, cache_stats.load_ms,
+             cache_stats.pipelines_created, cache_stats.pipeline_creation_ms);
+    return true;
+}
+
+bool Engine::init_gpu_driven() {
+    // The triangle shader picks its vertices by vertex index, the index buffer only has to count.
+    u32 indices[3] = {0, 1, 2};
+    triangle_indices = device.create_buffer(
+        BufferCreation()
+            .set(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, ResourceUsageType::Immutable, sizeof(indices))
+            .set_data(indices)
+            .set_name("Triangle Indices"));
+    if (triangle_indices.index == invalid_resource_handle) {
+        return false;
+    }
+
+    // Same grid as triangle.vert, bounding each triangle by its cell.
+    const u32 grid_size = draw_count ? (u32)ceil(sqrt((f64)draw_count)) : 1;
+    const f32 cell_size = 2.0f / (f32)grid_size;
+    std::vector<GpuInstance> instances(draw_count);
+    for (u32 i = 0; i < draw_count; ++i) {
+        GpuInstance &instance = instances[i];
+        instance = {};
+        instance.center[0] = -1.0f + cell_size * ((f32)(i % grid_size) + 0.5f);
+        instance.center[1] = -1.0f + cell_size * ((f32)(i / grid_size) + 0.5f);
+        // Circumscribes the cell.
+        instance.radius = cell_size * 0.7072f;
+        instance.index_count = 3;
+    }
+
+    if (!indirect_draws.init(device, shader_library, IndirectDrawCreation()
+                                         .set_instances(instances.data(), draw_count)
+                                         .set_name("Test Scene"))) {
+        device.destroy_buffer(triangle_indices);
+        return false;
+    }
+    // Both uploads are in flight, start them before the first frame.
+    device.flush_uploads();
     return true;
 }
 
 void Engine::shutdown() {
+    const FramePacerStats &pacing = frame_pacer.get_stats();
+    if (pacing.interval.count == 0) {
+        LOG_INFO("Frame interval: no samples");
+    } else {
+        LOG_INFO("Frame interval %.3f ms (p50 %.0f, p99 %.0f, max %.3f), jitter %.3f ms, "
+                 "%u missed deadlines; CPU %.3f ms (p99 %.0f), GPU %.3f ms (p99 %.0f)",
+                 pacing.interval.mean(), pacing.interval.percentile(0.5),
+                 pacing.interval.percentile(0.99), pacing.interval.max_ms, pacing.jitter_ms,
+                 pacing.missed_deadlines, pacing.cpu.mean(), pacing.cpu.percentile(0.99),
+                 pacing.gpu.mean(), pacing.gpu.percentile(0.99));
+    }
+
+    const ResourceCacheStats cache_stats = device.get_resource_cache_stats();
+    LOG_INFO("Resource caches (hits/misses): set layouts %u/%u, pipeline layouts %u/%u, samplers %u/%u, "
+             "render passes %u/%u, framebuffers %u/%u",
+             cache_stats.set_layout_hits, cache_stats.set_layout_misses,
+             cache_stats.pipeline_layout_hits, cache_stats.pipeline_layout_misses,
+             cache_stats.sampler_hits, cache_stats.sampler_misses, cache_stats.render_pass_hits,
+             cache_stats.render_pass_misses, cache_stats.framebuffer_hits,
+             cache_stats.framebuffer_misses);
+
+    MemoryStats memory_stats[max_memory_stats];
+    const u32 num_memory_stats = device.get_memory_stats(memory_stats, max_memory_stats);
+    for (u32 i = 0; i < num_memory_stats; ++i) {
+        LOG_INFO("%s memory: %llu bytes in use, %llu peak, %llu allocations", memory_stats[i].name,
+                 (unsigned long long)memory_stats[i].allocated_bytes,
+                 (unsigned long long)memory_stats[i].peak_bytes,
+                 (unsigned long long)memory_stats[i].allocations);
+    }
+
+    const GpuMemoryBudget &budget = device.get_memory_budget();
+    for (u32 i = 0; i < budget.num_heaps; ++i) {
+        const GpuHeapBudget &heap = budget.heaps[i];
+        LOG_INFO("GPU heap %u%s: %llu of %llu MB used, %llu MB in blocks", i,
+                 heap.device_local ? " (device local)" : "", (unsigned long long)(heap.usage >> 20),
+                 (unsigned long long)(heap.budget >> 20), (unsigned long long)(heap.block_bytes >> 20));
+    }
+    for (u32 i = 0; i < GpuMemoryCategory::Count; ++i) {
+        LOG_INFO("GPU %s memory: %llu bytes in %u allocations",
+                 gpu_memory_category_name((GpuMemoryCategory::Enum)i),
+                 (unsigned long long)budget.category_bytes[i], budget.category_allocations[i]);
+    }
+
     // TODO: Better way of automatically cleaning everything up?
-    window.teardown();
+    mesh_loader.shutdown();
+    texture_streamer.shutdown();
+    shader_library.destroy_pipeline(triangle_pipeline);
+    if (gpu_driven) {
+        indirect_draws.shutdown();
+        device.destroy_buffer(triangle_indices);
+    }
+    shader_library.shutdown();
+
+    // The device owns the window surface, so it has to go before the window.
     device.teardown();
+    if (!headless) {
+        window.teardown();
+    }
+    job_system.shutdown();
     LOG_INFO("Engine shutdown.");
+    LogService::shutdown();
 }
 
 void Engine::run() {
+    u64 frame_count = 0;
+    frame_stats = {};
+    frame_stats.interval_start = time_now();
+
     while (!window.requested_exit) {
-        window.handle_os_messages();
+        // Before input is sampled, so the frame sees the latest input.
+        frame_pacer.set_period(get_pacing_period_ms());
+        frame_pacer.begin_frame();
+        i64 frame_start = time_now();
+
+        if (!headless) {
+            window.handle_os_messages();
+            if (window.resized) {
+                // Applied by the next new_frame, frames in flight keep the old swapchain.
+                device.resize(window.width, window.height);
+                window.resized = false;
+            }
+        }
+        // Work that jobs handed back to the main thread, e.g. SDL calls.
+        job_system.run_pinned_jobs();
+        // Before anything looks up a pipeline for this frame.
+        shader_library.update();
+        mesh_loader.update();
+        for (StreamedTextureHandle texture : streamed_textures) {
+            texture_streamer.request(texture, 0);
+        }
+        texture_streamer.update();
+
+        // Nothing to present to while minimized.
+        if (!window.minimized) {
+            render_frame();
+            frame_pacer.end_frame(device.fence_wait_ms, get_gpu_frame_ms());
+        } else {
+            frame_pacer.end_frame(0.0, 0.0);
+        }
+
+        update_frame_stats(time_elapsed_ms(frame_start));
+
+        ++frame_count;
+        if (frame_limit && frame_count >= frame_limit) {
+            break;
+        }
     }
 }
 
-} // namespace sren
\ No newline at end of file
+void Engine::render_frame() {
+    if (!device.new_frame()) {
+        return;
+    }
+
+    VkCommandBuffer command_buffer = device.get_command_buffer();
+    device.push_gpu_marker(command_buffer, "Frame");
+
+    // Until its instances are uploaded, the GPU-driven list is drawn the CPU way.
+    const Buffer *indices = gpu_driven ? device.access_buffer(triangle_indices) : nullptr;
+    const bool draw_indirect =
+        indices && device.is_upload_ready(indices->upload_value) && indirect_draws.is_ready();
+    if (draw_indirect) {
+        device.push_gpu_marker(command_buffer, "Cull");
+        indirect_draws.cull(command_buffer, clip_frustum_planes);
+        device.pop_gpu_marker(command_buffer);
+    }
+
+    const f32 clear_color[4] = {0.1f, 0.1f, 0.12f, 1.0f};
+    device.push_gpu_marker(command_buffer, "Swapchain Pass");
+
+    const u32 num_threads = device.get_num_recording_threads();
+    if (draw_indirect) {
+        device.begin_swapchain_pass(command_buffer, clear_color);
+        record_indirect_draws(command_buffer);
+    } else if (num_threads > 1 && draw_count >= min_draws_per_thread * 2) {
+        // Split the draws into jobs, each recording a secondary command buffer from its thread's pool.
+        device.begin_swapchain_pass(command_buffer, clear_color,
+                                    VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        u32 num_ranges = draw_count / min_draws_per_thread;
+        num_ranges = num_ranges < num_threads ? num_ranges : num_threads;
+        const u32 draws_per_range = (draw_count + num_ranges - 1) / num_ranges;
+
+        RecordDrawsJob job_data[max_recording_threads];
+        JobDecl jobs[max_recording_threads];
+        for (u32 i = 0; i < num_ranges; ++i) {
+            u32 first_draw = i * draws_per_range;
+            first_draw = first_draw < draw_count ? first_draw : draw_count;
+            u32 last_draw = first_draw + draws_per_range;
+            last_draw = last_draw < draw_count ? last_draw : draw_count;
+
+            job_data[i] = {this, first_draw, last_draw - first_draw, VK_NULL_HANDLE};
+            jobs[i].function = record_draws_job;
+            jobs[i].data = &job_data[i];
+        }
+
+        JobCounter counter;
+        job_system.run(jobs, num_ranges, &counter);
+        job_system.wait(&counter);
+
+        // Executed in submission order, whichever thread recorded them.
+        VkCommandBuffer secondaries[max_recording_threads];
+        for (u32 i = 0; i < num_ranges; ++i) {
+            secondaries[i] = job_data[i].command_buffer;
+        }
+        vkCmdExecuteCommands(command_buffer, num_ranges, secondaries);
+    } else {
+        device.begin_swapchain_pass(command_buffer, clear_color);
+        record_draws(command_buffer, 0, draw_count);
+    }
+
+    device.end_swapchain_pass(command_buffer);
+    device.pop_gpu_marker(command_buffer);
+
+    device.pop_gpu_marker(command_buffer);
+    device.present();
+}
+
+void Engine::record_draws(VkCommandBuffer command_buffer, u32 first_draw, u32 count) {
+    // Secondary command buffers don't inherit any state, so every range sets everything up.
+    VkExtent2D extent = device.get_swapchain_extent();
+    VkViewport viewport = {0.0f, 0.0f, (f32)extent.width, (f32)extent.height, 0.0f, 1.0f};
+    VkRect2D scissor = {{0, 0}, extent};
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    Pipeline *pipeline = device.access_pipeline(shader_library.get_pipeline(triangle_pipeline));
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->vk_pipeline);
+    u32 grid_size = draw_count ? (u32)ceil(sqrt((f64)draw_count)) : 1;
+    vkCmdPushConstants(command_buffer, pipeline->vk_pipeline_layout, VK_SHADER_STAGE_ALL, 0, sizeof(u32),
+                       &grid_size);
+    // One draw per triangle on purpose: the test scene stresses draw submission.
+    for (u32 i = first_draw; i < first_draw + count; ++i) {
+        vkCmdDraw(command_buffer, 3, 1, 0, i);
+    }
+}
+
+void Engine::record_indirect_draws(VkCommandBuffer command_buffer) {
+    VkExtent2D extent = device.get_swapchain_extent();
+    VkViewport viewport = {0.0f, 0.0f, (f32)extent.width, (f32)extent.height, 0.0f, 1.0f};
+    VkRect2D scissor = {{0, 0}, extent};
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    Pipeline *pipeline = device.access_pipeline(shader_library.get_pipeline(triangle_pipeline));
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->vk_pipeline);
+    u32 grid_size = draw_count ? (u32)ceil(sqrt((f64)draw_count)) : 1;
+    vkCmdPushConstants(command_buffer, pipeline->vk_pipeline_layout, VK_SHADER_STAGE_ALL, 0, sizeof(u32),
+                       &grid_size);
+    vkCmdBindIndexBuffer(command_buffer, device.access_buffer(triangle_indices)->vk_buffer, 0,
+                         VK_INDEX_TYPE_UINT32);
+    indirect_draws.draw(command_buffer);
+}
+
+void Engine::record_draws_job(void *data, u32 thread_index) {
+    RecordDrawsJob *job = (RecordDrawsJob *)data;
+    Engine *engine = job->engine;
+
+    job->command_buffer = engine->device.begin_swapchain_secondary_command_buffer(thread_index);
+    engine->record_draws(job->command_buffer, job->first_draw, job->count);
+    vkEndCommandBuffer(job->command_buffer);
+}
+
+f64 Engine::get_pacing_period_ms() const {
+    if (!frame_pacing) {
+        return 0.0;
+    }
+    if (target_frame_rate > 0.0f) {
+        return 1000.0 / target_frame_rate;
+    }
+    // SDL reports 0 Hz for displays with an unknown refresh rate.
+    const f64 refresh_ms = headless ? 0.0 : window.display_refresh * 1000.0;
+    return refresh_ms > 0.0 && refresh_ms < 1000.0 ? refresh_ms : 0.0;
+}
+
+f64 Engine::get_gpu_frame_ms() const {
+    u32 count;
+    u64 frame_index;
+    const GpuTimestamp *timestamps = device.get_gpu_timestamps(count, frame_index);
+    f64 gpu_ms = 0.0;
+    for (u32 i = 0; i < count; ++i) {
+        if (timestamps[i].depth == 0) {
+            gpu_ms += timestamps[i].elapsed_ms;
+        }
+    }
+    return gpu_ms;
+}
+
+void Engine::update_frame_stats(f64 frame_ms) {
+    static const f64 report_interval_seconds = 1.0;
+
+    frame_stats.frames++;
+    frame_stats.frame_ms += frame_ms;
+    frame_stats.fence_wait_ms += device.fence_wait_ms;
+    if (device.fence_wait_ms > frame_stats.max_fence_wait_ms) {
+        frame_stats.max_fence_wait_ms = device.fence_wait_ms;
+    }
+
+    i64 now = time_now();
+    if (time_delta_seconds(frame_stats.interval_start, now) < report_interval_seconds) {
+        return;
+    }
+
+    // Most of the frame spent blocked on the fence means the GPU is the bottleneck.
+    f64 average_frame_ms = frame_stats.frame_ms / frame_stats.frames;
+    f64 average_wait_ms = frame_stats.fence_wait_ms / frame_stats.frames;
+    const char *bound = average_wait_ms > average_frame_ms * 0.5 ? "GPU" : "CPU";
+    LOG_DBG("Frame %.3f ms, fence wait %.3f ms (max %.3f ms), %s-bound", average_frame_ms,
+            average_wait_ms, frame_stats.max_fence_wait_ms, bound);
+
+    u32 timestamp_count;
+    u64 timestamp_frame;
+    const GpuTimestamp *timestamps = device.get_gpu_timestamps(timestamp_count, timestamp_frame);
+    for (u32 i = 0; i < timestamp_count; ++i) {
+        const GpuTimestamp &timestamp = timestamps[i];
+        LOG_DBG("GPU frame %llu %*s%s: %.3f ms", (unsigned long long)timestamp_frame,
+                timestamp.depth * 2, "", timestamp.name, timestamp.elapsed_ms);
+    }
+
+    frame_stats = {};
+    frame_stats.interval_start = now;
+}
+
+} // namespace sren
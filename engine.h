@@ -1,24 +1,118 @@
 #pragma once
 
 #include "device.h"
+#include "frame_pacer.h"
+#include "indirect_draw.h"
+#include "job_system.h"
+#include "log.h"
+#include "mesh_loader.h"
 #include "platform.h"
+#include "shader_library.h"
+#include "texture_streamer.h"
 #include "window.h"
 
+#include <vector>
+
 namespace sren {
 
+struct EngineCreation {
+    // Run without a window, rendering into offscreen images.
+    bool headless = false;
+    // Stop after this many frames. 0 runs until the window is closed.
+    u32 frame_limit = 0;
+
+    // Explicit GPU selection, forwarded to DeviceCreation.
+    i32 gpu_index = -1;
+    const char *gpu_name = nullptr;
+
+    // Persistent pipeline cache file. Null disables it.
+    const char *pipeline_cache_path = "pipeline_cache.bin";
+    // Compiled SPIR-V by source hash, see ShaderLibrary. Null disables it.
+    const char *shader_cache_path = "shader_cache/";
+    // Recompile edited shaders and rebuild their pipelines while running.
+    bool shader_hot_reload = true;
+
+    // Number of draws recorded per frame by the test scene.
+    u32 draw_count = 1024;
+    // Job system threads, including the main thread. 0 uses one per core.
+    u32 num_threads = 0;
+    // Render with dynamic rendering instead of render pass objects.
+    bool dynamic_rendering = false;
+    // Cull the test scene on the GPU and draw it with indirect draws, see IndirectDrawList. Falls back
+    // to recording the draws when the device can't.
+    bool gpu_driven = false;
+
+    // Delay frame starts so frames complete just before their deadline, see FramePacer.
+    bool frame_pacing = true;
+    // Frames per second to pace to. 0 uses the display refresh, or leaves headless runs unpaced.
+    f32 target_frame_rate = 0.0f;
+    // Latency/throughput trade-off, see FramePacerCreation::margin_ms.
+    f32 pacing_margin_ms = 1.0f;
+
+    // glTF/GLB or cooked meshes streamed in the background after startup. The paths must outlive init.
+    const char *const *mesh_paths = nullptr;
+    u32 num_mesh_paths = 0;
+    // KTX2 files streamed by mip level, within texture_budget bytes of device memory. The test scene
+    // requests every level of each, see TextureStreamer.
+    const char *const *texture_paths = nullptr;
+    u32 num_texture_paths = 0;
+    u64 texture_budget = 256 * 1024 * 1024;
+
+    LogConfig log;
+}; // struct EngineCreation
+
 class Engine {
   public:
-    bool init();
+    bool init(const EngineCreation &creation);
     void shutdown();
 
     void run();
 
+    const FramePacerStats &get_frame_pacing_stats() const { return frame_pacer.get_stats(); }
+
   private:
     bool init_vulkan();
     bool init_resources();
+    bool init_gpu_driven();
+
+    void render_frame();
+    void record_draws(VkCommandBuffer command_buffer, u32 first_draw, u32 count);
+    static void record_draws_job(void *data, u32 thread_index);
+    void record_indirect_draws(VkCommandBuffer command_buffer);
+    void update_frame_stats(f64 frame_ms);
+    f64 get_pacing_period_ms() const;
+    // GPU time of the latest frame with resolved timestamps, 0 when there is none.
+    f64 get_gpu_frame_ms() const;
 
     Window window;
     Device device;
+    JobSystem job_system;
+    ShaderLibrary shader_library;
+    FramePacer frame_pacer;
+    MeshLoader mesh_loader;
+    TextureStreamer texture_streamer;
+    std::vector<StreamedTextureHandle> streamed_textures;
+
+    bool headless = false;
+    u32 frame_limit = 0;
+    bool frame_pacing = true;
+    f32 target_frame_rate = 0.0f;
+
+    // Test scene
+    u32 draw_count = 0;
+    ShaderPipelineHandle triangle_pipeline = invalid_shader_pipeline;
+    bool gpu_driven = false;
+    IndirectDrawList indirect_draws;
+    BufferHandle triangle_indices = invalid_buffer;
+
+    // Accumulated over the current reporting interval.
+    struct FrameStats {
+        i64 interval_start = 0;
+        u32 frames = 0;
+        f64 frame_ms = 0.0;
+        f64 fence_wait_ms = 0.0;
+        f64 max_fence_wait_ms = 0.0;
+    } frame_stats;
 };
 
-} // namespace sren
\ No newline at end of file
+} // namespace sren
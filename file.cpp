@@ -0,0 +1,117 @@
+#include "file.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sren {
+
+bool MappedFile::map(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG_ERR("Failed to map %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    data = mapping;
+    size = (size_t)file_stat.st_size;
+    return true;
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const {
+    if (!data || offset >= size) {
+        return;
+    }
+    // madvise wants a page aligned start.
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t start = offset / page_size * page_size;
+    length = offset + length < size ? offset + length - start : size - start;
+    madvise((u8 *)data + start, length, MADV_WILLNEED);
+}
+
+void MappedFile::unmap() {
+    if (data) {
+        munmap(data, size);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+bool file_write_atomic(const char *path, const void *data, size_t size) {
+    // Unique, so concurrent writers of the same path never share a temporary file.
+    char temp_path[1024];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path) >= (int)sizeof(temp_path)) {
+        LOG_ERR("Path too long: %s", path);
+        return false;
+    }
+
+    const int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        LOG_ERR("Failed to create a temporary file for %s: %s", path, strerror(errno));
+        return false;
+    }
+    // mkstemp creates the file readable by its owner only.
+    fchmod(fd, 0644);
+    FILE *file = fdopen(fd, "wb");
+    if (!file) {
+        LOG_ERR("Failed to open %s for writing: %s", temp_path, strerror(errno));
+        close(fd);
+        remove(temp_path);
+        return false;
+    }
+    bool written = fwrite(data, 1, size, file) == size;
+    written = fflush(file) == 0 && written;
+    // Make sure the data is on disk before the rename makes it visible.
+    written = fsync(fileno(file)) == 0 && written;
+    fclose(file);
+
+    if (!written || rename(temp_path, path) != 0) {
+        LOG_ERR("Failed to write %s: %s", path, strerror(errno));
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
+
+bool file_exists(const char *path) {
+    struct stat file_stat;
+    return stat(path, &file_stat) == 0;
+}
+
+u64 file_modified_time(const char *path) {
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0) {
+        return 0;
+    }
+    return (u64)file_stat.st_mtim.tv_sec * 1000000000ull + (u64)file_stat.st_mtim.tv_nsec;
+}
+
+bool create_directory(const char *path) {
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        LOG_ERR("Failed to create directory %s: %s", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace sren
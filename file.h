@@ -0,0 +1,30 @@
+#pragma once
+
+#include "platform.h"
+
+#include <stddef.h>
+
+namespace sren {
+
+// Read-only memory mapping of a whole file.
+struct MappedFile {
+    void *data = nullptr;
+    size_t size = 0;
+
+    bool map(const char *path);
+    void unmap();
+    // Asks the kernel to start reading a range in, so touching it later doesn't stall on page faults.
+    void prefetch(size_t offset, size_t length) const;
+}; // struct MappedFile
+
+// Writes to a unique temporary file next to path and renames it over path, so readers never see a
+// partially written file, even with several writers.
+bool file_write_atomic(const char *path, const void *data, size_t size);
+
+bool file_exists(const char *path);
+// Last modification in nanoseconds since the epoch, 0 when the file can't be found.
+u64 file_modified_time(const char *path);
+// Creates the directory unless it already exists. Parent directories have to exist.
+bool create_directory(const char *path);
+
+} // namespace sren
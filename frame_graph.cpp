@@ -0,0 +1,539 @@
+#include "frame_graph.h"
+
+#include "log.h"
+
+namespace sren {
+
+// Sampled reads are the only kind of read a pass declares.
+static const VkPipelineStageFlags shader_read_stages =
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+static const VkPipelineStageFlags depth_stages =
+    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+//
+// FrameGraphPassCreation
+//
+FrameGraphPassCreation &FrameGraphPassCreation::reset() {
+    num_reads = 0;
+    num_color_writes = 0;
+    depth_write = invalid_frame_graph_resource;
+    color_operation = depth_operation = RenderPassOperation::Clear;
+    clear_color = {};
+    clear_depth = 1.0f;
+    execute = nullptr;
+    user_data = nullptr;
+    name = nullptr;
+    return *this;
+}
+
+FrameGraphPassCreation &FrameGraphPassCreation::add_read(FrameGraphResourceHandle resource) {
+    if (num_reads == max_pass_reads) {
+        LOG_ERR("Frame graph pass reads more than %u textures.", max_pass_reads);
+        return *this;
+    }
+    reads[num_reads++] = resource;
+    return *this;
+}
+
+FrameGraphPassCreation &FrameGraphPassCreation::add_color_write(FrameGraphResourceHandle resource) {
+    if (num_color_writes == max_image_outputs) {
+        LOG_ERR("Frame graph pass writes more than %u color attachments.", max_image_outputs);
+        return *this;
+    }
+    color_writes[num_color_writes++] = resource;
+    return *this;
+}
+
+FrameGraphPassCreation &FrameGraphPassCreation::set_depth_write(FrameGraphResourceHandle resource) {
+    depth_write = resource;
+    return *this;
+}
+
+FrameGraphPassCreation &FrameGraphPassCreation::set_operations(RenderPassOperation::Enum color,
+                                                               RenderPassOperation::Enum depth) {
+    color_operation = color;
+    depth_operation = depth;
+    return *this;
+}
+
+FrameGraphPassCreation &FrameGraphPassCreation::set_clear(f32 r, f32 g, f32 b, f32 a, f32 depth) {
+    clear_color.float32[0] = r;
+    clear_color.float32[1] = g;
+    clear_color.float32[2] = b;
+    clear_color.float32[3] = a;
+    clear_depth = depth;
+    return *this;
+}
+
+FrameGraphPassCreation &FrameGraphPassCreation::set_execute(FrameGraphExecute execute_,
+                                                            void *user_data_) {
+    execute = execute_;
+    user_data = user_data_;
+    return *this;
+}
+
+FrameGraphPassCreation &FrameGraphPassCreation::set_name(const char *name_) {
+    name = name_;
+    return *this;
+}
+
+//
+// FrameGraph
+//
+void FrameGraph::init(Device *device_) {
+    device = device_;
+    num_passes = num_resources = num_memory_slots = 0;
+    compiled = false;
+    stats = {};
+}
+
+void FrameGraph::shutdown() {
+    reset();
+    device = nullptr;
+}
+
+void FrameGraph::reset() {
+    for (u32 i = 0; i < num_resources; ++i) {
+        if (!resources[i].imported && resources[i].texture.index != invalid_resource_handle) {
+            device->destroy_texture(resources[i].texture);
+        }
+    }
+    // Queued after the textures, so they are gone before their memory is freed.
+    for (u32 i = 0; i < num_memory_slots; ++i) {
+        if (memory_slots[i].memory.index != invalid_resource_handle) {
+            device->destroy_memory(memory_slots[i].memory);
+        }
+    }
+    num_passes = num_resources = num_memory_slots = 0;
+    compiled = false;
+    stats = {};
+}
+
+FrameGraphResourceHandle FrameGraph::create_texture(const TextureCreation &creation) {
+    if (compiled || num_resources == max_frame_graph_resources) {
+        LOG_ERR("Can't add texture %s to the frame graph.", creation.name ? creation.name : "");
+        return invalid_frame_graph_resource;
+    }
+
+    Resource &resource = resources[num_resources];
+    resource.creation = creation;
+    resource.creation.flags |= TextureFlags::RenderTarget_mask;
+    resource.texture = invalid_texture;
+    resource.imported = false;
+    resource.output = false;
+    return num_resources++;
+}
+
+FrameGraphResourceHandle FrameGraph::import_texture(TextureHandle handle) {
+    Texture *texture = device->access_texture(handle);
+    if (compiled || !texture || num_resources == max_frame_graph_resources) {
+        LOG_ERR("Can't import texture into the frame graph.");
+        return invalid_frame_graph_resource;
+    }
+
+    Resource &resource = resources[num_resources];
+    resource.creation = {};
+    resource.creation.set_size(texture->width, texture->height, texture->depth)
+        .set_flags(texture->mipmaps, texture->flags)
+        .set_format_type(texture->vk_format, texture->type)
+        .set_name(texture->name);
+    resource.texture = handle;
+    resource.imported = true;
+    resource.output = false;
+    return num_resources++;
+}
+
+u32 FrameGraph::add_pass(const FrameGraphPassCreation &creation) {
+    if (compiled || num_passes == max_frame_graph_passes) {
+        LOG_ERR("Can't add pass %s to the frame graph.", creation.name ? creation.name : "");
+        return u32_max;
+    }
+
+    passes[num_passes].creation = creation;
+    passes[num_passes].culled = false;
+    return num_passes++;
+}
+
+void FrameGraph::mark_output(FrameGraphResourceHandle resource) {
+    if (resource < num_resources) {
+        resources[resource].output = true;
+    }
+}
+
+TextureHandle FrameGraph::get_texture(FrameGraphResourceHandle resource) const {
+    return resource < num_resources ? resources[resource].texture : invalid_texture;
+}
+
+bool FrameGraph::compile() {
+    if (compiled) {
+        return true;
+    }
+
+    for (u32 p = 0; p < num_passes; ++p) {
+        const FrameGraphPassCreation &creation = passes[p].creation;
+        const char *name = creation.name ? creation.name : "";
+        if (creation.num_color_writes == 0 && creation.depth_write == invalid_frame_graph_resource) {
+            LOG_ERR("Frame graph pass %s writes nothing.", name);
+            return false;
+        }
+
+        u32 width = 0, height = 0;
+        for (u32 i = 0; i < creation.num_color_writes + 1; ++i) {
+            const bool is_depth = i == creation.num_color_writes;
+            const FrameGraphResourceHandle write =
+                is_depth ? creation.depth_write : creation.color_writes[i];
+            if (is_depth && write == invalid_frame_graph_resource) {
+                break;
+            }
+            if (write >= num_resources ||
+                texture_format_has_depth(resources[write].creation.format) != is_depth) {
+                LOG_ERR("Frame graph pass %s has an invalid attachment.", name);
+                return false;
+            }
+            const TextureCreation &attachment = resources[write].creation;
+            if (!(attachment.flags & TextureFlags::RenderTarget_mask)) {
+                LOG_ERR("Frame graph pass %s writes a texture that isn't a render target.", name);
+                return false;
+            }
+            if (width && (attachment.width != width || attachment.height != height)) {
+                LOG_ERR("Frame graph pass %s has attachments of different sizes.", name);
+                return false;
+            }
+            width = attachment.width;
+            height = attachment.height;
+
+            for (u32 r = 0; r < creation.num_reads; ++r) {
+                if (creation.reads[r] == write) {
+                    LOG_ERR("Frame graph pass %s reads a texture it writes.", name);
+                    return false;
+                }
+            }
+        }
+        for (u32 r = 0; r < creation.num_reads; ++r) {
+            if (creation.reads[r] >= num_resources) {
+                LOG_ERR("Frame graph pass %s has an invalid read.", name);
+                return false;
+            }
+        }
+    }
+
+    cull_passes();
+    assign_memory();
+
+    for (u32 s = 0; s < num_memory_slots; ++s) {
+        MemorySlot &slot = memory_slots[s];
+        slot.memory = device->create_memory(slot.requirements, "Frame graph memory");
+        if (slot.memory.index == invalid_resource_handle) {
+            return false;
+        }
+        slot.stages = 0;
+        slot.writes = 0;
+        stats.aliased_bytes += slot.requirements.size;
+    }
+    stats.memory_blocks = num_memory_slots;
+
+    for (u32 i = 0; i < num_resources; ++i) {
+        Resource &resource = resources[i];
+        if (resource.imported || resource.first_use == u32_max) {
+            continue;
+        }
+        resource.creation.set_alias(memory_slots[resource.memory_slot].memory);
+        resource.texture = device->create_texture(resource.creation);
+        if (resource.texture.index == invalid_resource_handle) {
+            return false;
+        }
+    }
+
+    compiled = true;
+    return true;
+}
+
+void FrameGraph::cull_passes() {
+    // Walking back from the outputs, a pass lives if an output or a later live pass needs its writes.
+    // Imported textures outlive the frame, so writing them counts as an output.
+    bool needed[max_frame_graph_resources];
+    for (u32 i = 0; i < num_resources; ++i) {
+        needed[i] = resources[i].output || resources[i].imported;
+    }
+
+    stats.passes = num_passes;
+    stats.culled_passes = 0;
+    for (u32 p = num_passes; p-- > 0;) {
+        Pass &pass = passes[p];
+        const FrameGraphPassCreation &creation = pass.creation;
+        const bool has_depth = creation.depth_write != invalid_frame_graph_resource;
+
+        bool alive = has_depth && needed[creation.depth_write];
+        for (u32 i = 0; i < creation.num_color_writes; ++i) {
+            alive |= needed[creation.color_writes[i]];
+        }
+        pass.culled = !alive;
+        if (!alive) {
+            ++stats.culled_passes;
+            continue;
+        }
+
+        // Anything written before this pass without being loaded by it is overwritten.
+        if (creation.color_operation != RenderPassOperation::Load) {
+            for (u32 i = 0; i < creation.num_color_writes; ++i) {
+                needed[creation.color_writes[i]] = false;
+            }
+        }
+        if (has_depth && creation.depth_operation != RenderPassOperation::Load) {
+            needed[creation.depth_write] = false;
+        }
+        for (u32 i = 0; i < creation.num_reads; ++i) {
+            needed[creation.reads[i]] = true;
+        }
+    }
+
+    for (u32 i = 0; i < num_resources; ++i) {
+        resources[i].first_use = resources[i].last_use = u32_max;
+    }
+    for (u32 p = 0; p < num_passes; ++p) {
+        const FrameGraphPassCreation &creation = passes[p].creation;
+        if (passes[p].culled) {
+            continue;
+        }
+
+        FrameGraphResourceHandle used[max_pass_reads + max_image_outputs + 1];
+        u32 num_used = 0;
+        for (u32 i = 0; i < creation.num_reads; ++i) {
+            used[num_used++] = creation.reads[i];
+        }
+        for (u32 i = 0; i < creation.num_color_writes; ++i) {
+            used[num_used++] = creation.color_writes[i];
+        }
+        if (creation.depth_write != invalid_frame_graph_resource) {
+            used[num_used++] = creation.depth_write;
+        }
+        for (u32 i = 0; i < num_used; ++i) {
+            Resource &resource = resources[used[i]];
+            if (resource.first_use == u32_max) {
+                resource.first_use = p;
+            }
+            resource.last_use = p;
+        }
+    }
+    // Outputs are read after the frame, so their memory can't be handed to later passes.
+    for (u32 i = 0; i < num_resources; ++i) {
+        if (resources[i].output && resources[i].first_use != u32_max) {
+            resources[i].last_use = num_passes;
+        }
+    }
+}
+
+void FrameGraph::assign_memory() {
+    // Transient textures in order of first use, so each can take over a slot whose textures are done.
+    u32 order[max_frame_graph_resources];
+    u32 count = 0;
+    for (u32 i = 0; i < num_resources; ++i) {
+        if (resources[i].imported || resources[i].first_use == u32_max) {
+            continue;
+        }
+        u32 j = count++;
+        for (; j > 0 && resources[order[j - 1]].first_use > resources[i].first_use; --j) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    num_memory_slots = 0;
+    stats.transient_textures = count;
+    stats.unaliased_bytes = stats.aliased_bytes = 0;
+    for (u32 i = 0; i < count; ++i) {
+        Resource &resource = resources[order[i]];
+        const VkMemoryRequirements requirements =
+            device->get_texture_memory_requirements(resource.creation);
+        stats.unaliased_bytes += requirements.size;
+
+        // Best fit among the free compatible slots: the least growth, then the least waste.
+        u32 best = u32_max;
+        VkDeviceSize best_growth = 0, best_size = 0;
+        for (u32 s = 0; s < num_memory_slots; ++s) {
+            const MemorySlot &slot = memory_slots[s];
+            if (slot.last_use >= resource.first_use ||
+                !(slot.requirements.memoryTypeBits & requirements.memoryTypeBits)) {
+                continue;
+            }
+            const VkDeviceSize size = slot.requirements.size;
+            const VkDeviceSize growth = requirements.size > size ? requirements.size - size : 0;
+            if (best == u32_max || growth < best_growth || (growth == best_growth && size < best_size)) {
+                best = s;
+                best_growth = growth;
+                best_size = size;
+            }
+        }
+
+        if (best == u32_max) {
+            best = num_memory_slots++;
+            memory_slots[best].requirements = requirements;
+        } else {
+            VkMemoryRequirements &merged = memory_slots[best].requirements;
+            merged.size = requirements.size > merged.size ? requirements.size : merged.size;
+            merged.alignment =
+                requirements.alignment > merged.alignment ? requirements.alignment : merged.alignment;
+            merged.memoryTypeBits &= requirements.memoryTypeBits;
+        }
+        memory_slots[best].memory = invalid_memory;
+        memory_slots[best].last_use = resource.last_use;
+        resource.memory_slot = best;
+    }
+}
+
+void FrameGraph::use_texture(FrameGraphResourceHandle handle, VkImageLayout layout,
+                             VkPipelineStageFlags stage, VkAccessFlags access, bool write,
+                             bool discard) {
+    Resource &resource = resources[handle];
+    MemorySlot *slot = resource.imported ? nullptr : &memory_slots[resource.memory_slot];
+
+    // The first use of a transient texture in the frame follows whatever last used its memory.
+    VkPipelineStageFlags src_stages = resource.stages;
+    VkAccessFlags src_writes = resource.writes;
+    if (slot && resource.layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+        src_stages = slot->stages;
+        src_writes = slot->writes;
+    }
+
+    if (!write && src_writes == 0 && resource.layout == layout) {
+        // Read after read in the same layout.
+        resource.stages |= stage;
+    } else {
+        Texture *texture = device->access_texture(resource.texture);
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        if (texture_format_has_depth(texture->vk_format)) {
+            aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+            if (texture_format_has_stencil(texture->vk_format)) {
+                aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+            }
+        }
+
+        VkImageMemoryBarrier &barrier = barriers[num_barriers++];
+        barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_writes;
+        barrier.dstAccessMask = access;
+        barrier.oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : resource.layout;
+        barrier.newLayout = layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = texture->vk_image;
+        barrier.subresourceRange = {aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+        barrier_src_stages |= src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        barrier_dst_stages |= stage;
+
+        resource.layout = layout;
+        resource.stages = stage;
+        resource.writes = write ? access : 0;
+    }
+
+    if (slot) {
+        slot->stages = resource.stages;
+        slot->writes = resource.writes;
+    }
+}
+
+void FrameGraph::flush_barriers(VkCommandBuffer command_buffer) {
+    if (num_barriers == 0) {
+        return;
+    }
+    vkCmdPipelineBarrier(command_buffer, barrier_src_stages, barrier_dst_stages, 0, 0, nullptr, 0,
+                         nullptr, num_barriers, barriers);
+    stats.barriers += num_barriers;
+    num_barriers = 0;
+    barrier_src_stages = barrier_dst_stages = 0;
+}
+
+void FrameGraph::execute(VkCommandBuffer command_buffer) {
+    if (!compiled) {
+        LOG_ERR("Executing a frame graph that isn't compiled.");
+        return;
+    }
+
+    stats.barriers = 0;
+    for (u32 i = 0; i < num_resources; ++i) {
+        Resource &resource = resources[i];
+        resource.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        resource.stages = 0;
+        resource.writes = 0;
+        if (resource.imported) {
+            resource.layout = device->access_texture(resource.texture)->vk_image_layout;
+            resource.stages = resource.layout != VK_IMAGE_LAYOUT_UNDEFINED ? shader_read_stages : 0;
+        }
+    }
+
+    for (u32 p = 0; p < num_passes; ++p) {
+        if (passes[p].culled) {
+            continue;
+        }
+        const FrameGraphPassCreation &creation = passes[p].creation;
+        const bool load_color = creation.color_operation == RenderPassOperation::Load;
+        const bool load_depth = creation.depth_operation == RenderPassOperation::Load;
+        const bool has_depth = creation.depth_write != invalid_frame_graph_resource;
+
+        for (u32 i = 0; i < creation.num_reads; ++i) {
+            use_texture(creation.reads[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shader_read_stages,
+                        VK_ACCESS_SHADER_READ_BIT, false, false);
+        }
+
+        RenderPassOutput output;
+        output.reset().set_operations(creation.color_operation, creation.depth_operation,
+                                      creation.depth_operation);
+        TextureHandle color_attachments[max_image_outputs];
+        TextureHandle depth_attachment = invalid_texture;
+        VkClearValue clear_values[max_image_outputs + 1];
+        for (u32 i = 0; i < creation.num_color_writes; ++i) {
+            const Resource &resource = resources[creation.color_writes[i]];
+            use_texture(creation.color_writes[i], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true,
+                        !load_color);
+            output.color(resource.creation.format);
+            color_attachments[i] = resource.texture;
+            clear_values[i].color = creation.clear_color;
+        }
+        if (has_depth) {
+            const Resource &resource = resources[creation.depth_write];
+            use_texture(creation.depth_write, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                        depth_stages,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        true, !load_depth);
+            output.depth(resource.creation.format);
+            depth_attachment = resource.texture;
+            clear_values[creation.num_color_writes].depthStencil = {creation.clear_depth, 0};
+        }
+        flush_barriers(command_buffer);
+
+        if (creation.name) {
+            device->push_gpu_marker(command_buffer, creation.name);
+        }
+        if (device->begin_render_pass(command_buffer, output, color_attachments, depth_attachment,
+                                      clear_values)) {
+            if (creation.execute) {
+                creation.execute(command_buffer, creation.user_data);
+            }
+            device->end_render_pass(command_buffer);
+        }
+        if (creation.name) {
+            device->pop_gpu_marker(command_buffer);
+        }
+    }
+
+    for (u32 i = 0; i < num_resources; ++i) {
+        Resource &resource = resources[i];
+        if ((resource.output || resource.imported) && resource.first_use != u32_max) {
+            use_texture(i, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shader_read_stages,
+                        VK_ACCESS_SHADER_READ_BIT, false, false);
+        }
+    }
+    flush_barriers(command_buffer);
+
+    for (u32 i = 0; i < num_resources; ++i) {
+        if (resources[i].first_use != u32_max) {
+            device->access_texture(resources[i].texture)->vk_image_layout = resources[i].layout;
+        }
+    }
+}
+
+} // namespace sren
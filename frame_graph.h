@@ -0,0 +1,156 @@
+#pragma once
+
+#include "device.h"
+#include "gpu_resources.h"
+#include "platform.h"
+
+#include <vulkan/vulkan.h>
+
+namespace sren {
+
+static const u32 max_frame_graph_passes = 64;
+static const u32 max_frame_graph_resources = 128;
+static const u32 max_pass_reads = 16;
+
+// Index of a texture declared in a frame graph.
+typedef u32 FrameGraphResourceHandle;
+static const FrameGraphResourceHandle invalid_frame_graph_resource = u32_max;
+
+// Records a pass' draws. Called inside the pass' render pass, with viewport and scissor left to it.
+typedef void (*FrameGraphExecute)(VkCommandBuffer command_buffer, void *user_data);
+
+struct FrameGraphPassCreation {
+    // Sampled from fragment or compute shaders.
+    FrameGraphResourceHandle reads[max_pass_reads];
+    u32 num_reads = 0;
+    FrameGraphResourceHandle color_writes[max_image_outputs];
+    u32 num_color_writes = 0;
+    FrameGraphResourceHandle depth_write = invalid_frame_graph_resource;
+
+    // Clear and DontCare overwrite the attachments, so earlier writers are only kept alive by Load.
+    RenderPassOperation::Enum color_operation = RenderPassOperation::Clear;
+    RenderPassOperation::Enum depth_operation = RenderPassOperation::Clear;
+    VkClearColorValue clear_color = {};
+    f32 clear_depth = 1.0f;
+
+    FrameGraphExecute execute = nullptr;
+    void *user_data = nullptr;
+
+    const char *name = nullptr;
+
+    FrameGraphPassCreation &reset();
+    FrameGraphPassCreation &add_read(FrameGraphResourceHandle resource);
+    FrameGraphPassCreation &add_color_write(FrameGraphResourceHandle resource);
+    FrameGraphPassCreation &set_depth_write(FrameGraphResourceHandle resource);
+    FrameGraphPassCreation &set_operations(RenderPassOperation::Enum color,
+                                           RenderPassOperation::Enum depth);
+    FrameGraphPassCreation &set_clear(f32 r, f32 g, f32 b, f32 a, f32 depth);
+    FrameGraphPassCreation &set_execute(FrameGraphExecute execute, void *user_data);
+    FrameGraphPassCreation &set_name(const char *name);
+}; // struct FrameGraphPassCreation
+
+struct FrameGraphStats {
+    u32 passes;
+    u32 culled_passes;
+    u32 transient_textures;
+    u32 memory_blocks;
+    // What the transient textures would take with one allocation each, and what they take aliased.
+    u64 unaliased_bytes;
+    u64 aliased_bytes;
+    // Image barriers recorded by the last execute.
+    u32 barriers;
+}; // struct FrameGraphStats
+
+// A frame described as passes that declare the textures they read and write. Passes run in the order
+// they are added. Compiling culls passes whose writes never reach an output, creates the transient
+// textures and places those with disjoint lifetimes in the same memory block. Executing records every
+// layout transition and dependency from the declared usage, and nothing more: reads of a texture in the
+// same layout need no barrier between them.
+//
+// Transient textures live in the graph and are undefined at the start of each frame. Imported textures
+// keep their contents and are assumed shader readable unless their layout says otherwise. Outputs, and
+// imported textures written by the graph, end the frame in SHADER_READ_ONLY_OPTIMAL.
+class FrameGraph {
+  public:
+    void init(Device *device);
+    void shutdown();
+    // Destroys the transient textures and forgets every pass and resource, e.g. to rebuild on resize.
+    void reset();
+
+    // Declaration, before compile.
+    FrameGraphResourceHandle create_texture(const TextureCreation &creation);
+    FrameGraphResourceHandle import_texture(TextureHandle texture);
+    u32 add_pass(const FrameGraphPassCreation &creation);
+    void mark_output(FrameGraphResourceHandle resource);
+
+    bool compile();
+    // Records the live passes. Outside of any render pass.
+    void execute(VkCommandBuffer command_buffer);
+
+    // Invalid for transient textures until compiled, and for ones no live pass uses.
+    TextureHandle get_texture(FrameGraphResourceHandle resource) const;
+    const FrameGraphStats &get_stats() const { return stats; }
+
+  private:
+    struct Resource {
+        TextureCreation creation;
+        TextureHandle texture;
+        bool imported;
+        bool output;
+
+        // First and last live pass using the texture, u32_max when none does. Outputs last past the
+        // final pass.
+        u32 first_use;
+        u32 last_use;
+        u32 memory_slot;
+
+        // Usage so far in the frame being recorded.
+        VkImageLayout layout;
+        VkPipelineStageFlags stages;
+        VkAccessFlags writes;
+    }; // struct Resource
+
+    struct Pass {
+        FrameGraphPassCreation creation;
+        bool culled;
+    }; // struct Pass
+
+    // Memory shared by transient textures, the union of their requirements.
+    struct MemorySlot {
+        VkMemoryRequirements requirements;
+        MemoryHandle memory;
+        u32 last_use;
+
+        // Last usage of any texture in the slot, carried over frames: the first texture of the next
+        // frame has to wait on it before overwriting the memory.
+        VkPipelineStageFlags stages;
+        VkAccessFlags writes;
+    }; // struct MemorySlot
+
+    void cull_passes();
+    void assign_memory();
+    // Brings a texture to the pass' usage, adding a barrier to the batch when one is needed. Discarding
+    // skips the transition of the previous contents.
+    void use_texture(FrameGraphResourceHandle resource, VkImageLayout layout, VkPipelineStageFlags stage,
+                     VkAccessFlags access, bool write, bool discard);
+    void flush_barriers(VkCommandBuffer command_buffer);
+
+    Device *device = nullptr;
+
+    Pass passes[max_frame_graph_passes];
+    u32 num_passes = 0;
+    Resource resources[max_frame_graph_resources];
+    u32 num_resources = 0;
+    MemorySlot memory_slots[max_frame_graph_resources];
+    u32 num_memory_slots = 0;
+    bool compiled = false;
+
+    VkImageMemoryBarrier barriers[max_frame_graph_resources];
+    u32 num_barriers = 0;
+    VkPipelineStageFlags barrier_src_stages = 0;
+    VkPipelineStageFlags barrier_dst_stages = 0;
+
+    FrameGraphStats stats = {};
+}; // class FrameGraph
+
+} // namespace sren
@@ -0,0 +1,165 @@
+#include "frame_pacer.h"
+
+#include "timer.h"
+
+#include <math.h>
+
+namespace sren {
+
+// Weight of the newest frame in the cost average.
+static const f64 cost_smoothing = 0.1;
+// Fraction of the fence wait error corrected per frame, lower is steadier but slower to lock.
+static const f64 vsync_correction = 0.25;
+
+static i64 ms_to_ns(f64 ms) { return (i64)(ms * 1000000.0); }
+
+//
+// FrameHistogram
+//
+void FrameHistogram::reset() {
+    for (u32 i = 0; i < frame_histogram_buckets; ++i) {
+        buckets[i] = 0;
+    }
+    count = 0;
+    sum_ms = max_ms = 0.0;
+}
+
+void FrameHistogram::add(f64 ms) {
+    u32 bucket = ms > 0.0 ? (u32)ms : 0;
+    bucket = bucket < frame_histogram_buckets ? bucket : frame_histogram_buckets - 1;
+    ++buckets[bucket];
+    ++count;
+    sum_ms += ms;
+    max_ms = ms > max_ms ? ms : max_ms;
+}
+
+f64 FrameHistogram::mean() const { return count ? sum_ms / count : 0.0; }
+
+f64 FrameHistogram::percentile(f64 fraction) const {
+    if (count == 0) {
+        return 0.0;
+    }
+    const u32 target = (u32)ceil(fraction * count);
+    u32 accumulated = 0;
+    for (u32 i = 0; i < frame_histogram_buckets - 1; ++i) {
+        accumulated += buckets[i];
+        if (accumulated >= target) {
+            return (f64)(i + 1);
+        }
+    }
+    return max_ms;
+}
+
+//
+// FramePacerCreation
+//
+FramePacerCreation &FramePacerCreation::set_period(f64 period_ms_) {
+    period_ms = period_ms_;
+    return *this;
+}
+
+FramePacerCreation &FramePacerCreation::set_margin(f64 margin_ms_) {
+    margin_ms = margin_ms_;
+    return *this;
+}
+
+FramePacerCreation &FramePacerCreation::set_vsync(bool vsync_) {
+    vsync = vsync_;
+    return *this;
+}
+
+//
+// FramePacer
+//
+void FramePacer::init(const FramePacerCreation &creation) {
+    period_ms = creation.period_ms;
+    margin_ms = creation.margin_ms;
+    vsync = creation.vsync;
+    deadline = frame_start = 0;
+    cost_mean_ms = cost_variance = 0.0;
+    reset_stats();
+}
+
+void FramePacer::set_period(f64 period_ms_) {
+    if (period_ms_ != period_ms) {
+        period_ms = period_ms_;
+        deadline = 0;
+    }
+}
+
+void FramePacer::reset_stats() {
+    stats.interval.reset();
+    stats.cpu.reset();
+    stats.gpu.reset();
+    stats.jitter_ms = stats.delay_ms = 0.0;
+    stats.missed_deadlines = 0;
+    jitter_sum_ms = 0.0;
+    last_interval_ms = 0.0;
+}
+
+void FramePacer::begin_frame() {
+    const i64 now = time_now();
+    if (period_ms > 0.0 && deadline) {
+        const f64 cost_ms = cost_mean_ms + 2.0 * sqrt(cost_variance);
+        const i64 start = deadline - ms_to_ns(cost_ms + margin_ms);
+        // A frame that can't make its deadline anyway starts right away.
+        if (start > now) {
+            time_sleep_until(start);
+        }
+    }
+
+    const i64 previous_start = frame_start;
+    frame_start = time_now();
+    stats.delay_ms += time_delta_ms(now, frame_start);
+
+    if (previous_start) {
+        const f64 interval_ms = time_delta_ms(previous_start, frame_start);
+        if (stats.interval.count) {
+            jitter_sum_ms += fabs(interval_ms - last_interval_ms);
+            stats.jitter_ms = jitter_sum_ms / stats.interval.count;
+        }
+        stats.interval.add(interval_ms);
+        last_interval_ms = interval_ms;
+    }
+}
+
+void FramePacer::end_frame(f64 fence_wait_ms, f64 gpu_ms) {
+    const i64 now = time_now();
+    f64 cpu_ms = time_delta_ms(frame_start, now) - fence_wait_ms;
+    cpu_ms = cpu_ms > 0.0 ? cpu_ms : 0.0;
+    stats.cpu.add(cpu_ms);
+    if (gpu_ms > 0.0) {
+        stats.gpu.add(gpu_ms);
+    }
+
+    const f64 cost_ms = cpu_ms + gpu_ms;
+    const f64 difference = cost_ms - cost_mean_ms;
+    cost_mean_ms += cost_smoothing * difference;
+    cost_variance = (1.0 - cost_smoothing) * (cost_variance + cost_smoothing * difference * difference);
+
+    if (period_ms <= 0.0) {
+        return;
+    }
+
+    const i64 period = ms_to_ns(period_ms);
+    if (!deadline) {
+        deadline = now + period;
+        return;
+    }
+
+    if (now > deadline) {
+        ++stats.missed_deadlines;
+    }
+    deadline += period;
+    if (vsync) {
+        // Waiting longer than the margin means vblank comes later than the deadline, and not waiting at
+        // all that it may come earlier.
+        deadline += ms_to_ns(vsync_correction * (fence_wait_ms - margin_ms));
+    }
+    if (deadline < now) {
+        // Fell more than a period behind, start over from this frame.
+        deadline = now + period;
+    }
+}
+
+} // namespace sren
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "platform.h"
+
+namespace sren {
+
+// 1 ms buckets, the last one also counts everything slower.
+static const u32 frame_histogram_buckets = 64;
+
+struct FrameHistogram {
+    u32 buckets[frame_histogram_buckets];
+    u32 count;
+    f64 sum_ms;
+    f64 max_ms;
+
+    void reset();
+    void add(f64 ms);
+    f64 mean() const;
+    // Upper bound of the bucket reaching the given fraction of the samples, e.g. 0.99. 0 without
+    // samples.
+    f64 percentile(f64 fraction) const;
+}; // struct FrameHistogram
+
+struct FramePacerCreation {
+    // Frame interval to pace to, 0 only measures frames.
+    f64 period_ms = 0.0;
+    // Time the frame is allowed to wait on the GPU, and slack kept before each deadline. Smaller values
+    // start frames later and lower input latency, larger ones absorb more frame time spikes.
+    f64 margin_ms = 1.0;
+    // Presentation blocks on vblank, so fence waits tell where vblank is. Without it the pacer is a
+    // plain frame limiter.
+    bool vsync = false;
+
+    FramePacerCreation &set_period(f64 period_ms);
+    FramePacerCreation &set_margin(f64 margin_ms);
+    FramePacerCreation &set_vsync(bool vsync);
+}; // struct FramePacerCreation
+
+struct FramePacerStats {
+    // Time between frame starts, the cadence frames are presented at.
+    FrameHistogram interval;
+    // CPU time per frame, without the pacing delay and the fence wait.
+    FrameHistogram cpu;
+    FrameHistogram gpu;
+
+    // Mean absolute change of the frame interval from one frame to the next.
+    f64 jitter_ms;
+    f64 delay_ms;
+    u32 missed_deadlines;
+}; // struct FramePacerStats
+
+// Delays the start of each frame, and with it input sampling, so the frame completes just before its
+// deadline instead of queueing behind the previous ones. Deadlines are spaced by the period. The start
+// is the deadline minus the expected frame cost (CPU plus GPU time, with twice their deviation) and the
+// margin. With vsync the deadlines are also shifted by how long the frame still waited on the GPU beyond
+// the margin, which locks them onto vblank.
+class FramePacer {
+  public:
+    void init(const FramePacerCreation &creation);
+
+    // The display refresh can change, e.g. when the window moves to another monitor.
+    void set_period(f64 period_ms);
+
+    // Sleeps until the frame should start. Call before sampling input.
+    void begin_frame();
+    // Call after present. gpu_ms is the GPU time of a recent frame, 0 when unknown.
+    void end_frame(f64 fence_wait_ms, f64 gpu_ms);
+
+    const FramePacerStats &get_stats() const { return stats; }
+    void reset_stats();
+
+  private:
+    f64 period_ms = 0.0;
+    f64 margin_ms = 1.0;
+    bool vsync = false;
+
+    // Timestamps, 0 until known.
+    i64 deadline = 0;
+    i64 frame_start = 0;
+
+    f64 last_interval_ms = 0.0;
+    // Moving average and variance of the frame cost.
+    f64 cost_mean_ms = 0.0;
+    f64 cost_variance = 0.0;
+
+    f64 jitter_sum_ms = 0.0;
+    FramePacerStats stats;
+}; // class FramePacer
+
+} // namespace sren
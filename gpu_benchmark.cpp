@@ -0,0 +1,466 @@
+#include "gpu_benchmark.h"
+
+#include "device.h"
+#include "file.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace sren {
+
+static const u32 bench_width = 800;
+static const u32 bench_height = 600;
+static const u32 bench_max_scenarios = 8;
+
+static const u32 bench_upload_size = 256 * 1024;
+static const u32 bench_uploads_per_frame = 16;
+static const u32 bench_churn_buffers = 64;
+static const u32 bench_churn_draws = 256;
+static const u32 bench_pipelines_per_frame = 4;
+// Push constant sizes (in u32s) cycled through. Only the first round of variants misses the pipeline
+// and pipeline layout caches, so the scenario measures warm-cache creation.
+static const u32 bench_push_constant_variants = 32;
+static const u32 bench_resize_draws = 64;
+
+static const size_t bench_json_capacity = 64 * 1024;
+
+struct BenchScenario {
+    const char *name;
+    // Draws, uploads, buffers, pipelines or resizes per frame.
+    u32 operations_per_frame;
+    u32 frames;
+    u64 first_frame;
+
+    // Whole frame, and the frame without the fence wait.
+    std::unique_ptr<f64[]> frame_ms;
+    std::unique_ptr<f64[]> cpu_ms;
+    std::unique_ptr<f64[]> gpu_ms;
+    u32 gpu_samples;
+    u64 next_gpu_frame;
+
+    // Host allocations made during the scenario, through every tracked allocator and through the
+    // Vulkan allocation callbacks alone.
+    u64 host_allocations;
+    u64 vulkan_allocations;
+    // Device resource allocations alive at the end.
+    u32 gpu_allocations;
+    u64 gpu_bytes;
+}; // struct BenchScenario
+
+class GpuBenchmark;
+// Records one frame of a scenario inside the swapchain pass.
+typedef void (*BenchFrameFunction)(GpuBenchmark &bench, VkCommandBuffer command_buffer, u32 frame);
+
+class GpuBenchmark {
+  public:
+    bool init(const GpuBenchmarkCreation &creation);
+    void shutdown();
+
+    bool run_scenario(const char *name, u32 operations_per_frame, BenchFrameFunction function);
+    bool write_results(const char *path);
+
+    static void draws_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer, u32 frame);
+    static void uploads_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer, u32 frame);
+    static void descriptor_churn_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer, u32 frame);
+    static void pipeline_creation_warm_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer,
+                                             u32 frame);
+    static void swapchain_recreation_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer,
+                                           u32 frame);
+
+    u32 frames = 0;
+    u32 draw_count = 0;
+
+  private:
+    PipelineHandle create_triangle_pipeline(u32 push_constant_size, const char *name);
+    void record_draws(VkCommandBuffer command_buffer, u32 count);
+    void collect_gpu_time(BenchScenario &scenario);
+    u64 count_host_allocations(u64 &vulkan_allocations) const;
+
+    Device device;
+    bool device_initialized = false;
+    MappedFile vertex_code;
+    MappedFile fragment_code;
+    PipelineHandle triangle_pipeline = invalid_pipeline;
+    f64 init_ms = 0.0;
+
+    BufferHandle upload_buffers[bench_uploads_per_frame];
+    std::unique_ptr<u8[]> upload_data;
+
+    BenchScenario scenarios[bench_max_scenarios];
+    u32 num_scenarios = 0;
+}; // class GpuBenchmark
+
+// Appends formatted text to a fixed buffer, truncating on overflow.
+struct JsonWriter {
+    char *data;
+    size_t size;
+    size_t capacity;
+
+    void append(const char *format, ...) {
+        if (size >= capacity) {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        const int written = vsnprintf(data + size, capacity - size, format, args);
+        va_end(args);
+        size = written > 0 ? std::min(size + (size_t)written, capacity - 1) : size;
+    }
+}; // struct JsonWriter
+
+// Nearest rank on sorted samples.
+static f64 percentile(const f64 *sorted, u32 count, f64 fraction) {
+    const u32 rank = (u32)ceil(fraction * count);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void write_timings(JsonWriter &json, const char *name, const f64 *samples, u32 count) {
+    if (count == 0) {
+        json.append("\"%s\": null", name);
+        return;
+    }
+    std::unique_ptr<f64[]> sorted(new f64[count]);
+    f64 sum = 0.0;
+    for (u32 i = 0; i < count; ++i) {
+        sorted[i] = samples[i];
+        sum += samples[i];
+    }
+    std::sort(sorted.get(), sorted.get() + count);
+    json.append("\"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, ", name,
+                sum / count, percentile(sorted.get(), count, 0.5), percentile(sorted.get(), count, 0.9),
+                percentile(sorted.get(), count, 0.99));
+    json.append("\"max\": %.4f}", sorted[count - 1]);
+}
+
+static f64 mean(const f64 *samples, u32 count) {
+    f64 sum = 0.0;
+    for (u32 i = 0; i < count; ++i) {
+        sum += samples[i];
+    }
+    return count ? sum / count : 0.0;
+}
+
+bool GpuBenchmark::init(const GpuBenchmarkCreation &creation) {
+    frames = creation.frames ? creation.frames : 1;
+    draw_count = creation.draw_count;
+    for (u32 i = 0; i < bench_uploads_per_frame; ++i) {
+        upload_buffers[i] = invalid_buffer;
+    }
+
+    const i64 init_start = time_now();
+    DeviceCreation device_creation;
+    device_creation.set_headless(bench_width, bench_height)
+        .set_gpu_index(creation.gpu_index)
+        .set_gpu_name(creation.gpu_name)
+        .set_num_threads(1);
+    if (!device.init(device_creation)) {
+        LOG_ERR("Failed to initialize device!");
+        return false;
+    }
+    device_initialized = true;
+    init_ms = time_elapsed_ms(init_start);
+
+    if (!vertex_code.map(SREN_SHADER_DIR "triangle.vert.spv") ||
+        !fragment_code.map(SREN_SHADER_DIR "triangle.frag.spv")) {
+        LOG_ERR("Failed to load triangle shaders from %s", SREN_SHADER_DIR);
+        return false;
+    }
+    triangle_pipeline = create_triangle_pipeline(sizeof(u32), "Bench Triangle");
+    if (triangle_pipeline.index == invalid_resource_handle) {
+        return false;
+    }
+
+    upload_data.reset(new u8[bench_upload_size]);
+    for (u32 i = 0; i < bench_upload_size; ++i) {
+        upload_data[i] = (u8)i;
+    }
+    BufferCreation buffer_creation;
+    buffer_creation
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable, bench_upload_size)
+        .set_name("Bench Upload");
+    for (u32 i = 0; i < bench_uploads_per_frame; ++i) {
+        upload_buffers[i] = device.create_buffer(buffer_creation);
+        if (upload_buffers[i].index == invalid_resource_handle) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void GpuBenchmark::shutdown() {
+    vertex_code.unmap();
+    fragment_code.unmap();
+    if (!device_initialized) {
+        return;
+    }
+    for (u32 i = 0; i < bench_uploads_per_frame; ++i) {
+        if (upload_buffers[i].index != invalid_resource_handle) {
+            device.destroy_buffer(upload_buffers[i]);
+        }
+    }
+    if (triangle_pipeline.index != invalid_resource_handle) {
+        device.destroy_pipeline(triangle_pipeline);
+    }
+    device.teardown();
+}
+
+PipelineHandle GpuBenchmark::create_triangle_pipeline(u32 push_constant_size, const char *name) {
+    PipelineCreation pipeline_creation;
+    pipeline_creation.shaders.reset()
+        .add_stage((const u32 *)vertex_code.data, (u32)vertex_code.size, VK_SHADER_STAGE_VERTEX_BIT)
+        .add_stage((const u32 *)fragment_code.data, (u32)fragment_code.size,
+                   VK_SHADER_STAGE_FRAGMENT_BIT)
+        .set_name(name);
+    pipeline_creation.render_pass = device.get_swapchain_output();
+    pipeline_creation.push_constant_size = push_constant_size;
+    pipeline_creation.name = name;
+    return device.create_pipeline(pipeline_creation);
+}
+
+void GpuBenchmark::record_draws(VkCommandBuffer command_buffer, u32 count) {
+    VkExtent2D extent = device.get_swapchain_extent();
+    VkViewport viewport = {0.0f, 0.0f, (f32)extent.width, (f32)extent.height, 0.0f, 1.0f};
+    VkRect2D scissor = {{0, 0}, extent};
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    Pipeline *pipeline = device.access_pipeline(triangle_pipeline);
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->vk_pipeline);
+    u32 grid_size = count ? (u32)ceil(sqrt((f64)count)) : 1;
+    vkCmdPushConstants(command_buffer, pipeline->vk_pipeline_layout, VK_SHADER_STAGE_ALL, 0, sizeof(u32),
+                       &grid_size);
+    for (u32 i = 0; i < count; ++i) {
+        vkCmdDraw(command_buffer, 3, 1, 0, i);
+    }
+}
+
+void GpuBenchmark::collect_gpu_time(BenchScenario &scenario) {
+    u32 count;
+    u64 frame_index;
+    const GpuTimestamp *timestamps = device.get_gpu_timestamps(count, frame_index);
+    if (count == 0 || frame_index < scenario.next_gpu_frame ||
+        frame_index >= scenario.first_frame + scenario.frames) {
+        return;
+    }
+    f64 gpu_ms = 0.0;
+    for (u32 i = 0; i < count; ++i) {
+        if (timestamps[i].depth == 0) {
+            gpu_ms += timestamps[i].elapsed_ms;
+        }
+    }
+    scenario.gpu_ms[scenario.gpu_samples++] = gpu_ms;
+    scenario.next_gpu_frame = frame_index + 1;
+}
+
+u64 GpuBenchmark::count_host_allocations(u64 &vulkan_allocations) const {
+    MemoryStats stats[max_memory_stats];
+    const u32 num_stats = device.get_memory_stats(stats, max_memory_stats);
+    u64 allocations = 0;
+    vulkan_allocations = 0;
+    for (u32 i = 0; i < num_stats; ++i) {
+        allocations += stats[i].allocations;
+        if (!strcmp(stats[i].name, "Vulkan")) {
+            vulkan_allocations = stats[i].allocations;
+        }
+    }
+    return allocations;
+}
+
+bool GpuBenchmark::run_scenario(const char *name, u32 operations_per_frame,
+                                BenchFrameFunction function) {
+    if (num_scenarios == bench_max_scenarios) {
+        LOG_ERR("Too many benchmark scenarios!");
+        return false;
+    }
+    BenchScenario &scenario = scenarios[num_scenarios++];
+    scenario.name = name;
+    scenario.operations_per_frame = operations_per_frame;
+    scenario.frames = 0;
+    scenario.first_frame = scenario.next_gpu_frame = device.absolute_frame;
+    scenario.frame_ms.reset(new f64[frames]);
+    scenario.cpu_ms.reset(new f64[frames]);
+    scenario.gpu_ms.reset(new f64[frames]);
+    scenario.gpu_samples = 0;
+
+    u64 vulkan_start;
+    const u64 host_start = count_host_allocations(vulkan_start);
+    const f32 clear_color[4] = {0.1f, 0.1f, 0.12f, 1.0f};
+
+    // GPU timings are resolved max_frames frames late, the last frames run empty to collect them.
+    for (u32 frame = 0; frame < frames + max_frames; ++frame) {
+        const bool measured = frame < frames;
+        const i64 frame_start = time_now();
+        if (!device.new_frame()) {
+            LOG_ERR("Benchmark %s failed to start frame %u.", name, frame);
+            return false;
+        }
+        collect_gpu_time(scenario);
+
+        VkCommandBuffer command_buffer = device.get_command_buffer();
+        device.push_gpu_marker(command_buffer, "Frame");
+        device.begin_swapchain_pass(command_buffer, clear_color);
+        if (measured) {
+            function(*this, command_buffer, frame);
+        }
+        device.end_swapchain_pass(command_buffer);
+        device.pop_gpu_marker(command_buffer);
+        device.present();
+
+        if (measured) {
+            const f64 frame_ms = time_elapsed_ms(frame_start);
+            scenario.frame_ms[frame] = frame_ms;
+            scenario.cpu_ms[frame] = frame_ms - device.fence_wait_ms;
+            scenario.frames = frame + 1;
+        }
+        if (frame + 1 == frames) {
+            u64 vulkan_end;
+            scenario.host_allocations = count_host_allocations(vulkan_end) - host_start;
+            scenario.vulkan_allocations = vulkan_end - vulkan_start;
+        }
+    }
+
+    const GpuMemoryBudget &budget = device.get_memory_budget();
+    scenario.gpu_allocations = 0;
+    scenario.gpu_bytes = 0;
+    for (u32 i = 0; i < GpuMemoryCategory::Count; ++i) {
+        scenario.gpu_allocations += budget.category_allocations[i];
+        scenario.gpu_bytes += budget.category_bytes[i];
+    }
+
+    LOG_INFO("Benchmark %s: %.3f ms per frame, %.3f ms CPU, %.3f ms GPU", name,
+             mean(scenario.frame_ms.get(), scenario.frames),
+             mean(scenario.cpu_ms.get(), scenario.frames),
+             mean(scenario.gpu_ms.get(), scenario.gpu_samples));
+    return true;
+}
+
+void GpuBenchmark::draws_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer, u32) {
+    bench.record_draws(command_buffer, bench.draw_count);
+}
+
+void GpuBenchmark::uploads_frame(GpuBenchmark &bench, VkCommandBuffer, u32) {
+    // Submitted with the frame by present().
+    for (u32 i = 0; i < bench_uploads_per_frame; ++i) {
+        bench.device.upload_buffer(bench.upload_buffers[i], bench.upload_data.get(), bench_upload_size);
+    }
+}
+
+void GpuBenchmark::descriptor_churn_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer, u32) {
+    Device &device = bench.device;
+
+    // Short-lived storage buffers, each one writes and later frees a bindless descriptor slot.
+    BufferCreation buffer_creation;
+    buffer_creation.set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Stream, 256)
+        .set_name("Bench Churn");
+    for (u32 i = 0; i < bench_churn_buffers; ++i) {
+        BufferHandle buffer = device.create_buffer(buffer_creation);
+        if (buffer.index != invalid_resource_handle) {
+            device.destroy_buffer(buffer);
+        }
+    }
+
+    // Fresh dynamic offsets for every draw.
+    bench.record_draws(command_buffer, 0);
+    for (u32 i = 0; i < bench_churn_draws; ++i) {
+        u32 uniform_offset = 0;
+        u32 storage_offset = 0;
+        f32 *constants = (f32 *)device.dynamic_allocate_uniform(sizeof(f32) * 4, uniform_offset);
+        if (!constants || !device.dynamic_allocate_storage(sizeof(f32) * 4, storage_offset)) {
+            break;
+        }
+        constants[0] = constants[1] = constants[2] = constants[3] = (f32)i;
+        device.bind_dynamic_buffers(command_buffer, bench.triangle_pipeline, uniform_offset,
+                                    storage_offset);
+        vkCmdDraw(command_buffer, 3, 1, 0, i);
+    }
+}
+
+void GpuBenchmark::pipeline_creation_warm_frame(GpuBenchmark &bench, VkCommandBuffer, u32 frame) {
+    for (u32 i = 0; i < bench_pipelines_per_frame; ++i) {
+        const u32 variant = (frame * bench_pipelines_per_frame + i) % bench_push_constant_variants;
+        PipelineHandle pipeline =
+            bench.create_triangle_pipeline(sizeof(u32) * (variant + 1), "Bench Pipeline");
+        if (pipeline.index != invalid_resource_handle) {
+            bench.device.destroy_pipeline(pipeline);
+        }
+    }
+}
+
+void GpuBenchmark::swapchain_recreation_frame(GpuBenchmark &bench, VkCommandBuffer command_buffer,
+                                              u32 frame) {
+    // Applied by the next new_frame, alternating between two sizes.
+    const u32 shrink = (frame & 1) ? 64 : 0;
+    bench.device.resize(bench_width - shrink, bench_height - shrink);
+    bench.record_draws(command_buffer, bench_resize_draws);
+}
+
+bool GpuBenchmark::write_results(const char *path) {
+    std::unique_ptr<char[]> buffer(new char[bench_json_capacity]);
+    JsonWriter json = {buffer.get(), 0, bench_json_capacity};
+
+    json.append("{\n  \"gpu\": \"%s\",\n  \"frames\": %u,\n  \"draws\": %u,\n  \"init_ms\": %.3f,\n",
+                device.get_gpu_name(), frames, draw_count, init_ms);
+    json.append("  \"scenarios\": [\n");
+    for (u32 i = 0; i < num_scenarios; ++i) {
+        const BenchScenario &scenario = scenarios[i];
+        const f64 cpu_mean_ms = mean(scenario.cpu_ms.get(), scenario.frames);
+        const f64 operation_us =
+            scenario.operations_per_frame ? cpu_mean_ms * 1000.0 / scenario.operations_per_frame : 0.0;
+        json.append("    {\n      \"name\": \"%s\",\n      \"frames\": %u,\n", scenario.name,
+                    scenario.frames);
+        json.append("      \"operations_per_frame\": %u,\n      \"cpu_us_per_operation\": %.3f,\n",
+                    scenario.operations_per_frame, operation_us);
+        json.append("      ");
+        write_timings(json, "frame_ms", scenario.frame_ms.get(), scenario.frames);
+        json.append(",\n      ");
+        write_timings(json, "cpu_ms", scenario.cpu_ms.get(), scenario.frames);
+        json.append(",\n      ");
+        write_timings(json, "gpu_ms", scenario.gpu_ms.get(), scenario.gpu_samples);
+        json.append(",\n      \"host_allocations\": %llu,\n      \"vulkan_allocations\": %llu,\n",
+                    (unsigned long long)scenario.host_allocations,
+                    (unsigned long long)scenario.vulkan_allocations);
+        json.append("      \"gpu_allocations\": %u,\n      \"gpu_bytes\": %llu\n    }%s\n",
+                    scenario.gpu_allocations, (unsigned long long)scenario.gpu_bytes,
+                    i + 1 < num_scenarios ? "," : "");
+    }
+    json.append("  ]\n}\n");
+
+    if (!path) {
+        fwrite(json.data, 1, json.size, stdout);
+        return true;
+    }
+    if (!file_write_atomic(path, json.data, json.size)) {
+        LOG_ERR("Failed to write benchmark results to %s", path);
+        return false;
+    }
+    LOG_INFO("Benchmark results written to %s", path);
+    return true;
+}
+
+bool run_gpu_benchmark(const GpuBenchmarkCreation &creation) {
+    LogService::init(creation.log);
+
+    GpuBenchmark bench;
+    bool success = bench.init(creation);
+    success = success && bench.run_scenario("draws", bench.draw_count, GpuBenchmark::draws_frame);
+    success = success &&
+              bench.run_scenario("uploads", bench_uploads_per_frame, GpuBenchmark::uploads_frame);
+    success = success && bench.run_scenario("descriptor_churn", bench_churn_buffers + bench_churn_draws,
+                                            GpuBenchmark::descriptor_churn_frame);
+    success = success && bench.run_scenario("pipeline_creation_warm", bench_pipelines_per_frame,
+                                            GpuBenchmark::pipeline_creation_warm_frame);
+    success = success && bench.run_scenario("swapchain_recreation", 1,
+                                            GpuBenchmark::swapchain_recreation_frame);
+    success = success && bench.write_results(creation.output_path);
+    bench.shutdown();
+
+    LogService::shutdown();
+    return success;
+}
+
+} // namespace sren
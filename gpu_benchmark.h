@@ -0,0 +1,28 @@
+#pragma once
+
+#include "log.h"
+#include "platform.h"
+
+namespace sren {
+
+struct GpuBenchmarkCreation {
+    // Explicit GPU selection, see DeviceCreation. Software rasterizers like lavapipe work.
+    i32 gpu_index = -1;
+    const char *gpu_name = nullptr;
+
+    // Frames per scenario.
+    u32 frames = 300;
+    // Draws per frame of the draw submission scenario.
+    u32 draw_count = 1024;
+    // JSON results are written here, to stdout when null.
+    const char *output_path = nullptr;
+
+    LogConfig log;
+}; // struct GpuBenchmarkCreation
+
+// Runs rendering scenarios on a headless device and reports CPU and GPU frame times, percentiles and
+// allocation counts as JSON: draw submission, buffer uploads, descriptor churn, pipeline creation with
+// warm caches and swapchain recreation. Returns false when the device or a scenario fails.
+bool run_gpu_benchmark(const GpuBenchmarkCreation &creation);
+
+} // namespace sren
@@ -0,0 +1,65 @@
+#include "gpu_profiler.h"
+
+#include "log.h"
+
+namespace sren {
+
+void GpuTimestampManager::reset(u32 frame) {
+    counts[frame] = 0;
+    current_parent[frame] = invalid_gpu_timestamp;
+    current_depth[frame] = 0;
+    overflow_depth[frame] = 0;
+}
+
+u32 GpuTimestampManager::push(u32 frame, u64 absolute_frame, const char *name) {
+    if (counts[frame] >= max_gpu_timestamps_per_frame) {
+        overflow_depth[frame]++;
+        return u32_max;
+    }
+
+    u16 index = counts[frame]++;
+    GpuTimestamp &timestamp = timestamps[frame][index];
+    timestamp.start_query = first_query(frame) + index * 2;
+    timestamp.end_query = timestamp.start_query + 1;
+    timestamp.elapsed_ms = 0.0;
+    timestamp.parent_index = current_parent[frame];
+    timestamp.depth = current_depth[frame]++;
+    timestamp.name = name;
+    timestamp.frame_index = absolute_frame;
+
+    current_parent[frame] = index;
+    return timestamp.start_query;
+}
+
+u32 GpuTimestampManager::pop(u32 frame) {
+    if (overflow_depth[frame] > 0) {
+        overflow_depth[frame]--;
+        return u32_max;
+    }
+    if (current_parent[frame] == invalid_gpu_timestamp) {
+        LOG_ERR("Unbalanced GPU timestamp pop.");
+        return u32_max;
+    }
+
+    GpuTimestamp &timestamp = timestamps[frame][current_parent[frame]];
+    current_parent[frame] = timestamp.parent_index;
+    current_depth[frame]--;
+    return timestamp.end_query;
+}
+
+void GpuTimestampManager::resolve(u32 frame, const u64 *ticks, u64 valid_mask, f64 ms_per_tick) {
+    const u32 base = first_query(frame);
+    for (u32 i = 0; i < counts[frame]; ++i) {
+        GpuTimestamp &timestamp = timestamps[frame][i];
+        u64 start = ticks[timestamp.start_query - base] & valid_mask;
+        u64 end = ticks[timestamp.end_query - base] & valid_mask;
+        // Wrapped counters are masked back into range.
+        timestamp.elapsed_ms = (f64)((end - start) & valid_mask) * ms_per_tick;
+
+        resolved[i] = timestamp;
+    }
+    resolved_count = counts[frame];
+    resolved_frame = resolved_count ? timestamps[frame][0].frame_index : 0;
+}
+
+} // namespace sren
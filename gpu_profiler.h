@@ -0,0 +1,64 @@
+#pragma once
+
+#include "gpu_resources.h"
+#include "platform.h"
+
+namespace sren {
+
+// Maximum number of named GPU scopes per frame. Each scope uses two timestamp queries.
+static const u16 max_gpu_timestamps_per_frame = 32;
+static const u16 invalid_gpu_timestamp = u16_max;
+
+// A named GPU scope. Scopes nest: parent_index refers to the enclosing scope of the same frame and
+// depth is 0 for top level scopes, so the scopes of a frame form a tree in push order.
+struct GpuTimestamp {
+    u32 start_query;
+    u32 end_query;
+
+    f64 elapsed_ms;
+
+    u16 parent_index;
+    u16 depth;
+
+    // Not copied, must outlive the frame (string literals).
+    const char *name;
+    u64 frame_index;
+}; // struct GpuTimestamp
+
+// Bookkeeping for the per-frame timestamp queries. Every frame in flight owns a contiguous range of
+// max_gpu_timestamps_per_frame * 2 queries, which is read back once that frame's fence has signalled,
+// max_frames frames later, so resolving never stalls.
+class GpuTimestampManager {
+  public:
+    void reset(u32 frame);
+
+    // Returns the query to write the start timestamp to, or u32_max when the frame is full.
+    u32 push(u32 frame, u64 absolute_frame, const char *name);
+    // Returns the query to write the end timestamp to, or u32_max when no scope is open.
+    u32 pop(u32 frame);
+
+    u32 first_query(u32 frame) const { return frame * max_gpu_timestamps_per_frame * 2; }
+    // Number of queries written in the frame, starting at first_query().
+    u32 query_count(u32 frame) const { return counts[frame] * 2; }
+    bool has_open_scopes(u32 frame) const { return current_parent[frame] != invalid_gpu_timestamp; }
+
+    // Converts the raw ticks of the frame's queries into milliseconds and publishes them as the
+    // latest resolved tree.
+    void resolve(u32 frame, const u64 *ticks, u64 valid_mask, f64 ms_per_tick);
+
+    const GpuTimestamp *resolved_timestamps() const { return resolved; }
+    u32 resolved_count = 0;
+    u64 resolved_frame = 0;
+
+  private:
+    GpuTimestamp timestamps[max_frames][max_gpu_timestamps_per_frame];
+    u16 counts[max_frames] = {};
+    u16 current_parent[max_frames] = {};
+    u16 current_depth[max_frames] = {};
+    // Pushes that didn't fit in the frame, so their pops can be ignored.
+    u16 overflow_depth[max_frames] = {};
+
+    GpuTimestamp resolved[max_gpu_timestamps_per_frame];
+}; // class GpuTimestampManager
+
+} // namespace sren
@@ -1,5 +1,7 @@
 #include "gpu_resources.h"
 
+#include "hash_cache.h"
+
 namespace sren {
 
 // RenderPassOutput
@@ -34,4 +36,328 @@ RenderPassOutput &RenderPassOutput::set_operations(RenderPassOperation::Enum col
     return *this;
 }
 
-} // namespace sren
\ No newline at end of file
+// BufferCreation
+BufferCreation &BufferCreation::reset() {
+    type_flags = 0;
+    usage = ResourceUsageType::Immutable;
+    size = 0;
+    initial_data = nullptr;
+    name = nullptr;
+    return *this;
+}
+
+BufferCreation &BufferCreation::set(VkBufferUsageFlags flags, ResourceUsageType::Enum usage_,
+                                    u32 size_) {
+    type_flags = flags;
+    usage = usage_;
+    size = size_;
+    return *this;
+}
+
+BufferCreation &BufferCreation::set_data(void *data) {
+    initial_data = data;
+    return *this;
+}
+
+BufferCreation &BufferCreation::set_name(const char *name_) {
+    name = name_;
+    return *this;
+}
+
+// TextureCreation
+TextureCreation &TextureCreation::set_size(u16 width_, u16 height_, u16 depth_) {
+    width = width_;
+    height = height_;
+    depth = depth_;
+    return *this;
+}
+
+TextureCreation &TextureCreation::set_flags(u8 mipmaps_, u8 flags_) {
+    mipmaps = mipmaps_;
+    flags = flags_;
+    return *this;
+}
+
+TextureCreation &TextureCreation::set_format_type(VkFormat format_, TextureType::Enum type_) {
+    format = format_;
+    type = type_;
+    return *this;
+}
+
+TextureCreation &TextureCreation::set_alias(MemoryHandle alias_) {
+    alias = alias_;
+    return *this;
+}
+
+TextureCreation &TextureCreation::set_name(const char *name_) {
+    name = name_;
+    return *this;
+}
+
+// SamplerCreation
+SamplerCreation &SamplerCreation::set_min_mag_mip(VkFilter min, VkFilter mag, VkSamplerMipmapMode mip) {
+    min_filter = min;
+    mag_filter = mag;
+    mip_filter = mip;
+    return *this;
+}
+
+SamplerCreation &SamplerCreation::set_address_mode_u(VkSamplerAddressMode u) {
+    address_mode_u = u;
+    return *this;
+}
+
+SamplerCreation &SamplerCreation::set_address_mode_uv(VkSamplerAddressMode u, VkSamplerAddressMode v) {
+    address_mode_u = u;
+    address_mode_v = v;
+    return *this;
+}
+
+SamplerCreation &SamplerCreation::set_address_mode_uvw(VkSamplerAddressMode u, VkSamplerAddressMode v,
+                                                       VkSamplerAddressMode w) {
+    address_mode_u = u;
+    address_mode_v = v;
+    address_mode_w = w;
+    return *this;
+}
+
+SamplerCreation &SamplerCreation::set_name(const char *name_) {
+    name = name_;
+    return *this;
+}
+
+// DescriptorSetLayoutCreation
+DescriptorSetLayoutCreation &DescriptorSetLayoutCreation::reset() {
+    num_bindings = 0;
+    name = nullptr;
+    return *this;
+}
+
+DescriptorSetLayoutCreation &DescriptorSetLayoutCreation::add_binding(const DescriptorBinding &binding) {
+    if (num_bindings < max_descriptors_per_set) {
+        bindings[num_bindings++] = binding;
+    }
+    return *this;
+}
+
+DescriptorSetLayoutCreation &DescriptorSetLayoutCreation::set_name(const char *name_) {
+    name = name_;
+    return *this;
+}
+
+// ShaderStateCreation
+ShaderStateCreation &ShaderStateCreation::reset() {
+    stages_count = 0;
+    name = nullptr;
+    return *this;
+}
+
+ShaderStateCreation &ShaderStateCreation::add_stage(const u32 *code, u32 code_size,
+                                                    VkShaderStageFlagBits type) {
+    if (stages_count >= max_shader_stages) {
+        return *this;
+    }
+    stages[stages_count].code = code;
+    stages[stages_count].code_size = code_size;
+    stages[stages_count].type = type;
+    ++stages_count;
+    return *this;
+}
+
+ShaderStateCreation &ShaderStateCreation::set_name(const char *name_) {
+    name = name_;
+    return *this;
+}
+
+// VertexInputCreation
+VertexInputCreation &VertexInputCreation::reset() {
+    num_vertex_streams = num_vertex_attributes = 0;
+    return *this;
+}
+
+VertexInputCreation &VertexInputCreation::add_vertex_stream(const VertexStream &stream) {
+    if (num_vertex_streams < max_vertex_streams) {
+        vertex_streams[num_vertex_streams++] = stream;
+    }
+    return *this;
+}
+
+VertexInputCreation &VertexInputCreation::add_vertex_attribute(const VertexAttribute &attribute) {
+    if (num_vertex_attributes < max_vertex_attributes) {
+        vertex_attributes[num_vertex_attributes++] = attribute;
+    }
+    return *this;
+}
+
+// PipelineCreation
+PipelineCreation &PipelineCreation::add_descriptor_set_layout(DescriptorSetLayoutHandle layout) {
+    if (num_descriptor_set_layouts < max_material_sets) {
+        descriptor_set_layouts[num_descriptor_set_layouts++] = layout;
+    }
+    return *this;
+}
+
+// BindlessSlotAllocator
+void BindlessSlotAllocator::init(u32 count) {
+    capacity = count;
+    free_slots.resize(count);
+    // Popped from the back, so lower slots are handed out first.
+    for (u32 i = 0; i < count; ++i) {
+        free_slots[i] = count - 1 - i;
+    }
+}
+
+void BindlessSlotAllocator::shutdown() {
+    free_slots.clear();
+    capacity = 0;
+}
+
+u32 BindlessSlotAllocator::obtain() {
+    if (free_slots.empty()) {
+        return invalid_bindless_index;
+    }
+    u32 slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+}
+
+void BindlessSlotAllocator::release(u32 slot) {
+    if (slot != invalid_bindless_index) {
+        free_slots.push_back(slot);
+    }
+}
+
+// Cache keys
+u64 hash_key(const SamplerCreation &key) {
+    u64 hash = hash_value(key.min_filter);
+    hash = hash_value(key.mag_filter, hash);
+    hash = hash_value(key.mip_filter, hash);
+    hash = hash_value(key.address_mode_u, hash);
+    hash = hash_value(key.address_mode_v, hash);
+    return hash_value(key.address_mode_w, hash);
+}
+
+bool keys_equal(const SamplerCreation &a, const SamplerCreation &b) {
+    return a.min_filter == b.min_filter && a.mag_filter == b.mag_filter &&
+           a.mip_filter == b.mip_filter && a.address_mode_u == b.address_mode_u &&
+           a.address_mode_v == b.address_mode_v && a.address_mode_w == b.address_mode_w;
+}
+
+u64 hash_key(const DescriptorSetLayoutCreation &key) {
+    u64 hash = hash_value(key.num_bindings);
+    for (u32 i = 0; i < key.num_bindings; ++i) {
+        const DescriptorBinding &binding = key.bindings[i];
+        hash = hash_value(binding.type, hash);
+        hash = hash_value(binding.index, hash);
+        hash = hash_value(binding.count, hash);
+        hash = hash_value(binding.stages, hash);
+    }
+    return hash;
+}
+
+bool keys_equal(const DescriptorSetLayoutCreation &a, const DescriptorSetLayoutCreation &b) {
+    if (a.num_bindings != b.num_bindings) {
+        return false;
+    }
+    for (u32 i = 0; i < a.num_bindings; ++i) {
+        const DescriptorBinding &binding_a = a.bindings[i];
+        const DescriptorBinding &binding_b = b.bindings[i];
+        if (binding_a.type != binding_b.type || binding_a.index != binding_b.index ||
+            binding_a.count != binding_b.count || binding_a.stages != binding_b.stages) {
+            return false;
+        }
+    }
+    return true;
+}
+
+u64 hash_key(const PipelineLayoutKey &key) {
+    u64 hash = hash_bytes(key.set_layouts, sizeof(VkDescriptorSetLayout) * key.num_set_layouts);
+    hash = hash_value(key.num_set_layouts, hash);
+    return hash_value(key.push_constant_size, hash);
+}
+
+bool keys_equal(const PipelineLayoutKey &a, const PipelineLayoutKey &b) {
+    if (a.num_set_layouts != b.num_set_layouts || a.push_constant_size != b.push_constant_size) {
+        return false;
+    }
+    for (u32 i = 0; i < a.num_set_layouts; ++i) {
+        if (a.set_layouts[i] != b.set_layouts[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+u64 hash_key(const RenderPassKey &key) {
+    const RenderPassOutput &output = key.output;
+    u64 hash = hash_bytes(output.color_formats, sizeof(VkFormat) * output.num_color_formats);
+    hash = hash_value(output.num_color_formats, hash);
+    hash = hash_value(output.depth_stencil_format, hash);
+    hash = hash_value(output.color_operation, hash);
+    hash = hash_value(output.depth_operation, hash);
+    hash = hash_value(output.stencil_operation, hash);
+    return hash_value(key.color_final_layout, hash);
+}
+
+bool keys_equal(const RenderPassKey &a, const RenderPassKey &b) {
+    const RenderPassOutput &output_a = a.output;
+    const RenderPassOutput &output_b = b.output;
+    if (output_a.num_color_formats != output_b.num_color_formats ||
+        output_a.depth_stencil_format != output_b.depth_stencil_format ||
+        output_a.color_operation != output_b.color_operation ||
+        output_a.depth_operation != output_b.depth_operation ||
+        output_a.stencil_operation != output_b.stencil_operation ||
+        a.color_final_layout != b.color_final_layout) {
+        return false;
+    }
+    for (u32 i = 0; i < output_a.num_color_formats; ++i) {
+        if (output_a.color_formats[i] != output_b.color_formats[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+u64 hash_key(const FramebufferKey &key) {
+    u64 hash = hash_value(key.render_pass);
+    hash = hash_bytes(key.attachments, sizeof(VkImageView) * key.num_attachments, hash);
+    hash = hash_value(key.num_attachments, hash);
+    hash = hash_value(key.width, hash);
+    return hash_value(key.height, hash);
+}
+
+bool keys_equal(const FramebufferKey &a, const FramebufferKey &b) {
+    if (a.render_pass != b.render_pass || a.num_attachments != b.num_attachments ||
+        a.width != b.width || a.height != b.height) {
+        return false;
+    }
+    for (u32 i = 0; i < a.num_attachments; ++i) {
+        if (a.attachments[i] != b.attachments[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Format helpers
+bool texture_format_has_depth(VkFormat format) {
+    return (format >= VK_FORMAT_D16_UNORM && format < VK_FORMAT_S8_UINT) ||
+           (format >= VK_FORMAT_D16_UNORM_S8_UINT && format <= VK_FORMAT_D32_SFLOAT_S8_UINT);
+}
+
+bool texture_format_has_stencil(VkFormat format) {
+    return format >= VK_FORMAT_S8_UINT && format <= VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+u32 texture_format_block_height(VkFormat format) {
+    return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK ? 4 : 1;
+}
+
+static const char *gpu_memory_category_names[GpuMemoryCategory::Count] = {"Buffer", "Texture",
+                                                                          "RenderTarget", "MemoryBlock"};
+
+const char *gpu_memory_category_name(GpuMemoryCategory::Enum category) {
+    return category < GpuMemoryCategory::Count ? gpu_memory_category_names[category] : "Unknown";
+}
+
+} // namespace sren
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "platform.h"
+#include "resource_pool.h"
 
+#include "external/vk_mem_alloc.h"
+#include <vector>
 #include <vulkan/vulkan_core.h>
 
 namespace sren {
@@ -23,14 +26,100 @@ static const u32 max_resource_deletions = 64;
 static const u32 max_swapchain_images = 3;
 static const u32 max_frames = 2;
 
+// Bindless descriptor set: set 1 of every pipeline layout when descriptor indexing is supported. Array
+// sizes are further clamped to the device's update-after-bind limits.
+static const u32 bindless_set_index = 1;
+static const u32 bindless_texture_binding = 0;
+static const u32 bindless_storage_buffer_binding = 1;
+static const u32 bindless_sampler_binding = 2;
+static const u32 invalid_bindless_index = u32_max;
+// Sets created from PipelineCreation::descriptor_set_layouts start here, after the dynamic and bindless
+// sets.
+static const u32 first_material_set_index = 2;
+static const u32 max_material_sets = max_descriptor_set_layouts - first_material_set_index;
+
+// Per-frame slice of the dynamic buffer, see Device::dynamic_allocate_uniform.
+static const u32 dynamic_buffer_frame_size = 4 * 1024 * 1024;
+// Range of the dynamic uniform and storage descriptors, so the largest single dynamic allocation.
+static const u32 max_dynamic_allocation_size = 64 * 1024;
+
+// Resource pool capacities.
+static const u32 max_buffers = 16384;
+static const u32 max_textures = 8192;
+static const u32 max_samplers = 256;
+static const u32 max_pipelines = 512;
+static const u32 max_descriptor_set_layout_resources = 256;
+static const u32 max_memory_blocks = 64;
+// Cache capacities.
+static const u32 max_render_passes = 64;
+static const u32 max_framebuffers = 256;
+
+// Handles
+struct BufferHandle {
+    ResourceHandle index;
+}; // struct BufferHandle
+
+struct TextureHandle {
+    ResourceHandle index;
+}; // struct TextureHandle
+
+struct SamplerHandle {
+    ResourceHandle index;
+}; // struct SamplerHandle
+
+struct PipelineHandle {
+    ResourceHandle index;
+}; // struct PipelineHandle
+
+struct DescriptorSetLayoutHandle {
+    ResourceHandle index;
+}; // struct DescriptorSetLayoutHandle
+
+struct MemoryHandle {
+    ResourceHandle index;
+}; // struct MemoryHandle
+
+static const BufferHandle invalid_buffer{invalid_resource_handle};
+static const TextureHandle invalid_texture{invalid_resource_handle};
+static const SamplerHandle invalid_sampler{invalid_resource_handle};
+static const PipelineHandle invalid_pipeline{invalid_resource_handle};
+static const DescriptorSetLayoutHandle invalid_descriptor_set_layout{invalid_resource_handle};
+static const MemoryHandle invalid_memory{invalid_resource_handle};
+
 namespace RenderPassOperation {
 enum Enum { DontCare, Load, Clear, Count }; // enum Enum
 } // namespace RenderPassOperation
 
+namespace ResourceUsageType {
+// Immutable: device local, written once through uploads.
+// Dynamic: host visible and persistently mapped, rewritten by the CPU.
+// Stream: like Dynamic, rewritten every frame.
+enum Enum { Immutable, Dynamic, Stream, Count }; // enum Enum
+} // namespace ResourceUsageType
+
+namespace TextureType {
+enum Enum { Texture1D, Texture2D, Texture3D, TextureCube, Count }; // enum Enum
+} // namespace TextureType
+
+namespace TextureFlags {
+enum Enum { Default, RenderTarget, Compute, Count }; // enum Enum
+enum Mask { Default_mask = 1 << 0, RenderTarget_mask = 1 << 1, Compute_mask = 1 << 2 }; // enum Mask
+} // namespace TextureFlags
+
+namespace ResourceDeletionType {
+enum Enum { Buffer, Texture, Sampler, Pipeline, DescriptorSetLayout, Memory, Count }; // enum Enum
+} // namespace ResourceDeletionType
+
 namespace PresentMode {
 enum Enum { Immediate, VSync, VSyncFast, VSyncRelaxed, Count }; // enum Enum
 } // namespace PresentMode
 
+// Device memory of the resources created through the device. Textures placed in a memory block only
+// count towards MemoryBlock.
+namespace GpuMemoryCategory {
+enum Enum { Buffer, Texture, RenderTarget, MemoryBlock, Count }; // enum Enum
+} // namespace GpuMemoryCategory
+
 class RenderPassOutput {
   public:
     VkFormat color_formats[max_image_outputs];
@@ -49,4 +138,317 @@ class RenderPassOutput {
 
 }; // struct RenderPassOutput
 
+// Creation descriptors
+struct BufferCreation {
+    VkBufferUsageFlags type_flags = 0;
+    ResourceUsageType::Enum usage = ResourceUsageType::Immutable;
+    u32 size = 0;
+    // Copied into the buffer at creation, through the transfer queue for Immutable buffers.
+    void *initial_data = nullptr;
+
+    const char *name = nullptr;
+
+    BufferCreation &reset();
+    BufferCreation &set(VkBufferUsageFlags flags, ResourceUsageType::Enum usage, u32 size);
+    BufferCreation &set_data(void *data);
+    BufferCreation &set_name(const char *name);
+}; // struct BufferCreation
+
+struct TextureCreation {
+    u16 width = 1;
+    u16 height = 1;
+    u16 depth = 1;
+    u8 mipmaps = 1;
+    u8 flags = 0; // TextureFlags::Mask
+
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    TextureType::Enum type = TextureType::Texture2D;
+
+    // Placed at the start of this memory block instead of getting its own allocation, so textures
+    // used at different times can share memory. The block must outlive the texture.
+    MemoryHandle alias = invalid_memory;
+
+    const char *name = nullptr;
+
+    TextureCreation &set_size(u16 width, u16 height, u16 depth);
+    TextureCreation &set_flags(u8 mipmaps, u8 flags);
+    TextureCreation &set_format_type(VkFormat format, TextureType::Enum type);
+    TextureCreation &set_alias(MemoryHandle alias);
+    TextureCreation &set_name(const char *name);
+}; // struct TextureCreation
+
+struct SamplerCreation {
+    VkFilter min_filter = VK_FILTER_NEAREST;
+    VkFilter mag_filter = VK_FILTER_NEAREST;
+    VkSamplerMipmapMode mip_filter = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+
+    VkSamplerAddressMode address_mode_u = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode address_mode_v = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode address_mode_w = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+    const char *name = nullptr;
+
+    SamplerCreation &set_min_mag_mip(VkFilter min, VkFilter mag, VkSamplerMipmapMode mip);
+    SamplerCreation &set_address_mode_u(VkSamplerAddressMode u);
+    SamplerCreation &set_address_mode_uv(VkSamplerAddressMode u, VkSamplerAddressMode v);
+    SamplerCreation &set_address_mode_uvw(VkSamplerAddressMode u, VkSamplerAddressMode v,
+                                          VkSamplerAddressMode w);
+    SamplerCreation &set_name(const char *name);
+}; // struct SamplerCreation
+
+struct DescriptorBinding {
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    u32 index = 0;
+    u32 count = 1;
+    VkShaderStageFlags stages = VK_SHADER_STAGE_ALL;
+}; // struct DescriptorBinding
+
+struct DescriptorSetLayoutCreation {
+    DescriptorBinding bindings[max_descriptors_per_set];
+    u32 num_bindings = 0;
+
+    const char *name = nullptr;
+
+    DescriptorSetLayoutCreation &reset();
+    DescriptorSetLayoutCreation &add_binding(const DescriptorBinding &binding);
+    DescriptorSetLayoutCreation &set_name(const char *name);
+}; // struct DescriptorSetLayoutCreation
+
+struct ShaderStage {
+    // SPIR-V, only referenced until the pipeline is created.
+    const u32 *code = nullptr;
+    u32 code_size = 0; // In bytes.
+    VkShaderStageFlagBits type = VK_SHADER_STAGE_VERTEX_BIT;
+}; // struct ShaderStage
+
+struct ShaderStateCreation {
+    ShaderStage stages[max_shader_stages];
+    u32 stages_count = 0;
+
+    const char *name = nullptr;
+
+    ShaderStateCreation &reset();
+    ShaderStateCreation &add_stage(const u32 *code, u32 code_size, VkShaderStageFlagBits type);
+    ShaderStateCreation &set_name(const char *name);
+}; // struct ShaderStateCreation
+
+struct VertexStream {
+    u16 binding = 0;
+    u16 stride = 0;
+    VkVertexInputRate input_rate = VK_VERTEX_INPUT_RATE_VERTEX;
+}; // struct VertexStream
+
+struct VertexAttribute {
+    u16 location = 0;
+    u16 binding = 0;
+    u32 offset = 0;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+}; // struct VertexAttribute
+
+struct VertexInputCreation {
+    VertexStream vertex_streams[max_vertex_streams];
+    VertexAttribute vertex_attributes[max_vertex_attributes];
+    u32 num_vertex_streams = 0;
+    u32 num_vertex_attributes = 0;
+
+    VertexInputCreation &reset();
+    VertexInputCreation &add_vertex_stream(const VertexStream &stream);
+    VertexInputCreation &add_vertex_attribute(const VertexAttribute &attribute);
+}; // struct VertexInputCreation
+
+struct PipelineCreation {
+    ShaderStateCreation shaders;
+    VertexInputCreation vertex_input;
+    // Attachment formats the pipeline renders to.
+    RenderPassOutput render_pass;
+
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkCullModeFlags cull_mode = VK_CULL_MODE_NONE;
+    VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    bool depth_test = false;
+    bool depth_write = false;
+    VkCompareOp depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+    bool blend = false;
+
+    // Push constant range visible to all stages, in bytes.
+    u32 push_constant_size = 0;
+
+    // Layouts of sets first_material_set_index onwards.
+    DescriptorSetLayoutHandle descriptor_set_layouts[max_material_sets];
+    u32 num_descriptor_set_layouts = 0;
+
+    const char *name = nullptr;
+
+    PipelineCreation &add_descriptor_set_layout(DescriptorSetLayoutHandle layout);
+}; // struct PipelineCreation
+
+// Identifies a pipeline layout: every set layout in set order and the push constant range.
+struct PipelineLayoutKey {
+    VkDescriptorSetLayout set_layouts[max_descriptor_set_layouts];
+    u32 num_set_layouts;
+    u32 push_constant_size;
+}; // struct PipelineLayoutKey
+
+// Identifies a render pass: its attachments and the layout color attachments are left in.
+struct RenderPassKey {
+    RenderPassOutput output;
+    VkImageLayout color_final_layout;
+}; // struct RenderPassKey
+
+// Identifies a framebuffer: the render pass, the attachment views and their extent.
+struct FramebufferKey {
+    VkRenderPass render_pass;
+    VkImageView attachments[max_image_outputs + 1];
+    u32 num_attachments;
+    u32 width;
+    u32 height;
+}; // struct FramebufferKey
+
+// Resources, stored by value in the device's resource pools.
+struct Buffer {
+    VkBuffer vk_buffer;
+    VmaAllocation vma_allocation;
+    VkDeviceSize vk_device_size;
+
+    VkBufferUsageFlags type_flags;
+    ResourceUsageType::Enum usage;
+    u32 size;
+
+    // Persistently mapped pointer, null for Immutable buffers.
+    u8 *mapped_data;
+    // Timeline value of the last upload, see Device::is_upload_ready.
+    u64 upload_value;
+    // Slot in the bindless storage buffer array, invalid_bindless_index for non storage buffers.
+    u32 bindless_index;
+
+    BufferHandle handle;
+    const char *name;
+}; // struct Buffer
+
+struct Texture {
+    VkImage vk_image;
+    VkImageView vk_image_view;
+    VkFormat vk_format;
+    VkImageLayout vk_image_layout;
+    // Null for textures placed in a memory block.
+    VmaAllocation vma_allocation;
+
+    u16 width;
+    u16 height;
+    u16 depth;
+    u8 mipmaps;
+    u8 flags;
+
+    // Timeline value of the last upload, see Device::is_upload_ready.
+    u64 upload_value;
+    // Slot in the bindless sampled image array.
+    u32 bindless_index;
+
+    TextureHandle handle;
+    TextureType::Enum type;
+
+    const char *name;
+}; // struct Texture
+
+struct Sampler {
+    VkSampler vk_sampler;
+
+    VkFilter min_filter;
+    VkFilter mag_filter;
+    VkSamplerMipmapMode mip_filter;
+
+    VkSamplerAddressMode address_mode_u;
+    VkSamplerAddressMode address_mode_v;
+    VkSamplerAddressMode address_mode_w;
+
+    // Slot in the bindless sampler array.
+    u32 bindless_index;
+    // Identical creations share the sampler, it's destroyed once every one of them is.
+    u32 references;
+
+    const char *name;
+}; // struct Sampler
+
+struct Pipeline {
+    VkPipeline vk_pipeline;
+    VkPipelineLayout vk_pipeline_layout;
+    VkPipelineBindPoint vk_bind_point;
+    // The layout is shared with every pipeline with the same key.
+    PipelineLayoutKey layout_key;
+
+    PipelineHandle handle;
+    const char *name;
+}; // struct Pipeline
+
+// Raw device memory that aliased textures are placed in.
+struct Memory {
+    VmaAllocation vma_allocation;
+    VkDeviceSize size;
+
+    MemoryHandle handle;
+    const char *name;
+}; // struct Memory
+
+struct DescriptorSetLayout {
+    VkDescriptorSetLayout vk_descriptor_set_layout;
+    DescriptorSetLayoutCreation creation;
+    // Identical creations share the layout, it's destroyed once every one of them is.
+    u32 references;
+
+    DescriptorSetLayoutHandle handle;
+}; // struct DescriptorSetLayout
+
+struct PipelineLayout {
+    VkPipelineLayout vk_pipeline_layout;
+    u32 references;
+}; // struct PipelineLayout
+
+// A destroy request, executed once the GPU is done with the frame it was issued on.
+struct ResourceUpdate {
+    ResourceDeletionType::Enum type;
+    ResourceHandle handle;
+    u64 frame;
+    // The resource also has to wait for uploads up to this value.
+    u64 upload_value;
+}; // struct ResourceUpdate
+
+// Free-list of slots in a bindless descriptor array. Slots are released together with their resource,
+// so only once no frame in flight can index them anymore.
+class BindlessSlotAllocator {
+  public:
+    void init(u32 count);
+    void shutdown();
+
+    // Returns invalid_bindless_index when every slot is in use.
+    u32 obtain();
+    void release(u32 slot);
+
+    u32 capacity = 0;
+
+  private:
+    std::vector<u32> free_slots;
+}; // class BindlessSlotAllocator
+
+// Cache keys, see HashCache. Debug names don't take part.
+u64 hash_key(const SamplerCreation &key);
+bool keys_equal(const SamplerCreation &a, const SamplerCreation &b);
+u64 hash_key(const DescriptorSetLayoutCreation &key);
+bool keys_equal(const DescriptorSetLayoutCreation &a, const DescriptorSetLayoutCreation &b);
+u64 hash_key(const PipelineLayoutKey &key);
+bool keys_equal(const PipelineLayoutKey &a, const PipelineLayoutKey &b);
+u64 hash_key(const RenderPassKey &key);
+bool keys_equal(const RenderPassKey &a, const RenderPassKey &b);
+u64 hash_key(const FramebufferKey &key);
+bool keys_equal(const FramebufferKey &a, const FramebufferKey &b);
+
+// Format helpers
+bool texture_format_has_depth(VkFormat format);
+bool texture_format_has_stencil(VkFormat format);
+// Texel rows per row of blocks: 4 for block compressed formats, 1 otherwise.
+u32 texture_format_block_height(VkFormat format);
+
+const char *gpu_memory_category_name(GpuMemoryCategory::Enum category);
+
 } // namespace sren
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "memory.h"
+#include "platform.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+namespace sren {
+
+// 64-bit FNV-1a, chained through seed to hash a key field by field.
+static const u64 hash_seed = 0xcbf29ce484222325ull;
+
+inline u64 hash_bytes(const void *data, size_t size, u64 seed = hash_seed) {
+    const u8 *bytes = (const u8 *)data;
+    u64 hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template <typename T> inline u64 hash_value(const T &value, u64 seed = hash_seed) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be hashed bytewise");
+    return hash_bytes(&value, sizeof(T), seed);
+}
+
+// Fixed-capacity open-addressing map from creation descriptors to the objects created from them, so
+// identical descriptors share one object. Keys provide u64 hash_key(const Key &) and
+// bool keys_equal(const Key &, const Key &), which lets them ignore fields such as debug names.
+// Linear probing with backward-shift removal, so no tombstones build up.
+template <typename Key, typename Value> class HashCache {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "Cache entries must be plain data");
+
+  public:
+    // Capacity is rounded up to a power of two and should be about twice the expected entry count.
+    void init(u32 capacity_, Allocator *allocator_);
+    void shutdown();
+
+    // Returns nullptr when the key isn't cached. Counts as a hit or a miss.
+    Value *find(const Key &key);
+    // Same as find, without counting. For bookkeeping on entries known to be cached.
+    Value *get(const Key &key);
+    // Returns false when the cache is full.
+    bool insert(const Key &key, const Value &value);
+    void remove(const Key &key);
+
+    // Entry iteration, used to evict or destroy cached objects. Removing an entry can move a later one
+    // into its index, so check the index again after a removal.
+    bool is_used(u32 index) const { return entries[index].used; }
+    const Key &key_at(u32 index) const { return entries[index].key; }
+    Value &value_at(u32 index) { return entries[index].value; }
+
+    u32 capacity = 0;
+    u32 size = 0;
+
+    u32 hits = 0;
+    u32 misses = 0;
+
+  private:
+    struct Entry {
+        u64 hash;
+        Key key;
+        Value value;
+        bool used;
+    }; // struct Entry
+
+    // Index of the key's entry, or of the free entry ending its probe sequence.
+    u32 probe(const Key &key, u64 hash) const;
+
+    Allocator *allocator = nullptr;
+    Entry *entries = nullptr;
+    u32 mask = 0;
+}; // class HashCache
+
+template <typename Key, typename Value>
+void HashCache<Key, Value>::init(u32 capacity_, Allocator *allocator_) {
+    capacity = 1;
+    while (capacity < capacity_) {
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    size = hits = misses = 0;
+    allocator = allocator_;
+    entries = allocate_array<Entry>(*allocator, capacity);
+    memset(entries, 0, sizeof(Entry) * capacity);
+}
+
+template <typename Key, typename Value> void HashCache<Key, Value>::shutdown() {
+    if (allocator) {
+        allocator->deallocate(entries);
+    }
+    entries = nullptr;
+    capacity = size = mask = 0;
+}
+
+template <typename Key, typename Value>
+u32 HashCache<Key, Value>::probe(const Key &key, u64 hash) const {
+    u32 index = (u32)hash & mask;
+    while (entries[index].used &&
+           !(entries[index].hash == hash && keys_equal(entries[index].key, key))) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+template <typename Key, typename Value> Value *HashCache<Key, Value>::find(const Key &key) {
+    Value *value = get(key);
+    if (value) {
+        ++hits;
+    } else {
+        ++misses;
+    }
+    return value;
+}
+
+template <typename Key, typename Value> Value *HashCache<Key, Value>::get(const Key &key) {
+    Entry &entry = entries[probe(key, hash_key(key))];
+    return entry.used ? &entry.value : nullptr;
+}
+
+template <typename Key, typename Value>
+bool HashCache<Key, Value>::insert(const Key &key, const Value &value) {
+    // Keep one entry free so probing always terminates.
+    if (size + 1 >= capacity) {
+        return false;
+    }
+
+    const u64 hash = hash_key(key);
+    Entry &entry = entries[probe(key, hash)];
+    if (!entry.used) {
+        ++size;
+    }
+    entry.hash = hash;
+    entry.key = key;
+    entry.value = value;
+    entry.used = true;
+    return true;
+}
+
+template <typename Key, typename Value> void HashCache<Key, Value>::remove(const Key &key) {
+    u32 index = probe(key, hash_key(key));
+    if (!entries[index].used) {
+        return;
+    }
+    entries[index].used = false;
+    --size;
+
+    // Shift later entries of the cluster back into the hole when their home slot allows it.
+    u32 next = (index + 1) & mask;
+    while (entries[next].used) {
+        const u32 home = (u32)entries[next].hash & mask;
+        const bool movable = ((next - home) & mask) >= ((next - index) & mask);
+        if (movable) {
+            entries[index] = entries[next];
+            entries[next].used = false;
+            index = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+} // namespace sren
@@ -0,0 +1,184 @@
+#include "indirect_draw.h"
+
+#include "log.h"
+
+#include <string.h>
+
+namespace sren {
+
+// Push constants of shaders/cull.comp.
+struct CullConstants {
+    f32 frustum_planes[num_frustum_planes][4];
+    u32 instance_buffer;
+    u32 command_buffer;
+    u32 count_buffer;
+    u32 instance_count;
+}; // struct CullConstants
+
+static_assert(sizeof(GpuInstance) == 32, "GpuInstance must match Instance in cull.comp");
+static_assert(sizeof(CullConstants) <= 128, "Cull constants exceed the guaranteed push constant size");
+
+IndirectDrawCreation &IndirectDrawCreation::set_instances(const GpuInstance *instances_,
+                                                          u32 num_instances_) {
+    instances = instances_;
+    num_instances = num_instances_;
+    return *this;
+}
+
+IndirectDrawCreation &IndirectDrawCreation::set_name(const char *name_) {
+    name = name_;
+    return *this;
+}
+
+bool IndirectDrawList::init(Device &device_, ShaderLibrary &shaders_,
+                            const IndirectDrawCreation &creation) {
+    device = &device_;
+    shaders = &shaders_;
+    if (!device->is_bindless_supported() || !device->is_draw_indirect_first_instance_supported()) {
+        LOG_ERR("GPU-driven draws need bindless descriptors and indirect draws with a first instance.");
+        return false;
+    }
+    if (!device->is_draw_indirect_count_supported()) {
+        LOG_INFO("No indirect draw count, %s draws every instance's command slot.",
+                 creation.name ? creation.name : "indirect draw list");
+    }
+
+    num_instances = creation.num_instances;
+    if (num_instances > device->get_max_draw_indirect_count()) {
+        LOG_ERR("%u instances exceed the device's %u indirect draws, the rest are dropped.",
+                num_instances, device->get_max_draw_indirect_count());
+        num_instances = device->get_max_draw_indirect_count();
+    }
+
+    ShaderCreation shader_creation;
+    shader_creation.set_source("cull.comp", VK_SHADER_STAGE_COMPUTE_BIT);
+    ShaderHandle cull_shader;
+    if (!shaders->load(&shader_creation, 1, &cull_shader)) {
+        LOG_ERR("Failed to load the cull shader.");
+        return false;
+    }
+    PipelineCreation pipeline_creation;
+    pipeline_creation.push_constant_size = sizeof(CullConstants);
+    pipeline_creation.name = "Cull";
+    cull_pipeline = shaders->create_pipeline(pipeline_creation, &cull_shader, 1);
+    if (cull_pipeline.index == invalid_shader_pipeline.index) {
+        return false;
+    }
+
+    // Storage buffers get bindless slots, which the cull shader is given in its push constants.
+    const u32 instances_size = (num_instances ? num_instances : 1) * sizeof(GpuInstance);
+    instance_buffer = device->create_buffer(
+        BufferCreation()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable, instances_size)
+            .set_data(num_instances ? (void *)creation.instances : nullptr)
+            .set_name("Cull Instances"));
+    const u32 commands_size =
+        (num_instances ? num_instances : 1) * sizeof(VkDrawIndexedIndirectCommand);
+    const VkBufferUsageFlags indirect_flags =
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    command_buffer = device->create_buffer(
+        BufferCreation()
+            .set(indirect_flags, ResourceUsageType::Immutable, commands_size)
+            .set_name("Indirect Draw Commands"));
+    count_buffer = device->create_buffer(
+        BufferCreation()
+            .set(indirect_flags, ResourceUsageType::Immutable, sizeof(u32))
+            .set_name("Indirect Draw Count"));
+    if (instance_buffer.index == invalid_resource_handle ||
+        command_buffer.index == invalid_resource_handle ||
+        count_buffer.index == invalid_resource_handle) {
+        LOG_ERR("Failed to create the buffers of %s", creation.name ? creation.name : "indirect draws");
+        shutdown();
+        return false;
+    }
+    return true;
+}
+
+void IndirectDrawList::shutdown() {
+    if (!device) {
+        return;
+    }
+    shaders->destroy_pipeline(cull_pipeline);
+    if (instance_buffer.index != invalid_resource_handle) {
+        device->destroy_buffer(instance_buffer);
+    }
+    if (command_buffer.index != invalid_resource_handle) {
+        device->destroy_buffer(command_buffer);
+    }
+    if (count_buffer.index != invalid_resource_handle) {
+        device->destroy_buffer(count_buffer);
+    }
+    cull_pipeline = invalid_shader_pipeline;
+    instance_buffer = command_buffer = count_buffer = invalid_buffer;
+    device = nullptr;
+}
+
+bool IndirectDrawList::is_ready() const {
+    if (!device) {
+        return false;
+    }
+    const Buffer *instances = device->access_buffer(instance_buffer);
+    return instances && device->is_upload_ready(instances->upload_value);
+}
+
+void IndirectDrawList::cull(VkCommandBuffer vk_command_buffer,
+                            const f32 frustum_planes[num_frustum_planes][4]) {
+    Buffer *instances = device->access_buffer(instance_buffer);
+    Buffer *commands = device->access_buffer(command_buffer);
+    Buffer *count = device->access_buffer(count_buffer);
+    // Looked up every frame, hot reloads replace it.
+    const PipelineHandle pipeline_handle = shaders->get_pipeline(cull_pipeline);
+    Pipeline *pipeline = device->access_pipeline(pipeline_handle);
+    if (!instances || !commands || !count || !pipeline) {
+        return;
+    }
+
+    // One set of buffers for every frame in flight: the previous frame's cull and draws have to be done
+    // with them before they are reset.
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(vk_command_buffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdFillBuffer(vk_command_buffer, count->vk_buffer, 0, sizeof(u32), 0);
+    // Without the count every command slot is drawn, the ones left empty have to draw nothing.
+    if (!device->is_draw_indirect_count_supported()) {
+        vkCmdFillBuffer(vk_command_buffer, commands->vk_buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(vk_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    if (num_instances) {
+        CullConstants constants;
+        memcpy(constants.frustum_planes, frustum_planes, sizeof(constants.frustum_planes));
+        constants.instance_buffer = instances->bindless_index;
+        constants.command_buffer = commands->bindless_index;
+        constants.count_buffer = count->bindless_index;
+        constants.instance_count = num_instances;
+        vkCmdPushConstants(vk_command_buffer, pipeline->vk_pipeline_layout, VK_SHADER_STAGE_ALL, 0,
+                           sizeof(constants), &constants);
+        device->bind_bindless_set(vk_command_buffer, pipeline_handle);
+        device->dispatch(vk_command_buffer, pipeline_handle,
+                         (num_instances + cull_group_size - 1) / cull_group_size, 1, 1);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(vk_command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void IndirectDrawList::draw(VkCommandBuffer vk_command_buffer) {
+    if (num_instances) {
+        device->draw_indexed_indirect(vk_command_buffer, command_buffer, count_buffer, num_instances);
+    }
+}
+
+} // namespace sren
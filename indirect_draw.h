@@ -0,0 +1,67 @@
+#pragma once
+
+#include "device.h"
+#include "platform.h"
+#include "shader_library.h"
+
+namespace sren {
+
+// Threads per cull shader workgroup, see shaders/cull.comp.
+static const u32 cull_group_size = 64;
+static const u32 num_frustum_planes = 6;
+
+// One instance of an indexed mesh, as read by the cull shader.
+struct GpuInstance {
+    // Bounding sphere center and radius, in the space of the frustum planes.
+    f32 center[3];
+    f32 radius;
+    // Index range of the mesh, see VkDrawIndexedIndirectCommand.
+    u32 index_count;
+    u32 first_index;
+    i32 vertex_offset;
+    u32 padding;
+}; // struct GpuInstance
+
+struct IndirectDrawCreation {
+    const GpuInstance *instances = nullptr;
+    u32 num_instances = 0;
+
+    const char *name = nullptr;
+
+    IndirectDrawCreation &set_instances(const GpuInstance *instances, u32 num_instances);
+    IndirectDrawCreation &set_name(const char *name);
+}; // struct IndirectDrawCreation
+
+// Draws a list of instances with a CPU cost independent of how many there are. A compute pass culls the
+// instances against the frustum and appends one draw command per visible instance, with the instance
+// index as its first instance. The commands are then drawn with a single indirect count draw.
+// Needs bindless descriptors: the cull shader reaches its buffers through the bindless set.
+class IndirectDrawList {
+  public:
+    // The cull pipeline is built from shaders/cull.comp by the shader library, rebuilt when it changes.
+    bool init(Device &device, ShaderLibrary &shaders, const IndirectDrawCreation &creation);
+    void shutdown();
+
+    // Whether the instances have been uploaded and the list can be culled and drawn.
+    bool is_ready() const;
+
+    // Outside of render passes, before draw. Planes are normal and distance, pointing inwards.
+    void cull(VkCommandBuffer command_buffer, const f32 frustum_planes[num_frustum_planes][4]);
+    // Inside a render pass, with the graphics pipeline, its push constants and the index buffer bound.
+    void draw(VkCommandBuffer command_buffer);
+
+    u32 get_num_instances() const { return num_instances; }
+
+  private:
+    Device *device = nullptr;
+    ShaderLibrary *shaders = nullptr;
+
+    ShaderPipelineHandle cull_pipeline = invalid_shader_pipeline;
+    BufferHandle instance_buffer = invalid_buffer;
+    // VkDrawIndexedIndirectCommands of the visible instances, and how many there are.
+    BufferHandle command_buffer = invalid_buffer;
+    BufferHandle count_buffer = invalid_buffer;
+    u32 num_instances = 0;
+}; // class IndirectDrawList
+
+} // namespace sren
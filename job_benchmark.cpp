@@ -0,0 +1,120 @@
+#include "job_benchmark.h"
+
+#include "job_system.h"
+#include "log.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace sren {
+
+static const u32 bench_throughput_jobs = 1 << 20;
+static const u32 bench_batch_size = 256;
+static const u32 bench_latency_samples = 10000;
+static const u32 bench_chain_length = 4096;
+
+static void bench_empty_job(void *, u32) {}
+
+// Roughly a microsecond of arithmetic, enough for the work to dominate scheduling.
+static void bench_work_job(void *data, u32) {
+    u32 value = (u32)(uintptr_t)data;
+    for (u32 i = 0; i < 1000; ++i) {
+        value = value * 1664525u + 1013904223u;
+    }
+    // Keeps the loop from being optimized out.
+    static std::atomic<u32> sink{0};
+    if (value == 0) {
+        sink.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static void bench_timestamp_job(void *data, u32) { *(i64 *)data = time_now(); }
+
+static f64 bench_throughput(JobSystem &job_system, JobFunction function) {
+    JobDecl jobs[bench_batch_size];
+    for (u32 i = 0; i < bench_batch_size; ++i) {
+        jobs[i].function = function;
+        jobs[i].data = (void *)(uintptr_t)i;
+    }
+
+    JobCounter counter;
+    i64 start = time_now();
+    for (u32 submitted = 0; submitted < bench_throughput_jobs; submitted += bench_batch_size) {
+        job_system.run(jobs, bench_batch_size, &counter);
+    }
+    job_system.wait(&counter);
+    return bench_throughput_jobs / time_delta_seconds(start, time_now());
+}
+
+// Time from submission until a worker starts running a job. With idle_wait the workers are given time
+// to fall asleep first, so this includes waking them up.
+static void bench_latency(JobSystem &job_system, bool idle_wait, const char *name) {
+    std::unique_ptr<f64[]> samples(new f64[bench_latency_samples]);
+    for (u32 i = 0; i < bench_latency_samples; ++i) {
+        if (idle_wait && (i & 63) == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        i64 started = 0;
+        JobDecl job;
+        job.function = bench_timestamp_job;
+        job.data = &started;
+
+        JobCounter counter;
+        i64 submitted = time_now();
+        job_system.run(&job, 1, &counter);
+        // Spin instead of helping, so the job has to be picked up by a worker.
+        while (counter.value.load(std::memory_order_acquire) > 0) {
+        }
+        job_system.wait(&counter);
+        samples[i] = time_delta_ms(submitted, started) * 1000.0;
+    }
+
+    std::sort(samples.get(), samples.get() + bench_latency_samples);
+    f64 total = 0.0;
+    for (u32 i = 0; i < bench_latency_samples; ++i) {
+        total += samples[i];
+    }
+    LOG_INFO("  %s latency: avg %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us", name,
+             total / bench_latency_samples, samples[bench_latency_samples / 2],
+             samples[bench_latency_samples * 99 / 100], samples[bench_latency_samples - 1]);
+}
+
+// Every job depends on the previous one, so this measures continuation overhead.
+static f64 bench_dependency_chain(JobSystem &job_system) {
+    std::unique_ptr<JobCounter[]> counters(new JobCounter[bench_chain_length]);
+
+    JobDecl job;
+    job.function = bench_empty_job;
+
+    i64 start = time_now();
+    for (u32 i = 0; i < bench_chain_length; ++i) {
+        job_system.run(&job, 1, &counters[i], i ? &counters[i - 1] : nullptr);
+    }
+    job_system.wait(&counters[bench_chain_length - 1]);
+    // Earlier counters may still be flushing their continuations.
+    for (u32 i = 0; i < bench_chain_length; ++i) {
+        job_system.wait(&counters[i]);
+    }
+    return time_delta_ms(start, time_now()) * 1000.0 / bench_chain_length;
+}
+
+void run_job_benchmark(u32 num_threads) {
+    JobSystem job_system;
+    job_system.init(JobSystemCreation().set_num_threads(num_threads));
+
+    LOG_INFO("Job benchmark, %u threads:", job_system.get_num_threads());
+    LOG_INFO("  Empty jobs: %.2f M jobs/s", bench_throughput(job_system, bench_empty_job) / 1e6);
+    LOG_INFO("  ~1 us jobs: %.2f M jobs/s", bench_throughput(job_system, bench_work_job) / 1e6);
+    if (job_system.get_num_threads() > 1) {
+        bench_latency(job_system, false, "Busy");
+        bench_latency(job_system, true, "Idle");
+    }
+    LOG_INFO("  Dependency chain: %.2f us per job", bench_dependency_chain(job_system));
+
+    job_system.shutdown();
+}
+
+} // namespace sren
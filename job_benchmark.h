@@ -0,0 +1,10 @@
+#pragma once
+
+#include "platform.h"
+
+namespace sren {
+
+// Measures job system throughput and scheduling latency, reporting through the log.
+void run_job_benchmark(u32 num_threads);
+
+} // namespace sren
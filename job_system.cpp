@@ -0,0 +1,290 @@
+#include "job_system.h"
+
+#include "log.h"
+
+namespace sren {
+
+// Failed attempts to find work before an idle worker goes to sleep.
+static const u32 job_idle_spins = 64;
+
+static thread_local u32 job_thread_index = u32_max;
+static thread_local u32 job_steal_seed = 0;
+
+//
+// JobQueue
+//
+bool JobQueue::push(const Job &job) {
+    i64 b = bottom.load(std::memory_order_relaxed);
+    i64 t = top.load(std::memory_order_acquire);
+    if (b - t >= (i64)job_queue_capacity) {
+        return false;
+    }
+
+    Slot &slot = slots[b & (job_queue_capacity - 1)];
+    slot.function.store(job.function, std::memory_order_relaxed);
+    slot.data.store(job.data, std::memory_order_relaxed);
+    slot.counter.store(job.counter, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+bool JobQueue::pop(Job &job) {
+    i64 b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    i64 t = top.load(std::memory_order_seq_cst);
+
+    if (t > b) {
+        // Empty.
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    read_slot(b, job);
+    if (t == b) {
+        // Last job, race the thieves for it.
+        bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+bool JobQueue::steal(Job &job) {
+    i64 t = top.load(std::memory_order_seq_cst);
+    i64 b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) {
+        return false;
+    }
+
+    read_slot(t, job);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+void JobQueue::read_slot(i64 index, Job &job) const {
+    const Slot &slot = slots[index & (job_queue_capacity - 1)];
+    job.function = slot.function.load(std::memory_order_relaxed);
+    job.data = slot.data.load(std::memory_order_relaxed);
+    job.counter = slot.counter.load(std::memory_order_relaxed);
+}
+
+static_assert((job_queue_capacity & (job_queue_capacity - 1)) == 0, "Capacity must be a power of two");
+
+//
+// JobSystemCreation
+//
+JobSystemCreation &JobSystemCreation::set_num_threads(u32 num_threads_) {
+    num_threads = num_threads_;
+    return *this;
+}
+
+//
+// JobSystem
+//
+bool JobSystem::init(const JobSystemCreation &creation) {
+    num_threads = creation.num_threads ? creation.num_threads : std::thread::hardware_concurrency();
+    num_threads = num_threads < 1 ? 1 : (num_threads > max_job_threads ? max_job_threads : num_threads);
+
+    job_thread_index = 0;
+    running.store(true);
+    for (u32 i = 1; i < num_threads; ++i) {
+        workers[i] = std::thread(&JobSystem::worker_loop, this, i);
+    }
+
+    LOG_INFO("Job system started with %u threads.", num_threads);
+    return true;
+}
+
+void JobSystem::shutdown() {
+    running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_condition.notify_all();
+    }
+    for (u32 i = 1; i < num_threads; ++i) {
+        workers[i].join();
+    }
+
+    // Whatever is left never had anyone waiting on it.
+    run_pinned_jobs();
+    job_thread_index = u32_max;
+    num_threads = 0;
+}
+
+u32 JobSystem::get_thread_index() { return job_thread_index; }
+
+void JobSystem::run(const JobDecl *jobs, u32 count, JobCounter *counter, JobCounter *dependency) {
+    if (counter) {
+        counter->value.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    if (dependency) {
+        // The counter only drops to zero under its lock, see finish_job.
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->value.load(std::memory_order_acquire) > 0) {
+            for (u32 i = 0; i < count; ++i) {
+                dependency->continuations.push_back({jobs[i].function, jobs[i].data, counter});
+            }
+            return;
+        }
+    }
+
+    for (u32 i = 0; i < count; ++i) {
+        enqueue({jobs[i].function, jobs[i].data, counter});
+    }
+
+    if (sleeping_workers.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        if (count > 1) {
+            sleep_condition.notify_all();
+        } else {
+            sleep_condition.notify_one();
+        }
+    }
+}
+
+void JobSystem::run_pinned(const JobDecl &job, JobCounter *counter) {
+    if (counter) {
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(pinned_mutex);
+    pinned_jobs.push_back({job.function, job.data, counter});
+}
+
+void JobSystem::wait(JobCounter *counter) {
+    const u32 thread_index = job_thread_index;
+    while (counter->value.load(std::memory_order_acquire) > 0) {
+        if (thread_index == 0) {
+            run_pinned_jobs();
+        }
+        if (thread_index == u32_max || !try_run_job(thread_index)) {
+            std::this_thread::yield();
+        }
+    }
+
+    // The last job may still be flushing continuations, it's done once it releases the lock.
+    std::lock_guard<std::mutex> lock(counter->mutex);
+}
+
+void JobSystem::run_pinned_jobs() {
+    {
+        std::lock_guard<std::mutex> lock(pinned_mutex);
+        if (pinned_jobs.empty()) {
+            return;
+        }
+        pinned_jobs_running.swap(pinned_jobs);
+    }
+
+    // Pinned jobs queued while these run are picked up by the next call.
+    for (const Job &job : pinned_jobs_running) {
+        execute(job, 0);
+    }
+    pinned_jobs_running.clear();
+}
+
+void JobSystem::worker_loop(u32 thread_index) {
+    job_thread_index = thread_index;
+    job_steal_seed = thread_index * 2654435761u;
+
+    u32 idle_spins = 0;
+    while (running.load(std::memory_order_relaxed)) {
+        if (try_run_job(thread_index)) {
+            idle_spins = 0;
+            continue;
+        }
+
+        if (++idle_spins < job_idle_spins) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Submitters check sleeping_workers after queueing, so either they see us or we see their job.
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping_workers.fetch_add(1);
+        sleep_condition.wait(lock, [this] { return queued_jobs.load() > 0 || !running.load(); });
+        sleeping_workers.fetch_sub(1);
+        idle_spins = 0;
+    }
+}
+
+void JobSystem::enqueue(const Job &job) {
+    const u32 thread_index = job_thread_index;
+    if (thread_index == u32_max) {
+        LOG_ERR("Jobs can only be submitted from the main thread or from jobs, running inline.");
+        execute(job, thread_index);
+        return;
+    }
+
+    if (!queues[thread_index].push(job)) {
+        execute(job, thread_index);
+        return;
+    }
+    queued_jobs.fetch_add(1);
+}
+
+bool JobSystem::try_run_job(u32 thread_index) {
+    Job job;
+    if (queues[thread_index].pop(job)) {
+        queued_jobs.fetch_sub(1);
+        execute(job, thread_index);
+        return true;
+    }
+
+    if (num_threads < 2) {
+        return false;
+    }
+
+    // Start stealing at a random victim so thieves don't all pile onto the same queue.
+    job_steal_seed = job_steal_seed * 1664525u + 1013904223u;
+    u32 victim = (job_steal_seed >> 16) % num_threads;
+    for (u32 i = 0; i < num_threads; ++i, victim = (victim + 1) % num_threads) {
+        if (victim != thread_index && queues[victim].steal(job)) {
+            queued_jobs.fetch_sub(1);
+            execute(job, thread_index);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(const Job &job, u32 thread_index) {
+    job.function(job.data, thread_index);
+    finish_job(job.counter);
+}
+
+void JobSystem::finish_job(JobCounter *counter) {
+    if (!counter) {
+        return;
+    }
+
+    // Only the final decrement takes the lock: a waiter can destroy the counter as soon as it reads zero
+    // and then acquires the lock, so nothing may touch the counter after that unlock.
+    u32 value = counter->value.load(std::memory_order_relaxed);
+    while (value > 1) {
+        if (counter->value.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+
+    std::vector<Job> continuations;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            continuations.swap(counter->continuations);
+        }
+    }
+
+    if (continuations.empty()) {
+        return;
+    }
+    for (const Job &job : continuations) {
+        enqueue(job);
+    }
+    if (sleeping_workers.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_condition.notify_all();
+    }
+}
+
+} // namespace sren
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "platform.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sren {
+
+// Thread 0 is the thread calling JobSystem::init (the main thread), the others are workers.
+static const u32 max_job_threads = 16;
+// Jobs each thread can have queued at once. Submitting to a full queue runs the job inline.
+static const u32 job_queue_capacity = 4096;
+
+// Jobs receive the index of the thread running them, usable to pick per-thread resources.
+typedef void (*JobFunction)(void *data, u32 thread_index);
+
+struct JobDecl {
+    JobFunction function = nullptr;
+    void *data = nullptr;
+}; // struct JobDecl
+
+struct Job {
+    JobFunction function;
+    void *data;
+    struct JobCounter *counter;
+}; // struct Job
+
+// Counts the unfinished jobs of a submission. Jobs can be submitted to start only once a counter reaches
+// zero, they are parked on the counter until then. A counter must outlive its jobs and be waited on
+// before it is reused.
+struct JobCounter {
+    std::atomic<u32> value{0};
+
+    std::mutex mutex;
+    std::vector<Job> continuations;
+}; // struct JobCounter
+
+// Chase-Lev deque: the owning thread pushes and pops at the bottom, other threads steal from the top.
+class JobQueue {
+  public:
+    bool push(const Job &job);
+    bool pop(Job &job);
+    bool steal(Job &job);
+
+  private:
+    // A thief can read a slot the owner is overwriting, it then loses the race on top and discards it.
+    struct Slot {
+        std::atomic<JobFunction> function;
+        std::atomic<void *> data;
+        std::atomic<JobCounter *> counter;
+    }; // struct Slot
+
+    void read_slot(i64 index, Job &job) const;
+
+    alignas(64) std::atomic<i64> top{0};
+    alignas(64) std::atomic<i64> bottom{0};
+    Slot slots[job_queue_capacity];
+}; // class JobQueue
+
+struct JobSystemCreation {
+    // Threads including the main thread. 0 uses one per core.
+    u32 num_threads = 0;
+
+    JobSystemCreation &set_num_threads(u32 num_threads);
+}; // struct JobSystemCreation
+
+// Work-stealing scheduler. Every thread owns a queue; idle threads steal from the others and sleep once
+// there is nothing left to steal. Jobs may only be submitted from the main thread or from other jobs.
+class JobSystem {
+  public:
+    bool init(const JobSystemCreation &creation);
+    void shutdown();
+
+    // Queues the jobs and adds them to counter (optional). With a dependency, the jobs only start once
+    // the dependency counter reaches zero.
+    void run(const JobDecl *jobs, u32 count, JobCounter *counter, JobCounter *dependency = nullptr);
+    // Queues a job that only the main thread runs, for APIs such as SDL that must stay there.
+    void run_pinned(const JobDecl &job, JobCounter *counter);
+
+    // Runs queued jobs until counter reaches zero. The main thread also runs its pinned jobs.
+    void wait(JobCounter *counter);
+    // Runs the pinned jobs queued so far. Main thread only.
+    void run_pinned_jobs();
+
+    u32 get_num_threads() const { return num_threads; }
+    // Index of the calling thread, u32_max outside the job system.
+    static u32 get_thread_index();
+
+  private:
+    void worker_loop(u32 thread_index);
+    void enqueue(const Job &job);
+    bool try_run_job(u32 thread_index);
+    void execute(const Job &job, u32 thread_index);
+    void finish_job(JobCounter *counter);
+
+    u32 num_threads = 0;
+    JobQueue queues[max_job_threads];
+    std::thread workers[max_job_threads];
+
+    std::mutex pinned_mutex;
+    std::vector<Job> pinned_jobs;
+    std::vector<Job> pinned_jobs_running;
+
+    // Idle workers sleep on this until jobs are queued.
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
+    std::atomic<u32> queued_jobs{0};
+    std::atomic<u32> sleeping_workers{0};
+    std::atomic<bool> running{false};
+}; // class JobSystem
+
+} // namespace sren
@@ -0,0 +1,234 @@
+#include "json.h"
+
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace sren {
+
+// Nesting deeper than this is rejected instead of overflowing the stack.
+static const u32 max_json_depth = 128;
+
+bool JsonDocument::parse(const char *text_, size_t size) {
+    text = position = text_;
+    end = text_ + size;
+    values.clear();
+
+    const u32 root = parse_value(0);
+    skip_whitespace();
+    if (root == invalid_json_value || position != end) {
+        LOG_ERR("Invalid JSON at offset %zu of %zu.", (size_t)(position - text), size);
+        values.clear();
+        return false;
+    }
+    return true;
+}
+
+const JsonValue *JsonDocument::get_member(const JsonValue *object, const char *key) const {
+    if (!object || object->type != JsonType::Object) {
+        return nullptr;
+    }
+    const size_t key_length = strlen(key);
+    for (const JsonValue *member = get_first_child(object); member; member = get_next_sibling(member)) {
+        if (member->key_length == key_length && !memcmp(member->key, key, key_length)) {
+            return member;
+        }
+    }
+    return nullptr;
+}
+
+const JsonValue *JsonDocument::get_first_child(const JsonValue *value) const {
+    return value && value->first_child != invalid_json_value ? &values[value->first_child] : nullptr;
+}
+
+const JsonValue *JsonDocument::get_next_sibling(const JsonValue *value) const {
+    return value && value->next_sibling != invalid_json_value ? &values[value->next_sibling] : nullptr;
+}
+
+f64 JsonDocument::get_number(const JsonValue *object, const char *key, f64 default_value) const {
+    const JsonValue *member = get_member(object, key);
+    return member && member->type == JsonType::Number ? member->number : default_value;
+}
+
+bool JsonDocument::string_equals(const JsonValue *value, const char *string) {
+    return value && value->type == JsonType::String && strlen(string) == value->string_length &&
+           !memcmp(value->string, string, value->string_length);
+}
+
+bool JsonDocument::copy_string(const JsonValue *value, char *buffer, u32 buffer_size) {
+    if (!value || value->type != JsonType::String || buffer_size == 0) {
+        return false;
+    }
+    u32 length = 0;
+    for (u32 i = 0; i < value->string_length; ++i) {
+        char c = value->string[i];
+        if (c == '\\' && i + 1 < value->string_length) {
+            c = value->string[++i];
+            if (c == 'u') {
+                // Only ASCII code points, anything else isn't expected in paths.
+                if (i + 4 >= value->string_length) {
+                    return false;
+                }
+                char hex[5] = {value->string[i + 1], value->string[i + 2], value->string[i + 3],
+                               value->string[i + 4], 0};
+                const long code = strtol(hex, nullptr, 16);
+                if (code <= 0 || code > 0x7f) {
+                    return false;
+                }
+                c = (char)code;
+                i += 4;
+            } else if (const char *escape = strchr("b\bf\fn\nr\rt\t", c)) {
+                // Pairs of escape letter and character, anything else stands for itself.
+                c = escape[1];
+            }
+        }
+        if (length + 1 >= buffer_size) {
+            return false;
+        }
+        buffer[length++] = c;
+    }
+    buffer[length] = 0;
+    return true;
+}
+
+void JsonDocument::skip_whitespace() {
+    while (position < end && (*position == ' ' || *position == '\t' || *position == '\n' ||
+                              *position == '\r')) {
+        ++position;
+    }
+}
+
+u32 JsonDocument::add_value(JsonType::Enum type) {
+    JsonValue value = {};
+    value.type = type;
+    value.first_child = invalid_json_value;
+    value.next_sibling = invalid_json_value;
+    values.push_back(value);
+    return (u32)values.size() - 1;
+}
+
+bool JsonDocument::parse_string(const char *&string, u32 &length) {
+    if (position >= end || *position != '"') {
+        return false;
+    }
+    string = ++position;
+    while (position < end && *position != '"') {
+        if ((u8)*position < 0x20) {
+            return false;
+        }
+        // Escapes are kept, copy_string resolves them.
+        position += *position == '\\' ? 2 : 1;
+    }
+    if (position >= end) {
+        return false;
+    }
+    length = (u32)(position - string);
+    ++position;
+    return true;
+}
+
+u32 JsonDocument::parse_value(u32 depth) {
+    skip_whitespace();
+    if (position >= end || depth > max_json_depth) {
+        return invalid_json_value;
+    }
+
+    const char c = *position;
+    if (c == '{' || c == '[') {
+        const bool object = c == '{';
+        const u32 index = add_value(object ? JsonType::Object : JsonType::Array);
+        ++position;
+        skip_whitespace();
+        if (position < end && *position == (object ? '}' : ']')) {
+            ++position;
+            return index;
+        }
+
+        u32 previous = invalid_json_value;
+        while (true) {
+            const char *key = nullptr;
+            u32 key_length = 0;
+            if (object) {
+                skip_whitespace();
+                if (!parse_string(key, key_length)) {
+                    return invalid_json_value;
+                }
+                skip_whitespace();
+                if (position >= end || *position != ':') {
+                    return invalid_json_value;
+                }
+                ++position;
+            }
+
+            const u32 child = parse_value(depth + 1);
+            if (child == invalid_json_value) {
+                return invalid_json_value;
+            }
+            // Indices, values can move while the children are parsed.
+            values[child].key = key;
+            values[child].key_length = key_length;
+            if (previous == invalid_json_value) {
+                values[index].first_child = child;
+            } else {
+                values[previous].next_sibling = child;
+            }
+            values[index].num_children++;
+            previous = child;
+
+            skip_whitespace();
+            if (position < end && *position == ',') {
+                ++position;
+            } else if (position < end && *position == (object ? '}' : ']')) {
+                ++position;
+                return index;
+            } else {
+                return invalid_json_value;
+            }
+        }
+    }
+
+    if (c == '"') {
+        const u32 index = add_value(JsonType::String);
+        const char *string;
+        u32 length;
+        if (!parse_string(string, length)) {
+            return invalid_json_value;
+        }
+        values[index].string = string;
+        values[index].string_length = length;
+        return index;
+    }
+
+    static const char *const literals[] = {"true", "false", "null"};
+    for (u32 i = 0; i < 3; ++i) {
+        const size_t length = strlen(literals[i]);
+        if ((size_t)(end - position) >= length && !memcmp(position, literals[i], length)) {
+            position += length;
+            const u32 index = add_value(i == 2 ? JsonType::Null : JsonType::Bool);
+            values[index].number = i == 0 ? 1.0 : 0.0;
+            return index;
+        }
+    }
+
+    // The text isn't null terminated, so strtod gets a copy.
+    char number[64];
+    u32 length = 0;
+    while (position + length < end && length + 1 < sizeof(number) &&
+           strchr("+-0123456789.eE", position[length]) && position[length]) {
+        number[length] = position[length];
+        ++length;
+    }
+    number[length] = 0;
+    char *number_end;
+    const f64 parsed = strtod(number, &number_end);
+    if (length == 0 || number_end != number + length) {
+        return invalid_json_value;
+    }
+    position += length;
+    const u32 index = add_value(JsonType::Number);
+    values[index].number = parsed;
+    return index;
+}
+
+} // namespace sren
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <vector>
+
+namespace sren {
+
+namespace JsonType {
+enum Enum { Null, Bool, Number, String, Array, Object, Count }; // enum Enum
+} // namespace JsonType
+
+static const u32 invalid_json_value = u32_max;
+
+// Value of a JsonDocument. Strings and keys point into the parsed text, with their escapes.
+struct JsonValue {
+    JsonType::Enum type;
+    // Key of object members.
+    const char *key;
+    u32 key_length;
+    const char *string;
+    u32 string_length;
+    // Numbers, and 1 or 0 for booleans.
+    f64 number;
+
+    // Children of arrays and objects in order, as indices into the document.
+    u32 first_child;
+    u32 next_sibling;
+    u32 num_children;
+}; // struct JsonValue
+
+// Read-only JSON DOM. Nothing is copied out of the text: it must outlive the document, which allows
+// parsing straight from a file mapping.
+class JsonDocument {
+  public:
+    // Logs the offset of the first syntax error.
+    bool parse(const char *text, size_t size);
+
+    const JsonValue *get_root() const { return values.empty() ? nullptr : &values[0]; }
+    // Null when value isn't an object or has no such member.
+    const JsonValue *get_member(const JsonValue *object, const char *key) const;
+    const JsonValue *get_first_child(const JsonValue *value) const;
+    const JsonValue *get_next_sibling(const JsonValue *value) const;
+
+    // The member's number, or default_value when it is missing or not a number.
+    f64 get_number(const JsonValue *object, const char *key, f64 default_value) const;
+    // Whether the string value equals text.
+    static bool string_equals(const JsonValue *value, const char *text);
+    // Unescapes a string value into buffer. Returns false when it doesn't fit.
+    static bool copy_string(const JsonValue *value, char *buffer, u32 buffer_size);
+
+  private:
+    u32 parse_value(u32 depth);
+    bool parse_string(const char *&string, u32 &length);
+    void skip_whitespace();
+    u32 add_value(JsonType::Enum type);
+
+    std::vector<JsonValue> values;
+    const char *text = nullptr;
+    const char *end = nullptr;
+    const char *position = nullptr;
+}; // class JsonDocument
+
+} // namespace sren
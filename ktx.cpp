@@ -0,0 +1,170 @@
+#include "ktx.h"
+
+#include "log.h"
+
+#include <string.h>
+
+namespace sren {
+
+static const u8 ktx2_identifier[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+struct Ktx2Header {
+    u8 identifier[12];
+    u32 vk_format;
+    u32 type_size;
+    u32 pixel_width;
+    u32 pixel_height;
+    u32 pixel_depth;
+    u32 layer_count;
+    u32 face_count;
+    u32 level_count;
+    u32 supercompression_scheme;
+    // Data format descriptor, key/value data and supercompression global data, unused.
+    u32 dfd_offset;
+    u32 dfd_length;
+    u32 kvd_offset;
+    u32 kvd_length;
+    u64 sgd_offset;
+    u64 sgd_length;
+}; // struct Ktx2Header
+
+struct Ktx2LevelIndex {
+    u64 offset;
+    u64 length;
+    u64 uncompressed_length;
+}; // struct Ktx2LevelIndex
+
+// Texel block of the format, false for formats that can't be loaded.
+static bool texture_format_block(VkFormat format, u32 &block_width, u32 &block_height, u32 &block_size) {
+    block_width = 1;
+    block_height = 1;
+    if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK) {
+        block_width = 4;
+        block_height = 4;
+        // BC1 and BC4 are half the size of the others.
+        const bool half_size = format <= VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+                               format == VK_FORMAT_BC4_UNORM_BLOCK ||
+                               format == VK_FORMAT_BC4_SNORM_BLOCK;
+        block_size = half_size ? 8 : 16;
+        return true;
+    }
+    switch (format) {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_SRGB:
+        block_size = 1;
+        return true;
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R8G8_SRGB:
+    case VK_FORMAT_R16_SFLOAT:
+        block_size = 2;
+        return true;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+    case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+        block_size = 4;
+        return true;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+        block_size = 8;
+        return true;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        block_size = 16;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool load_ktx2(const char *path, KtxTexture &texture) {
+    texture.release();
+    if (!texture.file.map(path)) {
+        LOG_ERR("Failed to map texture %s", path);
+        return false;
+    }
+    const u8 *data = (const u8 *)texture.file.data;
+    const u64 size = texture.file.size;
+
+    Ktx2Header header;
+    if (size < sizeof(header)) {
+        LOG_ERR("%s: not a KTX2 file.", path);
+        texture.release();
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier))) {
+        LOG_ERR("%s: not a KTX2 file.", path);
+        texture.release();
+        return false;
+    }
+
+    // A level count of 0 asks for generated mips, there is only the base level in the file.
+    const u32 num_levels = header.level_count ? header.level_count : 1;
+    const VkFormat format = (VkFormat)header.vk_format;
+    u32 block_width, block_height, block_size;
+    const char *error = nullptr;
+    if (header.supercompression_scheme != 0) {
+        error = "supercompressed files aren't supported, transcode it offline";
+    } else if (!texture_format_block(format, block_width, block_height, block_size)) {
+        error = "unsupported vkFormat";
+    } else if (header.layer_count > 1 || (header.face_count != 1 && header.face_count != 6)) {
+        error = "texture arrays aren't supported";
+    } else if (header.pixel_width == 0 || header.pixel_width > u16_max ||
+               header.pixel_height > u16_max || header.pixel_depth > u16_max ||
+               (header.face_count == 6 && header.pixel_depth > 0)) {
+        error = "invalid extent";
+    } else if (num_levels > max_texture_mips ||
+               sizeof(header) + num_levels * sizeof(Ktx2LevelIndex) > size) {
+        error = "invalid level count";
+    }
+    if (error) {
+        LOG_ERR("%s: %s.", path, error);
+        texture.release();
+        return false;
+    }
+
+    texture.format = format;
+    texture.width = (u16)header.pixel_width;
+    texture.height = (u16)(header.pixel_height ? header.pixel_height : 1);
+    texture.depth = (u16)(header.pixel_depth ? header.pixel_depth : 1);
+    texture.type = TextureType::Texture2D;
+    if (header.face_count == 6) {
+        texture.type = TextureType::TextureCube;
+    } else if (header.pixel_depth) {
+        texture.type = TextureType::Texture3D;
+    } else if (!header.pixel_height) {
+        texture.type = TextureType::Texture1D;
+    }
+    texture.num_levels = num_levels;
+
+    for (u32 i = 0; i < num_levels; ++i) {
+        Ktx2LevelIndex level;
+        memcpy(&level, data + sizeof(header) + i * sizeof(level), sizeof(level));
+        const u64 width = texture.width >> i ? texture.width >> i : 1;
+        const u64 height = texture.height >> i ? texture.height >> i : 1;
+        const u64 depth = texture.depth >> i ? texture.depth >> i : 1;
+        const u64 blocks = (width + block_width - 1) / block_width *
+                           ((height + block_height - 1) / block_height) * depth;
+        const u64 expected = blocks * header.face_count * block_size;
+        if (level.length != expected || expected > u32_max || level.offset > size ||
+            level.length > size - level.offset) {
+            LOG_ERR("%s: level %u is truncated or has an unexpected size.", path, i);
+            texture.release();
+            return false;
+        }
+        texture.levels[i] = {data + level.offset, (u32)level.length};
+    }
+    return true;
+}
+
+void KtxTexture::release() {
+    file.unmap();
+    num_levels = 0;
+}
+
+} // namespace sren
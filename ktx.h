@@ -0,0 +1,38 @@
+#pragma once
+
+#include "file.h"
+#include "gpu_resources.h"
+#include "platform.h"
+
+namespace sren {
+
+// Enough for 65536 texels, the largest extent TextureCreation can describe.
+static const u32 max_texture_mips = 17;
+
+struct KtxLevel {
+    // Every face tightly packed, as upload_texture expects.
+    const u8 *data;
+    u32 size;
+}; // struct KtxLevel
+
+// A KTX2 file mapped into memory: levels point into the mapping, nothing is decoded or copied.
+struct KtxTexture {
+    MappedFile file;
+
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    TextureType::Enum type = TextureType::Texture2D;
+    u16 width = 0;
+    u16 height = 0;
+    u16 depth = 0;
+    // Level 0 is the full resolution.
+    KtxLevel levels[max_texture_mips];
+    u32 num_levels = 0;
+
+    void release();
+}; // struct KtxTexture
+
+// Maps a KTX2 file and validates its level index. Plain and block compressed (BCn) formats are
+// supported; supercompressed files, texture arrays and formats without a fixed block size aren't.
+bool load_ktx2(const char *path, KtxTexture &texture);
+
+} // namespace sren
@@ -0,0 +1,252 @@
+#include "log.h"
+
+#include "timer.h"
+
+#include <atomic>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+namespace sren {
+
+namespace LogRingState {
+enum Enum : u32 { Free, Owned, Released }; // enum Enum
+} // namespace LogRingState
+
+// Single producer (the owning thread), single consumer (the writer thread).
+struct LogRing {
+    std::atomic<u32> head{0}; // Written by the producer.
+    std::atomic<u32> tail{0}; // Written by the consumer.
+    std::atomic<u32> state{LogRingState::Free};
+
+    LogRecord records[log_ring_capacity];
+}; // struct LogRing
+
+static LogRing log_rings[log_max_threads];
+static std::atomic<u32> log_ring_count{0};
+
+static std::atomic<u8> log_runtime_level{LogLevel::Debug};
+static std::atomic<bool> log_running{false};
+static std::atomic<bool> log_stop{false};
+static std::atomic<u64> log_dropped{0};
+
+static std::thread log_writer;
+static FILE *log_binary_file = nullptr;
+// Serializes synchronous writes (before init, after shutdown) with each other.
+static std::mutex log_sync_mutex;
+
+static const char *log_level_names[LogLevel::Count] = {
+    "\033[1;34mDEBUG\033[0m", // Blue
+    "\033[1;32mINFO\033[0m",  // Green
+    "\033[1;31mERROR\033[0m", // Red
+    "",
+};
+
+// Marks the thread's ring as released on thread exit, so another thread can reuse it once drained.
+struct LogRingOwner {
+    LogRing *ring = nullptr;
+    u8 index = 0;
+    bool claim_failed = false;
+
+    ~LogRingOwner() {
+        if (ring) {
+            ring->state.store(LogRingState::Released, std::memory_order_release);
+        }
+    }
+}; // struct LogRingOwner
+
+static thread_local LogRingOwner log_ring_owner;
+// Used when the writer isn't running.
+static thread_local LogRecord log_sync_record;
+
+static void write_record(const LogRecord &record, FILE *binary_file) {
+    if (binary_file) {
+        u16 file_length = (u16)strlen(record.file);
+        u8 header[sizeof(i64) + sizeof(u32) + 2 + 2 * sizeof(u16)];
+        u8 *cursor = header;
+        memcpy(cursor, &record.timestamp, sizeof(i64));
+        cursor += sizeof(i64);
+        memcpy(cursor, &record.line, sizeof(u32));
+        cursor += sizeof(u32);
+        *cursor++ = record.level;
+        *cursor++ = record.thread;
+        memcpy(cursor, &file_length, sizeof(u16));
+        cursor += sizeof(u16);
+        memcpy(cursor, &record.length, sizeof(u16));
+
+        fwrite(header, sizeof(header), 1, binary_file);
+        fwrite(record.file, file_length, 1, binary_file);
+        fwrite(record.message, record.length, 1, binary_file);
+        return;
+    }
+
+    fprintf(stdout, "[%s][%s:%u]: %.*s\n", log_level_names[record.level], record.file, record.line,
+            (int)record.length, record.message);
+}
+
+// Returns the number of records written.
+static u32 drain_ring(LogRing &ring) {
+    u32 tail = ring.tail.load(std::memory_order_relaxed);
+    u32 head = ring.head.load(std::memory_order_acquire);
+    for (u32 i = tail; i != head; ++i) {
+        write_record(ring.records[i % log_ring_capacity], log_binary_file);
+    }
+    ring.tail.store(head, std::memory_order_release);
+    return head - tail;
+}
+
+static u32 drain_rings() {
+    u32 written = 0;
+    u32 count = log_ring_count.load(std::memory_order_acquire);
+    for (u32 i = 0; i < count; ++i) {
+        written += drain_ring(log_rings[i]);
+    }
+
+    u64 dropped = log_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped && !log_binary_file) {
+        fprintf(stdout, "[%s]: %llu log messages dropped.\n", log_level_names[LogLevel::Error],
+                (unsigned long long)dropped);
+    }
+    return written;
+}
+
+static void writer_loop() {
+    while (!log_stop.load(std::memory_order_acquire)) {
+        if (drain_rings() > 0) {
+            fflush(log_binary_file ? log_binary_file : stdout);
+        } else {
+            // Polling keeps producers free of any wake-up syscall.
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    drain_rings();
+    fflush(log_binary_file ? log_binary_file : stdout);
+}
+
+static LogRing *claim_ring() {
+    // Reuse a ring left behind by an exited thread, once the writer has drained it.
+    u32 count = log_ring_count.load(std::memory_order_acquire);
+    for (u32 i = 0; i < count; ++i) {
+        LogRing &ring = log_rings[i];
+        u32 expected = LogRingState::Released;
+        if (ring.head.load(std::memory_order_relaxed) == ring.tail.load(std::memory_order_acquire) &&
+            ring.state.compare_exchange_strong(expected, LogRingState::Owned)) {
+            log_ring_owner.index = (u8)i;
+            return &ring;
+        }
+    }
+
+    u32 index = log_ring_count.load(std::memory_order_relaxed);
+    while (index < log_max_threads) {
+        u32 expected = LogRingState::Free;
+        if (log_rings[index].state.compare_exchange_strong(expected, LogRingState::Owned)) {
+            // Publish the ring to the writer. Rings are claimed in order, so bump the count past it.
+            u32 current = log_ring_count.load(std::memory_order_relaxed);
+            while (current < index + 1 && !log_ring_count.compare_exchange_weak(
+                                              current, index + 1, std::memory_order_release)) {
+            }
+            log_ring_owner.index = (u8)index;
+            return &log_rings[index];
+        }
+        ++index;
+    }
+    return nullptr;
+}
+
+void LogService::init(const LogConfig &config) {
+    if (log_running.load()) {
+        return;
+    }
+    set_level(config.level);
+
+    if (config.binary_path) {
+        log_binary_file = fopen(config.binary_path, "wb");
+        if (log_binary_file) {
+            LogBinaryHeader header = {log_binary_magic, log_binary_version};
+            fwrite(&header, sizeof(header), 1, log_binary_file);
+        } else {
+            fprintf(stderr, "Failed to open binary log %s, logging to console.\n", config.binary_path);
+        }
+    }
+
+    log_stop.store(false);
+    log_writer = std::thread(writer_loop);
+    log_running.store(true, std::memory_order_release);
+}
+
+void LogService::shutdown() {
+    if (!log_running.load()) {
+        return;
+    }
+    log_running.store(false, std::memory_order_release);
+    log_stop.store(true, std::memory_order_release);
+    log_writer.join();
+
+    if (log_binary_file) {
+        fclose(log_binary_file);
+        log_binary_file = nullptr;
+    }
+}
+
+void LogService::set_level(LogLevel::Enum level) {
+    log_runtime_level.store(level, std::memory_order_relaxed);
+}
+
+bool LogService::enabled(LogLevel::Enum level) {
+    return level >= log_runtime_level.load(std::memory_order_relaxed);
+}
+
+LogRecord *LogService::acquire_record() {
+    if (!log_running.load(std::memory_order_acquire)) {
+        return &log_sync_record;
+    }
+
+    LogRing *ring = log_ring_owner.ring;
+    if (!ring) {
+        if (log_ring_owner.claim_failed) {
+            log_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        ring = log_ring_owner.ring = claim_ring();
+        if (!ring) {
+            // More logging threads than rings.
+            log_ring_owner.claim_failed = true;
+            log_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+
+    u32 head = ring->head.load(std::memory_order_relaxed);
+    u32 tail = ring->tail.load(std::memory_order_acquire);
+    if (head - tail >= log_ring_capacity) {
+        log_dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &ring->records[head % log_ring_capacity];
+}
+
+void LogService::submit_record(LogRecord *record, LogLevel::Enum level, const char *file, int line,
+                               int length) {
+    record->timestamp = time_now();
+    record->file = file;
+    record->line = (u32)line;
+    record->level = level;
+    record->thread = log_ring_owner.index;
+    // snprintf returns the untruncated length.
+    if (length < 0) {
+        length = 0;
+    }
+    record->length = (u16)((u32)length < sizeof(record->message) ? length : sizeof(record->message) - 1);
+
+    if (record == &log_sync_record) {
+        std::lock_guard<std::mutex> lock(log_sync_mutex);
+        write_record(*record, nullptr);
+        fflush(stdout);
+        return;
+    }
+
+    LogRing *ring = log_ring_owner.ring;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+} // namespace sren
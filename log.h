@@ -1,14 +1,36 @@
 #pragma once
 
-#include <iostream>
-#include <memory>
-#include <string>
+#include "platform.h"
+
+#include <stdio.h>
+
+#define SREN_LOG_LEVEL_DEBUG 0
+#define SREN_LOG_LEVEL_INFO 1
+#define SREN_LOG_LEVEL_ERROR 2
+#define SREN_LOG_LEVEL_NONE 3
 
 #define ENABLE_DEBUG_LOGGING
 
+// Compile-time minimum level, calls below it compile to nothing. Override with -DSREN_LOG_LEVEL=...
+#ifndef SREN_LOG_LEVEL
+#ifdef ENABLE_DEBUG_LOGGING
+#define SREN_LOG_LEVEL SREN_LOG_LEVEL_DEBUG
+#else
+#define SREN_LOG_LEVEL SREN_LOG_LEVEL_INFO
+#endif
+#endif
+
+#if SREN_LOG_LEVEL <= SREN_LOG_LEVEL_INFO
 #define LOG_INFO(format, ...) sren::LogService::log_info(__FILE__, __LINE__, format, ##__VA_ARGS__);
+#else
+#define LOG_INFO(format, ...) ;
+#endif
+#if SREN_LOG_LEVEL <= SREN_LOG_LEVEL_ERROR
 #define LOG_ERR(format, ...) sren::LogService::log_error(__FILE__, __LINE__, format, ##__VA_ARGS__);
-#ifdef ENABLE_DEBUG_LOGGING
+#else
+#define LOG_ERR(format, ...) ;
+#endif
+#if SREN_LOG_LEVEL <= SREN_LOG_LEVEL_DEBUG
 #define LOG_DBG(format, ...) sren::LogService::log_debug(__FILE__, __LINE__, format, ##__VA_ARGS__)
 #else
 #define LOG_DBG(format, ...)
@@ -16,36 +38,87 @@
 
 namespace sren {
 
+namespace LogLevel {
+enum Enum : u8 { Debug, Info, Error, None, Count }; // enum Enum
+} // namespace LogLevel
+
+// Each logging thread formats into its own lock-free ring of fixed-size records, and a background
+// writer thread drains the rings to the console (or a binary file). Logging never allocates or blocks
+// on I/O: when a ring is full the message is dropped and counted.
+static const u32 log_max_threads = 16;
+static const u32 log_ring_capacity = 128;
+static const u32 log_record_size = 256;
+
+// Binary log file layout: a LogBinaryHeader followed by records of
+//   i64 timestamp (ns), u32 line, u8 level, u8 thread, u16 file_length, u16 message_length,
+//   file bytes, message bytes (neither null-terminated).
+static const u32 log_binary_magic = 0x474c5253; // "SRLG"
+static const u32 log_binary_version = 1;
+
+struct LogBinaryHeader {
+    u32 magic;
+    u32 version;
+}; // struct LogBinaryHeader
+
+struct LogConfig {
+    // Runtime minimum level, on top of SREN_LOG_LEVEL.
+    LogLevel::Enum level = LogLevel::Debug;
+    // When set, records are appended to this file in the binary format instead of printed.
+    const char *binary_path = nullptr;
+}; // struct LogConfig
+
+struct LogRecord {
+    i64 timestamp;
+    const char *file;
+    u32 line;
+    u16 length;
+    u8 level;
+    u8 thread;
+    char message[log_record_size - sizeof(i64) - sizeof(const char *) - sizeof(u32) - 4];
+}; // struct LogRecord
+
 class LogService {
   public:
+    // Starts the writer thread. Before init and after shutdown messages are written synchronously.
+    static void init(const LogConfig &config);
+    static void shutdown();
+
+    static void set_level(LogLevel::Enum level);
+    static bool enabled(LogLevel::Enum level);
+
     template <typename... Args>
     static void log_info(const char *file, int line, const char *format, Args... args) {
-        log("\033[1;32mINFO\033[0m", file, line, format, args...); // Green
+        log(LogLevel::Info, file, line, format, args...);
     }
 
     template <typename... Args>
     static void log_error(const char *file, int line, const char *format, Args... args) {
-        log("\033[1;31mERROR\033[0m", file, line, format, args...); // Red
+        log(LogLevel::Error, file, line, format, args...);
     }
 
     template <typename... Args>
     static void log_debug(const char *file, int line, const char *format, Args... args) {
-        log("\033[1;34mDEBUG\033[0m", file, line, format, args...); // Blue
+        log(LogLevel::Debug, file, line, format, args...);
     }
 
   private:
     template <typename... Args>
-    static void log(const char *level, const char *file, int line, const char *format, Args... args) {
-        std::string message = string_format(format, args...);
-        std::cout << "[" << level << "][" << file << ":" << line << "]: " << message << std::endl;
+    static void log(LogLevel::Enum level, const char *file, int line, const char *format, Args... args) {
+        if (!enabled(level)) {
+            return;
+        }
+        LogRecord *record = acquire_record();
+        if (!record) {
+            return;
+        }
+        int length = snprintf(record->message, sizeof(record->message), format, args...);
+        submit_record(record, level, file, line, length);
     }
 
-    template <typename... Args> static std::string string_format(const char *format, Args... args) {
-        size_t size = snprintf(nullptr, 0, format, args...) + 1; // +1 for '\0'
-        std::unique_ptr<char[]> buf(new char[size]);
-        snprintf(buf.get(), size, format, args...);
-        return std::string(buf.get(), buf.get() + size - 1); // -1 for '\0'
-    }
+    // Returns a slot in the calling thread's ring, or nullptr when the message has to be dropped.
+    static LogRecord *acquire_record();
+    static void submit_record(LogRecord *record, LogLevel::Enum level, const char *file, int line,
+                              int length);
 };
 
 } // namespace sren
@@ -1,15 +1,145 @@
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
 
 #include "engine.h"
+#include "gpu_benchmark.h"
+#include "job_benchmark.h"
+
+static void print_usage(const char *program) {
+    std::cerr << "Usage: " << program
+              << " [--headless] [--frames <count>] [--gpu <index|name>]"
+                 " [--log-level <debug|info|error|none>] [--binary-log <path>]"
+                 " [--pipeline-cache <path>] [--shader-cache <dir>] [--no-shader-reload]"
+                 " [--draws <count>] [--threads <count>] [--dynamic-rendering]"
+                 " [--gpu-driven] [--mesh <file.gltf|file.glb|file.smesh>]..."
+                 " [--texture <file.ktx2>]... [--texture-budget <MB>]"
+                 " [--no-pacing] [--fps <rate>] [--pacing-margin <ms>] [--max-jitter <ms>]"
+                 " [--bench-jobs] [--bench <output.json|->]\n";
+}
+
+int main(int argc, char **argv) {
+    sren::EngineCreation creation;
+    static const u32 max_mesh_paths = 64;
+    const char *mesh_paths[max_mesh_paths];
+    creation.mesh_paths = mesh_paths;
+    static const u32 max_texture_paths = 256;
+    const char *texture_paths[max_texture_paths];
+    creation.texture_paths = texture_paths;
+    bool bench_jobs = false;
+    // Headless GPU benchmark, "-" writes the results to stdout.
+    const char *bench_output = nullptr;
+    // Fail the run when frame pacing jitter exceeds this, for automated headless runs. 0 disables it.
+    double max_jitter_ms = 0.0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--headless")) {
+            creation.headless = true;
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            creation.frame_limit = (u32)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--gpu") && i + 1 < argc) {
+            // A number selects by enumeration index, anything else matches the device name.
+            const char *gpu = argv[++i];
+            char *end;
+            long index = strtol(gpu, &end, 10);
+            if (*gpu && *end == '\0') {
+                creation.gpu_index = (i32)index;
+            } else {
+                creation.gpu_name = gpu;
+            }
+        } else if (!strcmp(argv[i], "--log-level") && i + 1 < argc) {
+            const char *level = argv[++i];
+            if (!strcmp(level, "debug")) {
+                creation.log.level = sren::LogLevel::Debug;
+            } else if (!strcmp(level, "info")) {
+                creation.log.level = sren::LogLevel::Info;
+            } else if (!strcmp(level, "error")) {
+                creation.log.level = sren::LogLevel::Error;
+            } else if (!strcmp(level, "none")) {
+                creation.log.level = sren::LogLevel::None;
+            } else {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--binary-log") && i + 1 < argc) {
+            creation.log.binary_path = argv[++i];
+        } else if (!strcmp(argv[i], "--pipeline-cache") && i + 1 < argc) {
+            creation.pipeline_cache_path = argv[++i];
+        } else if (!strcmp(argv[i], "--shader-cache") && i + 1 < argc) {
+            creation.shader_cache_path = argv[++i];
+        } else if (!strcmp(argv[i], "--no-shader-reload")) {
+            creation.shader_hot_reload = false;
+        } else if (!strcmp(argv[i], "--draws") && i + 1 < argc) {
+            creation.draw_count = (u32)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            creation.num_threads = (u32)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--dynamic-rendering")) {
+            creation.dynamic_rendering = true;
+        } else if (!strcmp(argv[i], "--gpu-driven")) {
+            creation.gpu_driven = true;
+        } else if (!strcmp(argv[i], "--mesh") && i + 1 < argc &&
+                   creation.num_mesh_paths < max_mesh_paths) {
+            mesh_paths[creation.num_mesh_paths++] = argv[++i];
+        } else if (!strcmp(argv[i], "--texture") && i + 1 < argc &&
+                   creation.num_texture_paths < max_texture_paths) {
+            texture_paths[creation.num_texture_paths++] = argv[++i];
+        } else if (!strcmp(argv[i], "--texture-budget") && i + 1 < argc) {
+            creation.texture_budget = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (!strcmp(argv[i], "--no-pacing")) {
+            creation.frame_pacing = false;
+        } else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+            creation.target_frame_rate = strtof(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--pacing-margin") && i + 1 < argc) {
+            creation.pacing_margin_ms = strtof(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--max-jitter") && i + 1 < argc) {
+            max_jitter_ms = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--bench-jobs")) {
+            bench_jobs = true;
+        } else if (!strcmp(argv[i], "--bench") && i + 1 < argc) {
+            bench_output = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (bench_jobs) {
+        sren::run_job_benchmark(creation.num_threads);
+        return 0;
+    }
+
+    if (bench_output) {
+        sren::GpuBenchmarkCreation bench_creation;
+        bench_creation.gpu_index = creation.gpu_index;
+        bench_creation.gpu_name = creation.gpu_name;
+        if (creation.frame_limit) {
+            bench_creation.frames = creation.frame_limit;
+        }
+        bench_creation.draw_count = creation.draw_count;
+        bench_creation.output_path = strcmp(bench_output, "-") ? bench_output : nullptr;
+        bench_creation.log = creation.log;
+        return sren::run_gpu_benchmark(bench_creation) ? 0 : 1;
+    }
+
+    // Headless runs have no window to close, so give them a default length.
+    if (creation.headless && creation.frame_limit == 0) {
+        creation.frame_limit = 1000;
+    }
 
-int main() {
     sren::Engine engine;
-    if (!engine.init()) {
+    if (!engine.init(creation)) {
+        // Flush whatever explains the failure.
+        sren::LogService::shutdown();
         std::cerr << "Failed to init engine!\n";
         return -1;
     }
 
     engine.run();
 
+    const double jitter_ms = engine.get_frame_pacing_stats().jitter_ms;
     engine.shutdown();
+
+    if (max_jitter_ms > 0.0 && jitter_ms > max_jitter_ms) {
+        std::cerr << "Frame pacing jitter " << jitter_ms << " ms exceeds " << max_jitter_ms << " ms\n";
+        return 1;
+    }
 }
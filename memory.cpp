@@ -0,0 +1,138 @@
+#include "memory.h"
+
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace sren {
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//
+// TrackingAllocator
+//
+
+// Stored right before every tracked allocation.
+struct AllocationHeader {
+    u64 size;
+    // From the start of the malloc'ed block to the returned pointer.
+    u64 offset;
+}; // struct AllocationHeader
+
+static AllocationHeader *get_header(void *pointer) {
+    return (AllocationHeader *)((u8 *)pointer - sizeof(AllocationHeader));
+}
+
+void *TrackingAllocator::allocate(size_t size, size_t alignment) {
+    alignment = alignment > default_alignment ? alignment : default_alignment;
+    u8 *block = (u8 *)malloc(size + alignment + sizeof(AllocationHeader));
+    if (!block) {
+        return nullptr;
+    }
+    u8 *pointer = (u8 *)align_up((size_t)(block + sizeof(AllocationHeader)), alignment);
+    AllocationHeader *header = get_header(pointer);
+    header->size = size;
+    header->offset = (u64)(pointer - block);
+
+    const u64 allocated = allocated_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    u64 peak = peak_bytes.load(std::memory_order_relaxed);
+    while (allocated > peak && !peak_bytes.compare_exchange_weak(peak, allocated)) {
+    }
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return pointer;
+}
+
+void *TrackingAllocator::reallocate(void *pointer, size_t size, size_t alignment) {
+    if (!pointer) {
+        return allocate(size, alignment);
+    }
+    void *new_pointer = allocate(size, alignment);
+    if (new_pointer) {
+        const u64 old_size = get_header(pointer)->size;
+        memcpy(new_pointer, pointer, old_size < size ? old_size : size);
+        deallocate(pointer);
+    }
+    return new_pointer;
+}
+
+void TrackingAllocator::deallocate(void *pointer) {
+    if (!pointer) {
+        return;
+    }
+    AllocationHeader *header = get_header(pointer);
+    allocated_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+    free((u8 *)pointer - header->offset);
+}
+
+MemoryStats TrackingAllocator::get_stats() const {
+    return {name, allocated_bytes.load(), peak_bytes.load(), allocations.load()};
+}
+
+//
+// LinearAllocator
+//
+bool LinearAllocator::init(Allocator *parent_, size_t capacity_) {
+    parent = parent_;
+    memory = (u8 *)parent->allocate(capacity_, default_alignment);
+    if (!memory) {
+        return false;
+    }
+    capacity = capacity_;
+    allocated_size = peak_size = last_allocation = 0;
+    return true;
+}
+
+void LinearAllocator::shutdown() {
+    if (parent) {
+        parent->deallocate(memory);
+    }
+    memory = nullptr;
+    capacity = allocated_size = 0;
+}
+
+void *LinearAllocator::allocate(size_t size, size_t alignment) {
+    const size_t start = align_up(allocated_size, alignment);
+    if (start + size > capacity) {
+        LOG_ERR("Linear allocator out of memory: %zu of %zu bytes used, %zu requested.", allocated_size,
+                capacity, size);
+        return nullptr;
+    }
+    allocated_size = start + size;
+    peak_size = allocated_size > peak_size ? allocated_size : peak_size;
+    last_allocation = start;
+    return memory + start;
+}
+
+void *LinearAllocator::reallocate(void *pointer, size_t size, size_t alignment) {
+    if (!pointer) {
+        return allocate(size, alignment);
+    }
+    const size_t offset = (size_t)((u8 *)pointer - memory);
+    if (offset == last_allocation && offset + size <= capacity) {
+        allocated_size = offset + size;
+        peak_size = allocated_size > peak_size ? allocated_size : peak_size;
+        return pointer;
+    }
+
+    // The old size isn't known, but the allocation can't extend past the end of the used range.
+    const size_t old_size = allocated_size - offset;
+    void *new_pointer = allocate(size, alignment);
+    if (new_pointer) {
+        memcpy(new_pointer, pointer, old_size < size ? old_size : size);
+    }
+    return new_pointer;
+}
+
+void LinearAllocator::free_marker(size_t marker) {
+    if (marker <= allocated_size) {
+        allocated_size = marker;
+        last_allocation = last_allocation < marker ? last_allocation : marker;
+    }
+}
+
+void LinearAllocator::clear() { allocated_size = last_allocation = 0; }
+
+} // namespace sren
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "platform.h"
+
+#include <atomic>
+#include <stddef.h>
+
+namespace sren {
+
+static const size_t default_alignment = 16;
+
+class Allocator {
+  public:
+    virtual ~Allocator() {}
+
+    // Alignment must be a power of two. Returns nullptr when out of memory.
+    virtual void *allocate(size_t size, size_t alignment) = 0;
+    // Keeps the contents up to the smaller size. A null pointer allocates.
+    virtual void *reallocate(void *pointer, size_t size, size_t alignment) = 0;
+    // Null pointers are ignored.
+    virtual void deallocate(void *pointer) = 0;
+}; // class Allocator
+
+template <typename T> T *allocate_array(Allocator &allocator, size_t count) {
+    const size_t alignment = alignof(T) > default_alignment ? alignof(T) : default_alignment;
+    return (T *)allocator.allocate(sizeof(T) * count, alignment);
+}
+
+struct MemoryStats {
+    const char *name;
+    u64 allocated_bytes;
+    u64 peak_bytes;
+    u64 allocations;
+}; // struct MemoryStats
+
+// Heap allocator that counts the bytes it hands out, one per subsystem so each can be reported on its
+// own. Thread safe, drivers call it from their own threads.
+class TrackingAllocator : public Allocator {
+  public:
+    explicit TrackingAllocator(const char *name) : name(name) {}
+
+    void *allocate(size_t size, size_t alignment) override;
+    void *reallocate(void *pointer, size_t size, size_t alignment) override;
+    void deallocate(void *pointer) override;
+
+    MemoryStats get_stats() const;
+
+  private:
+    const char *name;
+    std::atomic<u64> allocated_bytes{0};
+    std::atomic<u64> peak_bytes{0};
+    std::atomic<u64> allocations{0};
+}; // class TrackingAllocator
+
+// Bump allocator over one block. Nothing is freed on its own: everything goes at once with clear, or
+// back to a marker. Not thread safe.
+class LinearAllocator : public Allocator {
+  public:
+    bool init(Allocator *parent, size_t capacity);
+    void shutdown();
+
+    void *allocate(size_t size, size_t alignment) override;
+    // Grows in place when pointer is the last allocation.
+    void *reallocate(void *pointer, size_t size, size_t alignment) override;
+    void deallocate(void *) override {}
+
+    size_t get_marker() const { return allocated_size; }
+    void free_marker(size_t marker);
+    void clear();
+
+    size_t capacity = 0;
+    size_t allocated_size = 0;
+    // Highest allocated_size seen, to size the block.
+    size_t peak_size = 0;
+
+  private:
+    Allocator *parent = nullptr;
+    u8 *memory = nullptr;
+    size_t last_allocation = 0;
+}; // class LinearAllocator
+
+// Frees everything allocated from a linear allocator during its lifetime, for short-lived scratch
+// arrays that shouldn't have to be released on every return path.
+class LinearScope {
+  public:
+    explicit LinearScope(LinearAllocator &allocator)
+        : allocator(allocator), marker(allocator.get_marker()) {}
+    ~LinearScope() { allocator.free_marker(marker); }
+
+  private:
+    LinearAllocator &allocator;
+    size_t marker;
+}; // class LinearScope
+
+} // namespace sren
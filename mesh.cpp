@@ -0,0 +1,639 @@
+#include "mesh.h"
+
+#include "json.h"
+#include "log.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace sren {
+
+// Geometry buffer placement of each buffer view, enough for any vertex format.
+static const u32 geometry_view_alignment = 16;
+
+static const u32 glb_magic = 0x46546c67;       // "glTF"
+static const u32 glb_chunk_json = 0x4e4f534a; // "JSON"
+static const u32 glb_chunk_bin = 0x004e4942;  // "BIN\0"
+// Largest integer a JSON number holds exactly.
+static const u64 max_json_integer = 1ull << 53;
+
+namespace GltfComponent {
+enum Enum { Byte = 5120, UnsignedByte, Short, UnsignedShort, UnsignedInt = 5125, Float }; // enum Enum
+} // namespace GltfComponent
+
+static const char *const gltf_attribute_names[MeshAttribute::Count] = {"POSITION", "NORMAL", "TANGENT",
+                                                                        "TEXCOORD_0"};
+
+struct GltfBuffer {
+    const u8 *data;
+    u64 size;
+    // Mapping holding the data, for prefetching.
+    u32 file;
+}; // struct GltfBuffer
+
+struct GltfView {
+    u32 buffer;
+    u64 offset;
+    u32 length;
+    u32 stride;
+}; // struct GltfView
+
+struct GltfAccessor {
+    // u32_max for sparse accessors and accessors without a buffer view, which aren't supported.
+    u32 view;
+    u32 offset;
+    u32 count;
+    u32 component_type;
+    u32 components;
+    bool normalized;
+    // First three components of the accessor's bounds, required for positions.
+    f32 min[3];
+    f32 max[3];
+}; // struct GltfAccessor
+
+static u32 read_u32(const u8 *data) {
+    u32 value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static u32 gltf_component_size(u32 component_type) {
+    switch (component_type) {
+    case GltfComponent::Byte:
+    case GltfComponent::UnsignedByte:
+        return 1;
+    case GltfComponent::Short:
+    case GltfComponent::UnsignedShort:
+        return 2;
+    case GltfComponent::UnsignedInt:
+    case GltfComponent::Float:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static u32 gltf_component_count(const JsonValue *type) {
+    static const char *const types[] = {"SCALAR", "VEC2", "VEC3", "VEC4"};
+    for (u32 i = 0; i < 4; ++i) {
+        if (JsonDocument::string_equals(type, types[i])) {
+            return i + 1;
+        }
+    }
+    // Matrices aren't vertex attributes.
+    return 0;
+}
+
+static VkFormat gltf_vertex_format(const GltfAccessor &accessor) {
+    static const VkFormat float_formats[4] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+                                              VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat unorm8_formats[4] = {VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8_UNORM,
+                                               VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_R8G8B8A8_UNORM};
+    static const VkFormat snorm8_formats[4] = {VK_FORMAT_R8_SNORM, VK_FORMAT_R8G8_SNORM,
+                                               VK_FORMAT_R8G8B8_SNORM, VK_FORMAT_R8G8B8A8_SNORM};
+    static const VkFormat unorm16_formats[4] = {VK_FORMAT_R16_UNORM, VK_FORMAT_R16G16_UNORM,
+                                                VK_FORMAT_R16G16B16_UNORM, VK_FORMAT_R16G16B16A16_UNORM};
+    static const VkFormat snorm16_formats[4] = {VK_FORMAT_R16_SNORM, VK_FORMAT_R16G16_SNORM,
+                                                VK_FORMAT_R16G16B16_SNORM, VK_FORMAT_R16G16B16A16_SNORM};
+    if (accessor.components == 0 || accessor.components > 4) {
+        return VK_FORMAT_UNDEFINED;
+    }
+    const u32 i = accessor.components - 1;
+    // glTF only allows normalized or float components for the supported attributes.
+    switch (accessor.component_type) {
+    case GltfComponent::Float:
+        return float_formats[i];
+    case GltfComponent::UnsignedByte:
+        return accessor.normalized ? unorm8_formats[i] : VK_FORMAT_UNDEFINED;
+    case GltfComponent::Byte:
+        return accessor.normalized ? snorm8_formats[i] : VK_FORMAT_UNDEFINED;
+    case GltfComponent::UnsignedShort:
+        return accessor.normalized ? unorm16_formats[i] : VK_FORMAT_UNDEFINED;
+    case GltfComponent::Short:
+        return accessor.normalized ? snorm16_formats[i] : VK_FORMAT_UNDEFINED;
+    default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
+static VkPrimitiveTopology gltf_topology(u32 mode) {
+    switch (mode) {
+    case 0:
+        return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    case 1:
+        return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    case 3:
+        return VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
+    case 5:
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    case 6:
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN;
+    case 4:
+    default:
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    }
+}
+
+// Resolves glTF buffers, buffer views and accessors to ranges of the mapped files, and lays out every
+// buffer view the meshes use in the geometry buffer.
+class GltfParser {
+  public:
+    GltfParser(const char *path, MeshGeometry &geometry) : path(path), geometry(geometry) {}
+
+    bool parse();
+
+  private:
+    bool map_file(const char *file_path, u32 &file);
+    // Reads a whole, non-negative number of at most max, or default_value when the key is missing.
+    // Returns false for anything else, which can't be cast safely.
+    bool get_integer(const JsonValue *object, const char *key, u64 default_value, u64 max,
+                     u64 &value) const;
+    bool get_u32(const JsonValue *object, const char *key, u32 default_value, u32 &value) const;
+    bool parse_buffers(const JsonValue *root, const u8 *bin, u64 bin_size);
+    bool parse_views(const JsonValue *root);
+    bool parse_accessors(const JsonValue *root);
+    void parse_primitive(const JsonValue *primitive, u32 mesh_index);
+    // Places the accessor's buffer view in the geometry buffer, if not done yet, and checks that count
+    // elements of element_size fit the view. Returns the accessor's offset in the geometry buffer.
+    bool place_accessor(u32 accessor_index, u32 element_size, u32 &offset, u32 &stride);
+    // Largest value of a placed, tightly packed index accessor.
+    u32 max_index(const GltfAccessor &accessor, u32 index_size) const;
+
+    const char *path;
+    MeshGeometry &geometry;
+    JsonDocument json;
+    std::vector<GltfBuffer> buffers;
+    std::vector<GltfView> views;
+    std::vector<GltfAccessor> accessors;
+    // Offset of each view in the geometry buffer, u32_max until used.
+    std::vector<u32> view_offsets;
+    u64 geometry_size = 0;
+}; // class GltfParser
+
+bool GltfParser::map_file(const char *file_path, u32 &file) {
+    if (geometry.num_files >= max_mesh_files) {
+        LOG_ERR("%s: more than %u files.", path, max_mesh_files);
+        return false;
+    }
+    if (!geometry.files[geometry.num_files].map(file_path)) {
+        LOG_ERR("%s: failed to map %s", path, file_path);
+        return false;
+    }
+    file = geometry.num_files++;
+    return true;
+}
+
+bool GltfParser::get_integer(const JsonValue *object, const char *key, u64 default_value, u64 max,
+                             u64 &value) const {
+    const JsonValue *member = json.get_member(object, key);
+    if (!member) {
+        value = default_value;
+        return true;
+    }
+    // Also rejects NaN.
+    if (member->type != JsonType::Number || !(member->number >= 0.0 && member->number <= (f64)max) ||
+        floor(member->number) != member->number) {
+        return false;
+    }
+    value = (u64)member->number;
+    return true;
+}
+
+bool GltfParser::get_u32(const JsonValue *object, const char *key, u32 default_value, u32 &value) const {
+    u64 integer;
+    if (!get_integer(object, key, default_value, u32_max, integer)) {
+        return false;
+    }
+    value = (u32)integer;
+    return true;
+}
+
+bool GltfParser::parse() {
+    // Mapped by load_mesh.
+    const u8 *data = (const u8 *)geometry.files[0].data;
+    const u64 size = geometry.files[0].size;
+
+    // GLB: header, then a JSON chunk and an optional binary chunk.
+    const char *json_text = (const char *)data;
+    u64 json_size = size;
+    const u8 *bin = nullptr;
+    u64 bin_size = 0;
+    if (size >= 12 && read_u32(data) == glb_magic) {
+        if (read_u32(data + 4) != 2 || read_u32(data + 8) > size) {
+            LOG_ERR("%s: unsupported GLB version or truncated file.", path);
+            return false;
+        }
+        const u64 length = read_u32(data + 8);
+        u64 chunk = 12;
+        json_text = nullptr;
+        while (chunk + 8 <= length) {
+            const u64 chunk_size = read_u32(data + chunk);
+            const u32 chunk_type = read_u32(data + chunk + 4);
+            if (chunk + 8 + chunk_size > length) {
+                break;
+            }
+            if (chunk_type == glb_chunk_json && !json_text) {
+                json_text = (const char *)data + chunk + 8;
+                json_size = chunk_size;
+            } else if (chunk_type == glb_chunk_bin && !bin) {
+                bin = data + chunk + 8;
+                bin_size = chunk_size;
+            }
+            chunk += 8 + chunk_size;
+        }
+        if (!json_text) {
+            LOG_ERR("%s: GLB without a JSON chunk.", path);
+            return false;
+        }
+    }
+
+    // The JSON chunk may be padded with spaces, which the parser skips.
+    if (!json.parse(json_text, (size_t)json_size)) {
+        LOG_ERR("%s: invalid glTF JSON.", path);
+        return false;
+    }
+    const JsonValue *root = json.get_root();
+    if (!parse_buffers(root, bin, bin_size) || !parse_views(root) || !parse_accessors(root)) {
+        return false;
+    }
+
+    const JsonValue *meshes = json.get_member(root, "meshes");
+    u32 mesh_index = 0;
+    for (const JsonValue *mesh = json.get_first_child(meshes); mesh;
+         mesh = json.get_next_sibling(mesh)) {
+        const JsonValue *primitives = json.get_member(mesh, "primitives");
+        for (const JsonValue *primitive = json.get_first_child(primitives); primitive;
+             primitive = json.get_next_sibling(primitive)) {
+            parse_primitive(primitive, mesh_index);
+        }
+        ++mesh_index;
+    }
+
+    if (geometry.primitives.empty()) {
+        LOG_ERR("%s: no supported mesh primitives.", path);
+        return false;
+    }
+    if (geometry_size > u32_max) {
+        LOG_ERR("%s: %llu bytes of geometry exceed the 4 GB buffer limit.", path,
+                (unsigned long long)geometry_size);
+        return false;
+    }
+    geometry.size = (u32)geometry_size;
+    return true;
+}
+
+bool GltfParser::parse_buffers(const JsonValue *root, const u8 *bin, u64 bin_size) {
+    // Paths of external buffers are relative to the glTF file.
+    const char *slash = strrchr(path, '/');
+    const u32 directory_length = slash ? (u32)(slash - path) + 1 : 0;
+
+    const JsonValue *buffer_values = json.get_member(root, "buffers");
+    for (const JsonValue *value = json.get_first_child(buffer_values); value;
+         value = json.get_next_sibling(value)) {
+        GltfBuffer buffer = {};
+        u64 length;
+        if (!get_integer(value, "byteLength", 0, max_json_integer, length)) {
+            LOG_ERR("%s: buffer %zu has an invalid length.", path, buffers.size());
+            return false;
+        }
+        const JsonValue *uri = json.get_member(value, "uri");
+        if (!uri) {
+            // The GLB binary chunk, only valid for the first buffer.
+            if (!buffers.empty() || !bin) {
+                LOG_ERR("%s: buffer %zu has no data.", path, buffers.size());
+                return false;
+            }
+            buffer = {bin, bin_size, 0};
+        } else {
+            char buffer_path[max_mesh_path_length];
+            memcpy(buffer_path, path, directory_length);
+            if (!JsonDocument::copy_string(uri, buffer_path + directory_length,
+                                           max_mesh_path_length - directory_length)) {
+                LOG_ERR("%s: buffer uri too long.", path);
+                return false;
+            }
+            if (!strncmp(buffer_path + directory_length, "data:", 5)) {
+                // Would need decoding into a copy, instead of streaming from the mapping.
+                LOG_ERR("%s: embedded data URIs aren't supported, use .glb or .bin buffers.",
+                        path);
+                return false;
+            }
+            if (!map_file(buffer_path, buffer.file)) {
+                return false;
+            }
+            buffer.data = (const u8 *)geometry.files[buffer.file].data;
+            buffer.size = geometry.files[buffer.file].size;
+        }
+        if (length > buffer.size) {
+            LOG_ERR("%s: buffer %zu is truncated.", path, buffers.size());
+            return false;
+        }
+        buffer.size = length;
+        buffers.push_back(buffer);
+    }
+    return true;
+}
+
+bool GltfParser::parse_views(const JsonValue *root) {
+    const JsonValue *view_values = json.get_member(root, "bufferViews");
+    for (const JsonValue *value = json.get_first_child(view_values); value;
+         value = json.get_next_sibling(value)) {
+        GltfView view;
+        u64 length;
+        if (!get_u32(value, "buffer", u32_max, view.buffer) ||
+            !get_integer(value, "byteOffset", 0, max_json_integer, view.offset) ||
+            !get_integer(value, "byteLength", 0, max_json_integer, length) ||
+            !get_u32(value, "byteStride", 0, view.stride)) {
+            // Kept as a placeholder so the following views keep their index, no accessor can use it.
+            LOG_ERR("%s: buffer view %zu has invalid numbers, skipping it.", path, views.size());
+            views.push_back({u32_max, 0, 0, 0});
+            continue;
+        }
+        view.length = (u32)length;
+        if (view.buffer >= buffers.size() || length > u32_max ||
+            view.offset + length > buffers[view.buffer].size) {
+            LOG_ERR("%s: buffer view %zu is out of bounds.", path, views.size());
+            return false;
+        }
+        views.push_back(view);
+    }
+    view_offsets.assign(views.size(), u32_max);
+    return true;
+}
+
+bool GltfParser::parse_accessors(const JsonValue *root) {
+    const JsonValue *accessor_values = json.get_member(root, "accessors");
+    for (const JsonValue *value = json.get_first_child(accessor_values); value;
+         value = json.get_next_sibling(value)) {
+        GltfAccessor accessor = {};
+        if (!get_u32(value, "bufferView", u32_max, accessor.view) ||
+            !get_u32(value, "byteOffset", 0, accessor.offset) ||
+            !get_u32(value, "count", 0, accessor.count) ||
+            !get_u32(value, "componentType", 0, accessor.component_type)) {
+            LOG_ERR("%s: accessor %zu has invalid numbers, skipping it.", path, accessors.size());
+            accessor.view = u32_max;
+        }
+        if (json.get_member(value, "sparse") || accessor.view >= views.size() ||
+            views[accessor.view].buffer == u32_max) {
+            accessor.view = u32_max;
+        }
+        accessor.components = gltf_component_count(json.get_member(value, "type"));
+        const JsonValue *normalized = json.get_member(value, "normalized");
+        accessor.normalized = normalized && normalized->number != 0.0;
+        const JsonValue *min = json.get_first_child(json.get_member(value, "min"));
+        const JsonValue *max = json.get_first_child(json.get_member(value, "max"));
+        for (u32 i = 0; i < 3; ++i) {
+            accessor.min[i] = min ? (f32)min->number : 0.0f;
+            accessor.max[i] = max ? (f32)max->number : 0.0f;
+            min = json.get_next_sibling(min);
+            max = json.get_next_sibling(max);
+        }
+        accessors.push_back(accessor);
+    }
+    return true;
+}
+
+bool GltfParser::place_accessor(u32 accessor_index, u32 element_size, u32 &offset, u32 &stride) {
+    if (accessor_index >= accessors.size() || accessors[accessor_index].view == u32_max) {
+        return false;
+    }
+    const GltfAccessor &accessor = accessors[accessor_index];
+    const GltfView &view = views[accessor.view];
+    stride = view.stride ? view.stride : element_size;
+    const u64 end = accessor.count
+                        ? (u64)accessor.offset + (u64)stride * (accessor.count - 1) + element_size
+                        : accessor.offset;
+    if (end > view.length) {
+        return false;
+    }
+
+    u32 &view_offset = view_offsets[accessor.view];
+    if (view_offset == u32_max) {
+        geometry_size = (geometry_size + geometry_view_alignment - 1) / geometry_view_alignment *
+                        geometry_view_alignment;
+        // Checked against the 4 GB limit once everything is placed.
+        view_offset = (u32)geometry_size;
+        const GltfBuffer &buffer = buffers[view.buffer];
+        geometry.regions.push_back({buffer.data + view.offset, view.length, view_offset});
+        geometry_size += view.length;
+    }
+    offset = view_offset + accessor.offset;
+    return true;
+}
+
+u32 GltfParser::max_index(const GltfAccessor &accessor, u32 index_size) const {
+    const GltfView &view = views[accessor.view];
+    const u8 *data = buffers[view.buffer].data + view.offset + accessor.offset;
+    u32 max = 0;
+    for (u32 i = 0; i < accessor.count; ++i) {
+        u32 index;
+        if (index_size == 2) {
+            u16 index16;
+            memcpy(&index16, data + i * 2, 2);
+            index = index16;
+        } else {
+            memcpy(&index, data + i * 4, 4);
+        }
+        max = index > max ? index : max;
+    }
+    return max;
+}
+
+void GltfParser::parse_primitive(const JsonValue *primitive, u32 mesh_index) {
+    MeshPrimitive result = {};
+    u32 mode;
+    if (!get_u32(primitive, "mode", 4, mode) ||
+        !get_u32(primitive, "material", u32_max, result.material)) {
+        LOG_ERR("%s: mesh %u has an invalid mode or material, skipping the primitive.", path,
+                mesh_index);
+        return;
+    }
+    result.topology = gltf_topology(mode);
+    result.index_type = VK_INDEX_TYPE_UINT32;
+
+    const JsonValue *attributes = json.get_member(primitive, "attributes");
+    for (u32 i = 0; i < MeshAttribute::Count; ++i) {
+        if (!json.get_member(attributes, gltf_attribute_names[i])) {
+            continue;
+        }
+        u32 accessor_index = u32_max;
+        const GltfAccessor *accessor =
+            get_u32(attributes, gltf_attribute_names[i], u32_max, accessor_index) &&
+                    accessor_index < accessors.size()
+                ? &accessors[accessor_index]
+                : nullptr;
+        MeshAttributeView &view = result.attributes[i];
+        view.format = accessor ? gltf_vertex_format(*accessor) : VK_FORMAT_UNDEFINED;
+        const u32 element_size =
+            accessor ? gltf_component_size(accessor->component_type) * accessor->components : 0;
+        if (view.format == VK_FORMAT_UNDEFINED ||
+            !place_accessor(accessor_index, element_size, view.offset, view.stride)) {
+            LOG_ERR("%s: mesh %u has an unsupported %s accessor, skipping the primitive.", path,
+                    mesh_index, gltf_attribute_names[i]);
+            return;
+        }
+        // Position comes first, the other attributes are read for every vertex it has.
+        if (accessor->count < result.vertex_count) {
+            LOG_ERR("%s: mesh %u has fewer %s than positions, skipping the primitive.", path,
+                    mesh_index, gltf_attribute_names[i]);
+            return;
+        }
+        if (i == MeshAttribute::Position) {
+            result.vertex_count = accessor->count;
+            memcpy(result.bounds_min, accessor->min, sizeof(result.bounds_min));
+            memcpy(result.bounds_max, accessor->max, sizeof(result.bounds_max));
+        }
+    }
+    if (result.attributes[MeshAttribute::Position].format == VK_FORMAT_UNDEFINED) {
+        LOG_ERR("%s: mesh %u has a primitive without positions, skipping it.", path, mesh_index);
+        return;
+    }
+
+    if (json.get_member(primitive, "indices")) {
+        u32 indices = u32_max;
+        const GltfAccessor *accessor =
+            get_u32(primitive, "indices", u32_max, indices) && indices < accessors.size()
+                ? &accessors[indices]
+                : nullptr;
+        const u32 component_type = accessor ? accessor->component_type : 0;
+        // Index buffers are bound as they are stored, so they have to be tightly packed u16 or u32.
+        const bool supported = accessor && accessor->components == 1 &&
+                               (component_type == GltfComponent::UnsignedShort ||
+                                component_type == GltfComponent::UnsignedInt);
+        const u32 index_size = gltf_component_size(component_type);
+        u32 stride = 0;
+        if (!supported || !place_accessor(indices, index_size, result.index_offset, stride) ||
+            stride != index_size) {
+            LOG_ERR("%s: mesh %u has unsupported indices, skipping the primitive.", path,
+                    mesh_index);
+            return;
+        }
+        // Out of range indices would read past the vertex streams.
+        if (accessor->count && max_index(*accessor, index_size) >= result.vertex_count) {
+            LOG_ERR("%s: mesh %u has indices past its vertices, skipping the primitive.", path,
+                    mesh_index);
+            return;
+        }
+        result.index_count = accessor->count;
+        result.index_type =
+            component_type == GltfComponent::UnsignedShort ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    }
+    geometry.primitives.push_back(result);
+}
+
+static bool load_cooked_mesh(const char *path, MeshGeometry &geometry) {
+    const MappedFile &file = geometry.files[0];
+    const u8 *data = (const u8 *)file.data;
+    CookedMeshHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != cooked_mesh_version) {
+        LOG_ERR("%s: cooked mesh version %u, expected %u. Cook it again.", path, header.version,
+                cooked_mesh_version);
+        return false;
+    }
+    const u64 table_end = sizeof(header) + (u64)header.num_primitives * sizeof(CookedPrimitive);
+    if (header.num_primitives == 0 || table_end > header.geometry_offset ||
+        (u64)header.geometry_offset + header.geometry_size > file.size) {
+        LOG_ERR("%s: truncated cooked mesh.", path);
+        return false;
+    }
+
+    const u32 stride = sizeof(CookedVertexAttributes);
+    geometry.primitives.resize(header.num_primitives);
+    for (u32 i = 0; i < header.num_primitives; ++i) {
+        CookedPrimitive cooked;
+        memcpy(&cooked, data + sizeof(header) + i * sizeof(CookedPrimitive), sizeof(cooked));
+        const u64 index_end = (u64)cooked.index_offset + (u64)cooked.index_count * cooked.index_size;
+        const u64 attribute_end = (u64)cooked.attribute_offset + (u64)cooked.vertex_count * stride;
+        const u64 position_end =
+            (u64)cooked.position_offset + (u64)cooked.vertex_count * 3 * sizeof(f32);
+        if ((cooked.index_size != 2 && cooked.index_size != 4) || index_end > header.geometry_size ||
+            attribute_end > header.geometry_size || position_end > header.geometry_size) {
+            LOG_ERR("%s: cooked primitive %u is out of bounds.", path, i);
+            return false;
+        }
+
+        MeshPrimitive &primitive = geometry.primitives[i];
+        primitive = {};
+        primitive.attributes[MeshAttribute::Position] = {VK_FORMAT_R32G32B32_SFLOAT,
+                                                         cooked.position_offset, 3 * sizeof(f32)};
+        primitive.attributes[MeshAttribute::Normal] = {
+            VK_FORMAT_R8G8B8A8_SNORM,
+            cooked.attribute_offset + (u32)offsetof(CookedVertexAttributes, normal), stride};
+        primitive.attributes[MeshAttribute::Tangent] = {
+            VK_FORMAT_R8G8B8A8_SNORM,
+            cooked.attribute_offset + (u32)offsetof(CookedVertexAttributes, tangent), stride};
+        primitive.attributes[MeshAttribute::TexCoord0] = {
+            VK_FORMAT_R16G16_SFLOAT, cooked.attribute_offset + (u32)offsetof(CookedVertexAttributes, uv),
+            stride};
+        primitive.vertex_count = cooked.vertex_count;
+        primitive.index_offset = cooked.index_offset;
+        primitive.index_count = cooked.index_count;
+        primitive.index_type = cooked.index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        primitive.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        primitive.material = cooked.material;
+        memcpy(primitive.bounds_min, cooked.bounds_min, sizeof(primitive.bounds_min));
+        memcpy(primitive.bounds_max, cooked.bounds_max, sizeof(primitive.bounds_max));
+    }
+
+    // The geometry block is uploaded as stored.
+    geometry.size = header.geometry_size;
+    geometry.regions.push_back({data + header.geometry_offset, header.geometry_size, 0});
+    return true;
+}
+
+bool load_mesh(const char *path, MeshGeometry &geometry) {
+    geometry.release_files();
+    geometry.primitives.clear();
+    geometry.size = 0;
+    if (!geometry.files[0].map(path)) {
+        LOG_ERR("Failed to map mesh %s", path);
+        return false;
+    }
+    geometry.num_files = 1;
+
+    const MappedFile &file = geometry.files[0];
+    const bool cooked =
+        file.size >= sizeof(CookedMeshHeader) && read_u32((const u8 *)file.data) == cooked_mesh_magic;
+    const bool loaded = cooked ? load_cooked_mesh(path, geometry) : GltfParser(path, geometry).parse();
+    if (!loaded) {
+        geometry.release_files();
+        geometry.primitives.clear();
+        geometry.size = 0;
+        return false;
+    }
+
+    // Start reading the used ranges in, the copies into staging memory happen later on the main thread.
+    for (const MeshUploadRegion &region : geometry.regions) {
+        for (u32 i = 0; i < geometry.num_files; ++i) {
+            const MappedFile &mapping = geometry.files[i];
+            if (region.data >= (const u8 *)mapping.data &&
+                region.data < (const u8 *)mapping.data + mapping.size) {
+                mapping.prefetch((size_t)(region.data - (const u8 *)mapping.data), region.size);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+const u8 *MeshGeometry::resolve(u32 offset, u32 resolve_size) const {
+    for (const MeshUploadRegion &region : regions) {
+        if (offset >= region.offset && (u64)offset + resolve_size <= (u64)region.offset + region.size) {
+            return region.data + (offset - region.offset);
+        }
+    }
+    return nullptr;
+}
+
+void MeshGeometry::release_files() {
+    for (u32 i = 0; i < num_files; ++i) {
+        files[i].unmap();
+    }
+    num_files = 0;
+    regions.clear();
+    regions.shrink_to_fit();
+}
+
+} // namespace sren
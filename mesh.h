@@ -0,0 +1,113 @@
+#pragma once
+
+#include "file.h"
+#include "platform.h"
+
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+namespace sren {
+
+static const u32 max_mesh_path_length = 512;
+// Files mapped per mesh: the glTF/GLB file and its external buffers.
+static const u32 max_mesh_files = 8;
+
+namespace MeshAttribute {
+enum Enum { Position, Normal, Tangent, TexCoord0, Count }; // enum Enum
+} // namespace MeshAttribute
+
+// One vertex attribute inside the geometry buffer, bindable as a vertex stream.
+struct MeshAttributeView {
+    // VK_FORMAT_UNDEFINED when the primitive doesn't have the attribute.
+    VkFormat format;
+    u32 offset;
+    u32 stride;
+}; // struct MeshAttributeView
+
+struct MeshPrimitive {
+    MeshAttributeView attributes[MeshAttribute::Count];
+    u32 vertex_count;
+
+    // Offset in the geometry buffer. Primitives without indices have an index_count of 0.
+    u32 index_offset;
+    u32 index_count;
+    VkIndexType index_type;
+
+    VkPrimitiveTopology topology;
+    // glTF material index, u32_max for the default material.
+    u32 material;
+
+    // Object space bounding box, zero when the file doesn't have one.
+    f32 bounds_min[3];
+    f32 bounds_max[3];
+}; // struct MeshPrimitive
+
+// Part of a mapped file, copied to offset in the geometry buffer.
+struct MeshUploadRegion {
+    const u8 *data;
+    u32 size;
+    u32 offset;
+}; // struct MeshUploadRegion
+
+// A mesh file's primitives, which reference offsets in one geometry buffer of size bytes. The buffer's
+// contents are ranges of the mapped files, nothing is copied while loading.
+struct MeshGeometry {
+    std::vector<MeshPrimitive> primitives;
+    u32 size = 0;
+
+    MappedFile files[max_mesh_files];
+    u32 num_files = 0;
+    std::vector<MeshUploadRegion> regions;
+
+    // The size bytes at a geometry buffer offset, null unless they are inside one region.
+    const u8 *resolve(u32 offset, u32 size) const;
+    // Unmaps the files and drops the regions, the primitives stay.
+    void release_files();
+}; // struct MeshGeometry
+
+// Cooked meshes, written by tools/mesh_cooker.cpp: a header, the primitive table and the geometry
+// block, stored exactly as it is uploaded. Little endian.
+static const u32 cooked_mesh_magic = 0x48534d53; // "SMSH"
+// Bumped whenever the layout or the vertex formats change, older files are rejected.
+static const u32 cooked_mesh_version = 1;
+static const u32 cooked_mesh_alignment = 16;
+
+struct CookedMeshHeader {
+    u32 magic;
+    u32 version;
+    u32 num_primitives;
+    // From the start of the file, aligned to cooked_mesh_alignment.
+    u32 geometry_offset;
+    u32 geometry_size;
+    u32 padding[3];
+}; // struct CookedMeshHeader
+
+// Offsets are in the geometry block. Primitives are indexed triangle lists with two vertex streams:
+// positions as 3 floats, and a CookedVertexAttributes per vertex.
+struct CookedPrimitive {
+    u32 vertex_count;
+    u32 index_count;
+    // 2 or 4 bytes.
+    u32 index_size;
+    u32 material;
+    u32 position_offset;
+    u32 attribute_offset;
+    u32 index_offset;
+    u32 padding;
+    f32 bounds_min[3];
+    f32 bounds_max[3];
+}; // struct CookedPrimitive
+
+struct CookedVertexAttributes {
+    // Unit normal, and tangent with the bitangent sign in w, as snorm8.
+    i8 normal[4];
+    i8 tangent[4];
+    // Half floats, UVs can leave the 0-1 range.
+    u16 uv[2];
+}; // struct CookedVertexAttributes
+
+// Maps a .gltf, .glb or cooked mesh and resolves its primitives. Cooked meshes need no parsing: their
+// geometry is one region of the file. Safe to call from job threads.
+bool load_mesh(const char *path, MeshGeometry &geometry);
+
+} // namespace sren
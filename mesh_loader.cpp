@@ -0,0 +1,167 @@
+#include "mesh_loader.h"
+
+#include "log.h"
+#include "timer.h"
+
+#include <string.h>
+
+namespace sren {
+
+MeshLoaderCreation &MeshLoaderCreation::set_upload_budget(u32 upload_budget_) {
+    upload_budget = upload_budget_;
+    return *this;
+}
+
+void MeshLoader::init(Device &device_, JobSystem &job_system_, const MeshLoaderCreation &creation) {
+    device = &device_;
+    job_system = &job_system_;
+    upload_budget = creation.upload_budget ? creation.upload_budget : 1;
+}
+
+void MeshLoader::shutdown() {
+    if (!job_system) {
+        return;
+    }
+    job_system->wait(&parse_counter);
+    for (MeshAsset *asset : assets) {
+        if (asset->geometry.index != invalid_resource_handle) {
+            device->destroy_buffer(asset->geometry);
+        }
+        release_files(*asset);
+        delete asset;
+    }
+    assets.clear();
+    num_pending = 0;
+    job_system = nullptr;
+}
+
+MeshHandle MeshLoader::load(const char *path) {
+    if (strlen(path) >= max_mesh_path_length) {
+        LOG_ERR("Mesh path too long: %s", path);
+        return invalid_mesh;
+    }
+    MeshAsset *asset = new MeshAsset();
+    strcpy(asset->path, path);
+    asset->request_time = time_now();
+    assets.push_back(asset);
+    ++num_pending;
+
+    JobDecl job;
+    job.function = parse_job;
+    job.data = asset;
+    job_system->run(&job, 1, &parse_counter);
+    return {(u32)assets.size() - 1};
+}
+
+void MeshLoader::parse_job(void *data, u32) {
+    MeshAsset &asset = *(MeshAsset *)data;
+    const i64 start = time_now();
+    const bool parsed = load_mesh(asset.path, asset.mesh);
+    asset.parse_ms = time_elapsed_ms(start);
+    // Publishes the parsing results to the main thread.
+    asset.state.store(parsed ? MeshLoadState::Parsed : MeshLoadState::Failed, std::memory_order_release);
+}
+
+void MeshLoader::update() {
+    u32 budget = upload_budget;
+    num_pending = 0;
+    // In load order, so the first requested assets become usable first.
+    for (MeshAsset *asset : assets) {
+        u32 state = asset->state.load(std::memory_order_acquire);
+        if (state == MeshLoadState::Parsed) {
+            asset->geometry = device->create_buffer(
+                BufferCreation()
+                    .set(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                         ResourceUsageType::Immutable, asset->mesh.size)
+                    .set_name(asset->path));
+            if (asset->geometry.index == invalid_resource_handle) {
+                LOG_ERR("%s: failed to create the geometry buffer.", asset->path);
+                release_files(*asset);
+                state = MeshLoadState::Failed;
+            } else {
+                asset->upload_start = time_now();
+                state = MeshLoadState::Uploading;
+            }
+            asset->state.store(state, std::memory_order_relaxed);
+        }
+
+        if (state == MeshLoadState::Uploading) {
+            if (asset->next_region < asset->mesh.regions.size()) {
+                if (budget > 0) {
+                    budget -= upload(*asset, budget);
+                    state = asset->state.load(std::memory_order_relaxed);
+                }
+            } else if (device->is_upload_ready(asset->last_upload)) {
+                const i64 now = time_now();
+                asset->upload_ms = time_delta_ms(asset->upload_start, now);
+                asset->total_ms = time_delta_ms(asset->request_time, now);
+                state = MeshLoadState::Ready;
+                asset->state.store(state, std::memory_order_relaxed);
+                LOG_INFO("Loaded %s: %zu primitives, %.2f MB, parsed in %.3f ms, uploaded in %.3f ms, "
+                         "usable %.3f ms after the request",
+                         asset->path, asset->mesh.primitives.size(),
+                         asset->mesh.size / (1024.0 * 1024.0), asset->parse_ms, asset->upload_ms, asset->total_ms);
+            }
+        }
+
+        if (state != MeshLoadState::Ready && state != MeshLoadState::Failed) {
+            ++num_pending;
+        }
+    }
+}
+
+u32 MeshLoader::upload(MeshAsset &asset, u32 budget) {
+    u32 uploaded = 0;
+    while (asset.next_region < asset.mesh.regions.size() && uploaded < budget) {
+        const MeshUploadRegion &region = asset.mesh.regions[asset.next_region];
+        const u32 remaining = region.size - asset.region_offset;
+        const u32 size = remaining < budget - uploaded ? remaining : budget - uploaded;
+        // Copied from the mapping into staging memory right away.
+        const u64 upload = device->upload_buffer(asset.geometry, region.data + asset.region_offset, size,
+                                                 region.offset + asset.region_offset);
+        if (!upload) {
+            LOG_ERR("%s: geometry upload failed.", asset.path);
+            device->destroy_buffer(asset.geometry);
+            asset.geometry = invalid_buffer;
+            release_files(asset);
+            asset.state.store(MeshLoadState::Failed, std::memory_order_relaxed);
+            return uploaded;
+        }
+        asset.last_upload = upload;
+        uploaded += size;
+        asset.region_offset += size;
+        if (asset.region_offset == region.size) {
+            asset.region_offset = 0;
+            asset.next_region++;
+        }
+    }
+
+    if (asset.next_region == asset.mesh.regions.size()) {
+        // Everything is in staging memory, the files aren't needed anymore.
+        release_files(asset);
+    }
+    return uploaded;
+}
+
+void MeshLoader::release_files(MeshAsset &asset) {
+    asset.mesh.release_files();
+    asset.next_region = 0;
+    asset.region_offset = 0;
+}
+
+const MeshAsset *MeshLoader::get_ready(MeshHandle mesh) const {
+    if (mesh.index >= assets.size() ||
+        assets[mesh.index]->state.load(std::memory_order_acquire) != MeshLoadState::Ready) {
+        return nullptr;
+    }
+    return assets[mesh.index];
+}
+
+MeshLoadState::Enum MeshLoader::get_state(MeshHandle mesh) const {
+    if (mesh.index >= assets.size()) {
+        return MeshLoadState::Failed;
+    }
+    return (MeshLoadState::Enum)assets[mesh.index]->state.load(std::memory_order_acquire);
+}
+
+} // namespace sren
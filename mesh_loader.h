@@ -0,0 +1,91 @@
+#pragma once
+
+#include "device.h"
+#include "job_system.h"
+#include "mesh.h"
+#include "platform.h"
+
+#include <atomic>
+#include <vector>
+
+namespace sren {
+
+namespace MeshLoadState {
+// Parsing runs on a job thread, the other states are handled by MeshLoader::update.
+enum Enum { Parsing, Parsed, Uploading, Ready, Failed, Count }; // enum Enum
+} // namespace MeshLoadState
+
+struct MeshAsset {
+    char path[max_mesh_path_length];
+    std::atomic<u32> state{MeshLoadState::Parsing};
+
+    // Every primitive's vertices and indices, copied as stored in the file. The mesh's files are
+    // released once everything is uploaded.
+    BufferHandle geometry = invalid_buffer;
+    MeshGeometry mesh;
+
+    // Latencies: parsing on the job thread, from the first upload until the GPU can use the geometry,
+    // and from the load request until then.
+    i64 request_time = 0;
+    f64 parse_ms = 0.0;
+    i64 upload_start = 0;
+    f64 upload_ms = 0.0;
+    f64 total_ms = 0.0;
+
+    // Upload progress through the mesh's regions.
+    u32 next_region = 0;
+    u32 region_offset = 0;
+    u64 last_upload = 0;
+}; // struct MeshAsset
+
+struct MeshHandle {
+    u32 index;
+}; // struct MeshHandle
+
+static const MeshHandle invalid_mesh{u32_max};
+
+struct MeshLoaderCreation {
+    // Bytes handed to the upload manager per update, so streaming never stalls a frame on the staging
+    // ring.
+    u32 upload_budget = 32 * 1024 * 1024;
+
+    MeshLoaderCreation &set_upload_budget(u32 upload_budget);
+}; // struct MeshLoaderCreation
+
+// Streams glTF 2.0 (.gltf with .bin buffers, or .glb) and cooked meshes. Files are memory mapped and
+// parsed on job threads; vertex and index data is then copied from the mappings straight into staging
+// memory, a budget per frame, and from there into one device local buffer per asset. glTF meshes with
+// sparse accessors, embedded data URIs or 8-bit indices aren't supported.
+class MeshLoader {
+  public:
+    void init(Device &device, JobSystem &job_system, const MeshLoaderCreation &creation);
+    // Waits for the parsing jobs and destroys every asset.
+    void shutdown();
+
+    // Starts loading in the background. The path is copied.
+    MeshHandle load(const char *path);
+    // Main thread, once per frame: creates and fills the geometry buffers of parsed assets.
+    void update();
+
+    // Null until the asset is Ready, and for failed or invalid handles.
+    const MeshAsset *get_ready(MeshHandle mesh) const;
+    MeshLoadState::Enum get_state(MeshHandle mesh) const;
+    u32 get_num_pending() const { return num_pending; }
+
+  private:
+    static void parse_job(void *data, u32 thread_index);
+    // Starts the asset's uploads, within budget. Returns the bytes uploaded.
+    u32 upload(MeshAsset &asset, u32 budget);
+    void release_files(MeshAsset &asset);
+
+    Device *device = nullptr;
+    JobSystem *job_system = nullptr;
+    u32 upload_budget = 0;
+
+    // Pointers, assets are written by the jobs while more are added.
+    std::vector<MeshAsset *> assets;
+    u32 num_pending = 0;
+    JobCounter parse_counter;
+}; // class MeshLoader
+
+} // namespace sren
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "memory.h"
+#include "platform.h"
+
+#include <assert.h>
+#include <string.h>
+#include <type_traits>
+
+namespace sren {
+
+// 32-bit generational handle: the low bits index the pool slot, the high bits store the slot's
+// generation so handles to released (and possibly reused) slots are detected as stale.
+typedef u32 ResourceHandle;
+
+static const u32 resource_handle_index_bits = 20;
+static const u32 resource_handle_index_mask = (1u << resource_handle_index_bits) - 1;
+static const u32 resource_handle_generation_mask = (1u << (32 - resource_handle_index_bits)) - 1;
+static const ResourceHandle invalid_resource_handle = u32_max;
+
+inline u32 resource_handle_index(ResourceHandle handle) { return handle & resource_handle_index_mask; }
+inline u32 resource_handle_generation(ResourceHandle handle) {
+    return handle >> resource_handle_index_bits;
+}
+
+// Fixed-capacity pool of resource records. Records are stored contiguously and free slots are kept on
+// a stack, so obtain and release are O(1) and never touch the heap after init.
+template <typename T> class ResourcePool {
+    static_assert(std::is_trivially_copyable<T>::value, "Pool records must be plain data");
+
+  public:
+    void init(u32 pool_size_, Allocator *allocator_);
+    void shutdown();
+
+    ResourceHandle obtain_resource(); // Returns invalid_resource_handle when the pool is full.
+    void release_resource(ResourceHandle handle);
+
+    // Returns nullptr for invalid or stale handles.
+    T *access_resource(ResourceHandle handle);
+    const T *access_resource(ResourceHandle handle) const;
+
+    // Slot iteration, used to clean up whatever is still alive at shutdown.
+    bool is_alive(u32 index) const { return alive[index] != 0; }
+    ResourceHandle handle_at(u32 index) const {
+        return index | ((u32)generations[index] << resource_handle_index_bits);
+    }
+
+    u32 pool_size = 0;
+    u32 used_indices = 0;
+
+  private:
+    Allocator *allocator = nullptr;
+    T *memory = nullptr;
+    u32 *free_indices = nullptr;
+    u16 *generations = nullptr;
+    u8 *alive = nullptr;
+
+    u32 free_indices_head = 0;
+}; // class ResourcePool
+
+template <typename T> void ResourcePool<T>::init(u32 pool_size_, Allocator *allocator_) {
+    assert(pool_size_ > 0 && pool_size_ < resource_handle_index_mask);
+    pool_size = pool_size_;
+    used_indices = 0;
+    allocator = allocator_;
+
+    memory = allocate_array<T>(*allocator, pool_size);
+    free_indices = allocate_array<u32>(*allocator, pool_size);
+    generations = allocate_array<u16>(*allocator, pool_size);
+    alive = allocate_array<u8>(*allocator, pool_size);
+    memset(memory, 0, sizeof(T) * pool_size);
+    memset(generations, 0, sizeof(u16) * pool_size);
+    memset(alive, 0, sizeof(u8) * pool_size);
+
+    // Hand out low indices first.
+    for (u32 i = 0; i < pool_size; ++i) {
+        free_indices[i] = pool_size - 1 - i;
+    }
+    free_indices_head = pool_size;
+}
+
+template <typename T> void ResourcePool<T>::shutdown() {
+    if (allocator) {
+        allocator->deallocate(memory);
+        allocator->deallocate(free_indices);
+        allocator->deallocate(generations);
+        allocator->deallocate(alive);
+    }
+    memory = nullptr;
+    free_indices = nullptr;
+    generations = nullptr;
+    alive = nullptr;
+    pool_size = used_indices = free_indices_head = 0;
+}
+
+template <typename T> ResourceHandle ResourcePool<T>::obtain_resource() {
+    if (free_indices_head == 0) {
+        return invalid_resource_handle;
+    }
+
+    u32 index = free_indices[--free_indices_head];
+    alive[index] = 1;
+    ++used_indices;
+    memset(&memory[index], 0, sizeof(T));
+    return handle_at(index);
+}
+
+template <typename T> void ResourcePool<T>::release_resource(ResourceHandle handle) {
+    if (!access_resource(handle)) {
+        return;
+    }
+    u32 index = resource_handle_index(handle);
+    alive[index] = 0;
+    // Invalidate every outstanding handle to this slot.
+    generations[index] = (generations[index] + 1) & resource_handle_generation_mask;
+    free_indices[free_indices_head++] = index;
+    --used_indices;
+}
+
+template <typename T> T *ResourcePool<T>::access_resource(ResourceHandle handle) {
+    u32 index = resource_handle_index(handle);
+    if (handle == invalid_resource_handle || index >= pool_size || !alive[index] ||
+        generations[index] != resource_handle_generation(handle)) {
+        return nullptr;
+    }
+    return &memory[index];
+}
+
+template <typename T> const T *ResourcePool<T>::access_resource(ResourceHandle handle) const {
+    return const_cast<ResourcePool<T> *>(this)->access_resource(handle);
+}
+
+} // namespace sren
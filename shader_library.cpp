@@ -0,0 +1,548 @@
+#include "shader_library.h"
+
+#include "file.h"
+#include "hash_cache.h"
+#include "log.h"
+#include "timer.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+
+#ifdef SREN_SHADERC
+#include <shaderc/shaderc.h>
+#endif
+
+namespace sren {
+
+static const u32 spirv_magic = 0x07230203;
+// Part of every cache key, bump it when the compile options change.
+static const u32 shader_cache_version = 1;
+
+struct CompileShaderJob {
+    ShaderLibrary *library;
+    Shader *shader;
+}; // struct CompileShaderJob
+
+ShaderCreation &ShaderCreation::set_source(const char *path_, VkShaderStageFlagBits stage_) {
+    snprintf(path, sizeof(path), "%s", path_);
+    stage = stage_;
+    return *this;
+}
+
+ShaderCreation &ShaderCreation::add_define(const char *name, const char *value) {
+    if (num_defines >= max_shader_defines) {
+        LOG_ERR("%s: more than %u defines, %s is dropped.", path, max_shader_defines, name);
+        return *this;
+    }
+    snprintf(defines[num_defines].name, max_shader_define_length, "%s", name);
+    snprintf(defines[num_defines].value, max_shader_define_length, "%s", value);
+    ++num_defines;
+    return *this;
+}
+
+ShaderLibraryCreation &ShaderLibraryCreation::set_cache_dir(const char *cache_dir_) {
+    cache_dir = cache_dir_;
+    return *this;
+}
+
+ShaderLibraryCreation &ShaderLibraryCreation::set_hot_reload(bool hot_reload_) {
+    hot_reload = hot_reload_;
+    return *this;
+}
+
+// Directories are kept with a trailing slash, file names are appended to them.
+static bool copy_dir(char (&dir)[max_shader_path_length], const char *path) {
+    const size_t length = path ? strlen(path) : 0;
+    const char *separator = length && path[length - 1] != '/' ? "/" : "";
+    if (snprintf(dir, max_shader_path_length, "%s%s", length ? path : "", separator) >=
+        (int)max_shader_path_length) {
+        LOG_ERR("Shader directory path too long: %s", path);
+        return false;
+    }
+    return true;
+}
+
+// Records a file the shader was built from, with its modification time from before it is read.
+static void add_dependency(Shader &shader, const char *path) {
+    for (u32 i = 0; i < shader.num_dependencies; ++i) {
+        if (!strcmp(shader.dependencies[i], path)) {
+            return;
+        }
+    }
+    if (shader.num_dependencies == max_shader_dependencies) {
+        LOG_ERR("%s: more than %u files, changes to %s aren't watched.", shader.creation.path,
+                max_shader_dependencies, path);
+        return;
+    }
+    snprintf(shader.dependencies[shader.num_dependencies], max_shader_path_length, "%s", path);
+    shader.dependency_times[shader.num_dependencies] = file_modified_time(path);
+    ++shader.num_dependencies;
+}
+
+static bool read_file(const char *path, std::string &contents) {
+    MappedFile file;
+    if (!file.map(path)) {
+        return false;
+    }
+    contents.assign((const char *)file.data, file.size);
+    file.unmap();
+    return true;
+}
+
+static bool is_spirv(const std::vector<u32> &code) {
+    return !code.empty() && code[0] == spirv_magic;
+}
+
+#ifdef SREN_SHADERC
+struct ShaderIncludeContext {
+    Shader *shader;
+    const char *source_dir;
+}; // struct ShaderIncludeContext
+
+struct ShaderInclude {
+    shaderc_include_result result;
+    char path[max_shader_path_length];
+    std::string content;
+}; // struct ShaderInclude
+
+// #include "file" is relative to the including file, #include <file> to the source directory.
+static shaderc_include_result *resolve_include(void *user_data, const char *requested_source, int type,
+                                               const char *requesting_source, size_t) {
+    ShaderIncludeContext &context = *(ShaderIncludeContext *)user_data;
+    ShaderInclude *include = new ShaderInclude();
+    include->result = {};
+    include->result.user_data = include;
+
+    const char *slash = strrchr(requesting_source, '/');
+    const int dir_length = type == shaderc_include_type_relative && slash
+                               ? (int)(slash - requesting_source + 1)
+                               : 0;
+    const int length =
+        dir_length ? snprintf(include->path, sizeof(include->path), "%.*s%s", dir_length,
+                              requesting_source, requested_source)
+                   : snprintf(include->path, sizeof(include->path), "%s%s", context.source_dir,
+                              requested_source);
+    if (length >= (int)sizeof(include->path)) {
+        include->content = "include path too long";
+    } else {
+        add_dependency(*context.shader, include->path);
+        if (read_file(include->path, include->content)) {
+            include->result.source_name = include->path;
+            include->result.source_name_length = strlen(include->path);
+        } else {
+            include->content = std::string("can't read ") + include->path;
+        }
+    }
+    // An empty source name reports the content as the error.
+    include->result.content = include->content.data();
+    include->result.content_length = include->content.size();
+    return &include->result;
+}
+
+static void release_include(void *, shaderc_include_result *result) {
+    delete (ShaderInclude *)result->user_data;
+}
+
+static shaderc_shader_kind shader_kind(VkShaderStageFlagBits stage) {
+    switch (stage) {
+    case VK_SHADER_STAGE_VERTEX_BIT:
+        return shaderc_vertex_shader;
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+        return shaderc_tess_control_shader;
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+        return shaderc_tess_evaluation_shader;
+    case VK_SHADER_STAGE_GEOMETRY_BIT:
+        return shaderc_geometry_shader;
+    case VK_SHADER_STAGE_COMPUTE_BIT:
+        return shaderc_compute_shader;
+    case VK_SHADER_STAGE_FRAGMENT_BIT:
+    default:
+        return shaderc_fragment_shader;
+    }
+}
+
+// Logs and releases a failed result, returns whether it succeeded.
+static bool check_result(shaderc_compilation_result_t result, const char *path) {
+    if (shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success) {
+        return true;
+    }
+    LOG_ERR("Failed to compile %s:\n%s", path, shaderc_result_get_error_message(result));
+    shaderc_result_release(result);
+    return false;
+}
+#endif // SREN_SHADERC
+
+bool ShaderLibrary::init(Device &device_, JobSystem &job_system_,
+                         const ShaderLibraryCreation &creation) {
+    device = &device_;
+    job_system = &job_system_;
+    poll_interval_ms = creation.poll_interval_ms ? creation.poll_interval_ms : 1;
+    if (!copy_dir(source_dir, creation.source_dir) || !copy_dir(binary_dir, creation.binary_dir) ||
+        !copy_dir(cache_dir, creation.cache_dir)) {
+        device = nullptr;
+        return false;
+    }
+
+#ifdef SREN_SHADERC
+    compiler = shaderc_compiler_initialize();
+    if (!compiler) {
+        LOG_ERR("Failed to initialize the shader compiler.");
+        device = nullptr;
+        return false;
+    }
+    // Compiles without the cache when it can't be created.
+    if (cache_dir[0] && !create_directory(cache_dir)) {
+        cache_dir[0] = 0;
+    }
+    LOG_INFO("Compiling shaders from %s%s%s.", source_dir, cache_dir[0] ? ", cached in " : "",
+             cache_dir);
+#else
+    LOG_INFO("Built without shaderc, loading shaders compiled to %s.", binary_dir);
+#endif
+
+    if (creation.hot_reload) {
+        watching = true;
+        watcher = std::thread(&ShaderLibrary::watch_loop, this);
+    }
+    return true;
+}
+
+void ShaderLibrary::shutdown() {
+    if (!device) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        watching = false;
+    }
+    watch_condition.notify_one();
+    if (watcher.joinable()) {
+        watcher.join();
+    }
+
+    for (ShaderPipeline &pipeline : pipelines) {
+        if (pipeline.pipeline.index != invalid_resource_handle) {
+            device->destroy_pipeline(pipeline.pipeline);
+        }
+    }
+    pipelines.clear();
+    for (Shader *shader : shaders) {
+        delete shader;
+    }
+    shaders.clear();
+#ifdef SREN_SHADERC
+    shaderc_compiler_release((shaderc_compiler_t)compiler);
+#endif
+    compiler = nullptr;
+    device = nullptr;
+}
+
+bool ShaderLibrary::load(const ShaderCreation *creations, u32 count, ShaderHandle *handles) {
+    const i64 start = time_now();
+    const u32 start_hits = get_cache_hits();
+    const u32 start_compilations = get_compilations();
+
+    std::vector<CompileShaderJob> job_data(count);
+    std::vector<JobDecl> jobs(count);
+    for (u32 i = 0; i < count; ++i) {
+        Shader *shader = new Shader();
+        shader->creation = creations[i];
+        job_data[i] = {this, shader};
+        jobs[i].function = compile_job;
+        jobs[i].data = &job_data[i];
+    }
+    JobCounter counter;
+    job_system->run(jobs.data(), count, &counter);
+    job_system->wait(&counter);
+
+    bool loaded = true;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (u32 i = 0; i < count; ++i) {
+        Shader *shader = job_data[i].shader;
+        if (!shader->compiled) {
+            handles[i] = invalid_shader;
+            delete shader;
+            loaded = false;
+            continue;
+        }
+        shader->code = shader->compiled_code;
+        // From here on the watcher sees it.
+        shaders.push_back(shader);
+        handles[i] = {(u32)shaders.size() - 1};
+    }
+    if (compiler) {
+        LOG_INFO("%u shaders built in %.3f ms: %u from the cache, %u compiled.", count,
+                 time_elapsed_ms(start), get_cache_hits() - start_hits,
+                 get_compilations() - start_compilations);
+    } else {
+        LOG_INFO("%u shaders loaded in %.3f ms.", count, time_elapsed_ms(start));
+    }
+    return loaded;
+}
+
+void ShaderLibrary::compile_job(void *data, u32) {
+    CompileShaderJob &job = *(CompileShaderJob *)data;
+    job.shader->compiled = job.library->compile(*job.shader);
+}
+
+#ifdef SREN_SHADERC
+bool ShaderLibrary::compile(Shader &shader) {
+    const ShaderCreation &creation = shader.creation;
+    shader.num_dependencies = 0;
+    char path[max_shader_path_length];
+    if (snprintf(path, sizeof(path), "%s%s", source_dir, creation.path) >= (int)sizeof(path)) {
+        LOG_ERR("Shader path too long: %s", creation.path);
+        return false;
+    }
+    add_dependency(shader, path);
+    std::string source;
+    if (!read_file(path, source)) {
+        LOG_ERR("Failed to read shader %s", path);
+        return false;
+    }
+
+    const size_t extension_length = strlen(".hlsl");
+    const size_t path_length = strlen(path);
+    const bool hlsl =
+        path_length > extension_length && !strcmp(path + path_length - extension_length, ".hlsl");
+    ShaderIncludeContext include_context = {&shader, source_dir};
+    shaderc_compile_options_t options = shaderc_compile_options_initialize();
+    shaderc_compile_options_set_source_language(options, hlsl ? shaderc_source_language_hlsl
+                                                              : shaderc_source_language_glsl);
+    shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan,
+                                           shaderc_env_version_vulkan_1_3);
+    shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+    shaderc_compile_options_set_include_callbacks(options, resolve_include, release_include,
+                                                  &include_context);
+    for (u32 i = 0; i < creation.num_defines; ++i) {
+        const ShaderDefine &define = creation.defines[i];
+        shaderc_compile_options_add_macro_definition(options, define.name, strlen(define.name),
+                                                     define.value, strlen(define.value));
+    }
+
+    // Preprocessing is cheap next to compiling, and its output is everything the SPIR-V depends on
+    // besides the stage and the options.
+    shaderc_compiler_t shaderc = (shaderc_compiler_t)compiler;
+    const shaderc_shader_kind kind = shader_kind(creation.stage);
+    shaderc_compilation_result_t result = shaderc_compile_into_preprocessed_text(
+        shaderc, source.data(), source.size(), kind, path, "main", options);
+    if (!check_result(result, path)) {
+        shaderc_compile_options_release(options);
+        return false;
+    }
+    const std::string preprocessed(shaderc_result_get_bytes(result), shaderc_result_get_length(result));
+    shaderc_result_release(result);
+
+    u32 spirv_version = 0;
+    u32 spirv_revision = 0;
+    shaderc_get_spv_version(&spirv_version, &spirv_revision);
+    u64 key = hash_bytes(preprocessed.data(), preprocessed.size());
+    key = hash_value((u32)creation.stage, key);
+    key = hash_value(hlsl, key);
+    for (u32 i = 0; i < creation.num_defines; ++i) {
+        key = hash_bytes(creation.defines[i].name, strlen(creation.defines[i].name) + 1, key);
+        key = hash_bytes(creation.defines[i].value, strlen(creation.defines[i].value) + 1, key);
+    }
+    key = hash_value(shader_cache_version, key);
+    key = hash_value(spirv_version, key);
+    key = hash_value(spirv_revision, key);
+
+    char cache_path[max_shader_path_length + 32];
+    snprintf(cache_path, sizeof(cache_path), "%s%016llx.spv", cache_dir, (unsigned long long)key);
+    MappedFile cached;
+    if (cache_dir[0] && cached.map(cache_path)) {
+        shader.compiled_code.assign((const u32 *)cached.data,
+                                    (const u32 *)cached.data + cached.size / sizeof(u32));
+        cached.unmap();
+        if (is_spirv(shader.compiled_code)) {
+            shaderc_compile_options_release(options);
+            cache_hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        LOG_ERR("%s: corrupt cache entry %s, recompiling.", path, cache_path);
+    }
+
+    result = shaderc_compile_into_spv(shaderc, preprocessed.data(), preprocessed.size(), kind, path,
+                                      "main", options);
+    shaderc_compile_options_release(options);
+    if (!check_result(result, path)) {
+        return false;
+    }
+    const u32 *code = (const u32 *)shaderc_result_get_bytes(result);
+    shader.compiled_code.assign(code, code + shaderc_result_get_length(result) / sizeof(u32));
+    shaderc_result_release(result);
+    compilations.fetch_add(1, std::memory_order_relaxed);
+
+    if (cache_dir[0]) {
+        file_write_atomic(cache_path, shader.compiled_code.data(),
+                          shader.compiled_code.size() * sizeof(u32));
+    }
+    return true;
+}
+#else
+bool ShaderLibrary::compile(Shader &shader) {
+    const ShaderCreation &creation = shader.creation;
+    shader.num_dependencies = 0;
+    if (creation.num_defines) {
+        LOG_ERR("%s: defines need the engine built with SHADERC=1.", creation.path);
+        return false;
+    }
+    char path[max_shader_path_length];
+    if (snprintf(path, sizeof(path), "%s%s.spv", binary_dir, creation.path) >= (int)sizeof(path)) {
+        LOG_ERR("Shader path too long: %s", creation.path);
+        return false;
+    }
+    // Reloaded whenever make recompiles it.
+    add_dependency(shader, path);
+    std::string code;
+    if (!read_file(path, code)) {
+        LOG_ERR("Failed to load shader %s", path);
+        return false;
+    }
+    shader.compiled_code.assign((const u32 *)code.data(),
+                                (const u32 *)code.data() + code.size() / sizeof(u32));
+    if (!is_spirv(shader.compiled_code)) {
+        LOG_ERR("%s isn't SPIR-V.", path);
+        return false;
+    }
+    return true;
+}
+#endif // SREN_SHADERC
+
+ShaderPipelineHandle ShaderLibrary::create_pipeline(const PipelineCreation &creation,
+                                                    const ShaderHandle *shader_handles, u32 count) {
+    if (count == 0 || count > max_shader_stages) {
+        LOG_ERR("%s: pipelines take 1 to %u shaders.", creation.name ? creation.name : "Pipeline",
+                max_shader_stages);
+        return invalid_shader_pipeline;
+    }
+    ShaderPipeline pipeline;
+    pipeline.creation = creation;
+    for (u32 i = 0; i < count; ++i) {
+        if (shader_handles[i].index >= shaders.size()) {
+            LOG_ERR("%s: invalid shader.", creation.name ? creation.name : "Pipeline");
+            return invalid_shader_pipeline;
+        }
+        pipeline.shaders[i] = shader_handles[i];
+    }
+    pipeline.num_shaders = count;
+    if (!build_pipeline(pipeline)) {
+        return invalid_shader_pipeline;
+    }
+
+    // Reuse the slot of a destroyed pipeline.
+    for (u32 i = 0; i < pipelines.size(); ++i) {
+        if (pipelines[i].num_shaders == 0) {
+            pipelines[i] = pipeline;
+            return {i};
+        }
+    }
+    pipelines.push_back(pipeline);
+    return {(u32)pipelines.size() - 1};
+}
+
+void ShaderLibrary::destroy_pipeline(ShaderPipelineHandle pipeline) {
+    if (pipeline.index >= pipelines.size() || pipelines[pipeline.index].num_shaders == 0) {
+        return;
+    }
+    device->destroy_pipeline(pipelines[pipeline.index].pipeline);
+    pipelines[pipeline.index] = ShaderPipeline();
+}
+
+PipelineHandle ShaderLibrary::get_pipeline(ShaderPipelineHandle pipeline) const {
+    return pipeline.index < pipelines.size() ? pipelines[pipeline.index].pipeline : invalid_pipeline;
+}
+
+void ShaderLibrary::update() {
+    if (!reloads_pending.exchange(false, std::memory_order_acquire)) {
+        return;
+    }
+    std::vector<bool> reloaded(shaders.size(), false);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (u32 i = 0; i < shaders.size(); ++i) {
+            if (shaders[i]->reloaded) {
+                shaders[i]->code.swap(shaders[i]->reloaded_code);
+                shaders[i]->reloaded = false;
+                reloaded[i] = true;
+            }
+        }
+    }
+
+    for (ShaderPipeline &pipeline : pipelines) {
+        bool affected = false;
+        for (u32 i = 0; i < pipeline.num_shaders; ++i) {
+            affected = affected || reloaded[pipeline.shaders[i].index];
+        }
+        if (!affected) {
+            continue;
+        }
+        const char *name = pipeline.creation.name ? pipeline.creation.name : "";
+        const i64 start = time_now();
+        if (build_pipeline(pipeline)) {
+            LOG_INFO("Rebuilt pipeline %s in %.3f ms.", name, time_elapsed_ms(start));
+        } else {
+            LOG_ERR("Failed to rebuild pipeline %s, keeping the previous version.", name);
+        }
+    }
+}
+
+bool ShaderLibrary::build_pipeline(ShaderPipeline &pipeline) {
+    PipelineCreation &creation = pipeline.creation;
+    creation.shaders.reset().set_name(creation.name);
+    for (u32 i = 0; i < pipeline.num_shaders; ++i) {
+        const Shader &shader = *shaders[pipeline.shaders[i].index];
+        creation.shaders.add_stage(shader.code.data(), (u32)(shader.code.size() * sizeof(u32)),
+                                   shader.creation.stage);
+    }
+    const PipelineHandle handle = device->create_pipeline(creation);
+    if (handle.index == invalid_resource_handle) {
+        return false;
+    }
+    // Frames in flight keep using the previous version until they complete.
+    if (pipeline.pipeline.index != invalid_resource_handle) {
+        device->destroy_pipeline(pipeline.pipeline);
+    }
+    pipeline.pipeline = handle;
+    return true;
+}
+
+void ShaderLibrary::watch_loop() {
+    std::vector<Shader *> watched;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (watching) {
+        watch_condition.wait_for(lock, std::chrono::milliseconds(poll_interval_ms));
+        if (!watching) {
+            break;
+        }
+        watched = shaders;
+        lock.unlock();
+
+        for (Shader *shader : watched) {
+            bool changed = false;
+            for (u32 i = 0; i < shader->num_dependencies && !changed; ++i) {
+                changed = file_modified_time(shader->dependencies[i]) != shader->dependency_times[i];
+            }
+            if (!changed) {
+                continue;
+            }
+            // A failed compile still records the new modification times, so it is retried on the next
+            // change rather than every poll.
+            const i64 start = time_now();
+            if (!compile(*shader)) {
+                LOG_ERR("Failed to reload %s, keeping the previous version.", shader->creation.path);
+                continue;
+            }
+            LOG_INFO("Reloaded %s in %.3f ms.", shader->creation.path, time_elapsed_ms(start));
+            std::lock_guard<std::mutex> guard(mutex);
+            shader->reloaded_code.swap(shader->compiled_code);
+            shader->reloaded = true;
+            reloads_pending.store(true, std::memory_order_release);
+        }
+        lock.lock();
+    }
+}
+
+} // namespace sren
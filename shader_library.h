@@ -0,0 +1,153 @@
+#pragma once
+
+#include "device.h"
+#include "job_system.h"
+#include "platform.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef SREN_SHADER_SOURCE_DIR
+#define SREN_SHADER_SOURCE_DIR "shaders/"
+#endif
+
+namespace sren {
+
+static const u32 max_shader_path_length = 256;
+static const u32 max_shader_defines = 8;
+static const u32 max_shader_define_length = 64;
+// Files watched per shader: its source and everything it includes.
+static const u32 max_shader_dependencies = 16;
+
+struct ShaderDefine {
+    char name[max_shader_define_length];
+    char value[max_shader_define_length];
+}; // struct ShaderDefine
+
+struct ShaderCreation {
+    // Relative to ShaderLibraryCreation::source_dir. GLSL, or HLSL for .hlsl files, with main as the
+    // entry point. Without shaderc, the SPIR-V compiled from it by make is loaded instead.
+    char path[max_shader_path_length] = {};
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+    // Permutation, as #define name value. Needs shaderc.
+    ShaderDefine defines[max_shader_defines];
+    u32 num_defines = 0;
+
+    ShaderCreation &set_source(const char *path, VkShaderStageFlagBits stage);
+    ShaderCreation &add_define(const char *name, const char *value = "1");
+}; // struct ShaderCreation
+
+struct Shader {
+    ShaderCreation creation;
+    // SPIR-V of the latest successful compilation, main thread only.
+    std::vector<u32> code;
+
+    // Compilation results: written by the load jobs, then by the watcher thread only.
+    std::vector<u32> compiled_code;
+    bool compiled = false;
+    char dependencies[max_shader_dependencies][max_shader_path_length];
+    u64 dependency_times[max_shader_dependencies];
+    u32 num_dependencies = 0;
+
+    // A hot reload waiting for ShaderLibrary::update, guarded by the library's mutex.
+    std::vector<u32> reloaded_code;
+    bool reloaded = false;
+}; // struct Shader
+
+struct ShaderHandle {
+    u32 index;
+}; // struct ShaderHandle
+
+static const ShaderHandle invalid_shader{u32_max};
+
+// A pipeline rebuilt whenever one of its shaders is reloaded.
+struct ShaderPipeline {
+    // Stages are filled in from the shaders on every build. Names must outlive the library.
+    PipelineCreation creation;
+    ShaderHandle shaders[max_shader_stages];
+    u32 num_shaders = 0;
+    PipelineHandle pipeline = invalid_pipeline;
+}; // struct ShaderPipeline
+
+struct ShaderPipelineHandle {
+    u32 index;
+}; // struct ShaderPipelineHandle
+
+static const ShaderPipelineHandle invalid_shader_pipeline{u32_max};
+
+struct ShaderLibraryCreation {
+    const char *source_dir = SREN_SHADER_SOURCE_DIR;
+    // SPIR-V built by make, loaded when the engine is built without shaderc.
+    const char *binary_dir = SREN_SHADER_DIR;
+    // Compiled SPIR-V by hash of the preprocessed source. Null disables the cache.
+    const char *cache_dir = "shader_cache";
+    // Watch the sources and everything they include, recompiling them on change.
+    bool hot_reload = true;
+    u32 poll_interval_ms = 250;
+
+    ShaderLibraryCreation &set_cache_dir(const char *cache_dir);
+    ShaderLibraryCreation &set_hot_reload(bool hot_reload);
+}; // struct ShaderLibraryCreation
+
+// Builds shader modules from source. Built with SHADERC=1, sources are compiled by the embedded shaderc
+// compiler: a source is preprocessed, its includes resolved and its defines applied, and the SPIR-V is
+// looked up on disk by a hash of the result, so unchanged permutations are never compiled twice.
+// Otherwise the SPIR-V compiled by make is loaded. A watcher thread polls the files every shader was
+// built from and recompiles the changed shaders; update() then rebuilds only the pipelines using them.
+class ShaderLibrary {
+  public:
+    bool init(Device &device, JobSystem &job_system, const ShaderLibraryCreation &creation);
+    // Stops the watcher and destroys the remaining pipelines.
+    void shutdown();
+
+    // Builds the shaders in parallel on the job system and waits for them. Shaders that fail get
+    // invalid_shader, in which case false is returned.
+    bool load(const ShaderCreation *creations, u32 count, ShaderHandle *shaders);
+    // Creates a pipeline from creation with the shaders as its stages, creation.shaders is ignored.
+    ShaderPipelineHandle create_pipeline(const PipelineCreation &creation, const ShaderHandle *shaders,
+                                         u32 count);
+    void destroy_pipeline(ShaderPipelineHandle pipeline);
+    // Main thread, once per frame: swaps in reloaded shaders and rebuilds the pipelines using them.
+    // Pipelines that fail to build keep their previous version.
+    void update();
+
+    // Changes when the pipeline is rebuilt, so look it up every frame.
+    PipelineHandle get_pipeline(ShaderPipelineHandle pipeline) const;
+
+    u32 get_cache_hits() const { return cache_hits.load(std::memory_order_relaxed); }
+    u32 get_compilations() const { return compilations.load(std::memory_order_relaxed); }
+
+  private:
+    static void compile_job(void *data, u32 thread_index);
+    // Fills the shader's compiled_code and dependencies. Returns false when it doesn't compile.
+    bool compile(Shader &shader);
+    bool build_pipeline(ShaderPipeline &pipeline);
+    void watch_loop();
+
+    Device *device = nullptr;
+    JobSystem *job_system = nullptr;
+    char source_dir[max_shader_path_length];
+    char binary_dir[max_shader_path_length];
+    char cache_dir[max_shader_path_length];
+    u32 poll_interval_ms = 0;
+    // shaderc_compiler_t, which compiles from several threads at once.
+    void *compiler = nullptr;
+
+    // Pointers, the watcher keeps using shaders while more are added.
+    std::vector<Shader *> shaders;
+    std::vector<ShaderPipeline> pipelines;
+    std::atomic<u32> cache_hits{0};
+    std::atomic<u32> compilations{0};
+
+    // Guards shaders and the reload results against the watcher.
+    std::mutex mutex;
+    std::condition_variable watch_condition;
+    std::thread watcher;
+    bool watching = false;
+    std::atomic<bool> reloads_pending{false};
+}; // class ShaderLibrary
+
+} // namespace sren
@@ -0,0 +1,21 @@
+#version 450
+
+// One small triangle per instance, laid out on a grid_size x grid_size grid covering the screen.
+layout(push_constant) uniform Constants {
+    uint grid_size;
+} constants;
+
+layout(location = 0) out vec3 out_color;
+
+const vec2 corners[3] = vec2[](vec2(-0.5, 0.5), vec2(0.5, 0.5), vec2(0.0, -0.5));
+
+void main() {
+    uint x = uint(gl_InstanceIndex) % constants.grid_size;
+    uint y = uint(gl_InstanceIndex) / constants.grid_size;
+
+    float cell_size = 2.0 / float(constants.grid_size);
+    vec2 origin = vec2(-1.0) + cell_size * (vec2(x, y) + 0.5);
+    gl_Position = vec4(origin + corners[gl_VertexIndex] * cell_size * 0.8, 0.0, 1.0);
+
+    out_color = vec3(vec2(x, y) / float(constants.grid_size), 0.6);
+}
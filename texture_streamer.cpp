@@ -0,0 +1,318 @@
+#include "texture_streamer.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace sren {
+
+// Evicted memory comes back once the frames using it complete, so the budget is lowered at most this
+// often while the pressure lasts.
+static const u64 texture_pressure_interval = 30;
+// Frames without memory pressure before the full budget is restored.
+static const u64 texture_pressure_recovery = 600;
+
+TextureStreamerCreation &TextureStreamerCreation::set_budget(u64 budget_) {
+    budget = budget_;
+    return *this;
+}
+
+TextureStreamerCreation &TextureStreamerCreation::set_upload_budget(u32 upload_budget_) {
+    upload_budget = upload_budget_;
+    return *this;
+}
+
+void TextureStreamer::init(Device &device_, const TextureStreamerCreation &creation) {
+    device = &device_;
+    budget = creation.budget;
+    budget_limit = budget;
+    upload_budget = creation.upload_budget ? creation.upload_budget : 1;
+    tail_size = creation.tail_size;
+    device->add_memory_pressure_callback(on_memory_pressure, this);
+}
+
+void TextureStreamer::shutdown() {
+    if (!device) {
+        return;
+    }
+    device->remove_memory_pressure_callback(on_memory_pressure, this);
+    for (StreamedTexture *texture : textures) {
+        if (texture->texture.index != invalid_resource_handle) {
+            device->destroy_texture(texture->texture);
+        }
+        if (texture->pending.index != invalid_resource_handle) {
+            device->destroy_texture(texture->pending);
+        }
+        texture->file.release();
+        delete texture;
+    }
+    textures.clear();
+    resident_bytes = 0;
+    device = nullptr;
+}
+
+StreamedTextureHandle TextureStreamer::load(const char *path) {
+    if (strlen(path) >= max_texture_path_length) {
+        LOG_ERR("Texture path too long: %s", path);
+        return invalid_streamed_texture;
+    }
+    StreamedTexture *texture = new StreamedTexture();
+    strcpy(texture->path, path);
+    KtxTexture &file = texture->file;
+    if (!load_ktx2(path, file)) {
+        delete texture;
+        return invalid_streamed_texture;
+    }
+    if (!device->is_texture_format_supported(file.format)) {
+        LOG_ERR("%s: the GPU can't sample format %u.", path, file.format);
+        file.release();
+        delete texture;
+        return invalid_streamed_texture;
+    }
+
+    // The mip tail: as many of the smallest levels as fit tail_size, at least one.
+    texture->tail_mip = file.num_levels - 1;
+    while (texture->tail_mip > 0 &&
+           get_bytes(*texture, texture->tail_mip - 1) <= tail_size) {
+        --texture->tail_mip;
+    }
+    texture->resident_mip = file.num_levels;
+    texture->wanted_mip = texture->tail_mip;
+    if (!begin_residency(*texture, texture->tail_mip)) {
+        file.release();
+        delete texture;
+        return invalid_streamed_texture;
+    }
+    textures.push_back(texture);
+    return {(u32)textures.size() - 1};
+}
+
+void TextureStreamer::request(StreamedTextureHandle texture, u32 mip) {
+    if (texture.index < textures.size()) {
+        textures[texture.index]->wanted_mip = mip;
+        textures[texture.index]->last_used = frame;
+    }
+}
+
+void TextureStreamer::update() {
+    for (StreamedTexture *texture : textures) {
+        if (texture->pending.index != invalid_resource_handle &&
+            texture->next_level == texture->file.num_levels &&
+            device->is_upload_ready(texture->last_upload)) {
+            finish_residency(*texture);
+        }
+    }
+
+    if (budget_limit < budget && frame - pressure_frame > texture_pressure_recovery) {
+        budget_limit = budget;
+    }
+    while (resident_bytes > budget_limit && evict(nullptr)) {
+    }
+
+    // Textures used this frame that want more levels, the ones missing the most first. One level per
+    // update, so quality goes up progressively.
+    candidates.clear();
+    for (StreamedTexture *texture : textures) {
+        if (texture->last_used == frame && texture->texture.index != invalid_resource_handle &&
+            texture->pending.index == invalid_resource_handle &&
+            texture->wanted_mip < texture->resident_mip) {
+            candidates.push_back(texture);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const StreamedTexture *a, const StreamedTexture *b) {
+                  return a->resident_mip - a->wanted_mip > b->resident_mip - b->wanted_mip;
+              });
+    for (StreamedTexture *texture : candidates) {
+        // Evictions for an earlier candidate can have started one here.
+        if (texture->pending.index != invalid_resource_handle) {
+            continue;
+        }
+        const u32 mip = texture->resident_mip - 1;
+        const u64 growth = get_bytes(*texture, mip) - get_bytes(*texture, texture->resident_mip);
+        if (resident_bytes + growth > budget_limit + get_evictable_bytes(texture)) {
+            // Evicting wouldn't make room. Lower priority textures don't get to go first either.
+            break;
+        }
+        while (resident_bytes + growth > budget_limit && evict(texture)) {
+        }
+        if (resident_bytes + growth > budget_limit) {
+            break;
+        }
+        begin_residency(*texture, mip);
+    }
+
+    // Mip tails first, so new textures show up before others gain detail.
+    u32 remaining = upload_budget;
+    for (u32 pass = 0; pass < 2; ++pass) {
+        for (StreamedTexture *texture : textures) {
+            const bool tail = texture->texture.index == invalid_resource_handle;
+            if (remaining == 0 || texture->pending.index == invalid_resource_handle ||
+                tail != (pass == 0)) {
+                continue;
+            }
+            const u32 uploaded = upload(*texture, remaining);
+            remaining = uploaded < remaining ? remaining - uploaded : 0;
+        }
+    }
+    ++frame;
+}
+
+bool TextureStreamer::is_failed(StreamedTextureHandle texture) const {
+    return texture.index >= textures.size() || textures[texture.index]->failed;
+}
+
+TextureHandle TextureStreamer::get_texture(StreamedTextureHandle texture) const {
+    return texture.index < textures.size() ? textures[texture.index]->texture : invalid_texture;
+}
+
+u32 TextureStreamer::get_resident_mip(StreamedTextureHandle texture) const {
+    return texture.index < textures.size() ? textures[texture.index]->resident_mip : max_texture_mips;
+}
+
+void TextureStreamer::on_memory_pressure(const GpuMemoryBudget &, void *user_data) {
+    TextureStreamer &streamer = *(TextureStreamer *)user_data;
+    streamer.pressure_frame = streamer.frame;
+    if (streamer.pressure_evict_frame &&
+        streamer.frame - streamer.pressure_evict_frame < texture_pressure_interval) {
+        return;
+    }
+    // Give back a quarter, evicted by the next update.
+    streamer.pressure_evict_frame = streamer.frame;
+    streamer.budget_limit =
+        std::min(streamer.budget_limit, streamer.resident_bytes - streamer.resident_bytes / 4);
+    LOG_INFO("GPU memory pressure: texture budget lowered to %.1f MB.",
+             streamer.budget_limit / (1024.0 * 1024.0));
+}
+
+bool TextureStreamer::begin_residency(StreamedTexture &texture, u32 mip) {
+    const KtxTexture &file = texture.file;
+    TextureCreation creation;
+    creation.set_size(std::max(file.width >> mip, 1), std::max(file.height >> mip, 1),
+                      std::max(file.depth >> mip, 1))
+        .set_flags((u8)(file.num_levels - mip), TextureFlags::Default_mask)
+        .set_format_type(file.format, file.type)
+        .set_name(texture.path);
+    texture.pending = device->create_texture(creation);
+    if (texture.pending.index == invalid_resource_handle) {
+        LOG_ERR("%s: failed to create the texture for levels %u and below.", texture.path, mip);
+        return false;
+    }
+    texture.pending_mip = mip;
+    texture.next_level = mip;
+    resident_bytes += get_bytes(texture, mip);
+    if (texture.texture.index != invalid_resource_handle) {
+        resident_bytes -= get_bytes(texture, texture.resident_mip);
+    }
+
+    // Start reading the levels in, they are copied into staging memory by the next updates.
+    for (u32 i = mip; i < file.num_levels; ++i) {
+        const KtxLevel &level = file.levels[i];
+        file.file.prefetch((size_t)(level.data - (const u8 *)file.file.data), level.size);
+    }
+    return true;
+}
+
+void TextureStreamer::finish_residency(StreamedTexture &texture) {
+    if (texture.texture.index != invalid_resource_handle) {
+        device->destroy_texture(texture.texture);
+    }
+    texture.texture = texture.pending;
+    texture.resident_mip = texture.pending_mip;
+    texture.pending = invalid_texture;
+    LOG_DBG("%s: levels %u to %u resident.", texture.path, texture.resident_mip,
+            texture.file.num_levels - 1);
+}
+
+void TextureStreamer::cancel_residency(StreamedTexture &texture) {
+    device->destroy_texture(texture.pending);
+    texture.pending = invalid_texture;
+    resident_bytes -= get_bytes(texture, texture.pending_mip);
+    if (texture.texture.index != invalid_resource_handle) {
+        resident_bytes += get_bytes(texture, texture.resident_mip);
+    }
+}
+
+u32 TextureStreamer::upload(StreamedTexture &texture, u32 budget_) {
+    const KtxTexture &file = texture.file;
+    u32 uploaded = 0;
+    while (texture.next_level < file.num_levels) {
+        const KtxLevel &level = file.levels[texture.next_level];
+        // Levels can't be split, the first one goes even over budget so large levels make progress.
+        if (uploaded > 0 && uploaded + level.size > budget_) {
+            break;
+        }
+        const u64 upload = device->upload_texture(texture.pending, level.data, level.size,
+                                                  texture.next_level - texture.pending_mip);
+        if (!upload) {
+            LOG_ERR("%s: upload of level %u failed.", texture.path, texture.next_level);
+            cancel_residency(texture);
+            if (texture.texture.index == invalid_resource_handle) {
+                // Nothing to fall back to: without its mip tail the texture is never shown.
+                LOG_ERR("%s: the mip tail couldn't be uploaded, the texture is unavailable.",
+                        texture.path);
+                texture.failed = true;
+            }
+            return uploaded;
+        }
+        texture.last_upload = upload;
+        uploaded += level.size;
+        ++texture.next_level;
+    }
+    return uploaded;
+}
+
+bool TextureStreamer::is_evictable(const StreamedTexture &texture,
+                                   const StreamedTexture *requester) const {
+    if (&texture == requester || texture.pending.index != invalid_resource_handle ||
+        texture.texture.index == invalid_resource_handle || texture.resident_mip >= texture.tail_mip) {
+        return false;
+    }
+    // Without a requester anything above its mip tail can go.
+    return !requester || texture.wanted_mip > texture.resident_mip ||
+           texture.last_used < requester->last_used;
+}
+
+u64 TextureStreamer::get_evictable_bytes(const StreamedTexture *requester) const {
+    // A victim is pending once it drops its highest level, so it gives up one level per update.
+    u64 bytes = 0;
+    for (const StreamedTexture *texture : textures) {
+        if (is_evictable(*texture, requester)) {
+            bytes += texture->file.levels[texture->resident_mip].size;
+        }
+    }
+    return bytes;
+}
+
+bool TextureStreamer::evict(const StreamedTexture *requester) {
+    // Textures holding levels they no longer want go first, then the least recently used.
+    StreamedTexture *victim = nullptr;
+    for (StreamedTexture *texture : textures) {
+        if (!is_evictable(*texture, requester)) {
+            continue;
+        }
+        if (!victim) {
+            victim = texture;
+            continue;
+        }
+        const bool unwanted = texture->wanted_mip > texture->resident_mip;
+        const bool victim_unwanted = victim->wanted_mip > victim->resident_mip;
+        if (unwanted != victim_unwanted) {
+            victim = unwanted ? texture : victim;
+        } else if (texture->last_used < victim->last_used) {
+            victim = texture;
+        }
+    }
+    return victim && begin_residency(*victim, victim->resident_mip + 1);
+}
+
+u64 TextureStreamer::get_bytes(const StreamedTexture &texture, u32 mip) const {
+    u64 bytes = 0;
+    for (u32 i = mip; i < texture.file.num_levels; ++i) {
+        bytes += texture.file.levels[i].size;
+    }
+    return bytes;
+}
+
+} // namespace sren
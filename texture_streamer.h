@@ -0,0 +1,120 @@
+#pragma once
+
+#include "device.h"
+#include "ktx.h"
+#include "platform.h"
+
+#include <vector>
+
+namespace sren {
+
+static const u32 max_texture_path_length = 512;
+
+struct StreamedTexture {
+    char path[max_texture_path_length];
+    // Stays mapped, evicted levels are streamed from it again.
+    KtxTexture file;
+
+    // Holds file levels resident_mip and below, sampled by the renderer. Invalid, with resident_mip the
+    // level count, until the mip tail is uploaded.
+    TextureHandle texture = invalid_texture;
+    u32 resident_mip = 0;
+    // Levels tail_mip and below are uploaded at load and never evicted.
+    u32 tail_mip = 0;
+
+    // Replaces texture once levels pending_mip and below are uploaded to it.
+    TextureHandle pending = invalid_texture;
+    u32 pending_mip = 0;
+    u32 next_level = 0;
+    u64 last_upload = 0;
+
+    // Latest request, kept until the next one.
+    u32 wanted_mip = 0;
+    u64 last_used = 0;
+
+    // The mip tail failed to upload, the texture stays invalid.
+    bool failed = false;
+}; // struct StreamedTexture
+
+struct StreamedTextureHandle {
+    u32 index;
+}; // struct StreamedTextureHandle
+
+static const StreamedTextureHandle invalid_streamed_texture{u32_max};
+
+struct TextureStreamerCreation {
+    // Device memory for the texels of every streamed texture. Above it, the highest levels of the least
+    // recently used textures are evicted.
+    u64 budget = 256 * 1024 * 1024;
+    // Bytes handed to the upload manager per update.
+    u32 upload_budget = 16 * 1024 * 1024;
+    // Levels are uploaded at load until they add up to this, so textures show up at once.
+    u32 tail_size = 64 * 1024;
+
+    TextureStreamerCreation &set_budget(u64 budget);
+    TextureStreamerCreation &set_upload_budget(u32 upload_budget);
+}; // struct TextureStreamerCreation
+
+// Streams KTX2 textures by mip level. A texture's smallest levels are uploaded when it is loaded; larger
+// ones follow one level at a time for the textures requested most recently, while the streamed textures
+// fit the budget. Changing residency recreates the texture with the new number of levels and uploads
+// them from the file mapping, so the memory of evicted levels is really freed. Main thread only.
+class TextureStreamer {
+  public:
+    void init(Device &device, const TextureStreamerCreation &creation);
+    void shutdown();
+
+    // Maps the file and queues its mip tail. The path is copied.
+    StreamedTextureHandle load(const char *path);
+    // The texture is used this frame and wants file levels mip and below, 0 being the full resolution.
+    void request(StreamedTextureHandle texture, u32 mip);
+    // Once per frame, after the requests: swaps in finished textures, evicts and starts uploads.
+    void update();
+
+    // What to sample, the resolution changes between frames. invalid_texture until the mip tail is
+    // uploaded.
+    TextureHandle get_texture(StreamedTextureHandle texture) const;
+    // The texture will never be available, see get_texture.
+    bool is_failed(StreamedTextureHandle texture) const;
+    // File level of the texture's level 0, the level count while nothing is resident.
+    u32 get_resident_mip(StreamedTextureHandle texture) const;
+    // Texel bytes of the textures, counting pending textures instead of the ones they replace.
+    u64 get_resident_bytes() const { return resident_bytes; }
+    // The budget, lowered for a while after memory pressure.
+    u64 get_budget() const { return budget_limit; }
+
+  private:
+    static void on_memory_pressure(const GpuMemoryBudget &budget, void *user_data);
+    // Creates the texture with file levels mip and below, uploaded by upload().
+    bool begin_residency(StreamedTexture &texture, u32 mip);
+    void finish_residency(StreamedTexture &texture);
+    void cancel_residency(StreamedTexture &texture);
+    // Uploads pending levels within budget. Returns the bytes uploaded.
+    u32 upload(StreamedTexture &texture, u32 budget);
+    // Whether the texture can give up levels to make room for requester, which can be null.
+    bool is_evictable(const StreamedTexture &texture, const StreamedTexture *requester) const;
+    // What one round of evictions for requester can free.
+    u64 get_evictable_bytes(const StreamedTexture *requester) const;
+    // Drops the highest level of the least recently used texture that isn't needed more than requester.
+    // Returns false when there is none.
+    bool evict(const StreamedTexture *requester);
+    // Texel bytes of file levels mip and below.
+    u64 get_bytes(const StreamedTexture &texture, u32 mip) const;
+
+    Device *device = nullptr;
+    u64 budget = 0;
+    u64 budget_limit = 0;
+    u32 upload_budget = 0;
+    u32 tail_size = 0;
+
+    std::vector<StreamedTexture *> textures;
+    // Textures to stream in this update, kept to reuse the memory.
+    std::vector<StreamedTexture *> candidates;
+    u64 resident_bytes = 0;
+    u64 frame = 1;
+    // Last memory pressure callback, and the last one that lowered the budget.
+    u64 pressure_frame = 0;
+    u64 pressure_evict_frame = 0;
+}; // class TextureStreamer
+
+} // namespace sren
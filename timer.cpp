@@ -0,0 +1,32 @@
+#include "timer.h"
+
+#include <chrono>
+#include <thread>
+
+namespace sren {
+
+i64 time_now() {
+    auto now = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+}
+
+f64 time_delta_ms(i64 start, i64 end) { return (f64)(end - start) / 1000000.0; }
+
+f64 time_delta_seconds(i64 start, i64 end) { return (f64)(end - start) / 1000000000.0; }
+
+f64 time_elapsed_ms(i64 start) { return time_delta_ms(start, time_now()); }
+
+void time_sleep_until(i64 timestamp) {
+    // Scheduler wake-ups can be late by about this much.
+    static const i64 sleep_slack_ns = 1000000;
+
+    i64 remaining = timestamp - time_now();
+    if (remaining > sleep_slack_ns) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(remaining - sleep_slack_ns));
+    }
+    while (time_now() < timestamp) {
+        std::this_thread::yield();
+    }
+}
+
+} // namespace sren
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "platform.h"
+
+namespace sren {
+
+// Monotonic timestamp, in nanoseconds.
+i64 time_now();
+
+f64 time_delta_ms(i64 start, i64 end);
+f64 time_delta_seconds(i64 start, i64 end);
+
+// Milliseconds elapsed since the given timestamp.
+f64 time_elapsed_ms(i64 start);
+
+// Sleeps until the given timestamp. The last stretch is spent yielding, which is more accurate than
+// the OS timer.
+void time_sleep_until(i64 timestamp);
+
+} // namespace sren
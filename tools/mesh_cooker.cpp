@@ -0,0 +1,699 @@
+// Offline mesh cooker: converts a .gltf or .glb file to the cooked format of mesh.h, which the engine
+// loads without parsing. Triangles are reordered for the post-transform vertex cache and for overdraw,
+// vertices for fetch locality, and normals, tangents and UVs are quantized. Prints the size, VRAM and
+// vertex cache savings next to the quantization error.
+//
+// Usage: mesh-cooker <input.gltf|input.glb> <output.smesh>
+
+#include "file.h"
+#include "log.h"
+#include "mesh.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+using namespace sren;
+
+// Entries of the simulated FIFO post-transform cache, and the cache size Tipsify optimizes for. Current
+// GPUs reuse at least this many recent vertices.
+static const u32 vertex_cache_size = 16;
+
+namespace ComponentType {
+enum Enum { Float, Half, Unorm8, Snorm8, Unorm16, Snorm16, Count }; // enum Enum
+} // namespace ComponentType
+
+struct VertexFormatInfo {
+    VkFormat format;
+    u32 components;
+    ComponentType::Enum type;
+}; // struct VertexFormatInfo
+
+// Every format load_mesh produces for the attributes.
+static const VertexFormatInfo vertex_formats[] = {
+    {VK_FORMAT_R32_SFLOAT, 1, ComponentType::Float},
+    {VK_FORMAT_R32G32_SFLOAT, 2, ComponentType::Float},
+    {VK_FORMAT_R32G32B32_SFLOAT, 3, ComponentType::Float},
+    {VK_FORMAT_R32G32B32A32_SFLOAT, 4, ComponentType::Float},
+    {VK_FORMAT_R16G16_SFLOAT, 2, ComponentType::Half},
+    {VK_FORMAT_R8_UNORM, 1, ComponentType::Unorm8},
+    {VK_FORMAT_R8G8_UNORM, 2, ComponentType::Unorm8},
+    {VK_FORMAT_R8G8B8_UNORM, 3, ComponentType::Unorm8},
+    {VK_FORMAT_R8G8B8A8_UNORM, 4, ComponentType::Unorm8},
+    {VK_FORMAT_R8_SNORM, 1, ComponentType::Snorm8},
+    {VK_FORMAT_R8G8_SNORM, 2, ComponentType::Snorm8},
+    {VK_FORMAT_R8G8B8_SNORM, 3, ComponentType::Snorm8},
+    {VK_FORMAT_R8G8B8A8_SNORM, 4, ComponentType::Snorm8},
+    {VK_FORMAT_R16_UNORM, 1, ComponentType::Unorm16},
+    {VK_FORMAT_R16G16_UNORM, 2, ComponentType::Unorm16},
+    {VK_FORMAT_R16G16B16_UNORM, 3, ComponentType::Unorm16},
+    {VK_FORMAT_R16G16B16A16_UNORM, 4, ComponentType::Unorm16},
+    {VK_FORMAT_R16_SNORM, 1, ComponentType::Snorm16},
+    {VK_FORMAT_R16G16_SNORM, 2, ComponentType::Snorm16},
+    {VK_FORMAT_R16G16B16_SNORM, 3, ComponentType::Snorm16},
+    {VK_FORMAT_R16G16B16A16_SNORM, 4, ComponentType::Snorm16},
+};
+
+static const u32 component_sizes[ComponentType::Count] = {4, 2, 1, 1, 2, 2};
+
+// Vertices as floats, expanded to four components.
+struct CookerVertex {
+    f32 position[3];
+    f32 normal[3];
+    f32 tangent[4];
+    f32 uv[2];
+}; // struct CookerVertex
+
+struct CookerStats {
+    // Vertices and indices.
+    u64 input_vertex_bytes = 0;
+    u64 output_vertex_bytes = 0;
+    u64 input_vertices = 0;
+    u64 vertices = 0;
+    u64 triangles = 0;
+    // Vertex shader invocations with the simulated cache, before and after the reordering.
+    u64 input_transforms = 0;
+    u64 output_transforms = 0;
+    f32 max_normal_error_degrees = 0.0f;
+    f32 max_tangent_error_degrees = 0.0f;
+    f32 max_uv_error = 0.0f;
+}; // struct CookerStats
+
+static f32 half_to_float(u16 half) {
+    const u32 sign = (u32)(half & 0x8000) << 16;
+    const u32 exponent = (half >> 10) & 0x1f;
+    const u32 mantissa = half & 0x3ff;
+    u32 bits;
+    if (exponent == 0) {
+        // Zero or subnormal, exactly representable as a float.
+        const f32 value = ldexpf((f32)mantissa, -24);
+        memcpy(&bits, &value, sizeof(bits));
+        bits |= sign;
+    } else if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    f32 result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Rounds to nearest, overflowing to infinity.
+static u16 float_to_half(f32 value) {
+    u32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const u16 sign = (u16)((bits >> 16) & 0x8000);
+    const f32 magnitude = fabsf(value);
+    if (magnitude != magnitude) {
+        return sign | 0x7e00;
+    }
+    if (magnitude >= 65520.0f) {
+        return sign | 0x7c00;
+    }
+    if (magnitude < 6.103515625e-05f) {
+        // Subnormal: multiples of 2^-24.
+        return sign | (u16)lrintf(magnitude * 16777216.0f);
+    }
+    const u32 magnitude_bits = bits & 0x7fffffff;
+    // Round to nearest even on the 13 dropped mantissa bits, a carry correctly bumps the exponent.
+    const u32 rounded = magnitude_bits + 0xfff + ((magnitude_bits >> 13) & 1);
+    return sign | (u16)((rounded >> 13) - (112 << 10));
+}
+
+static i8 float_to_snorm8(f32 value) {
+    const f32 clamped = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    return (i8)lrintf(clamped * 127.0f);
+}
+
+static f32 snorm8_to_float(i8 value) {
+    const f32 result = value / 127.0f;
+    return result < -1.0f ? -1.0f : result;
+}
+
+static f32 dot3(const f32 *a, const f32 *b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+static void cross3(const f32 *a, const f32 *b, f32 *result) {
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static bool normalize3(f32 *v) {
+    const f32 length = sqrtf(dot3(v, v));
+    if (length < 1e-12f) {
+        return false;
+    }
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+    return true;
+}
+
+// Angle between two directions, in degrees.
+static f32 angle_degrees(const f32 *a, const f32 *b) {
+    f32 na[3] = {a[0], a[1], a[2]};
+    f32 nb[3] = {b[0], b[1], b[2]};
+    if (!normalize3(na) || !normalize3(nb)) {
+        return 0.0f;
+    }
+    const f32 cosine = dot3(na, nb);
+    return acosf(cosine > 1.0f ? 1.0f : (cosine < -1.0f ? -1.0f : cosine)) * 57.2957795f;
+}
+
+// Expands an attribute to 4 floats per vertex, missing components keep the values already in out.
+static bool read_attribute(const MeshGeometry &geometry, const MeshAttributeView &view, u32 vertex_count,
+                           u32 out_components, f32 *out, u32 out_stride) {
+    const VertexFormatInfo *info = nullptr;
+    for (const VertexFormatInfo &format : vertex_formats) {
+        if (format.format == view.format) {
+            info = &format;
+        }
+    }
+    if (!info || vertex_count == 0) {
+        return info != nullptr;
+    }
+    const u32 element_size = info->components * component_sizes[info->type];
+    const u8 *data = geometry.resolve(view.offset, view.stride * (vertex_count - 1) + element_size);
+    if (!data) {
+        return false;
+    }
+
+    const u32 components = info->components < out_components ? info->components : out_components;
+    for (u32 v = 0; v < vertex_count; ++v) {
+        const u8 *element = data + (u64)view.stride * v;
+        f32 *result = (f32 *)((u8 *)out + (u64)out_stride * v);
+        for (u32 c = 0; c < components; ++c) {
+            switch (info->type) {
+            case ComponentType::Float:
+                memcpy(&result[c], element + c * 4, 4);
+                break;
+            case ComponentType::Half: {
+                u16 half;
+                memcpy(&half, element + c * 2, 2);
+                result[c] = half_to_float(half);
+                break;
+            }
+            case ComponentType::Unorm8:
+                result[c] = element[c] / 255.0f;
+                break;
+            case ComponentType::Snorm8:
+                result[c] = snorm8_to_float((i8)element[c]);
+                break;
+            case ComponentType::Unorm16: {
+                u16 value;
+                memcpy(&value, element + c * 2, 2);
+                result[c] = value / 65535.0f;
+                break;
+            }
+            case ComponentType::Snorm16: {
+                i16 value;
+                memcpy(&value, element + c * 2, 2);
+                result[c] = value / 32767.0f < -1.0f ? -1.0f : value / 32767.0f;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+static u32 attribute_size(VkFormat format) {
+    for (const VertexFormatInfo &info : vertex_formats) {
+        if (info.format == format) {
+            return info.components * component_sizes[info.type];
+        }
+    }
+    return 0;
+}
+
+// Vertex shader invocations for the index order with a FIFO cache of vertex_cache_size entries.
+static u64 simulate_vertex_cache(const std::vector<u32> &indices, u32 vertex_count) {
+    std::vector<u32> inserted(vertex_count, 0);
+    u64 transforms = 0;
+    for (u32 index : indices) {
+        // FIFO: entries are evicted vertex_cache_size misses after their insertion, hits don't refresh.
+        if (inserted[index] == 0 || transforms - inserted[index] >= vertex_cache_size) {
+            inserted[index] = (u32)++transforms;
+        }
+    }
+    return transforms;
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"): fans out around a vertex still in the cache, preferring those soon to be evicted.
+// Returns the reordered indices, and the first triangle of each cluster: the jumps to a vertex outside
+// of the cache, which the overdraw pass may reorder without hurting cache efficiency.
+static void tipsify(const std::vector<u32> &indices, u32 vertex_count, std::vector<u32> &result,
+                    std::vector<u32> &clusters) {
+    const u32 triangle_count = (u32)indices.size() / 3;
+    std::vector<u32> live(vertex_count, 0);
+    for (u32 index : indices) {
+        live[index]++;
+    }
+    // Triangles around each vertex, with offsets from a prefix sum of the counts.
+    std::vector<u32> adjacency_offsets(vertex_count + 1, 0);
+    for (u32 v = 0; v < vertex_count; ++v) {
+        adjacency_offsets[v + 1] = adjacency_offsets[v] + live[v];
+    }
+    std::vector<u32> adjacency(indices.size());
+    std::vector<u32> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (u32 i = 0; i < (u32)indices.size(); ++i) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<u32> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<u32> dead_ends;
+    std::vector<u32> candidates;
+    result.clear();
+    result.reserve(indices.size());
+    clusters.clear();
+
+    u32 time = vertex_cache_size + 1;
+    u32 cursor = 0;
+    u32 fanning = vertex_count ? 0 : u32_max;
+    bool jumped = true;
+    while (fanning != u32_max) {
+        if (jumped) {
+            clusters.push_back((u32)result.size() / 3);
+            jumped = false;
+        }
+        candidates.clear();
+        for (u32 a = adjacency_offsets[fanning]; a < adjacency_offsets[fanning + 1]; ++a) {
+            const u32 triangle = adjacency[a];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (u32 corner = 0; corner < 3; ++corner) {
+                const u32 v = indices[triangle * 3 + corner];
+                result.push_back(v);
+                dead_ends.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > vertex_cache_size) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // The candidate in the cache that leaves the cache soonest, while its fan still fits.
+        u32 best = u32_max;
+        i64 best_priority = -1;
+        for (u32 v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            i64 priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= vertex_cache_size) {
+                priority = time - cache_time[v];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+        if (best == u32_max) {
+            // Dead end: the most recent vertex with triangles left, else the next in input order.
+            jumped = true;
+            while (!dead_ends.empty() && best == u32_max) {
+                const u32 v = dead_ends.back();
+                dead_ends.pop_back();
+                if (live[v] > 0) {
+                    best = v;
+                }
+            }
+            while (best == u32_max && cursor < vertex_count) {
+                if (live[cursor] > 0) {
+                    best = cursor;
+                }
+                ++cursor;
+            }
+        }
+        fanning = best;
+    }
+}
+
+// Sorts the clusters so the ones facing away from the mesh center come first: they are likelier to
+// occlude the rest, which then fails the depth test instead of being shaded.
+static void sort_clusters_for_overdraw(std::vector<u32> &indices, const std::vector<u32> &clusters,
+                                       const std::vector<CookerVertex> &vertices) {
+    const u32 triangle_count = (u32)indices.size() / 3;
+    f32 center[3] = {0.0f, 0.0f, 0.0f};
+    f32 total_area = 0.0f;
+
+    struct Cluster {
+        u32 first;
+        u32 count;
+        f32 sort_key;
+        f32 centroid[3];
+        f32 normal[3];
+        f32 area;
+    };
+    std::vector<Cluster> sorted(clusters.size());
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        Cluster &cluster = sorted[c];
+        cluster = {};
+        cluster.first = clusters[c];
+        cluster.count = (c + 1 < clusters.size() ? clusters[c + 1] : triangle_count) - clusters[c];
+        for (u32 t = cluster.first; t < cluster.first + cluster.count; ++t) {
+            const f32 *p0 = vertices[indices[t * 3]].position;
+            const f32 *p1 = vertices[indices[t * 3 + 1]].position;
+            const f32 *p2 = vertices[indices[t * 3 + 2]].position;
+            const f32 e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            const f32 e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            f32 normal[3];
+            cross3(e1, e2, normal);
+            // Twice the area, weighting centroids and normals by it.
+            const f32 area = sqrtf(dot3(normal, normal));
+            for (u32 i = 0; i < 3; ++i) {
+                cluster.centroid[i] += (p0[i] + p1[i] + p2[i]) * area / 3.0f;
+                cluster.normal[i] += normal[i];
+            }
+            cluster.area += area;
+        }
+        for (u32 i = 0; i < 3; ++i) {
+            center[i] += cluster.centroid[i];
+            cluster.centroid[i] = cluster.area > 0.0f ? cluster.centroid[i] / cluster.area : 0.0f;
+        }
+        total_area += cluster.area;
+        normalize3(cluster.normal);
+    }
+    for (u32 i = 0; i < 3; ++i) {
+        center[i] = total_area > 0.0f ? center[i] / total_area : 0.0f;
+    }
+
+    for (Cluster &cluster : sorted) {
+        const f32 offset[3] = {cluster.centroid[0] - center[0], cluster.centroid[1] - center[1],
+                               cluster.centroid[2] - center[2]};
+        cluster.sort_key = dot3(offset, cluster.normal);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Cluster &a, const Cluster &b) { return a.sort_key > b.sort_key; });
+
+    std::vector<u32> result;
+    result.reserve(indices.size());
+    for (const Cluster &cluster : sorted) {
+        result.insert(result.end(), indices.begin() + cluster.first * 3,
+                      indices.begin() + (cluster.first + cluster.count) * 3);
+    }
+    indices.swap(result);
+}
+
+// Area weighted vertex normals, for primitives without any.
+static void generate_normals(std::vector<CookerVertex> &vertices, const std::vector<u32> &indices) {
+    for (CookerVertex &vertex : vertices) {
+        vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+    }
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const f32 *p0 = vertices[indices[t]].position;
+        const f32 *p1 = vertices[indices[t + 1]].position;
+        const f32 *p2 = vertices[indices[t + 2]].position;
+        const f32 e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const f32 e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        f32 normal[3];
+        cross3(e1, e2, normal);
+        for (u32 corner = 0; corner < 3; ++corner) {
+            f32 *n = vertices[indices[t + corner]].normal;
+            n[0] += normal[0];
+            n[1] += normal[1];
+            n[2] += normal[2];
+        }
+    }
+    for (CookerVertex &vertex : vertices) {
+        if (!normalize3(vertex.normal)) {
+            vertex.normal[0] = vertex.normal[1] = 0.0f;
+            vertex.normal[2] = 1.0f;
+        }
+    }
+}
+
+// Any unit vector perpendicular to the normal, for primitives without tangents.
+static void generate_tangent(CookerVertex &vertex) {
+    const f32 *n = vertex.normal;
+    const f32 axis[3] = {fabsf(n[0]) < 0.9f ? 1.0f : 0.0f, fabsf(n[0]) < 0.9f ? 0.0f : 1.0f, 0.0f};
+    f32 bitangent[3];
+    cross3(n, axis, bitangent);
+    cross3(bitangent, n, vertex.tangent);
+    normalize3(vertex.tangent);
+    vertex.tangent[3] = 1.0f;
+}
+
+static u32 align_size(u32 size, u32 alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+static void append_aligned(std::vector<u8> &output, const void *data, size_t size) {
+    output.resize(align_size((u32)output.size(), cooked_mesh_alignment), 0);
+    output.insert(output.end(), (const u8 *)data, (const u8 *)data + size);
+}
+
+// Cooks one primitive, appending its streams to the geometry block.
+static bool cook_primitive(const MeshGeometry &geometry, const MeshPrimitive &primitive, u32 index,
+                           std::vector<u8> &block, CookedPrimitive &cooked, CookerStats &stats) {
+    const u32 vertex_count = primitive.vertex_count;
+    std::vector<CookerVertex> vertices(vertex_count);
+    for (CookerVertex &vertex : vertices) {
+        vertex = {};
+        vertex.tangent[3] = 1.0f;
+    }
+    const MeshAttributeView *attributes = primitive.attributes;
+    const bool has_normals = attributes[MeshAttribute::Normal].format != VK_FORMAT_UNDEFINED;
+    const bool has_tangents = attributes[MeshAttribute::Tangent].format != VK_FORMAT_UNDEFINED;
+    const bool has_uvs = attributes[MeshAttribute::TexCoord0].format != VK_FORMAT_UNDEFINED;
+    const u32 stride = sizeof(CookerVertex);
+    if (!read_attribute(geometry, attributes[MeshAttribute::Position], vertex_count, 3,
+                        vertices[0].position, stride) ||
+        (has_normals && !read_attribute(geometry, attributes[MeshAttribute::Normal], vertex_count, 3,
+                                        vertices[0].normal, stride)) ||
+        (has_tangents && !read_attribute(geometry, attributes[MeshAttribute::Tangent], vertex_count, 4,
+                                         vertices[0].tangent, stride)) ||
+        (has_uvs && !read_attribute(geometry, attributes[MeshAttribute::TexCoord0], vertex_count, 2,
+                                    vertices[0].uv, stride))) {
+        LOG_ERR("Primitive %u: unsupported vertex format.", index);
+        return false;
+    }
+    for (u32 i = 0; i < MeshAttribute::Count; ++i) {
+        stats.input_vertex_bytes += (u64)attribute_size(attributes[i].format) * vertex_count;
+    }
+
+    std::vector<u32> indices;
+    if (primitive.index_count) {
+        const u32 index_size = primitive.index_type == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+        const u8 *data = geometry.resolve(primitive.index_offset, primitive.index_count * index_size);
+        if (!data) {
+            LOG_ERR("Primitive %u: indices out of bounds.", index);
+            return false;
+        }
+        indices.resize(primitive.index_count);
+        for (u32 i = 0; i < primitive.index_count; ++i) {
+            u16 index16;
+            if (index_size == 2) {
+                memcpy(&index16, data + i * 2, 2);
+                indices[i] = index16;
+            } else {
+                memcpy(&indices[i], data + i * 4, 4);
+            }
+            if (indices[i] >= vertex_count) {
+                LOG_ERR("Primitive %u: index %u out of range.", index, indices[i]);
+                return false;
+            }
+        }
+        stats.input_vertex_bytes += (u64)primitive.index_count * index_size;
+    } else {
+        indices.resize(vertex_count);
+        for (u32 i = 0; i < vertex_count; ++i) {
+            indices[i] = i;
+        }
+    }
+    indices.resize(indices.size() / 3 * 3);
+    if (indices.empty()) {
+        LOG_ERR("Primitive %u: no triangles.", index);
+        return false;
+    }
+
+    if (!has_normals) {
+        generate_normals(vertices, indices);
+    }
+    if (!has_tangents) {
+        for (CookerVertex &vertex : vertices) {
+            generate_tangent(vertex);
+        }
+    }
+
+    // Triangle order: vertex cache first, then overdraw between the clusters.
+    stats.input_transforms += simulate_vertex_cache(indices, vertex_count);
+    stats.input_vertices += vertex_count;
+    std::vector<u32> reordered;
+    std::vector<u32> clusters;
+    tipsify(indices, vertex_count, reordered, clusters);
+    sort_clusters_for_overdraw(reordered, clusters, vertices);
+
+    // Vertex order: first use, so fetches walk memory forward. Unreferenced vertices are dropped.
+    std::vector<u32> remap(vertex_count, u32_max);
+    u32 output_vertex_count = 0;
+    for (u32 &index : reordered) {
+        if (remap[index] == u32_max) {
+            remap[index] = output_vertex_count++;
+        }
+        index = remap[index];
+    }
+    stats.output_transforms += simulate_vertex_cache(reordered, output_vertex_count);
+
+    std::vector<f32> positions(output_vertex_count * 3);
+    std::vector<CookedVertexAttributes> packed(output_vertex_count);
+    for (u32 i = 0; i < 3; ++i) {
+        cooked.bounds_min[i] = INFINITY;
+        cooked.bounds_max[i] = -INFINITY;
+    }
+    for (u32 v = 0; v < vertex_count; ++v) {
+        if (remap[v] == u32_max) {
+            continue;
+        }
+        const CookerVertex &vertex = vertices[v];
+        memcpy(&positions[remap[v] * 3], vertex.position, sizeof(vertex.position));
+        for (u32 i = 0; i < 3; ++i) {
+            cooked.bounds_min[i] = std::min(cooked.bounds_min[i], vertex.position[i]);
+            cooked.bounds_max[i] = std::max(cooked.bounds_max[i], vertex.position[i]);
+        }
+
+        CookedVertexAttributes &attributes_out = packed[remap[v]];
+        f32 normal[3] = {vertex.normal[0], vertex.normal[1], vertex.normal[2]};
+        f32 tangent[3] = {vertex.tangent[0], vertex.tangent[1], vertex.tangent[2]};
+        normalize3(normal);
+        normalize3(tangent);
+        for (u32 i = 0; i < 3; ++i) {
+            attributes_out.normal[i] = float_to_snorm8(normal[i]);
+            attributes_out.tangent[i] = float_to_snorm8(tangent[i]);
+        }
+        attributes_out.normal[3] = 0;
+        attributes_out.tangent[3] = vertex.tangent[3] < 0.0f ? -127 : 127;
+        attributes_out.uv[0] = float_to_half(vertex.uv[0]);
+        attributes_out.uv[1] = float_to_half(vertex.uv[1]);
+
+        f32 decoded_normal[3];
+        f32 decoded_tangent[3];
+        for (u32 i = 0; i < 3; ++i) {
+            decoded_normal[i] = snorm8_to_float(attributes_out.normal[i]);
+            decoded_tangent[i] = snorm8_to_float(attributes_out.tangent[i]);
+        }
+        stats.max_normal_error_degrees =
+            std::max(stats.max_normal_error_degrees, angle_degrees(normal, decoded_normal));
+        stats.max_tangent_error_degrees =
+            std::max(stats.max_tangent_error_degrees, angle_degrees(tangent, decoded_tangent));
+        for (u32 i = 0; i < 2; ++i) {
+            if (fabsf(vertex.uv[i]) < 65504.0f) {
+                const f32 error = fabsf(half_to_float(attributes_out.uv[i]) - vertex.uv[i]);
+                stats.max_uv_error = std::max(stats.max_uv_error, error);
+            }
+        }
+    }
+
+    cooked.vertex_count = output_vertex_count;
+    cooked.index_count = (u32)reordered.size();
+    cooked.index_size = output_vertex_count <= 65536 ? 2 : 4;
+    cooked.material = primitive.material;
+
+    cooked.position_offset = align_size((u32)block.size(), cooked_mesh_alignment);
+    append_aligned(block, positions.data(), positions.size() * sizeof(f32));
+    cooked.attribute_offset = align_size((u32)block.size(), cooked_mesh_alignment);
+    append_aligned(block, packed.data(), packed.size() * sizeof(CookedVertexAttributes));
+    cooked.index_offset = align_size((u32)block.size(), cooked_mesh_alignment);
+    if (cooked.index_size == 2) {
+        std::vector<u16> indices16(reordered.begin(), reordered.end());
+        append_aligned(block, indices16.data(), indices16.size() * sizeof(u16));
+    } else {
+        append_aligned(block, reordered.data(), reordered.size() * sizeof(u32));
+    }
+
+    stats.output_vertex_bytes +=
+        (u64)output_vertex_count * (3 * sizeof(f32) + sizeof(CookedVertexAttributes)) +
+        (u64)reordered.size() * cooked.index_size;
+    stats.vertices += output_vertex_count;
+    stats.triangles += reordered.size() / 3;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input.gltf|input.glb> <output.smesh>\n", argv[0]);
+        return 1;
+    }
+    const char *input_path = argv[1];
+    const char *output_path = argv[2];
+    const i64 start = time_now();
+
+    MeshGeometry geometry;
+    if (!load_mesh(input_path, geometry)) {
+        return 1;
+    }
+    u64 input_file_bytes = 0;
+    for (u32 i = 0; i < geometry.num_files; ++i) {
+        input_file_bytes += geometry.files[i].size;
+    }
+
+    std::vector<CookedPrimitive> primitives;
+    std::vector<u8> block;
+    CookerStats stats;
+    for (u32 i = 0; i < (u32)geometry.primitives.size(); ++i) {
+        const MeshPrimitive &primitive = geometry.primitives[i];
+        if (primitive.topology != VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST) {
+            LOG_ERR("Primitive %u: only triangle lists can be cooked, skipping it.", i);
+            continue;
+        }
+        CookedPrimitive cooked = {};
+        if (cook_primitive(geometry, primitive, i, block, cooked, stats)) {
+            primitives.push_back(cooked);
+        }
+    }
+    const u32 input_geometry_bytes = geometry.size;
+    geometry.release_files();
+    if (primitives.empty()) {
+        LOG_ERR("%s: nothing to cook.", input_path);
+        return 1;
+    }
+
+    CookedMeshHeader header = {};
+    header.magic = cooked_mesh_magic;
+    header.version = cooked_mesh_version;
+    header.num_primitives = (u32)primitives.size();
+    header.geometry_offset = align_size(sizeof(header) + header.num_primitives * sizeof(CookedPrimitive),
+                                        cooked_mesh_alignment);
+    header.geometry_size = (u32)block.size();
+
+    std::vector<u8> output(header.geometry_offset, 0);
+    memcpy(output.data(), &header, sizeof(header));
+    memcpy(output.data() + sizeof(header), primitives.data(),
+           primitives.size() * sizeof(CookedPrimitive));
+    output.insert(output.end(), block.begin(), block.end());
+    if (!file_write_atomic(output_path, output.data(), output.size())) {
+        LOG_ERR("Failed to write %s", output_path);
+        return 1;
+    }
+
+    // Smaller is better everywhere but the error lines. ACMR: vertex shader invocations per triangle,
+    // ATVR: per vertex, 1.0 being the ideal.
+    const f64 triangles = (f64)stats.triangles;
+    const f64 vertices = (f64)stats.vertices;
+    printf("Cooked %s to %s in %.1f ms: %zu primitives, %llu vertices, %llu triangles\n", input_path,
+           output_path, time_elapsed_ms(start), primitives.size(), (unsigned long long)stats.vertices,
+           (unsigned long long)stats.triangles);
+    printf("  file size:       %12llu -> %12zu bytes (%.1f%%)\n", (unsigned long long)input_file_bytes,
+           output.size(), 100.0 * output.size() / (f64)input_file_bytes);
+    printf("  geometry buffer: %12u -> %12u bytes (%.1f%%)\n", input_geometry_bytes,
+           header.geometry_size, 100.0 * header.geometry_size / (f64)input_geometry_bytes);
+    printf("  vertex + index:  %12llu -> %12llu bytes, %zu bytes per vertex\n",
+           (unsigned long long)stats.input_vertex_bytes, (unsigned long long)stats.output_vertex_bytes,
+           3 * sizeof(f32) + sizeof(CookedVertexAttributes));
+    printf("  ACMR (FIFO %u):  %12.3f -> %12.3f\n", vertex_cache_size,
+           stats.input_transforms / triangles, stats.output_transforms / triangles);
+    printf("  ATVR (FIFO %u):  %12.3f -> %12.3f\n", vertex_cache_size,
+           stats.input_transforms / (f64)stats.input_vertices, stats.output_transforms / vertices);
+    printf("  max error:       normal %.3f deg, tangent %.3f deg, uv %.6f\n",
+           stats.max_normal_error_degrees, stats.max_tangent_error_degrees, stats.max_uv_error);
+    return 0;
+}
@@ -0,0 +1,385 @@
+#include "upload.h"
+
+#include "log.h"
+#include "vk_common.h"
+
+#include <string.h>
+
+namespace sren {
+
+// Larger uploads are split, so a single copy never needs more than half of the ring.
+static const u32 max_upload_chunk = staging_ring_size / 2;
+
+bool UploadManager::init(VkDevice device, VmaAllocator allocator, VkQueue transfer_queue,
+                         u32 transfer_family_, u32 graphics_family_, u32 copy_alignment_,
+                         VkAllocationCallbacks *alloc_callbacks) {
+    vk_device = device;
+    vma_allocator = allocator;
+    vk_alloc_callbacks = alloc_callbacks;
+    vk_transfer_queue = transfer_queue;
+    transfer_family = transfer_family_;
+    graphics_family = graphics_family_;
+    // Image copies need offsets aligned to the texel block size too, 16 covers every common format.
+    copy_alignment = copy_alignment_ > 16 ? copy_alignment_ : 16;
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.size = staging_ring_size;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo memory_info = {};
+    memory_info.usage = VMA_MEMORY_USAGE_AUTO;
+    memory_info.flags =
+        VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+    VmaAllocationInfo allocation_info;
+    if (!vkCheck(vmaCreateBuffer(vma_allocator, &buffer_info, &memory_info, &vk_staging_buffer,
+                                 &vma_staging_allocation, &allocation_info))) {
+        return false;
+    }
+    staging_data = (u8 *)allocation_info.pMappedData;
+    ring_head = 0;
+    ring_tail = 0;
+
+    VkSemaphoreTypeCreateInfo semaphore_type = {};
+    semaphore_type.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphore_type.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphore_type.initialValue = initial_value;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &semaphore_type;
+    if (!vkCheck(vkCreateSemaphore(vk_device, &semaphore_info, vk_alloc_callbacks,
+                                   &vk_timeline_semaphore))) {
+        return false;
+    }
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex = transfer_family;
+    pool_info.flags =
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (!vkCheck(vkCreateCommandPool(vk_device, &pool_info, vk_alloc_callbacks, &vk_command_pool))) {
+        return false;
+    }
+
+    VkCommandBuffer command_buffers[max_upload_batches];
+    VkCommandBufferAllocateInfo command_buffer_info = {};
+    command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_info.commandPool = vk_command_pool;
+    command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_info.commandBufferCount = max_upload_batches;
+    if (!vkCheck(vkAllocateCommandBuffers(vk_device, &command_buffer_info, command_buffers))) {
+        return false;
+    }
+    for (u32 i = 0; i < max_upload_batches; ++i) {
+        batches[i] = {command_buffers[i], 0, 0};
+    }
+    first_pending_batch = 0;
+    pending_batches = 0;
+    recording = false;
+    current_value = initial_value + 1;
+
+    LOG_DBG("Upload manager: %u MB staging ring, %s transfer queue.", staging_ring_size / (1024 * 1024),
+            ownership_transfer() ? "dedicated" : "shared graphics");
+    return true;
+}
+
+void UploadManager::shutdown() {
+    vkDestroyCommandPool(vk_device, vk_command_pool, vk_alloc_callbacks);
+    vkDestroySemaphore(vk_device, vk_timeline_semaphore, vk_alloc_callbacks);
+    vmaDestroyBuffer(vma_allocator, vk_staging_buffer, vma_staging_allocation);
+
+    buffer_acquires.clear();
+    image_acquires.clear();
+    pending_batches = 0;
+    recording = false;
+}
+
+VkCommandBuffer UploadManager::begin_batch() {
+    if (recording) {
+        return batches[(first_pending_batch + pending_batches) % max_upload_batches].vk_command_buffer;
+    }
+
+    // Every slot is in flight: the recording slot is the oldest one.
+    while (pending_batches == max_upload_batches) {
+        retire_batches(true);
+    }
+
+    Batch &batch = batches[(first_pending_batch + pending_batches) % max_upload_batches];
+    vkResetCommandBuffer(batch.vk_command_buffer, 0);
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(batch.vk_command_buffer, &begin_info);
+
+    batch.value = current_value;
+    recording = true;
+    return batch.vk_command_buffer;
+}
+
+bool UploadManager::allocate(u32 size, u64 &offset) {
+    if (size > max_upload_chunk) {
+        LOG_ERR("Upload of %u bytes doesn't fit the staging ring.", size);
+        return false;
+    }
+
+    while (true) {
+        u64 start = (ring_head + copy_alignment - 1) / copy_alignment * copy_alignment;
+        // Allocations never wrap around the end of the ring, skip to the next lap instead.
+        const u64 ring_offset = start % staging_ring_size;
+        if (ring_offset + size > staging_ring_size) {
+            start += staging_ring_size - ring_offset;
+        }
+        if (start + size - ring_tail <= staging_ring_size) {
+            ring_head = start + size;
+            offset = start % staging_ring_size;
+            return true;
+        }
+
+        if (pending_batches == 0 && !recording) {
+            // Nothing in flight, restart at the beginning of the ring.
+            ring_head = (ring_head + staging_ring_size - 1) / staging_ring_size * staging_ring_size;
+            ring_tail = ring_head;
+            continue;
+        }
+        // The ring is full of copies that haven't been submitted yet: submit them so they can retire.
+        if (pending_batches == 0) {
+            submit();
+        }
+        retire_batches(true);
+    }
+}
+
+void UploadManager::retire_batches(bool wait_oldest) {
+    if (wait_oldest && pending_batches > 0) {
+        // Blocks the CPU on the transfer queue only, graphics work keeps going.
+        const u64 value = batches[first_pending_batch].value;
+        VkSemaphoreWaitInfo wait_info = {};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &vk_timeline_semaphore;
+        wait_info.pValues = &value;
+        vkCheck(vkWaitSemaphores(vk_device, &wait_info, u64_max));
+    }
+
+    u64 completed = 0;
+    vkGetSemaphoreCounterValue(vk_device, vk_timeline_semaphore, &completed);
+    while (pending_batches > 0 && batches[first_pending_batch].value <= completed) {
+        ring_tail = batches[first_pending_batch].ring_end;
+        first_pending_batch = (first_pending_batch + 1) % max_upload_batches;
+        --pending_batches;
+    }
+}
+
+void UploadManager::submit() {
+    if (!recording) {
+        return;
+    }
+
+    Batch &batch = batches[(first_pending_batch + pending_batches) % max_upload_batches];
+    vkEndCommandBuffer(batch.vk_command_buffer);
+    batch.ring_end = ring_head;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &batch.value;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch.vk_command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &vk_timeline_semaphore;
+    vkCheck(vkQueueSubmit(vk_transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    ++pending_batches;
+    recording = false;
+    ++current_value;
+}
+
+u64 UploadManager::upload_buffer(VkBuffer buffer, u32 offset, const void *data, u32 size) {
+    if (size == 0) {
+        return initial_value;
+    }
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    for (u32 copied = 0; copied < size;) {
+        const u32 chunk = size - copied < max_upload_chunk ? size - copied : max_upload_chunk;
+        u64 staging_offset;
+        // Allocate first: it can submit the recording batch.
+        if (!allocate(chunk, staging_offset)) {
+            return 0;
+        }
+        command_buffer = begin_batch();
+        memcpy(staging_data + staging_offset, (const u8 *)data + copied, chunk);
+
+        VkBufferCopy region = {staging_offset, offset + copied, chunk};
+        vkCmdCopyBuffer(command_buffer, vk_staging_buffer, buffer, 1, &region);
+        copied += chunk;
+    }
+
+    if (command_buffer != VK_NULL_HANDLE && ownership_transfer()) {
+        // Release half of the ownership transfer, the acquire is recorded on the graphics queue.
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = transfer_family;
+        barrier.dstQueueFamilyIndex = graphics_family;
+        barrier.buffer = buffer;
+        barrier.offset = offset;
+        barrier.size = size;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0,
+                             nullptr);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        buffer_acquires.push_back({current_value, barrier});
+    }
+    return current_value;
+}
+
+u64 UploadManager::upload_image(VkImage image, VkImageAspectFlags aspect, u32 mip_level, u32 layer_count,
+                                VkExtent3D extent, u32 block_height, const void *data, u32 size) {
+    if (size == 0) {
+        return initial_value;
+    }
+    // The level is copied in chunks of whole block rows. Slices are the layers, or the depth of 3D
+    // images.
+    const u32 slice_rows = (extent.height + block_height - 1) / block_height;
+    const u32 num_slices = layer_count * extent.depth;
+    const u64 num_rows = (u64)slice_rows * num_slices;
+    const u32 row_size = (u32)(size / num_rows);
+    if (row_size == 0 || row_size * num_rows != size || row_size > max_upload_chunk) {
+        LOG_ERR("Image upload of %u bytes doesn't split into %llu rows.", size,
+                (unsigned long long)num_rows);
+        return 0;
+    }
+    const u32 rows_per_chunk = max_upload_chunk / row_size;
+
+    // The previous contents of the level are discarded, so no ownership is needed to start writing.
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {aspect, mip_level, 1, 0, layer_count};
+
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    for (u64 row = 0; row < num_rows;) {
+        const u32 chunk_rows = num_rows - row < rows_per_chunk ? (u32)(num_rows - row) : rows_per_chunk;
+        u64 staging_offset;
+        // Allocate first: it can submit the recording batch. Chunks in later batches still come after
+        // the layout transition, which is recorded once.
+        if (!allocate(chunk_rows * row_size, staging_offset)) {
+            return 0;
+        }
+        command_buffer = begin_batch();
+        if (row == 0) {
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+        memcpy(staging_data + staging_offset, (const u8 *)data + row * row_size, chunk_rows * row_size);
+
+        // One region per partial slice, whole slices in a row share one.
+        image_copies.clear();
+        for (u32 copied = 0; copied < chunk_rows;) {
+            const u32 slice = (u32)((row + copied) / slice_rows);
+            const u32 slice_row = (u32)((row + copied) % slice_rows);
+            const u32 layer = slice / extent.depth;
+            const u32 z = slice % extent.depth;
+            const u32 y = slice_row * block_height;
+            u32 rows = chunk_rows - copied < slice_rows - slice_row ? chunk_rows - copied
+                                                                    : slice_rows - slice_row;
+            // The last block row can be partial.
+            const u32 height = rows * block_height < extent.height - y ? rows * block_height
+                                                                       : extent.height - y;
+            VkBufferImageCopy region = {};
+            region.bufferOffset = staging_offset + (u64)copied * row_size;
+            region.imageSubresource = {aspect, mip_level, layer, 1};
+            region.imageOffset = {0, (i32)y, (i32)z};
+            region.imageExtent = {extent.width, height, 1};
+            if (slice_row == 0 && chunk_rows - copied >= slice_rows) {
+                // 3D images have a single layer, layered images a depth of 1.
+                u32 slices = (chunk_rows - copied) / slice_rows;
+                if (extent.depth > 1) {
+                    slices = slices < extent.depth - z ? slices : extent.depth - z;
+                    region.imageExtent.depth = slices;
+                } else {
+                    slices = slices < layer_count - layer ? slices : layer_count - layer;
+                    region.imageSubresource.layerCount = slices;
+                }
+                rows = slices * slice_rows;
+            }
+            image_copies.push_back(region);
+            copied += rows;
+        }
+        vkCmdCopyBufferToImage(command_buffer, vk_staging_buffer, image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (u32)image_copies.size(),
+                               image_copies.data());
+        row += chunk_rows;
+    }
+
+    // Transition for sampling, releasing ownership to the graphics family when it's a different one.
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    if (ownership_transfer()) {
+        barrier.srcQueueFamilyIndex = transfer_family;
+        barrier.dstQueueFamilyIndex = graphics_family;
+    }
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (ownership_transfer()) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        image_acquires.push_back({current_value, barrier});
+    }
+    return current_value;
+}
+
+u64 UploadManager::acquire_completed(VkCommandBuffer command_buffer) {
+    retire_batches(false);
+    u64 completed = 0;
+    vkGetSemaphoreCounterValue(vk_device, vk_timeline_semaphore, &completed);
+
+    // Order doesn't matter: swap with the last entry.
+    buffer_barriers.clear();
+    for (u32 i = 0; i < buffer_acquires.size();) {
+        if (buffer_acquires[i].value <= completed) {
+            buffer_barriers.push_back(buffer_acquires[i].barrier);
+            buffer_acquires[i] = buffer_acquires.back();
+            buffer_acquires.pop_back();
+        } else {
+            ++i;
+        }
+    }
+    image_barriers.clear();
+    for (u32 i = 0; i < image_acquires.size();) {
+        if (image_acquires[i].value <= completed) {
+            image_barriers.push_back(image_acquires[i].barrier);
+            image_acquires[i] = image_acquires.back();
+            image_acquires.pop_back();
+        } else {
+            ++i;
+        }
+    }
+
+    if (!buffer_barriers.empty() || !image_barriers.empty()) {
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+                             (u32)buffer_barriers.size(), buffer_barriers.data(),
+                             (u32)image_barriers.size(), image_barriers.data());
+    }
+    return completed;
+}
+
+} // namespace sren
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "external/vk_mem_alloc.h"
+#include "platform.h"
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace sren {
+
+// Persistently mapped staging memory shared by all uploads.
+static const u32 staging_ring_size = 64 * 1024 * 1024;
+// Submitted upload batches that can be in flight on the transfer queue.
+static const u32 max_upload_batches = 8;
+
+// Streams data to device local resources through the transfer queue. Data is copied into a staging ring
+// buffer and the copies are recorded into a batch, which is submitted to the transfer queue and signals
+// a timeline semaphore with the batch's value. Ring space is reclaimed once the semaphore passes it.
+//
+// With a dedicated transfer family, ownership of the uploaded range is released on the transfer queue
+// and acquired on the graphics queue once the batch has completed, so graphics work never waits on a
+// copy still in flight. Not thread safe.
+class UploadManager {
+  public:
+    bool init(VkDevice device, VmaAllocator allocator, VkQueue transfer_queue, u32 transfer_family,
+              u32 graphics_family, u32 copy_alignment, VkAllocationCallbacks *alloc_callbacks);
+    void shutdown();
+
+    // Return the timeline value the upload completes at, 0 on failure. Empty uploads get a value the
+    // semaphore has already reached.
+    u64 upload_buffer(VkBuffer buffer, u32 offset, const void *data, u32 size);
+    // One mip level with every array layer, tightly packed. The level is left shader readable. Levels
+    // larger than a staging allocation are copied in rows of block_height texels.
+    u64 upload_image(VkImage image, VkImageAspectFlags aspect, u32 mip_level, u32 layer_count,
+                     VkExtent3D extent, u32 block_height, const void *data, u32 size);
+
+    // Submits the recorded copies, if any.
+    void submit();
+    // Records the graphics side of completed ownership transfers into command_buffer. Returns the value
+    // the graphics submission has to wait on: every upload up to it is usable after the barriers.
+    u64 acquire_completed(VkCommandBuffer command_buffer);
+
+    VkSemaphore vk_timeline_semaphore = VK_NULL_HANDLE;
+
+  private:
+    struct Batch {
+        VkCommandBuffer vk_command_buffer;
+        u64 value;
+        // Ring position after the batch's last allocation, freed when the batch completes.
+        u64 ring_end;
+    }; // struct Batch
+
+    struct BufferAcquire {
+        u64 value;
+        VkBufferMemoryBarrier barrier;
+    }; // struct BufferAcquire
+
+    struct ImageAcquire {
+        u64 value;
+        VkImageMemoryBarrier barrier;
+    }; // struct ImageAcquire
+
+    VkCommandBuffer begin_batch();
+    // Reserves size bytes of staging memory, submitting and waiting on older batches if needed.
+    bool allocate(u32 size, u64 &offset);
+    void retire_batches(bool wait_oldest);
+    bool ownership_transfer() const { return transfer_family != graphics_family; }
+
+    VkDevice vk_device = VK_NULL_HANDLE;
+    VmaAllocator vma_allocator = VK_NULL_HANDLE;
+    VkAllocationCallbacks *vk_alloc_callbacks = nullptr;
+    VkQueue vk_transfer_queue = VK_NULL_HANDLE;
+    u32 transfer_family = 0;
+    u32 graphics_family = 0;
+    u32 copy_alignment = 16;
+
+    VkBuffer vk_staging_buffer = VK_NULL_HANDLE;
+    VmaAllocation vma_staging_allocation = VK_NULL_HANDLE;
+    u8 *staging_data = nullptr;
+    // Monotonic byte positions, the ring offset is position % staging_ring_size.
+    u64 ring_head = 0;
+    u64 ring_tail = 0;
+
+    VkCommandPool vk_command_pool = VK_NULL_HANDLE;
+    // Submitted batches are first_pending_batch .. + pending_batches, the next slot is recording.
+    Batch batches[max_upload_batches];
+    u32 first_pending_batch = 0;
+    u32 pending_batches = 0;
+    bool recording = false;
+    // The semaphore starts out signalled to it, so empty uploads are complete right away.
+    static const u64 initial_value = 1;
+    u64 current_value = initial_value + 1;
+
+    std::vector<BufferAcquire> buffer_acquires;
+    std::vector<ImageAcquire> image_acquires;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+    std::vector<VkImageMemoryBarrier> image_barriers;
+    std::vector<VkBufferImageCopy> image_copies;
+}; // class UploadManager
+
+} // namespace sren
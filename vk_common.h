@@ -9,7 +9,7 @@
 // Function to check Vulkan callbacks and return a boolean value
 inline bool vkAssert(VkResult result, bool abort = true) {
     if (result != VK_SUCCESS) {
-        LOG_ERR("vkAssert: ", string_VkResult(result));
+        LOG_ERR("vkAssert: %s", string_VkResult(result));
         if (abort) {
             exit(1);
         }
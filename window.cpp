@@ -35,6 +35,15 @@ void Window::teardown() {
     SDL_Quit();
 }
 
+void Window::set_fullscreen(bool fullscreen_) {
+    if (SDL_SetWindowFullscreen(window_handle, fullscreen_ ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0) != 0) {
+        LOG_ERR("Failed to change fullscreen mode: %s", SDL_GetError());
+        return;
+    }
+    // The size change arrives as a window event, like any other resize.
+    fullscreen = fullscreen_;
+}
+
 void Window::handle_os_messages() {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
@@ -49,6 +58,14 @@ void Window::handle_os_messages() {
             break;
         }
 
+        case SDL_KEYDOWN: {
+            if (event.key.keysym.sym == SDLK_F11 && !event.key.repeat) {
+                set_fullscreen(!fullscreen);
+            }
+            goto propagate_event;
+            break;
+        }
+
         // Handle subevent
         case SDL_WINDOWEVENT: {
             switch (event.window.event) {
@@ -15,6 +15,8 @@ class Window {
     void teardown();
 
     void handle_os_messages();
+    // Borderless fullscreen on the current display. Also toggled with F11.
+    void set_fullscreen(bool fullscreen);
 
     u32 width = 0;
     u32 height = 0;
@@ -27,6 +29,7 @@ class Window {
     bool requested_exit = false;
     bool resized = false;
     bool minimized = false;
+    bool fullscreen = false;
     f32 display_refresh = 1.0f / 60.0f;
 };
 